@@ -5,6 +5,10 @@
 
 #include "AVDecode.h"
 #include "Logger.h"
+#include "TextureLoader.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <chrono>
 using namespace std;
 
 extern "C" {
@@ -60,12 +64,35 @@ AVDecode::AVDecode()
     pkt = NULL;
     video_frame_count = 0;
     curFrameTimestampSecs = 0.0;
+    stopRequested = false;
+    decodeFinished = false;
+    presentedFrameCount = 0;
+    droppedFrameCount = 0;
+    repeatedFrameCount = 0;
+    repeatedSlots = 0;
+    firstPts = 0;
+    keyframesIndexed = false;
+    durationSecs = 0.0;
+    frameDurationSecs = 0.0;
+    loopEnabled = false;
+    loopTimeOffsetSecs = 0.0;
+    discardBeforeSecs = 0.0;
+
+    // Upload buffers are created on first upload
+    memset(uploadBuffers, 0, sizeof(uploadBuffers));
+    uploadBufferIndex = 0;
+    uploadBufferSize = 0;
 
     // Initialize texture IDs to undefined
     setTextureIDs();
 }
 
-AVDecode::~AVDecode() { theEnd(true); }
+AVDecode::~AVDecode()
+{
+    stopDecoding();
+    flushFrameQueue();
+    theEnd(true);
+}
 
 void AVDecode::setTextureIDs(GLuint yTexID, GLuint uTexID, GLuint vTexID)
 {
@@ -103,38 +130,106 @@ int AVDecode::output_video_frame(AVFrame* frame)
     return 0;
 }
 
+bool AVDecode::initUploadBuffers(size_t size)
+{
+    releaseUploadBuffers();
+
+    // Allocate every buffer in the ring up front for the full YUV frame
+    glGenBuffers(UPLOAD_BUFFER_COUNT, uploadBuffers);
+    for (int i = 0; i < UPLOAD_BUFFER_COUNT; i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffers[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    uploadBufferIndex = 0;
+    uploadBufferSize = size;
+    return true;
+}
+
+void AVDecode::releaseUploadBuffers()
+{
+    if (uploadBuffers[0] != 0) {
+        glDeleteBuffers(UPLOAD_BUFFER_COUNT, uploadBuffers);
+        memset(uploadBuffers, 0, sizeof(uploadBuffers));
+    }
+    uploadBufferSize = 0;
+}
+
 void AVDecode::send_frame_to_GPU(AVFrame* frame)
 {
-    if (textureIDs[0] != 0 && frame->data[0])
-    {
-        // Pass in the Y luminance plane as a GL_RED texture (e.g. one color channel)
-        glBindTexture(GL_TEXTURE_2D, textureIDs[0]);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[0]);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame->width, frame->height,
-            GL_RED, GL_UNSIGNED_BYTE, frame->data[0]);
+    TraceScope trace("Upload video frame", "video");
+    if (textureIDs[0] == 0 || !frame->data[0]) {
+        return;
     }
 
-    if (textureIDs[1] != 0 && frame->data[1])
-    {
-        // Pass in the u color plane as a GL_RED texture (also one color channel)
-        glBindTexture(GL_TEXTURE_2D, textureIDs[1]);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[1]);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame->width / 2, frame->height / 2,
-            GL_RED, GL_UNSIGNED_BYTE, frame->data[1]);
+    // Tightly packed plane sizes (Y is full size, U and V are half in each direction)
+    const int chromaWidth = frame->width / 2;
+    const int chromaHeight = frame->height / 2;
+    const size_t lumaSize = (size_t)frame->width * frame->height;
+    const size_t chromaSize = (size_t)chromaWidth * chromaHeight;
+    const size_t frameSize = lumaSize + 2 * chromaSize;
+
+    if (uploadBufferSize != frameSize) {
+        initUploadBuffers(frameSize);
     }
 
-    if (textureIDs[2] != 0 && frame->data[2])
-    {
-        // Pass in the v color plane as a GL_RED texture (also one color channel)
-        glBindTexture(GL_TEXTURE_2D, textureIDs[2]);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[2]);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame->width / 2, frame->height / 2,
-            GL_RED, GL_UNSIGNED_BYTE, frame->data[2]);
+    // Use the next buffer in the ring; the GPU may still be reading the previous ones
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffers[uploadBufferIndex]);
+    uploadBufferIndex = (uploadBufferIndex + 1) % UPLOAD_BUFFER_COUNT;
+
+    uint8_t* mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, frameSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!mapped) {
+        fprintf(stderr, "Could not map video upload buffer\n");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
     }
+
+    // Copy each plane into the buffer, dropping the decoder's row padding
+    av_image_copy_plane(mapped, frame->width, frame->data[0], frame->linesize[0],
+        frame->width, frame->height);
+    if (frame->data[1]) {
+        av_image_copy_plane(mapped + lumaSize, chromaWidth, frame->data[1], frame->linesize[1],
+            chromaWidth, chromaHeight);
+    }
+    if (frame->data[2]) {
+        av_image_copy_plane(mapped + lumaSize + chromaSize, chromaWidth, frame->data[2], frame->linesize[2],
+            chromaWidth, chromaHeight);
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // Rows are tightly packed and may not be word aligned
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Each plane goes to the texture unit it is sampled from, so rendering needs no rebind.
+    // With a buffer bound the data pointer is an offset and the copy runs asynchronously.
+    TextureLoader::Inst()->BindTextureUnit(0, textureIDs[0]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame->width, frame->height,
+        GL_RED, GL_UNSIGNED_BYTE, (const void*)0);
+
+    if (textureIDs[1] != 0 && frame->data[1]) {
+        TextureLoader::Inst()->BindTextureUnit(1, textureIDs[1]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, chromaWidth, chromaHeight,
+            GL_RED, GL_UNSIGNED_BYTE, (const void*)lumaSize);
+    }
+
+    if (textureIDs[2] != 0 && frame->data[2]) {
+        TextureLoader::Inst()->BindTextureUnit(2, textureIDs[2]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, chromaWidth, chromaHeight,
+            GL_RED, GL_UNSIGNED_BYTE, (const void*)(lumaSize + chromaSize));
+    }
+
+    // Restore default unpack state for regular texture loads
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
 
 int AVDecode::decode_packet(AVCodecContext* dec, const AVPacket* pkt)
 {
+    TraceScope trace("Decode packet", "video");
+
     // submit the packet to the decoder
     int ret = avcodec_send_packet(dec, pkt);
     if (ret < 0) {
@@ -155,10 +250,9 @@ int AVDecode::decode_packet(AVCodecContext* dec, const AVPacket* pkt)
             return ret;
         }
 
-        // write the frame data to output file
+        // hand the frame over to the render thread
         if (dec->codec->type == AVMEDIA_TYPE_VIDEO) {
-            curFrameTimestampSecs = frame->best_effort_timestamp * stream_time_base;
-            send_frame_to_GPU(frame);
+            ret = queue_frame(frame);
             // ret = output_video_frame(frame);
         }
 
@@ -170,9 +264,271 @@ int AVDecode::decode_packet(AVCodecContext* dec, const AVPacket* pkt)
     return 0;
 }
 
+int AVDecode::queue_frame(AVFrame* frame)
+{
+    // Wait for the render thread to free up a slot (or for a stop request)
+    unique_lock<mutex> lock(queueLock);
+    queueSpaceAvailable.wait(lock, [this] {
+        return stopRequested || frameQueue.size() < FRAME_QUEUE_CAPACITY;
+    });
+    if (stopRequested) {
+        return AVERROR_EXIT;
+    }
+
+    // Timestamp relative to the start of the file, moved forward by completed loops
+    double timestampSecs = loopTimeOffsetSecs;
+    if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+        timestampSecs += (frame->best_effort_timestamp - firstPts) * stream_time_base;
+    }
+
+    // After a seek, decode through to the target but don't show frames that end before it
+    if (timestampSecs + frameDurationSecs <= discardBeforeSecs) {
+        return 0;
+    }
+
+    // Move the frame data into a new frame owned by the queue
+    QueuedFrame queued;
+    queued.frame = av_frame_alloc();
+    if (!queued.frame) {
+        fprintf(stderr, "Could not allocate queued frame\n");
+        return AVERROR(ENOMEM);
+    }
+    av_frame_move_ref(queued.frame, frame);
+    queued.timestampSecs = timestampSecs;
+    frameQueue.push_back(queued);
+    video_frame_count++;
+
+    lock.unlock();
+    queueFrameAvailable.notify_one();
+    return 0;
+}
+
+void AVDecode::decodeLoop()
+{
+    tracer.setThreadName("Video Decode");
+    int ret = 0;
+
+    /* index keyframes here rather than when the file is opened, so a long
+     * video doesn't hold up the render thread before its first frame */
+    if (!keyframesIndexed && !buildKeyframeIndex()) {
+        stopRequested = true;
+    }
+
+    /* read frames from the file until the end or until told to stop */
+    while (!stopRequested) {
+        ret = av_read_frame(fmt_ctx, pkt);
+
+        /* when looping, pre-roll the start of the file straight after the end
+         * so the first frames of the next pass are queued before they are due */
+        if (ret == AVERROR_EOF && loopEnabled && durationSecs > 0.0) {
+            decode_packet(video_dec_ctx, NULL);
+            if (stopRequested || seekToKeyframe(0.0) < 0) { break; }
+            loopTimeOffsetSecs += durationSecs;
+            discardBeforeSecs = 0.0;
+            continue;
+        }
+        if (ret < 0) { break; }
+
+        if (pkt->stream_index == video_stream_idx) {
+            ret = decode_packet(video_dec_ctx, pkt);
+        }
+        av_packet_unref(pkt);
+        if (ret < 0) { break; }
+    }
+
+    /* flush the decoder so the last frames make it into the queue */
+    if (!stopRequested && ret == AVERROR_EOF) {
+        decode_packet(video_dec_ctx, NULL);
+    }
+
+    {
+        lock_guard<mutex> lock(queueLock);
+        decodeFinished = true;
+    }
+    queueFrameAvailable.notify_all();
+}
+
+bool AVDecode::startDecoding()
+{
+    if (!fmt_ctx || decodeThread.joinable()) {
+        return false;
+    }
+
+    stopRequested = false;
+    decodeFinished = false;
+    decodeThread = thread(&AVDecode::decodeLoop, this);
+    return true;
+}
+
+void AVDecode::stopDecoding()
+{
+    if (!decodeThread.joinable()) {
+        return;
+    }
+
+    // Wake the decoder if it is waiting on a full queue and wait for it to exit
+    {
+        lock_guard<mutex> lock(queueLock);
+        stopRequested = true;
+    }
+    queueSpaceAvailable.notify_all();
+    decodeThread.join();
+}
+
+void AVDecode::flushFrameQueue()
+{
+    lock_guard<mutex> lock(queueLock);
+    for (QueuedFrame& queued : frameQueue) {
+        av_frame_free(&queued.frame);
+    }
+    frameQueue.clear();
+}
+
+double AVDecode::presentFrame(double clockSec)
+{
+    AVFrame* toPresent = NULL;
+
+    {
+        // Take the newest frame that is due, dropping any the clock has already passed
+        lock_guard<mutex> lock(queueLock);
+        while (!frameQueue.empty() && frameQueue.front().timestampSecs <= clockSec) {
+            if (toPresent) {
+                av_frame_free(&toPresent);
+                droppedFrameCount++;
+            }
+            toPresent = frameQueue.front().frame;
+            curFrameTimestampSecs = frameQueue.front().timestampSecs;
+            frameQueue.pop_front();
+        }
+
+        // Nothing left to show and nothing more coming
+        if (!toPresent && frameQueue.empty() && decodeFinished) {
+            return -1.0;
+        }
+
+        // The next frame is due but the decoder hasn't produced it, so the current one stays up.
+        // Each due frame is counted once, however many renders it is missing for
+        if (toPresent) {
+            repeatedSlots = 0;
+        }
+        else if (frameQueue.empty() && frameDurationSecs > 0.0) {
+            int dueSlots = (int)((clockSec - curFrameTimestampSecs) / frameDurationSecs);
+            if (dueSlots > repeatedSlots) {
+                repeatedFrameCount += dueSlots - repeatedSlots;
+                repeatedSlots = dueSlots;
+            }
+        }
+    }
+    queueSpaceAvailable.notify_one();
+
+    // Upload on the calling (render) thread only
+    if (toPresent) {
+        presentedFrameCount++;
+        send_frame_to_GPU(toPresent);
+        av_frame_free(&toPresent);
+    }
+
+    return curFrameTimestampSecs;
+}
+
+bool AVDecode::buildKeyframeIndex()
+{
+    TraceScope trace("Index keyframes", "video");
+    int64_t endPts = 0;
+    bool foundPts = false;
+    keyframeIndex.clear();
+
+    /* demux (without decoding) every video packet once to find the keyframes
+     * and the exact end of the last frame */
+    while (av_read_frame(fmt_ctx, pkt) >= 0) {
+        if (pkt->stream_index == video_stream_idx) {
+            int64_t pts = (pkt->pts != AV_NOPTS_VALUE) ? pkt->pts : pkt->dts;
+            if (pts != AV_NOPTS_VALUE) {
+                if (!foundPts || pts < firstPts) { firstPts = pts; }
+                endPts = max(endPts, pts + pkt->duration);
+                foundPts = true;
+                if (pkt->flags & AV_PKT_FLAG_KEY) {
+                    keyframeIndex.push_back(pts);
+                }
+            }
+        }
+        av_packet_unref(pkt);
+    }
+    sort(keyframeIndex.begin(), keyframeIndex.end());
+
+    if (!foundPts) {
+        firstPts = 0;
+    }
+    durationSecs = (endPts - firstPts) * stream_time_base;
+    logger.log("Video keyframes indexed ", to_string(keyframeIndex.size()), ", duration ", to_string(durationSecs.load()), "s");
+
+    /* go back to the beginning for decoding */
+    if (av_seek_frame(fmt_ctx, video_stream_idx, firstPts, AVSEEK_FLAG_BACKWARD) < 0) {
+        fprintf(stderr, "Could not return to the start of the movie after indexing\n");
+        return false;
+    }
+    keyframesIndexed = true;
+    return true;
+}
+
+int AVDecode::seekToKeyframe(double timestampSecs)
+{
+    // Find the last keyframe at or before the target
+    int64_t target = firstPts + (int64_t)(timestampSecs / stream_time_base);
+    int64_t keyframe = firstPts;
+    auto next = upper_bound(keyframeIndex.begin(), keyframeIndex.end(), target);
+    if (next != keyframeIndex.begin()) {
+        keyframe = *(next - 1);
+    }
+
+    int ret = av_seek_frame(fmt_ctx, video_stream_idx, keyframe, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) {
+        fprintf(stderr, "Could not seek movie\n");
+        return ret;
+    }
+
+    // Drop anything the codec still holds from before the seek
+    avcodec_flush_buffers(video_dec_ctx);
+    return 0;
+}
+
+int AVDecode::seek(double timestampSecs)
+{
+    TraceScope trace("Seek video", "video");
+    if (!fmt_ctx) {
+        return AVERROR(EINVAL);
+    }
+
+    // The decoder thread owns the format and codec contexts while it runs
+    bool wasDecoding = decodeThread.joinable();
+    stopDecoding();
+    flushFrameQueue();
+
+    // Seeking before decoding ever started indexes here instead (the decoder thread is stopped)
+    if (!keyframesIndexed && !buildKeyframeIndex()) {
+        return AVERROR(EIO);
+    }
+
+    int ret = seekToKeyframe(timestampSecs);
+    if (ret < 0) {
+        return ret;
+    }
+
+    // Frames between the keyframe and the target are decoded but not shown
+    loopTimeOffsetSecs = 0.0;
+    discardBeforeSecs = timestampSecs;
+    curFrameTimestampSecs = timestampSecs;
+    repeatedSlots = 0;
+
+    if (wasDecoding) {
+        startDecoding();
+    }
+    return 0;
+}
+
 int AVDecode::rewind()
 {
-    int ret = av_seek_frame(fmt_ctx, video_stream_idx, 0, AVSEEK_FLAG_BACKWARD);
+    int ret = seek(0.0);
     if (ret < 0)
 	{
         fprintf(stderr, "Could not rewind movie\n");
@@ -224,6 +580,10 @@ int AVDecode::open_codec_context(const char* src_filename, int* stream_idx,
             return ret;
         }
 
+        /* Let the codec decode with frame and slice threads (0 = one per core) */
+        (*dec_ctx)->thread_count = 0;
+        (*dec_ctx)->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
         /* Init the decoders */
         if ((ret = avcodec_open2(*dec_ctx, dec, &opts)) < 0) {
             fprintf(stderr, "Failed to open %s codec\n",
@@ -237,6 +597,7 @@ int AVDecode::open_codec_context(const char* src_filename, int* stream_idx,
 }
 
 inline bool AVDecode::theEnd(bool result) {
+    releaseUploadBuffers();
     avcodec_free_context(&video_dec_ctx);
     avformat_close_input(&fmt_ctx);
     if (video_dst_file) {
@@ -259,8 +620,13 @@ inline bool AVDecode::theEnd(bool result) {
 }
 
 bool AVDecode::prepareToDecode(const char* src_filename) {
+    TraceScope trace("Open video", "video", src_filename);
     int ret;
 
+    /* a new file needs its own keyframe index */
+    keyframesIndexed = false;
+    durationSecs = 0.0;
+
     /* open input file, and allocate format context */
     if (avformat_open_input(&fmt_ctx, src_filename, NULL, NULL) < 0) {
         fprintf(stderr, "Could not open source file %s\n", src_filename);
@@ -280,11 +646,11 @@ bool AVDecode::prepareToDecode(const char* src_filename) {
 	    frameRateNum = video_dec_ctx->pkt_timebase.num;
 	    frameRateDen = video_dec_ctx->pkt_timebase.den;
 	    msecPerFrame = frameRateDen/(double)frameRateNum * 1000.0f;
-        logger.log("Millisecs per frame ", to_string(msecPerFrame));
+        logger.logDebug("Millisecs per frame ", to_string(msecPerFrame));
 
 	    /* Compute time base (in seconds) for stream */
 	    stream_time_base = video_stream->time_base.num / (double)video_stream->time_base.den;
-        logger.log("Stream time base ", to_string(stream_time_base));
+        logger.logDebug("Stream time base ", to_string(stream_time_base));
 
         /* allocate image where the decoded image will be put */
         width = video_dec_ctx->width;
@@ -322,31 +688,60 @@ bool AVDecode::prepareToDecode(const char* src_filename) {
         return theEnd(false);
     }
 
+    /* length of one frame, used to pick the frame covering a seek target */
+    AVRational frameRate = av_guess_frame_rate(fmt_ctx, video_stream, NULL);
+    frameDurationSecs = (frameRate.num > 0) ? frameRate.den / (double)frameRate.num : 0.0;
+
+    /* keyframes are indexed when decoding starts, see decodeLoop() */
     return true;
 }
 
-double AVDecode::decodeFrame() {
-    /* read frames from the file */
-    while (av_read_frame(fmt_ctx, pkt) >= 0) {
-        if (pkt->stream_index == video_stream_idx) {
-            int ret = decode_packet(video_dec_ctx, pkt);
-            av_packet_unref(pkt);
-            if (ret < 0) { return -1.0; }
-			return curFrameTimestampSecs;
-        }
+void AVDecode::closeDecoder() {
+    /* stop the decoder thread and drop anything it left behind */
+    stopDecoding();
+    flushFrameQueue();
 
-        // Not a video packet so get another one
-        av_packet_unref(pkt);
+    theEnd(true);
+}
+
+bool AVDecode::popFrameForBenchmark() {
+    QueuedFrame queued;
+
+    {
+        unique_lock<mutex> lock(queueLock);
+        queueFrameAvailable.wait(lock, [this] { return !frameQueue.empty() || decodeFinished; });
+        if (frameQueue.empty()) {
+            return false;
+        }
+        queued = frameQueue.front();
+        frameQueue.pop_front();
     }
+    queueSpaceAvailable.notify_one();
 
-    return -1.0;
+    av_frame_free(&queued.frame);
+    return true;
 }
 
-void AVDecode::closeDecoder() {
-    /* flush the decoder */
-    if (video_dec_ctx) {
-        decode_packet(video_dec_ctx, NULL);
+double AVDecode::benchmarkDecode(const char* src_filename) {
+    AVDecode decoder;
+    if (!decoder.prepareToDecode(src_filename)) {
+        logger.logError("Video benchmark could not open ", string(src_filename));
+        return -1.0;
     }
 
-    theEnd(true);
+    // Drain the queue as fast as the decoder thread can fill it (no GPU upload)
+    auto start = chrono::high_resolution_clock::now();
+    decoder.startDecoding();
+    int frames = 0;
+    while (decoder.popFrameForBenchmark()) {
+        frames++;
+    }
+    chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - start;
+    int codecThreads = decoder.video_dec_ctx->thread_count;
+    decoder.closeDecoder();
+
+    double fps = elapsed.count() > 0.0 ? frames / elapsed.count() : 0.0;
+    logger.log("Video benchmark ", string(src_filename), ": ", to_string(frames), " frames in ",
+        to_string(elapsed.count()), "s (", to_string(fps), " fps, ", to_string(codecThreads), " codec threads)");
+    return fps;
 }
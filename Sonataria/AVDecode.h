@@ -3,6 +3,13 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <GL/glew.h>
 
 extern "C" {
@@ -10,6 +17,12 @@ extern "C" {
 #include <libavformat/avformat.h>
 }
 
+// Number of decoded frames the decoder thread may run ahead of presentation
+#define FRAME_QUEUE_CAPACITY 8
+
+// Number of pixel buffer objects cycled through for texture uploads
+#define UPLOAD_BUFFER_COUNT 3
+
 class AVDecode
 {
 public:
@@ -17,16 +30,32 @@ public:
 	~AVDecode();
 
 	bool prepareToDecode(const char* src_filename);
-	double decodeFrame();
+	bool startDecoding();
+	void stopDecoding();
+	double presentFrame(double clockSec);
 	void closeDecoder();
 
 	void setTextureIDs(GLuint yTexID = 0, GLuint uTexID = 0, GLuint vTexID = 0);
+	void setLooping(bool loop) { loopEnabled = loop; }
+	int seek(double timestampSecs);
 	int rewind();
 
 	int getWidth() const { return width; }
 	int getHeight() const { return height; }
+	int getPresentedFrameCount() const { return presentedFrameCount; }
+	int getDroppedFrameCount() const { return droppedFrameCount; }
+	int getRepeatedFrameCount() const { return repeatedFrameCount; }
+	double getDuration() const { return durationSecs; }
+
+	static double benchmarkDecode(const char* src_filename);
 
 protected:
+	// A decoded frame waiting in the queue along with its presentation time
+	struct QueuedFrame {
+		AVFrame* frame;
+		double timestampSecs;
+	};
+
 	int width, height;
 	FILE* video_dst_file;
 
@@ -48,13 +77,51 @@ protected:
 	int frameRateNum, frameRateDen;
 	double msecPerFrame, curFrameTimestampSecs;
 
+	// Keyframe presentation timestamps (stream time base), found by the decoder thread before its first frame
+	std::vector<int64_t> keyframeIndex;
+	int64_t firstPts;
+	bool keyframesIndexed;
+	std::atomic<double> durationSecs;	// 0 until indexed
+	double frameDurationSecs;
+
+	// Looping and seeking state used by the decoder thread
+	std::atomic<bool> loopEnabled;
+	double loopTimeOffsetSecs;
+	double discardBeforeSecs;
+
 	GLuint textureIDs[3];
 
+	// Ring of pixel unpack buffers so a frame upload never waits on the previous one
+	GLuint uploadBuffers[UPLOAD_BUFFER_COUNT];
+	int uploadBufferIndex;
+	size_t uploadBufferSize;
+
+	// Decoder thread and the bounded queue it fills
+	std::thread decodeThread;
+	std::mutex queueLock;
+	std::condition_variable queueSpaceAvailable;
+	std::condition_variable queueFrameAvailable;
+	std::deque<QueuedFrame> frameQueue;
+	std::atomic<bool> stopRequested;
+	bool decodeFinished;
+	int presentedFrameCount;
+	int droppedFrameCount;
+	int repeatedFrameCount;
+	int repeatedSlots;		// Due frames already counted as repeated since the current frame was shown
+
 	bool theEnd(bool result);
+	bool buildKeyframeIndex();
+	int seekToKeyframe(double timestampSecs);
 	static int open_codec_context(const char* src_filename, int* stream_idx,
 		AVCodecContext** dec_ctx, AVFormatContext* fmt_ctx, enum AVMediaType type);
 
+	void decodeLoop();
+	void flushFrameQueue();
+	bool popFrameForBenchmark();
 	int decode_packet(AVCodecContext* dec, const AVPacket* pkt);
+	int queue_frame(AVFrame* frame);
+	bool initUploadBuffers(size_t size);
+	void releaseUploadBuffers();
 	void send_frame_to_GPU(AVFrame* frame);
 	int output_video_frame(AVFrame* frame);
 };
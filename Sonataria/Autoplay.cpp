@@ -0,0 +1,273 @@
+#include <algorithm>
+
+#include "Autoplay.h"
+#include "ControllerInput.h"
+#include "JudgementEngine.h"
+
+Autoplay autoplay;
+
+// Inputs are read at the start of a frame, so press about half a frame early
+const float FRAME_LEAD = 8.f;
+
+// One frame at 60 fps
+const float FRAME_TIME = 17.f;
+
+// Holds only start while the note is still ahead of the perfect line (and inside the near window),
+// so start them early enough to survive a few frames of queued chord presses
+const float HOLD_LEAD = 45.f;
+
+// How long a tap note's button stays down
+const float TAP_LENGTH = 50.f;
+
+// How long to keep a hold down after its last tick
+const float HOLD_RELEASE_DELAY = 20.f;
+
+/**
+ * Default constructor.
+ *
+ */
+Autoplay::Autoplay() {
+	this->enabled = false;
+	this->timingNoise = 0.f;
+	this->missChance = 0.f;
+	this->rng.seed(random_device{}());
+	this->nextEvent = 0;
+
+	for (int i = 0; i < 6; i++) {
+		this->held[i] = false;
+	}
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+Autoplay::~Autoplay() {
+
+}
+
+/**
+ * Turn the bot on or off for the next songs played.
+ *
+ * @param enable true to let the bot play
+ */
+void Autoplay::setEnabled(bool enable) {
+	this->enabled = enable;
+}
+
+/**
+ * Gets if the bot is playing.
+ *
+ * @return true if the bot is playing
+ */
+bool Autoplay::isEnabled() {
+	return this->enabled;
+}
+
+/**
+ * Set how far off the perfect time the bot's inputs are.
+ *
+ * @param noise standard deviation of the timing error in milliseconds (0 for perfect timing)
+ */
+void Autoplay::setTimingNoise(float noise) {
+	this->timingNoise = max(0.f, noise);
+}
+
+float Autoplay::getTimingNoise() {
+	return this->timingNoise;
+}
+
+/**
+ * Set how often the bot ignores a note.
+ *
+ * @param chance chance (0-1) that any note is not played
+ */
+void Autoplay::setMissChance(float chance) {
+	this->missChance = min(1.f, max(0.f, chance));
+}
+
+float Autoplay::getMissChance() {
+	return this->missChance;
+}
+
+/**
+ * Gets if the bot is set to play every note perfectly.
+ *
+ * @return true if there is no timing noise or missed notes
+ */
+bool Autoplay::isPerfect() {
+	return this->timingNoise <= 0.f && this->missChance <= 0.f;
+}
+
+/**
+ * Get a random timing error for one input.
+ *
+ * @return the error in milliseconds
+ */
+float Autoplay::jitter() {
+	if (this->timingNoise <= 0.f) {
+		return 0.f;
+	}
+	normal_distribution<float> noise(0.f, this->timingNoise);
+	return noise(this->rng);
+}
+
+/**
+ * Roll if the next note should be left unplayed.
+ *
+ * @return true to skip the note
+ */
+bool Autoplay::skipNote() {
+	if (this->missChance <= 0.f) {
+		return false;
+	}
+	uniform_real_distribution<float> roll(0.f, 1.f);
+	return roll(this->rng) < this->missChance;
+}
+
+/**
+ * Read in a chart and work out every input needed to play it.
+ *
+ * @param songPath Path of the song
+ * @param diffNumber Difficulty of the song
+ * @param speed Note speed the song starts at
+ * @return true if every lane and the wheel were read
+ */
+bool Autoplay::loadChart(string songPath, int diffNumber, int speed) {
+	this->events.clear();
+	this->nextEvent = 0;
+
+	bool loaded = true;
+
+	// Buttons
+	float screenTime = calculateScreenTime(speed);
+	for (int laneNum = 1; laneNum <= LANE_COUNT; laneNum++) {
+		vector<Note> lane;
+		loaded &= parseInNotes(lane, laneNum, songPath, diffNumber, speed);
+
+		// Only the front note of a lane is judged, so track when the lane is clear for the next press
+		float laneClear = -1000000.f;
+
+		// Press and release times of the notes being played in this lane
+		vector<float> presses;
+		vector<float> releases;
+
+		for (size_t i = 0; i < lane.size(); i++) {
+			// When this note leaves the lane if it is not hit (holds always stay until this point)
+			float noteClear = max(lane[i].perfectTime + MISS_WINDOW * screenTime / DISTANCE_TO_PERFECT, lane[i].getEndTime() + MISS_WINDOW);
+
+			if (skipNote()) {
+				laneClear = max(laneClear, noteClear);
+				continue;
+			}
+
+			float press = 0.f;
+			float release = 0.f;
+			if (lane[i].isHold()) {
+				press = lane[i].perfectTime - HOLD_LEAD + jitter();
+				release = lane[i].getEndTime() + HOLD_RELEASE_DELAY;
+			}
+			else {
+				press = lane[i].perfectTime - FRAME_LEAD + jitter();
+				release = press + TAP_LENGTH;
+			}
+
+			// Wait a frame after the previous note has left the lane
+			press = max(press, laneClear + FRAME_TIME);
+			release = max(release, press + 1.f);
+			laneClear = lane[i].isHold() ? noteClear : press;
+
+			presses.push_back(press);
+			releases.push_back(release);
+		}
+
+		for (size_t i = 0; i < presses.size(); i++) {
+			// Let go before the next note in the lane is pressed
+			if (i + 1 < presses.size()) {
+				releases[i] = max(presses[i] + 1.f, min(releases[i], presses[i + 1] - 1.f));
+			}
+
+			this->events.push_back({ presses[i], laneNum, 1 });
+			this->events.push_back({ releases[i], laneNum, 0 });
+		}
+	}
+
+	// Wheel
+	vector<WheelNote> wheel;
+	loaded &= parseInWheel(wheel, songPath, diffNumber, speed);
+
+	for (size_t i = 0; i < wheel.size(); i++) {
+		if (skipNote()) {
+			continue;
+		}
+
+		if (wheel[i].isSlam()) {
+			this->events.push_back({ wheel[i].perfectTime - FRAME_LEAD + jitter(), 0, wheel[i].getDirection() });
+		}
+		else {
+			// Turn the wheel again before every tick since each tick resets the last wheel position
+			// (a single tick note has no spacing between ticks)
+			float tickSpacing = wheel[i].getNoteQuantity() > 1 ? wheel[i].getHoldNoteDistance() : 0.f;
+			for (int tick = 0; tick < wheel[i].getNoteQuantity(); tick++) {
+				float tickTime = wheel[i].perfectTime + tickSpacing * (float)tick;
+				this->events.push_back({ tickTime - FRAME_LEAD + jitter(), 0, wheel[i].getDirection() });
+			}
+		}
+	}
+
+	// Keep releases ahead of presses that happen at the same time
+	stable_sort(this->events.begin(), this->events.end(), [](const Event& a, const Event& b) {
+		return a.time < b.time;
+	});
+
+	return loaded;
+}
+
+/**
+ * Gets every input the bot will make for the loaded chart.
+ *
+ * @return the inputs in the order they are made
+ */
+vector<Autoplay::Event>& Autoplay::getEvents() {
+	return this->events;
+}
+
+/**
+ * Make every input that is due at the current time in the song.
+ *
+ * @param songOffset current time in the song (ms)
+ */
+void Autoplay::update(int64_t songOffset) {
+	while (this->nextEvent < this->events.size() && this->events[this->nextEvent].time <= (float)songOffset) {
+		Event& event = this->events[this->nextEvent];
+
+		if (event.key == 0) {
+			if (event.value != 0) {
+				controllerInput.changeWheelPos(event.value);
+			}
+		}
+		else {
+			bool press = event.value != 0;
+			if (this->held[event.key] != press) {
+				this->held[event.key] = press;
+				controllerInput.setKeyState(event.key, press);
+			}
+		}
+
+		this->nextEvent++;
+	}
+}
+
+/**
+ * Let go of every button the bot is holding.
+ *
+ */
+void Autoplay::releaseAll() {
+	for (int key = 1; key <= LANE_COUNT; key++) {
+		if (this->held[key]) {
+			this->held[key] = false;
+			controllerInput.setKeyState(key, false);
+		}
+	}
+	this->nextEvent = this->events.size();
+}
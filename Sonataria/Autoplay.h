@@ -0,0 +1,61 @@
+/**
+ * @file Autoplay.h
+ *
+ * @brief Autoplay
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <random>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+/**
+ * Plays a chart by itself by pressing the buttons and turning the wheel
+ * through ControllerInput when each note is due
+ */
+class Autoplay {
+
+	public:
+		/**
+		 * A single input the bot will make
+		 */
+		struct Event {
+			float time;		// Song offset (ms) to make the input at
+			int key;		// Button 1-5, or 0 for the wheel
+			int value;		// Buttons: 1 press, 0 release | Wheel: direction to turn
+		};
+
+	private:
+		bool enabled;
+		float timingNoise;
+		float missChance;
+		mt19937 rng;
+
+		vector<Event> events;
+		size_t nextEvent;
+		bool held[6];
+
+		float jitter();
+		bool skipNote();
+
+	public:
+		Autoplay();
+		~Autoplay();
+		void setEnabled(bool);
+		bool isEnabled();
+		void setTimingNoise(float);
+		float getTimingNoise();
+		void setMissChance(float);
+		float getMissChance();
+		bool isPerfect();
+
+		bool loadChart(string songPath, int diffNumber, int speed);
+		vector<Event>& getEvents();
+		void update(int64_t songOffset);
+		void releaseAll();
+};
+
+extern Autoplay autoplay;
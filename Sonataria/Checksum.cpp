@@ -0,0 +1,249 @@
+#include <cstdio>
+#include <cstring>
+
+#include "Checksum.h"
+
+// Multiplier of an FNV-1a hash
+const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+/**
+ * Hash a block of bytes with 64 bit FNV-1a (fast, for spotting damage and
+ * telling files apart, not for security).
+ *
+ * @param data the bytes
+ * @param length how many bytes
+ * @param hash the hash so far, to continue one over several blocks
+ * @return the hash
+ */
+uint64_t fnv1a64(const void* data, size_t length, uint64_t hash) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/**
+ * Hash a string with 64 bit FNV-1a.
+ *
+ * @param text the string
+ * @return the hash
+ */
+uint64_t fnv1a64(const string& text) {
+	return fnv1a64(text.data(), text.size());
+}
+
+/**
+ * Write a hash as 16 hex digits.
+ *
+ * @param value the hash
+ * @return the hex digits
+ */
+string toHex(uint64_t value) {
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)value);
+	return hex;
+}
+
+/**
+ * Write bytes as hex digits.
+ *
+ * @param bytes the bytes
+ * @param length how many bytes
+ * @return the hex digits
+ */
+string toHex(const uint8_t* bytes, size_t length) {
+	static const char DIGITS[] = "0123456789abcdef";
+
+	string hex(length * 2, '0');
+	for (size_t i = 0; i < length; i++) {
+		hex[i * 2] = DIGITS[bytes[i] >> 4];
+		hex[i * 2 + 1] = DIGITS[bytes[i] & 0x0F];
+	}
+	return hex;
+}
+
+/**
+ * Read hex digits back into bytes.
+ *
+ * @param hex the hex digits (either case)
+ * @param bytes set to the bytes
+ * @return true if the text was valid hex
+ */
+bool fromHex(const string& hex, vector<uint8_t>& bytes) {
+	if (hex.size() % 2 != 0) {
+		return false;
+	}
+
+	bytes.resize(hex.size() / 2);
+	for (size_t i = 0; i < hex.size(); i++) {
+		char c = hex[i];
+		int value;
+		if (c >= '0' && c <= '9') { value = c - '0'; }
+		else if (c >= 'a' && c <= 'f') { value = c - 'a' + 10; }
+		else if (c >= 'A' && c <= 'F') { value = c - 'A' + 10; }
+		else { return false; }
+
+		if (i % 2 == 0) {
+			bytes[i / 2] = (uint8_t)(value << 4);
+		}
+		else {
+			bytes[i / 2] |= (uint8_t)value;
+		}
+	}
+	return true;
+}
+
+// SHA-256 round constants
+static const uint32_t SHA256_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotateRight(uint32_t value, int bits) {
+	return (value >> bits) | (value << (32 - bits));
+}
+
+/**
+ * Default constructor.
+ *
+ */
+Sha256::Sha256() {
+	reset();
+}
+
+/**
+ * Start a new hash.
+ *
+ */
+void Sha256::reset() {
+	static const uint32_t INITIAL[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	for (int i = 0; i < 8; i++) {
+		this->state[i] = INITIAL[i];
+	}
+	this->blockUsed = 0;
+	this->totalLength = 0;
+}
+
+/**
+ * Add the next piece of data.
+ *
+ * @param data the bytes
+ * @param length how many bytes
+ */
+void Sha256::update(const void* data, size_t length) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	this->totalLength += length;
+
+	// Finish a block left over from last time
+	if (this->blockUsed > 0) {
+		size_t take = 64 - this->blockUsed;
+		if (take > length) {
+			take = length;
+		}
+		memcpy(this->block + this->blockUsed, bytes, take);
+		this->blockUsed += take;
+		bytes += take;
+		length -= take;
+
+		if (this->blockUsed < 64) {
+			return;
+		}
+		transform(this->block);
+		this->blockUsed = 0;
+	}
+
+	// Whole blocks straight from the caller's data
+	while (length >= 64) {
+		transform(bytes);
+		bytes += 64;
+		length -= 64;
+	}
+
+	memcpy(this->block, bytes, length);
+	this->blockUsed = length;
+}
+
+/**
+ * Finish the hash. Call reset() before using the object again.
+ *
+ * @param digest set to the 32 byte hash
+ */
+void Sha256::finish(uint8_t digest[32]) {
+	uint64_t bitLength = this->totalLength * 8;
+
+	// Padding: a 1 bit, zeros, then the length in bits
+	uint8_t padding[72] = { 0x80 };
+	size_t padLength = (this->blockUsed < 56 ? 56 : 120) - this->blockUsed;
+	for (int i = 0; i < 8; i++) {
+		padding[padLength + i] = (uint8_t)(bitLength >> (56 - 8 * i));
+	}
+	update(padding, padLength + 8);
+
+	for (int i = 0; i < 8; i++) {
+		digest[i * 4] = (uint8_t)(this->state[i] >> 24);
+		digest[i * 4 + 1] = (uint8_t)(this->state[i] >> 16);
+		digest[i * 4 + 2] = (uint8_t)(this->state[i] >> 8);
+		digest[i * 4 + 3] = (uint8_t)this->state[i];
+	}
+}
+
+/**
+ * Finish the hash. Call reset() before using the object again.
+ *
+ * @return the hash as hex digits
+ */
+string Sha256::finishHex() {
+	uint8_t digest[32];
+	finish(digest);
+	return toHex(digest, sizeof(digest));
+}
+
+/**
+ * Mix one 64 byte block into the hash.
+ *
+ * @param data the block
+ */
+void Sha256::transform(const uint8_t* data) {
+	uint32_t w[64];
+	for (int i = 0; i < 16; i++) {
+		w[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) | ((uint32_t)data[i * 4 + 2] << 8) | data[i * 4 + 3];
+	}
+	for (int i = 16; i < 64; i++) {
+		uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = this->state[0], b = this->state[1], c = this->state[2], d = this->state[3];
+	uint32_t e = this->state[4], f = this->state[5], g = this->state[6], h = this->state[7];
+	for (int i = 0; i < 64; i++) {
+		uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+		uint32_t choose = (e & f) ^ (~e & g);
+		uint32_t temp1 = h + s1 + choose + SHA256_K[i] + w[i];
+		uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+		uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t temp2 = s0 + majority;
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + temp1;
+		d = c;
+		c = b;
+		b = a;
+		a = temp1 + temp2;
+	}
+
+	this->state[0] += a; this->state[1] += b; this->state[2] += c; this->state[3] += d;
+	this->state[4] += e; this->state[5] += f; this->state[6] += g; this->state[7] += h;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file Checksum.h
+ *
+ * @brief Checksum
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Starting value of an FNV-1a hash
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+
+uint64_t fnv1a64(const void* data, size_t length, uint64_t hash = FNV_OFFSET_BASIS);
+uint64_t fnv1a64(const string& text);
+string toHex(uint64_t value);
+string toHex(const uint8_t* bytes, size_t length);
+bool fromHex(const string& hex, vector<uint8_t>& bytes);
+
+/**
+ * SHA-256 of data that arrives a piece at a time
+ */
+class Sha256 {
+
+	private:
+		uint32_t state[8];
+		uint8_t block[64];
+		size_t blockUsed;
+		uint64_t totalLength;
+
+		void transform(const uint8_t* data);
+
+	public:
+		Sha256();
+		void reset();
+		void update(const void* data, size_t length);
+		void finish(uint8_t digest[32]);
+		string finishHex();
+};
@@ -3,6 +3,7 @@
 #include <PacDrive/PacDrive.h>
 #include "KeyboardState.h"
 #include <iostream>
+#include "LatencyMonitor.h"
 
 ControllerInput controllerInput;
 
@@ -46,7 +47,7 @@ void ControllerInput::setKeyState(int keyNum, bool state) {
 	// Only push to input queue if on the game screen and not the start button and only on button down
 	if (gameState.getGameState() == GameState::CurrentState::GAME && keyNum != 6 && state == true) {
 		this->queue_mutexLock.lock();
-		this->inputQueue.push_back(keyNum);
+		this->inputQueue.push_back({ keyNum, LatencyMonitor::nowMicros() });
 		this->queue_mutexLock.unlock();
 	}
 }
@@ -9,8 +9,17 @@
 #include <deque>
 #include "KeyboardState.h"
 #include <mutex>
+#include <stdint.h>
 #include <SFML/Graphics.hpp>
 
+/**
+ * A button press waiting to be judged
+ */
+struct InputEvent {
+	int button;
+	int64_t captureMicros;	// When the press was captured (steady clock microseconds)
+};
+
 /**
  * Handles all of the input from the controller
  */
@@ -30,7 +39,7 @@ class ControllerInput {
 		void changeWheelPos(int);
 		void setWheelPos(int);
 		int getWheelPos();
-		deque<int> inputQueue;
+		deque<InputEvent> inputQueue;
 		mutex queue_mutexLock;
 		int getWheelMovement();
 		void resetLast();
@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include <GL/glew.h>
+#include <windows.h>
+#include <mmsystem.h>
+
+#include "FramePacer.h"
+#include "Logger.h"
+#include "Profiler.h"
+#include "StreamBuffer.h"
+
+#pragma comment (lib, "winmm.lib")
+
+FramePacer framePacer;
+
+// Extra time left between sampling input and the expected submit, to absorb small spikes
+const float LATCH_MARGIN_MS = 1.5f;
+
+// Sleep in small steps until this close to the target, then spin the rest
+const float SPIN_THRESHOLD_MS = 2.f;
+
+// A frame that takes this many periods or more counts as late
+const float LATE_FRAME_FACTOR = 1.5f;
+
+// Rates accepted for fixed rate pacing
+const int MIN_TARGET_RATE = 30;
+const int MAX_TARGET_RATE = 360;
+
+// Frames the GPU may be working on at once
+const int MAX_FRAMES_IN_FLIGHT_LIMIT = 3;
+
+// Give up on a fence after this long rather than hang on a lost device (nanoseconds)
+const GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+
+/**
+ * Default constructor.
+ *
+ */
+FramePacer::FramePacer() {
+	this->mode = Mode::VSYNC;
+	this->targetRate = 0;
+	this->periodMs = 1000.0 / 60.0;
+	this->timerResolutionRaised = false;
+	this->workEstimateMs = 0.f;
+	this->maxFramesInFlight = 1;
+	this->lastGpuWaitMs = 0.f;
+	this->recording = false;
+
+	this->lastPresent = Clock::now();
+	this->nextPresent = this->lastPresent;
+	this->latchTime = this->lastPresent;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+FramePacer::~FramePacer() {
+	if (this->timerResolutionRaised) {
+		timeEndPeriod(1);
+	}
+}
+
+/**
+ * Set how frames are paced (takes effect on the next apply).
+ *
+ * @param newMode the pacing mode
+ */
+void FramePacer::setMode(Mode newMode) {
+	this->mode = newMode;
+}
+
+FramePacer::Mode FramePacer::getMode() {
+	return this->mode;
+}
+
+/**
+ * Set the frame rate used by fixed rate pacing.
+ *
+ * @param rate frames per second (0 to match the display's refresh rate)
+ */
+void FramePacer::setTargetRate(int rate) {
+	if (rate <= 0) {
+		this->targetRate = 0;
+	}
+	else if (rate < MIN_TARGET_RATE) {
+		this->targetRate = MIN_TARGET_RATE;
+	}
+	else if (rate > MAX_TARGET_RATE) {
+		this->targetRate = MAX_TARGET_RATE;
+	}
+	else {
+		this->targetRate = rate;
+	}
+}
+
+int FramePacer::getTargetRate() {
+	return this->targetRate;
+}
+
+/**
+ * Set how many frames the GPU may be working on, counting the frame just submitted.
+ * 1 waits for every frame to finish like glFinish, higher values trade latency for throughput.
+ *
+ * @param frames the number of frames (1-3)
+ */
+void FramePacer::setMaxFramesInFlight(int frames) {
+	if (frames < 1) {
+		this->maxFramesInFlight = 1;
+	}
+	else if (frames > MAX_FRAMES_IN_FLIGHT_LIMIT) {
+		this->maxFramesInFlight = MAX_FRAMES_IN_FLIGHT_LIMIT;
+	}
+	else {
+		this->maxFramesInFlight = frames;
+	}
+}
+
+int FramePacer::getMaxFramesInFlight() {
+	return this->maxFramesInFlight;
+}
+
+/**
+ * Gets how long the last present waited on the GPU.
+ *
+ * @return the wait in milliseconds
+ */
+float FramePacer::getLastGpuWaitMs() {
+	return this->lastGpuWaitMs;
+}
+
+/**
+ * Gets the time between frames being aimed for.
+ *
+ * @return the frame period in milliseconds (0 when uncapped)
+ */
+float FramePacer::getPeriodMs() {
+	return this->mode == Mode::UNCAPPED ? 0.f : (float)this->periodMs;
+}
+
+/**
+ * Set up the window for the current mode and restart the frame timeline.
+ * Must be called from the thread the window is active on.
+ *
+ * @param window the window being rendered to
+ */
+void FramePacer::apply(sf::Window* window) {
+	int displayRate = getDisplayRefreshRate();
+
+	// The precise sleeps rely on 1ms scheduler ticks
+	if (!this->timerResolutionRaised && this->mode != Mode::UNCAPPED) {
+		this->timerResolutionRaised = timeBeginPeriod(1) == TIMERR_NOERROR;
+	}
+
+	// All pacing is done here, so SFML's own limiter is always off
+	window->setFramerateLimit(0);
+	window->setVerticalSyncEnabled(this->mode == Mode::VSYNC);
+
+	int rate = displayRate;
+	if (this->mode == Mode::FIXED && this->targetRate > 0) {
+		rate = this->targetRate;
+	}
+	this->periodMs = 1000.0 / (double)rate;
+
+	// Fences from before belong to the old timeline
+	clearFrameFences();
+
+	this->workEstimateMs = 0.f;
+	this->lastPresent = Clock::now();
+	this->nextPresent = this->lastPresent + chrono::duration_cast<Clock::duration>(chrono::duration<double, milli>(this->periodMs));
+	this->latchTime = this->lastPresent;
+
+	if (this->mode == Mode::UNCAPPED) {
+		logger.log("Frame pacing: ", getModeName(this->mode), " (display ", to_string(displayRate), " Hz, ",
+			to_string(this->maxFramesInFlight), " frames in flight)");
+	}
+	else {
+		logger.log("Frame pacing: ", getModeName(this->mode), " at ", to_string(rate), " Hz (display ", to_string(displayRate), " Hz, ",
+			to_string(this->maxFramesInFlight), " frames in flight)");
+	}
+}
+
+/**
+ * Wait until the latest point the frame can start and still be submitted in time
+ * for its present. Input and the song clock should be sampled right after this.
+ *
+ */
+void FramePacer::waitForLatch() {
+	if (this->mode != Mode::UNCAPPED) {
+		float leadMs = this->workEstimateMs + LATCH_MARGIN_MS;
+		Clock::time_point latch = this->nextPresent - chrono::duration_cast<Clock::duration>(chrono::duration<float, milli>(leadMs));
+		sleepUntil(latch);
+	}
+
+	this->latchTime = Clock::now();
+}
+
+/**
+ * Gets how long after the latch the frame being built is expected to reach the
+ * screen, so anything that moves with the song can be drawn where it will be then.
+ *
+ * @return milliseconds from the latch to the predicted present
+ */
+float FramePacer::getPresentLeadMs() {
+	if (this->mode == Mode::UNCAPPED) {
+		return 0.f;
+	}
+
+	float leadMs = chrono::duration<float, milli>(this->nextPresent - this->latchTime).count();
+	return leadMs > 0.f ? leadMs : 0.f;
+}
+
+/**
+ * Submit the frame and schedule the next one.
+ *
+ * @param window the window being rendered to
+ */
+void FramePacer::present(sf::Window* window) {
+	// Track how long frames take to build, rising at once and falling slowly so a single fast frame doesn't cause a miss
+	float workMs = chrono::duration<float, milli>(Clock::now() - this->latchTime).count();
+	if (workMs > this->workEstimateMs) {
+		this->workEstimateMs = workMs;
+	}
+	else {
+		this->workEstimateMs = this->workEstimateMs * 0.95f + workMs * 0.05f;
+	}
+
+	// Never start a frame before the previous one is on screen
+	float maxEstimateMs = (float)this->periodMs * 0.8f;
+	if (this->workEstimateMs > maxEstimateMs) {
+		this->workEstimateMs = maxEstimateMs;
+	}
+
+	if (this->mode == Mode::FIXED) {
+		sleepUntil(this->nextPresent);
+	}
+
+	window->display();
+
+	// Vertices written from now on go to the next part of the ring
+	streamBuffer.nextFrame();
+
+	// Don't let the driver queue frames ahead, which would add latency and hide the real present time
+	this->lastGpuWaitMs = waitForFrameFences();
+
+	Clock::time_point now = Clock::now();
+	if (this->recording) {
+		this->intervals.push_back(chrono::duration<float, milli>(now - this->lastPresent).count());
+		this->gpuWaits.push_back(this->lastGpuWaitMs);
+	}
+	this->lastPresent = now;
+
+	Clock::duration period = chrono::duration_cast<Clock::duration>(chrono::duration<double, milli>(this->periodMs));
+	switch (this->mode) {
+		case Mode::FIXED:
+			// Keep to the fixed timeline, starting a new one after a late frame
+			this->nextPresent += period;
+			if (this->nextPresent <= now) {
+				this->nextPresent = now + period;
+			}
+			break;
+		case Mode::VSYNC:
+			this->nextPresent = now + period;
+			break;
+		case Mode::UNCAPPED:
+			this->nextPresent = now;
+			break;
+	}
+}
+
+/**
+ * Start tracking the time between presents.
+ *
+ */
+void FramePacer::beginReport() {
+	this->intervals.clear();
+	this->intervals.reserve(20000);
+	this->gpuWaits.clear();
+	this->gpuWaits.reserve(20000);
+	this->recording = true;
+}
+
+/**
+ * Stop tracking and summarize the time between presents.
+ *
+ * @return how consistent the frames were
+ */
+FramePacer::Report FramePacer::endReport() {
+	this->recording = false;
+
+	Report report = { this->intervals.size(), getPeriodMs(), 0.f, 0.f, 0.f, 0.f, 0, 0.f, 0.f };
+	if (this->intervals.empty()) {
+		return report;
+	}
+
+	double total = 0.0;
+	for (size_t i = 0; i < this->intervals.size(); i++) {
+		total += this->intervals[i];
+	}
+	report.averageMs = (float)(total / this->intervals.size());
+
+	double variance = 0.0;
+	for (size_t i = 0; i < this->intervals.size(); i++) {
+		double diff = this->intervals[i] - report.averageMs;
+		variance += diff * diff;
+	}
+	report.stdDevMs = (float)sqrt(variance / this->intervals.size());
+
+	// Uncapped frames have no target, so compare against the average instead
+	float lateMs = (report.targetMs > 0.f ? report.targetMs : report.averageMs) * LATE_FRAME_FACTOR;
+	for (size_t i = 0; i < this->intervals.size(); i++) {
+		if (this->intervals[i] >= lateMs) {
+			report.lateFrames++;
+		}
+	}
+
+	vector<float> sorted = this->intervals;
+	sort(sorted.begin(), sorted.end());
+	report.p99Ms = sorted[(sorted.size() - 1) * 99 / 100];
+	report.maxMs = sorted.back();
+
+	double totalGpuWait = 0.0;
+	for (size_t i = 0; i < this->gpuWaits.size(); i++) {
+		totalGpuWait += this->gpuWaits[i];
+		if (this->gpuWaits[i] > report.maxGpuWaitMs) {
+			report.maxGpuWaitMs = this->gpuWaits[i];
+		}
+	}
+	report.averageGpuWaitMs = (float)(totalGpuWait / this->gpuWaits.size());
+
+	return report;
+}
+
+/**
+ * Fence the frame just submitted and wait until fewer than the allowed number of frames are still on the GPU,
+ * so the next frame can be submitted without going over the limit.
+ *
+ * @return how long the CPU waited in milliseconds
+ */
+float FramePacer::waitForFrameFences() {
+	ProfileScope gpuWaitScope(ZONE_GPU_WAIT);
+
+	this->frameFences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+
+	Clock::time_point start = Clock::now();
+	while ((int)this->frameFences.size() >= this->maxFramesInFlight) {
+		GLsync fence = this->frameFences.front();
+		this->frameFences.pop_front();
+
+		if (fence) {
+			GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+			if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+				logger.logError(L"Timed out waiting for the GPU to finish a frame.");
+			}
+			glDeleteSync(fence);
+		}
+	}
+
+	return chrono::duration<float, milli>(Clock::now() - start).count();
+}
+
+/**
+ * Delete the fences of any frames still being tracked.
+ *
+ */
+void FramePacer::clearFrameFences() {
+	for (size_t i = 0; i < this->frameFences.size(); i++) {
+		if (this->frameFences[i]) {
+			glDeleteSync(this->frameFences[i]);
+		}
+	}
+	this->frameFences.clear();
+}
+
+/**
+ * Sleep until a point in time, spinning for the last stretch since sleeps are only accurate to about a millisecond.
+ *
+ * @param target when to wake up
+ */
+void FramePacer::sleepUntil(Clock::time_point target) {
+	Clock::duration spinThreshold = chrono::duration_cast<Clock::duration>(chrono::duration<float, milli>(SPIN_THRESHOLD_MS));
+
+	while (target - Clock::now() > spinThreshold) {
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	while (Clock::now() < target) {
+		this_thread::yield();
+	}
+}
+
+/**
+ * Gets the refresh rate of the main display.
+ *
+ * @return refresh rate in Hz (60 if it can't be read)
+ */
+int FramePacer::getDisplayRefreshRate() {
+	DEVMODE displayMode;
+	ZeroMemory(&displayMode, sizeof(displayMode));
+	displayMode.dmSize = sizeof(displayMode);
+
+	// 0 and 1 mean the hardware default
+	if (EnumDisplaySettings(NULL, ENUM_CURRENT_SETTINGS, &displayMode) && displayMode.dmDisplayFrequency > 1) {
+		return (int)displayMode.dmDisplayFrequency;
+	}
+	return 60;
+}
+
+/**
+ * Gets the name of a mode as stored in the settings file.
+ *
+ * @param mode the mode
+ * @return the name of the mode
+ */
+string FramePacer::getModeName(Mode mode) {
+	switch (mode) {
+		case Mode::VSYNC: return "VSYNC";
+		case Mode::FIXED: return "FIXED";
+		case Mode::UNCAPPED: return "UNCAPPED";
+		default: return "VSYNC";
+	}
+}
+
+/**
+ * Gets a mode from its name in the settings file.
+ *
+ * @param name the name of the mode
+ * @return the mode (VSYNC if the name isn't known)
+ */
+FramePacer::Mode FramePacer::getModeFromName(string name) {
+	if (name == "FIXED") {
+		return Mode::FIXED;
+	}
+	else if (name == "UNCAPPED") {
+		return Mode::UNCAPPED;
+	}
+	return Mode::VSYNC;
+}
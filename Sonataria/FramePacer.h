@@ -0,0 +1,106 @@
+/**
+ * @file FramePacer.h
+ *
+ * @brief Frame Pacer
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include <SFML/Window.hpp>
+
+/**
+ * Schedules when each frame starts and is presented. Input and the song clock are
+ * sampled as late as the expected render time allows, right before the frame is
+ * submitted, and the time between presents is tracked to report how even it was.
+ * Fences limit how many frames the GPU may have queued so hits reach the screen quickly.
+ */
+class FramePacer {
+
+	public:
+		/**
+		 * How frames are paced
+		 */
+		enum class Mode {
+			VSYNC,		// Present on the display's vertical blank
+			FIXED,		// Present at a fixed rate using precise sleeps
+			UNCAPPED	// Render as fast as possible
+		};
+
+		/**
+		 * Consistency of the frame times over a period
+		 */
+		struct Report {
+			size_t frameCount;
+			float targetMs;
+			float averageMs;
+			float stdDevMs;
+			float p99Ms;
+			float maxMs;
+			int lateFrames;
+			float averageGpuWaitMs;
+			float maxGpuWaitMs;
+		};
+
+	private:
+		typedef chrono::steady_clock Clock;
+
+		Mode mode;
+		int targetRate;
+		double periodMs;
+		bool timerResolutionRaised;
+
+		// When the next frame is expected to reach the screen
+		Clock::time_point nextPresent;
+		Clock::time_point lastPresent;
+		Clock::time_point latchTime;
+
+		// Expected time from sampling input to submitting the frame
+		float workEstimateMs;
+
+		// Fences of the frames the GPU may still be working on, oldest first
+		int maxFramesInFlight;
+		deque<GLsync> frameFences;
+		float lastGpuWaitMs;
+
+		bool recording;
+		vector<float> intervals;
+		vector<float> gpuWaits;
+
+		void sleepUntil(Clock::time_point target);
+		float waitForFrameFences();
+		void clearFrameFences();
+
+	public:
+		FramePacer();
+		~FramePacer();
+
+		void setMode(Mode);
+		Mode getMode();
+		void setTargetRate(int);
+		int getTargetRate();
+		float getPeriodMs();
+		void setMaxFramesInFlight(int);
+		int getMaxFramesInFlight();
+		float getLastGpuWaitMs();
+
+		void apply(sf::Window* window);
+		void waitForLatch();
+		float getPresentLeadMs();
+		void present(sf::Window* window);
+
+		void beginReport();
+		Report endReport();
+
+		static int getDisplayRefreshRate();
+		static string getModeName(Mode);
+		static Mode getModeFromName(string);
+};
+
+extern FramePacer framePacer;
@@ -24,15 +24,19 @@ using namespace std;
 
 #include "OpenGLText.h"
 #include "TextureList.h"
+#include "TextureLoader.h"
 
 #include "ScreenRenderer.h"
+#include "Replay.h"
+#include "Autoplay.h"
+#include "SoakTest.h"
+#include "Profiler.h"
+#include "FramePacer.h"
+#include "LatencyMonitor.h"
+#include "ScoreQueue.h"
+
+#include <filesystem>
 
-void parseInNotes(vector<Note>& lane, int LaneNum, string songPath, int diffNumber, int bpm);
-void parseInWheel(vector<WheelNote>& wheel, string songPath, int diffNumber, int bpm);
-void tokenize2(std::string const& str, const char delim, std::vector<std::string>& out);
-void updateAppearTime(vector<Note>& lane);
-void updateAppearTime(vector<WheelNote>& lane);
-void updateScreenTime(float& distance);
 wstring getScoreString(float score);
 
 std::chrono::milliseconds timespan(1000);
@@ -41,12 +45,6 @@ std::chrono::milliseconds timespan(1000);
 const float SCRWIDTH = 1920.f;
 const float SCRHEIGHT = 1080.f;
 
-// These only represent one side of the window
-const float PERFECT_WINDOW = 45.f;
-const float NEAR_WINDOW = 90.f;
-const float MISS_WINDOW = 135.f;
-const float SLAM_RANGE = 1.f;
-
 // The position of each lane on screen
 const float LANE_1_POS = SCRWIDTH / 2.f - 150.f;
 const float LANE_2_POS = SCRWIDTH / 2.f - 75.f;
@@ -68,16 +66,11 @@ const float SCRUB_LENGTH = SCRUB_END - SCRUB_START;
 // Where the wheel slam position is
 const float WHEEL_SLAM_POS = SCRWIDTH / 2.f;
 
-// Where the perfect line is on screen
-const float DISTANCE_TO_PERFECT = 921.f;
-
 // Where the judgement box is on screen
 const float JUDGEMENT_LOC = 4.f * SCRWIDTH / 5.f;
 
 const float laneNoteScale = 0.18f;
 
-ifstream inputFile;
-
 /**
  * Default constructor.
  * 
@@ -87,6 +80,7 @@ GameRenderer::GameRenderer() {
 
 	// Sprites
 	Audience = new QuadSprite(L"Audience");
+	backgroundVideo = NULL;
 
 	track = new QuadSprite(L"Track");
 	laneNote = new QuadSprite(L"Lane Note");
@@ -95,6 +89,12 @@ GameRenderer::GameRenderer() {
 	wheelPixelNote = new QuadSprite(L"Wheel Note in Pixel Units");
 	holdPixelNote = new QuadSprite(L"Hold Note in Pixel Units");
 	noteJudgement = new QuadSprite(L"Judgement for Notes");
+
+	// Text (made in init, the font needs OpenGL)
+	songTitle = NULL;
+	scoreText = NULL;
+	speedText = NULL;
+	profilerText = NULL;
 }
 
 /**
@@ -104,6 +104,7 @@ GameRenderer::GameRenderer() {
 GameRenderer::~GameRenderer() {
 	// Sprites
 	delete Audience;
+	delete backgroundVideo;
 
 	delete track;
 	delete laneNote;
@@ -112,6 +113,133 @@ GameRenderer::~GameRenderer() {
 	delete wheelPixelNote;
 	delete holdPixelNote;
 	delete noteJudgement;
+
+	// Text
+	delete songTitle;
+	delete scoreText;
+	delete speedText;
+	delete profilerText;
+}
+
+/**
+ * Create the shaders, sprites and text. Only done once, they are kept for every
+ * song after. Needs the game window to be active on the calling thread.
+ *
+ */
+void GameRenderer::init() {
+	if (this->openGLInitialized) {
+		return;
+	}
+	this->openGLInitialized = true;
+
+	logger.log(L"Initializing Game Renderer...");
+
+	// INITIALIZE SPRITE SHADER
+	if (!spriteShader.initShader()) {
+		logger.logError(L"Failed to initialize sprite shader");
+		exit(1);
+	}
+
+	// INITIALIZE THE SPRITES
+	
+	// Background
+	Audience->initSprite(spriteShader.getProgram());
+
+	track->initSprite(spriteShader.getProgram());
+	laneNote->initSprite(spriteShader.getProgram());
+	wheelSlamLeft->initSprite(spriteShader.getProgram());
+	wheelSlamRight->initSprite(spriteShader.getProgram());
+	wheelPixelNote->initSprite(spriteShader.getProgram());
+	holdPixelNote->initSprite(spriteShader.getProgram());
+	noteJudgement->initSprite(spriteShader.getProgram());
+
+	// INITIALIZE THE TEXTURES
+	
+	// Background
+	Audience->setTextureID(TextureList::Inst()->GetTextureID("Textures/Backgrounds/Audience.png"));
+
+	// Game
+	track->setTextureID(TextureList::Inst()->GetTextureID("Textures/Game/Notes/Track.png"));
+	laneNote->setTextureID(TextureList::Inst()->GetTextureID("Textures/Game/Notes/standardNote.png"));
+
+	wheelSlamLeft->setTextureID(TextureList::Inst()->GetTextureID("Textures/temp_SlamLeft.png"));
+	wheelSlamRight->setTextureID(TextureList::Inst()->GetTextureID("Textures/temp_SlamRight.png"));
+	wheelPixelNote->setTextureID(TextureList::Inst()->GetTextureID("Textures/temp_wheel_Note.png"));
+	holdPixelNote->setTextureID(TextureList::Inst()->GetTextureID("Textures/temp_hold_Note.png"));
+
+	// SET THE TRANSFORMATIONS
+
+	// Background
+	Audience->scale(2.f * (16.f/9.f), 2.f, 1.f);
+
+	// Track
+	track->scale(1.f, 5.f, 1.f);
+	track->translate(0.f, 0.34f, -3.5f);
+	track->rotate(-65.f, 0.f, 0.f);
+
+	laneNote->scale(1.f, 0.159f, 1.f);
+	laneNote->scale(laneNoteScale);
+	laneNote->translate(0.f, -1.f, -3.5f);
+	laneNote->rotate(-65.f, 0.f, 0.f);
+
+	wheelSlamLeft->scale(1.f, 0.159f, 1.f);
+	wheelSlamLeft->scale(laneNoteScale);
+	wheelSlamLeft->translate(0.f, -1.f, -3.5f);
+	wheelSlamLeft->rotate(-65.f, 0.f, 0.f);
+	wheelSlamLeft->setOpacity(0.5f);
+
+	wheelSlamRight->scale(1.f, 0.159f, 1.f);
+	wheelSlamRight->scale(laneNoteScale);
+	wheelSlamRight->translate(0.f, -1.f, -3.5f);
+	wheelSlamRight->rotate(-65.f, 0.f, 0.f);
+	wheelSlamRight->setOpacity(0.5f);
+
+	// Judgement Sizing
+	noteJudgement->scale(0.2f, .2f * 9.f / 16.f, 1.f);
+	noteJudgement->translate(0.f, .5f, 0.f);
+	noteJudgement->setTextureID(TextureList::Inst()->GetTextureID("Textures/Judgement/temp_Perfect.png"));
+	noteJudgement->setTextureID(TextureList::Inst()->GetTextureID("Textures/Judgement/temp_Near.png"));
+	noteJudgement->setTextureID(TextureList::Inst()->GetTextureID("Textures/Judgement/temp_Miss.png"));
+
+	// Setup scale on the pixelNote sprites so they are in units of pixels
+	wheelPixelNote->scale(1.0f / (.1984f * 2.f), 1.0f / 2.f, 1.0f);
+	wheelPixelNote->scale(0.5773f, 1.0f, 1.0f); // sqrt(3)/3
+
+	holdPixelNote->scale(1.0f / (.1984f * 2.f), 1.0f / 2.f, 1.0f);
+	holdPixelNote->scale(0.5773f, 1.0f, 1.0f); // sqrt(3)/3
+
+	// INITIALIZE TEXT SHADER
+	if (!textShader.initShader()) {
+		logger.logError(L"Failed to initialize text shader");
+		exit(1);
+	}
+
+	// INITIALIZE VIDEO SHADER
+	if (!videoShader.initShader()) {
+		logger.logError(L"Failed to initialize video shader");
+		exit(1);
+	}
+
+	// INITIALIZE TEXT
+	TextureManager::TextureInfo fontInfo = TextureList::Inst()->GetTextureInfo("Fonts/HonyaJi-Re.ttf");
+
+	songTitle = new OpenGLText(L"Song Title", *fontInfo.font);
+	songTitle->initSprite(textShader.getProgram());
+	songTitle->translate(-3300.f, 950.f, 0.f);
+
+	scoreText = new OpenGLText(L"Score", *fontInfo.font);
+	scoreText->initSprite(textShader.getProgram());
+	scoreText->translate(2600.f, 950.f, 0.f);
+
+	speedText = new OpenGLText(L"Speed", *fontInfo.font);
+	speedText->initSprite(textShader.getProgram());
+	speedText->translate(-3300.f, 800.f, 0.f);
+	speedText->scale(0.75f);
+
+	profilerText = new OpenGLText(L"Profiler", *fontInfo.font);
+	profilerText->initSprite(textShader.getProgram());
+
+	logger.log(L"Game Renderer initialized.");
 }
 
 /**
@@ -120,24 +248,15 @@ GameRenderer::~GameRenderer() {
  * @param gameWindow the game window
  */
 void GameRenderer::render(sf::RenderWindow* gameWindow) {
-	
-	// Initialize counts
-	int perfectCount = 0;
-	int nearCount = 0;
-	int missCount = 0;
-
-	// Score of the song (while playing)
-	float score = 0000000;
-
-	// Used to track if there was a change in the speed
-	int oldSpeed = 0;
+	// The speed the song starts at (changes during the song are picked up each frame)
+	int startSpeed = 0;
 	gameState.setSpeed(stoi(gameState.getSongPlaying().getBPM()));
-	oldSpeed = gameState.getSpeed();
+	startSpeed = gameState.getSpeed();
 
 	// If the user has a custom speed, set it now
 	if (userData.useCustomSpeed()) {
-		oldSpeed = userData.getGameSpeed();
-		gameState.setSpeed(oldSpeed);
+		startSpeed = userData.getGameSpeed();
+		gameState.setSpeed(startSpeed);
 	}
 
 	// Set the judgement "clear" off screen time back to default at 0
@@ -146,8 +265,13 @@ void GameRenderer::render(sf::RenderWindow* gameWindow) {
 	// Use OpenGL version of graphics implementation
 	logger.log(L"OpenGL Game Renderer Active.");
 
-	// Set the game window to active in this thread
-	gameWindow->setActive(true);
+	// Only the first song has to set up OpenGL (normally done during startup already)
+	init();
+
+	// Enable and configure alpha blending (SFML changes it at the end of every song)
+	glEnable(GL_BLEND);
+	glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
+	glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
 
 	// Load the Audio Files
 	sf::Music countdown;
@@ -157,198 +281,47 @@ void GameRenderer::render(sf::RenderWindow* gameWindow) {
 	song.openFromFile(gameState.getSongPlaying().getAudioFilePath());
 	float songDuration = (float)song.getDuration().asMilliseconds();
 
-	// OpenGL Setup
-	if (!this->openGLInitialized) {
-		this->openGLInitialized = true;
-
-		// Enable and configure alpha blending
-		glEnable(GL_BLEND);
-		glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
-		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
-
-		// INITIALIZE SPRITE SHADER
-		if (!spriteShader.initShader()) {
-			logger.logError(L"Failed to initialize sprite shader");
-			exit(1);
+	// Load the song's background video if it has one (decoding runs on the video's own thread)
+	delete backgroundVideo;
+	backgroundVideo = NULL;
+	if (gameState.getSongPlaying().hasVideo()) {
+		backgroundVideo = new VideoSprite(L"Background Video");
+		if (backgroundVideo->loadVideo(gameState.getSongPlaying().getVideoFilePath().c_str())) {
+			backgroundVideo->initSprite(videoShader.getProgram());
+			backgroundVideo->scale(2.f * aspect, -2.f, 1.f);
 		}
-
-		// INITIALIZE THE SPRITES
-		
-		// Background
-		Audience->initSprite(spriteShader.getProgram());
-
-		track->initSprite(spriteShader.getProgram());
-		laneNote->initSprite(spriteShader.getProgram());
-		wheelSlamLeft->initSprite(spriteShader.getProgram());
-		wheelSlamRight->initSprite(spriteShader.getProgram());
-		wheelPixelNote->initSprite(spriteShader.getProgram());
-		holdPixelNote->initSprite(spriteShader.getProgram());
-		noteJudgement->initSprite(spriteShader.getProgram());
-
-		// INITIALIZE THE TEXTURES
-		
-		// Background
-		Audience->setTextureID(TextureList::Inst()->GetTextureID("Textures/Backgrounds/Audience.png"));
-
-		// Game
-		track->setTextureID(TextureList::Inst()->GetTextureID("Textures/Game/Notes/Track.png"));
-		laneNote->setTextureID(TextureList::Inst()->GetTextureID("Textures/Game/Notes/standardNote.png"));
-
-		wheelSlamLeft->setTextureID(TextureList::Inst()->GetTextureID("Textures/temp_SlamLeft.png"));
-		wheelSlamRight->setTextureID(TextureList::Inst()->GetTextureID("Textures/temp_SlamRight.png"));
-		wheelPixelNote->setTextureID(TextureList::Inst()->GetTextureID("Textures/temp_wheel_Note.png"));
-		holdPixelNote->setTextureID(TextureList::Inst()->GetTextureID("Textures/temp_hold_Note.png"));
-
-		// SET THE TRANSFORMATIONS
-
-		// Background
-		Audience->scale(2.f * (16.f/9.f), 2.f, 1.f);
-
-		// Track
-		track->scale(1.f, 5.f, 1.f);
-		track->translate(0.f, 0.34f, -3.5f);
-		track->rotate(-65.f, 0.f, 0.f);
-
-		laneNote->scale(1.f, 0.159f, 1.f);
-		laneNote->scale(laneNoteScale);
-		laneNote->translate(0.f, -1.f, -3.5f);
-		laneNote->rotate(-65.f, 0.f, 0.f);
-
-		wheelSlamLeft->scale(1.f, 0.159f, 1.f);
-		wheelSlamLeft->scale(laneNoteScale);
-		wheelSlamLeft->translate(0.f, -1.f, -3.5f);
-		wheelSlamLeft->rotate(-65.f, 0.f, 0.f);
-		wheelSlamLeft->setOpacity(0.5f);
-
-		wheelSlamRight->scale(1.f, 0.159f, 1.f);
-		wheelSlamRight->scale(laneNoteScale);
-		wheelSlamRight->translate(0.f, -1.f, -3.5f);
-		wheelSlamRight->rotate(-65.f, 0.f, 0.f);
-		wheelSlamRight->setOpacity(0.5f);
-
-		// Judgement Sizing
-		noteJudgement->scale(0.2f, .2f * 9.f / 16.f, 1.f);
-		noteJudgement->translate(0.f, .5f, 0.f);
-		noteJudgement->setTextureID(TextureList::Inst()->GetTextureID("Textures/Judgement/temp_Perfect.png"));
-		noteJudgement->setTextureID(TextureList::Inst()->GetTextureID("Textures/Judgement/temp_Near.png"));
-		noteJudgement->setTextureID(TextureList::Inst()->GetTextureID("Textures/Judgement/temp_Miss.png"));
-
-		// Setup scale on the pixelNote sprites so they are in units of pixels
-		wheelPixelNote->scale(1.0f / (.1984f * 2.f), 1.0f / 2.f, 1.0f);
-		wheelPixelNote->scale(0.5773f, 1.0f, 1.0f); // sqrt(3)/3
-
-		holdPixelNote->scale(1.0f / (.1984f * 2.f), 1.0f / 2.f, 1.0f);
-		holdPixelNote->scale(0.5773f, 1.0f, 1.0f); // sqrt(3)/3
-
-		// INITIALIZE TEXT SHADER
-		if (!textShader.initShader()) {
-			logger.logError(L"Failed to initialize text shader");
-			exit(1);
+		else {
+			logger.logError("Failed to load background video: ", gameState.getSongPlaying().getVideoFilePath());
+			delete backgroundVideo;
+			backgroundVideo = NULL;
 		}
 	}
 
-	// INITIALIZE TEXT
-	TextureManager::TextureInfo fontInfo = TextureList::Inst()->GetTextureInfo("Fonts/HonyaJi-Re.ttf");
-
-	OpenGLText* songTitle = new OpenGLText(L"Song Title", *fontInfo.font);
-	songTitle->initSprite(textShader.getProgram());
-	songTitle->translate(-3300.f, 950.f, 0.f);
-
-	OpenGLText* scoreText = new OpenGLText(L"Score", *fontInfo.font);
-	scoreText->initSprite(textShader.getProgram());
-	scoreText->translate(2600.f, 950.f, 0.f);
-
-	OpenGLText* speedText = new OpenGLText(L"Speed", *fontInfo.font);
-	speedText->initSprite(textShader.getProgram());
-	speedText->translate(-3300.f, 800.f, 0.f);
-	speedText->scale(0.75f);
-
 	// Clear Color for Background
 	glClearColor(0.f, 0.f, 0.f, 1.0f);
 	glViewport(0, 0, 1920, 1080);
 
-	vector<Note> lane1;
-	vector<Note> lane2;
-	vector<Note> lane3;
-	vector<Note> lane4;
-	vector<Note> lane5;
-	vector<WheelNote> wheel;
+	// Start the frame timeline for this thread
+	framePacer.apply(gameWindow);
 
 	logger.log(L"Reading in notes...");
 
-	parseInNotes(lane1, 1, gameState.getSongPlaying().getPath(), gameState.getSongPlayingDifficulty(), gameState.getSpeed());
-	parseInNotes(lane2, 2, gameState.getSongPlaying().getPath(), gameState.getSongPlayingDifficulty(), gameState.getSpeed());
-	parseInNotes(lane3, 3, gameState.getSongPlaying().getPath(), gameState.getSongPlayingDifficulty(), gameState.getSpeed());
-	parseInNotes(lane4, 4, gameState.getSongPlaying().getPath(), gameState.getSongPlayingDifficulty(), gameState.getSpeed());
-	parseInNotes(lane5, 5, gameState.getSongPlaying().getPath(), gameState.getSongPlayingDifficulty(), gameState.getSpeed());
-	parseInWheel(wheel, gameState.getSongPlaying().getPath(), gameState.getSongPlayingDifficulty(), gameState.getSpeed());
-
-	// Calculate the total notes by adding each lane together
-	int totalNotes = 0;
-	{
-		for (size_t i = 0; i < lane1.size(); i++) {
-			if (lane1[i].isHold()) {
-				totalNotes += lane1[i].getHoldNoteQuantity();
-			}
-			else {
-				totalNotes += 1;
-			}
-		}
-
-		for (size_t i = 0; i < lane2.size(); i++) {
-			if (lane2[i].isHold()) {
-				totalNotes += lane2[i].getHoldNoteQuantity();
-			}
-			else {
-				totalNotes += 1;
-			}
-		}
-
-		for (size_t i = 0; i < lane3.size(); i++) {
-			if (lane3[i].isHold()) {
-				totalNotes += lane3[i].getHoldNoteQuantity();
-			}
-			else {
-				totalNotes += 1;
-			}
-		}
-
-		for (size_t i = 0; i < lane4.size(); i++) {
-			if (lane4[i].isHold()) {
-				totalNotes += lane4[i].getHoldNoteQuantity();
-			}
-			else {
-				totalNotes += 1;
-			}
-		}
-
-		for (size_t i = 0; i < lane5.size(); i++) {
-			if (lane5[i].isHold()) {
-				totalNotes += lane5[i].getHoldNoteQuantity();
-			}
-			else {
-				totalNotes += 1;
-			}
-		}
-
-		for (size_t i = 0; i < wheel.size(); i++) {
-			if (wheel[i].isSlam()) {
-				totalNotes += 1;
-			}
-			else {
-				totalNotes += wheel[i].getNoteQuantity();
-			}
-		}
+	// The judgement engine holds the chart and does all scoring
+	JudgementEngine judgement;
+	if (!judgement.loadChart(gameState.getSongPlaying().getPath(), gameState.getSongPlayingDifficulty(), startSpeed)) {
+		logger.logError("Missing chart files in ", gameState.getSongPlaying().getPath());
 	}
-	logger.log(L"Total Notes: " + to_wstring(totalNotes));
-
-	// Calculate the value that each note is worth based on the total notes
-	float perfectNoteScore = 1000000.f / (float)totalNotes;
-	float nearNoteScore = perfectNoteScore / 2.f;
+	logger.log(L"Total Notes: " + to_wstring(judgement.getTotalNotes()));
 
-	float distance = (float)(453075.9705 / pow(oldSpeed, 1.004140998));
+	// Record every frame of input so the play can be re-simulated
+	Replay replay;
+	replay.begin(gameState.getSongPlaying().getSongID(), gameState.getSongPlaying().getPath(), gameState.getSongPlayingDifficulty(), startSpeed);
 
-	int itemFront = NULL;
+	// Let the bot work out its inputs for this chart
+	if (autoplay.isEnabled()) {
+		autoplay.loadChart(gameState.getSongPlaying().getPath(), gameState.getSongPlayingDifficulty(), startSpeed);
+		logger.log(L"Autoplay Active.");
+	}
 
 	// Clear the input queue before the song starts
 	controllerInput.queue_mutexLock.lock();
@@ -364,6 +337,9 @@ void GameRenderer::render(sf::RenderWindow* gameWindow) {
 	// Do a render loop while playing to display the 3.2.1. countdown on screen
 	while (countdown.getStatus() == sf::Music::Status::Playing) {
 
+		// Wait for the frame's turn
+		framePacer.waitForLatch();
+
 		// If the service button was pressed, stop the song
 		if (gameState.checkService() || gameState.getGameState() == GameState::CurrentState::SHUTDOWN) {
 			logger.log(L"Ending Game Render Loop.");
@@ -371,12 +347,20 @@ void GameRenderer::render(sf::RenderWindow* gameWindow) {
 			continue;
 		}
 		else {
+			// Draw the background (holding the first video frame until the song starts)
+			if (backgroundVideo) {
+				glUseProgram(videoShader.getProgram());
+				backgroundVideo->update(0.0);
+				backgroundVideo->render(PROJECTION::ORTHOGRAPHIC);
+			}
+			else {
+				glUseProgram(spriteShader.getProgram());
+				Audience->render(PROJECTION::ORTHOGRAPHIC);
+			}
+
 			// Draw the sprites
 			glUseProgram(spriteShader.getProgram());
 
-			// Draw the background
-			Audience->render(PROJECTION::ORTHOGRAPHIC);
-
 			// Clear the depth buffer
 			glClear(GL_DEPTH_BUFFER_BIT);
 
@@ -386,7 +370,7 @@ void GameRenderer::render(sf::RenderWindow* gameWindow) {
 			// Draw all text
 			glUseProgram(textShader.getProgram());
 			songTitle->render(PROJECTION::ORTHOGRAPHIC, gameState.getSongPlaying().getTitle(), ALIGNMENT::LEFT, 1.f, 1.f, 1.f, 1.5f);
-			scoreText->render(PROJECTION::ORTHOGRAPHIC, getScoreString(score), ALIGNMENT::LEFT, 1.f, 1.f, 1.f, 1.5f);
+			scoreText->render(PROJECTION::ORTHOGRAPHIC, getScoreString(judgement.getScore()), ALIGNMENT::LEFT, 1.f, 1.f, 1.f, 1.5f);
 			if (controllerInput.getKeyboardState().getKeyState(6)) {
 				speedText->render(PROJECTION::ORTHOGRAPHIC, to_wstring(gameState.getSpeed()), ALIGNMENT::LEFT, 0.f, 1.f, 0.f, 1.5f);
 			}
@@ -394,11 +378,16 @@ void GameRenderer::render(sf::RenderWindow* gameWindow) {
 				speedText->render(PROJECTION::ORTHOGRAPHIC, to_wstring(gameState.getSpeed()), ALIGNMENT::LEFT, 1.f, 1.f, 1.f, 1.5f);
 			}
 
-			gameWindow->display();
+			framePacer.present(gameWindow);
 		}
 	}
 
 	// After countdown play the song
+	if (soakTest.isEnabled()) {
+		soakTest.beginPlay();
+	}
+	framePacer.beginReport();
+	latencyMonitor.setSong(gameState.getSongPlaying().getSongID());
 	song.play();
 
 	// Create time variables
@@ -406,16 +395,29 @@ void GameRenderer::render(sf::RenderWindow* gameWindow) {
 	typedef std::chrono::milliseconds ms;
 	typedef std::chrono::duration<float> fsec;
 	auto songStartTime = Time::now();
+	auto lastFrameTime = songStartTime;
 
 	// Do a render loop while playing the song
 	while (song.getStatus() == sf::Music::Status::Playing) {
-		
+
+		// Wait until just before the frame has to be built so input and the song clock are as fresh as possible
+		framePacer.waitForLatch();
+
 		// Set the current position in the song
 		auto currentSongPosition = Time::now();
 		fsec fs = currentSongPosition - songStartTime;
 		ms currentSongOffset = std::chrono::duration_cast<ms>(fs);
 		// Use currentSongOffset.count() to get millisecond value
 
+		// Track how long each frame took for soak test runs
+		if (soakTest.isEnabled()) {
+			soakTest.recordFrame(std::chrono::duration<float, std::milli>(currentSongPosition - lastFrameTime).count());
+		}
+		lastFrameTime = currentSongPosition;
+
+		// Time the whole frame for the profiler
+		ProfileScope frameScope(ZONE_FRAME);
+
 		// If the service button was pressed, stop the song
 		if (gameState.checkService() || gameState.getGameState() == GameState::CurrentState::SHUTDOWN) {
 			logger.log(L"Ending Game Render Loop.");
@@ -424,810 +426,166 @@ void GameRenderer::render(sf::RenderWindow* gameWindow) {
 		}
 		else {
 			// ** INPUT **
-			glUseProgram(spriteShader.getProgram());
-
-			// Check for new inputs
-			if (!controllerInput.inputQueue.empty()) {
-				// Lock the mutex
-				controllerInput.queue_mutexLock.lock();
-
-				// Store the front item in the queue
-				itemFront = controllerInput.inputQueue.front();
-				
-				// Remove that item from the queue
-				controllerInput.inputQueue.pop_front();
-
-				// Unlock the mutex
-				controllerInput.queue_mutexLock.unlock();
-			}
+			FrameInput input;
+			{
+				ProfileScope inputScope(ZONE_INPUT);
 
-			// Handle an input that was pulled off the queue
-			if (itemFront != NULL) {
-				switch (itemFront) {
-					// Logic for Lane 1
-					case 1:
-						// Note (not hold)
-						if (!lane1.empty() && !lane1[0].isHold() && lane1[0].getYPos() + MISS_WINDOW >= DISTANCE_TO_PERFECT) {
-							float dist = lane1[0].perfectTime - currentSongOffset.count();
-							
-							if (dist <= PERFECT_WINDOW && dist >= -PERFECT_WINDOW) {
-								// Perfect hit window
-								score += perfectNoteScore;
-								perfectCount++;
-
-								drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-								
-								// Remove note
-								lane1.erase(lane1.begin());
-							}
-							else if (dist <= NEAR_WINDOW && dist >= -NEAR_WINDOW) {
-								// Near hit window
-								score += nearNoteScore;
-								nearCount++;
-
-								drawJudgement(JUDGEMENT::NEAR_HIT, currentSongOffset, clearTime);
-								
-								// Remove note
-								lane1.erase(lane1.begin());
-							}
-							else if (dist <= MISS_WINDOW) {
-								// Miss window
-								missCount++;
-
-								drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-								
-								// Remove note
-								lane1.erase(lane1.begin());
-							}
-						} 
-						else if (!lane1.empty() && lane1[0].isHold()) { // Hold Note
-							float dist = lane1[0].perfectTime - currentSongOffset.count();
-
-							if (dist >= 0) { // Hold hasn't started yet
-								if (dist <= NEAR_WINDOW) { // Inside window to start hold
-									score += perfectNoteScore;
-									perfectCount++;
-
-									drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-									lane1[0].subtractHold();
-									lane1[0].setHitHold(true);
-								}
-								else if (dist <= MISS_WINDOW) { // Miss window to start hold
-									missCount++;
-
-									drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-									lane1[0].subtractHold();
-									lane1[0].setHitHold(false);
-								}
-							}
-						}
-						break;
-					// Logic for Lane 2
-					case 2:
-						// Note (not hold)
-						if (!lane2.empty() && !lane2[0].isHold() && lane2[0].getYPos() + MISS_WINDOW >= DISTANCE_TO_PERFECT) {
-							float dist = lane2[0].perfectTime - currentSongOffset.count();
-
-							if (dist <= PERFECT_WINDOW && dist >= -PERFECT_WINDOW) {
-								// Perfect hit window
-								score += perfectNoteScore;
-								perfectCount++;
-
-								drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-								// Remove note
-								lane2.erase(lane2.begin());
-							}
-							else if (dist <= NEAR_WINDOW && dist >= -NEAR_WINDOW) {
-								// Near hit window
-								score += nearNoteScore;
-								nearCount++;
-
-								drawJudgement(JUDGEMENT::NEAR_HIT, currentSongOffset, clearTime);
-
-								// Remove note
-								lane2.erase(lane2.begin());
-							}
-							else if (dist <= MISS_WINDOW) {
-								// Miss window
-								missCount++;
-
-								drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-								// Remove note
-								lane2.erase(lane2.begin());
-							}
-						}
-						else if (!lane2.empty() && lane2[0].isHold()) { // Hold Note
-							float dist = lane2[0].perfectTime - currentSongOffset.count();
-
-							if (dist >= 0) { // Hold hasn't started yet
-								if (dist <= NEAR_WINDOW) { // Inside window to start hold
-									score += perfectNoteScore;
-									perfectCount++;
-
-									drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-									lane2[0].subtractHold();
-									lane2[0].setHitHold(true);
-								}
-								else if (dist <= MISS_WINDOW) { // Miss window to start hold
-									missCount++;
-
-									drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-									lane2[0].subtractHold();
-									lane2[0].setHitHold(false);
-								}
-							}
-						}
-						break;
-					// Logic for Lane 3
-					case 3:
-						// Note (not hold)
-						if (!lane3.empty() && !lane3[0].isHold() && lane3[0].getYPos() + MISS_WINDOW >= DISTANCE_TO_PERFECT) {
-							float dist = lane3[0].perfectTime - currentSongOffset.count();
-
-							if (dist <= PERFECT_WINDOW && dist >= -PERFECT_WINDOW) {
-								// Perfect hit window
-								score += perfectNoteScore;
-								perfectCount++;
-
-								drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-								// Remove Note
-								lane3.erase(lane3.begin());
-							}
-							else if (dist <= NEAR_WINDOW && dist >= -NEAR_WINDOW) {
-								// Near hit window
-								score += nearNoteScore;
-								nearCount++;
-
-								drawJudgement(JUDGEMENT::NEAR_HIT, currentSongOffset, clearTime);
-
-								// Remove Note
-								lane3.erase(lane3.begin());
-							}
-							else if (dist <= MISS_WINDOW) {
-								// Miss window
-								missCount++;
-
-								drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-								// Remove Note
-								lane3.erase(lane3.begin());
-							}
-						}
-						else if (!lane3.empty() && lane3[0].isHold()) { // Hold Note
-							float dist = lane3[0].perfectTime - currentSongOffset.count();
-
-							if (dist >= 0) { // Hold hasn't started yet
-								if (dist <= NEAR_WINDOW) { // Inside window to start hold
-									score += perfectNoteScore;
-									perfectCount++;
-
-									drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-									lane3[0].subtractHold();
-									lane3[0].setHitHold(true);
-								}
-								else if (dist <= MISS_WINDOW) { // Miss window to start hold
-									missCount++;
-
-									drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-									lane3[0].subtractHold();
-									lane3[0].setHitHold(false);
-								}
-							}
-						}
-						break;
-					// Logic for Lane 4
-					case 4:
-						// Note (not hold)
-						if (!lane4.empty() && !lane4[0].isHold() && lane4[0].getYPos() + MISS_WINDOW >= DISTANCE_TO_PERFECT) {
-							float dist = lane4[0].perfectTime - currentSongOffset.count();
-
-							if (dist <= PERFECT_WINDOW && dist >= -PERFECT_WINDOW) {
-								// Perfect hit window
-								score += perfectNoteScore;
-								perfectCount++;
-
-								drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-								// Remove note
-								lane4.erase(lane4.begin());
-							}
-							else if (dist <= NEAR_WINDOW && dist >= -NEAR_WINDOW) {
-								// Near hit window
-								score += nearNoteScore;
-								nearCount++;
-
-								drawJudgement(JUDGEMENT::NEAR_HIT, currentSongOffset, clearTime);
-
-								// Remove note
-								lane4.erase(lane4.begin());
-							} 
-							else if (dist <= MISS_WINDOW) {
-								// Miss window
-								missCount++;
-
-								drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-								// Remove note
-								lane4.erase(lane4.begin());
-							}
-						}
-						else if (!lane4.empty() && lane4[0].isHold()) { // Hold Note
-							float dist = lane4[0].perfectTime - currentSongOffset.count();
-
-							if (dist >= 0) { // Hold hasn't started yet
-								if (dist <= NEAR_WINDOW) { // Inside window to start hold
-									score += perfectNoteScore;
-									perfectCount++;
-
-									drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-									lane4[0].subtractHold();
-									lane4[0].setHitHold(true);
-								}
-								else if (dist <= MISS_WINDOW) { // Miss window to start hold
-									missCount++;
-
-									drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-									lane4[0].subtractHold();
-									lane4[0].setHitHold(false);
-								}
-							}
-						}
-						break;
-					// Logic for Lane 5
-					case 5:
-						// Note (not hold)
-						if (!lane5.empty() && !lane5[0].isHold() && lane5[0].getYPos() + MISS_WINDOW >= DISTANCE_TO_PERFECT) {
-							float dist = lane5[0].perfectTime - currentSongOffset.count();
-
-							if (dist <= PERFECT_WINDOW && dist >= -PERFECT_WINDOW) {
-								// Perfect hit window
-								score += perfectNoteScore;
-								perfectCount++;
-
-								drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-								// Remove note
-								lane5.erase(lane5.begin());
-							}
-							else if (dist <= NEAR_WINDOW && dist >= -NEAR_WINDOW) {
-								// Near hit window
-								score += nearNoteScore;
-								nearCount++;
-
-								drawJudgement(JUDGEMENT::NEAR_HIT, currentSongOffset, clearTime);
-
-								// Remove note
-								lane5.erase(lane5.begin());
-							}
-							else if (dist <= MISS_WINDOW) {
-								// Miss window
-								missCount++;
-
-								drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-								// Remove note
-								lane5.erase(lane5.begin());
-							}
-						}
-						else if (!lane5.empty() && lane5[0].isHold()) { // Hold Note
-							float dist = lane5[0].perfectTime - currentSongOffset.count();
-
-							if (dist >= 0) { // Hold hasn't started yet
-								if (dist <= NEAR_WINDOW) { // Inside window to start hold
-									score += perfectNoteScore++;
-									perfectCount++;
-
-									drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-									lane5[0].subtractHold();
-									lane5[0].setHitHold(true);
-								}
-								else if (dist <= MISS_WINDOW) { // Miss window to start hold
-									missCount++;
-
-									drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-									lane5[0].subtractHold();
-									lane5[0].setHitHold(false);
-								}
-							}
-						}
-						break;
+				// Autoplay presses its buttons through the controller input like a player would
+				if (autoplay.isEnabled()) {
+					autoplay.update(currentSongOffset.count());
 				}
 
-				// After handling hit, set things back to null
-				itemFront = NULL;
-			}
-			
-			// Handle the remaining parts of the hold notes next
-
-			// Lane 1 Hold
-			if (!lane1.empty() && lane1[0].isHold()) {
-				float dist = lane1[0].perfectTime - currentSongOffset.count();
-				if (!(lane1[0].getHoldNotesRemaining() <= 0)) { // Check if the hold has any notes remaining
-					// Now that we know there are notes remaining
-					// Check if holding or dropped
-
-					float nextNote = lane1[0].perfectTime + (lane1[0].getHoldNoteDistance() * (float)lane1[0].getHoldNotesUsed());
-					float pastDist = nextNote - currentSongOffset.count();
+				input.songOffset = currentSongOffset.count();
+				input.button = 0;
+				input.captureMicros = 0;
 
-					if (dist < 0 && lane1[0].didHitHold()) { // Hold has started, and holding
-						if (pastDist <= 0) {
-							score += perfectNoteScore;
-							perfectCount++;
+				// Check for new inputs (one per frame)
+				if (!controllerInput.inputQueue.empty()) {
+					// Lock the mutex
+					controllerInput.queue_mutexLock.lock();
 
-							drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
+					// Store the front item in the queue (keeping when it was captured to measure latency)
+					input.button = controllerInput.inputQueue.front().button;
+					input.captureMicros = controllerInput.inputQueue.front().captureMicros;
 
-							lane1[0].subtractHold();
-						}
-					}
-					else if (dist < 0 && !lane1[0].didHitHold()) { // Hold has started, and not holding
-						if (pastDist <= 0) {
-							missCount++;
+					// Remove that item from the queue
+					controllerInput.inputQueue.pop_front();
 
-							drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-							lane1[0].subtractHold();
-						}
-					}
-
-					// Update hold status
-					if (currentSongOffset.count() > lane1[0].perfectTime && currentSongOffset.count() <= lane1[0].getEndTime()) {
-						if (controllerInput.getKeyboardState().getKeyState(1)) { // Button 1 Pressed
-							if (!lane1[0].didHitHold()) {
-								lane1[0].setHitHold(true);
-							}
-						}
-						else { // Button 1 Released
-							if (lane1[0].didHitHold()) {
-								lane1[0].setHitHold(false);
-							}
-						}
-					}
+					// Unlock the mutex
+					controllerInput.queue_mutexLock.unlock();
 				}
-			}
-
-			// Lane 2 Hold
-			if (!lane2.empty() && lane2[0].isHold()) {
-				float dist = lane2[0].perfectTime - currentSongOffset.count();
-				if (!(lane2[0].getHoldNotesRemaining() <= 0)) { // Check if the hold has any notes remaining
-					// Notw that we know there are notes remaining
-					// Check if holding or dropped
 
-					float nextNote = lane2[0].perfectTime + (lane2[0].getHoldNoteDistance() * (float)lane2[0].getHoldNotesUsed());
-					float pastDist = nextNote - currentSongOffset.count();
-
-					if (dist < 0 && lane2[0].didHitHold()) { // Hold has started, and holding
-						if (pastDist <= 0) {
-							score += perfectNoteScore;
-							perfectCount++;
-
-							drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-							lane2[0].subtractHold();
-						}
-					}
-					else if (dist < 0 && !lane2[0].didHitHold()) { // Hold has started, and not holding
-						if (pastDist <= 0) {
-							missCount++;
-
-							drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-							lane2[0].subtractHold();
-						}
-					}
-
-					// Update hold status
-					if (currentSongOffset.count() > lane2[0].perfectTime && currentSongOffset.count() <= lane2[0].getEndTime()) {
-						if (controllerInput.getKeyboardState().getKeyState(2)) { // Button 2 Pressed
-							if (!lane2[0].didHitHold()) {
-								lane2[0].setHitHold(true);
-							}
-						}
-						else { // Button 2 Released
-							if (lane2[0].didHitHold()) {
-								lane2[0].setHitHold(false);
-							}
-						}
+				// Held buttons, the wheel and the speed as of this frame
+				KeyboardState keyboardState = controllerInput.getKeyboardState();
+				input.heldMask = 0;
+				for (int laneNum = 1; laneNum <= LANE_COUNT; laneNum++) {
+					if (keyboardState.getKeyState(laneNum)) {
+						input.heldMask |= (uint8_t)(1 << (laneNum - 1));
 					}
 				}
+				input.wheelMovement = controllerInput.getWheelMovement();
+				input.speed = gameState.getSpeed();
 			}
 
-			// Lane 3 Hold
-			if (!lane3.empty() && lane3[0].isHold()) {
-				float dist = lane3[0].perfectTime - currentSongOffset.count();
-				if (!(lane3[0].getHoldNotesRemaining() <= 0)) { // Check if the hold has any notes remaining
-					// Now that we know there are notes remaining
-					// Check if holding or dropped
-
-					float nextNote = lane3[0].perfectTime + (lane3[0].getHoldNoteDistance() * (float)lane3[0].getHoldNotesUsed());
-					float pastDist = nextNote - currentSongOffset.count();
-
-					if (dist < 0 && lane3[0].didHitHold()) { // Hold has started, and holding
-						if (pastDist <= 0) {
-							score += perfectNoteScore;
-							perfectCount++;
-
-							drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-							lane3[0].subtractHold();
-						}
-					}
-					else if (dist < 0 && !lane3[0].didHitHold()) { // Hold has started, and not holding
-						if (pastDist <= 0) {
-							missCount++;
-
-							drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-							lane3[0].subtractHold();
-						}
-					}
-
-					// Update hold status
-					if (currentSongOffset.count() > lane3[0].perfectTime && currentSongOffset.count() <= lane3[0].getEndTime()) {
-						if (controllerInput.getKeyboardState().getKeyState(3)) { // Button 3 Pressed
-							if (!lane3[0].didHitHold()) {
-								lane3[0].setHitHold(true);
-							}
-						}
-						else {
-							if (lane3[0].didHitHold()) {
-								lane3[0].setHitHold(false);
-							}
-						}
-					}
-				}
-			}
-
-			// Lane 4 Hold
-			if (!lane4.empty() && lane4[0].isHold()) {
-				float dist = lane4[0].perfectTime - currentSongOffset.count();
-				if (!(lane4[0].getHoldNotesRemaining() <= 0)) { // Check if the hold has any notes remaining
-					// Now that we know there are notes remaining
-					// Check if holding or dropped
-
-					float nextNote = lane4[0].perfectTime + (lane4[0].getHoldNoteDistance() * (float)lane4[0].getHoldNotesUsed());
-					float pastDist = nextNote - currentSongOffset.count();
-
-					if (dist < 0 && lane4[0].didHitHold()) { // Hold has started, and holding
-						if (pastDist <= 0) {
-							score += perfectNoteScore;
-							perfectCount++;
-
-							drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-							lane4[0].subtractHold();
-						}
-					}
-					else if (dist < 0 && !lane4[0].didHitHold()) { // Hold has started, and not holding
-						if (pastDist <= 0) {
-							missCount++;
-
-							drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-							lane4[0].subtractHold();
-						}
-					}
+			// Judge this frame
+			{
+				ProfileScope judgementScope(ZONE_JUDGEMENT);
+				replay.addFrame(input);
+				judgement.step(input);
 
-					// Update hold status
-					if (currentSongOffset.count() > lane4[0].perfectTime && currentSongOffset.count() <= lane4[0].getEndTime()) {
-						if (controllerInput.getKeyboardState().getKeyState(4)) { // Button 4 Pressed
-							if (!lane4[0].didHitHold()) {
-								lane4[0].setHitHold(true);
-							}
-						}
-						else { // Button 4 Released
-							if (lane4[0].didHitHold()) {
-								lane4[0].setHitHold(false);
-							}
-						}
-					}
+				// Follow a judged press until the frame drawing its judgement is presented
+				if (judgement.getJudgedCapture() != 0) {
+					latencyMonitor.judged(judgement.getJudgedButton(), judgement.getJudgedCapture());
 				}
 			}
 
-			// Lane 5 Hold
-			if (!lane5.empty() && lane5[0].isHold()) {
-				float dist = lane5[0].perfectTime - currentSongOffset.count();
-				if (!(lane5[0].getHoldNotesRemaining() <= 0)) { // Check if the hold has any notes remaining
-					// Now that we know there are notes remaining
-					// Check if holding or stopped
-
-					float nextNote = lane5[0].perfectTime + (lane5[0].getHoldNoteDistance() * (float)lane5[0].getHoldNotesUsed());
-					float pastDist = nextNote - currentSongOffset.count();
-
-					if (dist < 0 && lane5[0].didHitHold()) { // Hold has started, and holding
-						if (pastDist <= 0) {
-							score += perfectNoteScore;
-							perfectCount++;
-
-							drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-							lane5[0].subtractHold();
-						}
-					}
-					else if (dist < 0 && !lane5[0].didHitHold()) { // Hold has started, and not holding
-						if (pastDist <= 0) {
-							missCount++;
-
-							drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-							lane5[0].subtractHold();
-						}
-					}
-
-					// Update hold status
-					if (currentSongOffset.count() > lane5[0].perfectTime && currentSongOffset.count() <= lane5[0].getEndTime()) {
-						if (controllerInput.getKeyboardState().getKeyState(5)) { // Button 5 Pressed
-							if (!lane5[0].didHitHold()) {
-								lane5[0].setHitHold(true);
-							}
-						}
-						else { // Button 5 Released
-							if (lane5[0].didHitHold()) {
-								lane5[0].setHitHold(false);
-							}
-						}
-					}
-				}
+			if (judgement.didJudge()) {
+				drawJudgement(judgement.getLastJudgement(), currentSongOffset, clearTime);
 			}
-
-			// Wheel Input
-			if (!wheel.empty()) {
-				float dist = wheel[0].perfectTime - currentSongOffset.count();
-				if (wheel[0].isSlam()) { // Slam Notes
-					// If note is within range
-					if (dist <= SLAM_RANGE && dist >= -SLAM_RANGE) {
-						switch (wheel[0].getDirection()) {
-							case 1: // Slam -> Direction
-								if (controllerInput.getWheelMovement() == 1) {
-									score += perfectNoteScore;
-									perfectCount++;
-
-									drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-									// Remove Note
-									wheel.erase(wheel.begin());
-								}
-								else {
-									missCount++;
-
-									drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-									// Remove Note
-									wheel.erase(wheel.begin());
-								}
-								
-								// If there are no more wheel notes on screen, reset the last wheel position
-								if (wheel.empty()) {
-									controllerInput.resetLast();
-								}
-								break;
-							case -1: // Slame <- Direction
-								if (controllerInput.getWheelMovement() == -1) {
-									score += perfectNoteScore;
-									perfectCount++;
-
-									drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-									// Remove Note
-									wheel.erase(wheel.begin());
-								}
-								else {
-									missCount++;
-
-									drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-									// Remove Note
-									wheel.erase(wheel.begin());
-								}
-
-								// If there are no more wheel notes on screen, reset the last wheel position
-								if (wheel.empty()) {
-									controllerInput.resetLast();
-								}
-								break;
-						}
-					}
-				} 
-				else { // Continuous Notes
-					if (!(wheel[0].getHoldNotesRemaining() <= 0)) {
-						if (dist < 0) {
-							float nextNote = wheel[0].perfectTime + (wheel[0].getHoldNoteDistance() * (float)wheel[0].getHoldNotesUsed());
-							float pastDist = nextNote - currentSongOffset.count();
-
-							if (pastDist <= 0) {
-								if (wheel[0].getDirection() == controllerInput.getWheelMovement()) {
-									score += perfectNoteScore;
-									perfectCount++;
-
-									drawJudgement(JUDGEMENT::PERFECT_HIT, currentSongOffset, clearTime);
-
-									wheel[0].subtractHold();
-								}
-								else {
-									missCount++;
-
-									drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-									wheel[0].subtractHold();
-								}
-
-								// Reset the last wheel position before the next note check
-								controllerInput.resetLast();
-							}
-						}
-					}
-				}
+			if (judgement.didResetWheel()) {
+				controllerInput.resetLast();
 			}
+				
+			// ** END INPUT **
 
-			// Delete notes if too far
+			// Render Background (the video follows the song clock, dropping or holding frames as needed)
 			{
-				// Lane 1 Note
-				while (!lane1.empty() && !lane1[0].isHold() && lane1[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && currentSongOffset.count() > lane1[0].getEndTime() + MISS_WINDOW) {
-					missCount++;
-
-					drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-					lane1.erase(lane1.begin());
+				ProfileScope backgroundScope(ZONE_BACKGROUND);
+				if (backgroundVideo) {
+					glUseProgram(videoShader.getProgram());
+					backgroundVideo->update((double)fs.count());
+					backgroundVideo->render(PROJECTION::ORTHOGRAPHIC);
 				}
-
-				// Lane 1 Hold
-				while (!lane1.empty() && lane1[0].isHold() && lane1[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && currentSongOffset.count() > lane1[0].getEndTime() + MISS_WINDOW) {
-					// Don't need to apply a miss as the holds miss are taken care of elsewhere
-
-					lane1.erase(lane1.begin());
-				}
-
-				// Lane 2 Note
-				while (!lane2.empty() && !lane2[0].isHold() && lane2[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && currentSongOffset.count() > lane2[0].getEndTime() + MISS_WINDOW) {
-					missCount++;
-
-					drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-					lane2.erase(lane2.begin());
-				}
-
-				// Lane 2 Hold
-				while (!lane2.empty() && lane2[0].isHold() && lane2[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && currentSongOffset.count() > lane2[0].getEndTime() + MISS_WINDOW) {
-					// Don't need to apply a miss as the holds miss are taken care of elsewhere
-
-					lane2.erase(lane2.begin());
+				else {
+					glUseProgram(spriteShader.getProgram());
+					Audience->render(PROJECTION::ORTHOGRAPHIC);
 				}
+			}
 
-				// Lane 3 Note
-				while (!lane3.empty() && !lane3[0].isHold() && lane3[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && currentSongOffset.count() > lane3[0].getEndTime() + MISS_WINDOW) {
-					missCount++;
-
-					drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-					lane3.erase(lane3.begin());
-				}
+			// ** MAKE SURE TO MIND ORDER IF YOU REDRAW ANYTHING **
 
-				// Lane 3 Hold
-				while (!lane3.empty() && lane3[0].isHold() && lane3[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && currentSongOffset.count() > lane3[0].getEndTime() + MISS_WINDOW) {
-					// Don't need to apply a miss as the holds miss are taken care of elsewhere
+			// Clear the depth buffer
+			glClear(GL_DEPTH_BUFFER_BIT);
 
-					lane3.erase(lane3.begin());
-				}
+			// Use the sprite shader
+			glUseProgram(spriteShader.getProgram());
 
-				// Lane 4 Note
-				while (!lane4.empty() && !lane4[0].isHold() && lane4[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && currentSongOffset.count() > lane4[0].getEndTime() + MISS_WINDOW) {
-					missCount++;
+			{
+				ProfileScope notesScope(ZONE_NOTES);
 
-					drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
+				// Notes are drawn where they will be when the frame reaches the screen
+				ms presentSongOffset = currentSongOffset + ms((long long)framePacer.getPresentLeadMs());
 
-					lane4.erase(lane4.begin());
+				// Draw judgement text
+				if (currentSongOffset.count() < clearTime) {
+					noteJudgement->render(PROJECTION::ORTHOGRAPHIC);
 				}
 
-				// Lane 4 Hold
-				while (!lane4.empty() && lane4[0].isHold() && lane4[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && currentSongOffset.count() > lane4[0].getEndTime() + MISS_WINDOW) {
-					// Don't need to apply a miss as the holds miss are taken care of elsewhere
-
-					lane4.erase(lane4.begin());
+				// Draw all other graphics
+				track->render(PROJECTION::PERSPECTIVE);
+				track->pushModelMatrix();
+				for (int laneNum = 1; laneNum <= LANE_COUNT; laneNum++) {
+					drawLaneNotes(laneNum, judgement.getLane(laneNum), presentSongOffset, judgement.getDistance());
 				}
+				drawWheelNotes(judgement.getWheel(), presentSongOffset, judgement.getDistance());
+				OpenGLSprite::popMatrix();
+			}
 
-				// Lane 5 Note
-				while (!lane5.empty() && !lane5[0].isHold() && lane5[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && currentSongOffset.count() > lane5[0].getEndTime() + MISS_WINDOW) {
-					missCount++;
-
-					drawJudgement(JUDGEMENT::MISS, currentSongOffset, clearTime);
-
-					lane5.erase(lane5.begin());
+			// Draw all text
+			{
+				ProfileScope textScope(ZONE_TEXT);
+				glUseProgram(textShader.getProgram());
+				songTitle->render(PROJECTION::ORTHOGRAPHIC, gameState.getSongPlaying().getTitle(), ALIGNMENT::LEFT, 1.f, 1.f, 1.f, 1.5f);
+				scoreText->render(PROJECTION::ORTHOGRAPHIC, getScoreString(judgement.getScore()), ALIGNMENT::LEFT, 1.f, 1.f, 1.f, 1.5f);
+				if (controllerInput.getKeyboardState().getKeyState(6)) {
+					speedText->render(PROJECTION::ORTHOGRAPHIC, to_wstring(gameState.getSpeed()), ALIGNMENT::LEFT, 0.f, 1.f, 0.f, 1.5f);
 				}
-
-				// Lane 5 Hold
-				while (!lane5.empty() && lane5[0].isHold() && lane5[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && currentSongOffset.count() > lane5[0].getEndTime() + MISS_WINDOW) {
-					// Don't need to apply a miss as the holds miss are taken care of elsewhere
-
-					lane5.erase(lane5.begin());
+				else {
+					speedText->render(PROJECTION::ORTHOGRAPHIC, to_wstring(gameState.getSpeed()), ALIGNMENT::LEFT, 1.f, 1.f, 1.f, 1.5f);
 				}
 
-				// Wheel Continuous
-				while (!wheel.empty() && !wheel[0].isSlam() && currentSongOffset.count() > wheel[0].getEndTime()) {
-					// Don't need to apply a miss as the miss is taken care of elsewhere
-
-					wheel.erase(wheel.begin());
-
-					// Reset controller last
-					controllerInput.resetLast();
+				// Frame times overlay
+				if (profiler.isOverlayVisible()) {
+					profiler.drawOverlay(profilerText);
 				}
-
-				// Wheel slams are taken care of in the input section
 			}
-				
-			// ** END INPUT **
-
-			// Render Background
-			glUseProgram(spriteShader.getProgram());
-			Audience->render(PROJECTION::ORTHOGRAPHIC);
 
-			// ** MAKE SURE TO MIND ORDER IF YOU REDRAW ANYTHING **
-
-			// Clear the depth buffer
-			glClear(GL_DEPTH_BUFFER_BIT);
-
-			// Use the sprite shader
-			glUseProgram(spriteShader.getProgram());
-
-			// Draw judgement text
-			if (currentSongOffset.count() < clearTime) {
-				noteJudgement->render(PROJECTION::ORTHOGRAPHIC);
-			}
-
-			// Draw all other graphics
-			track->render(PROJECTION::PERSPECTIVE);
-			track->pushModelMatrix();
-			drawLaneNotes(1, lane1, currentSongOffset, missCount, distance);
-			drawLaneNotes(2, lane2, currentSongOffset, missCount, distance);
-			drawLaneNotes(3, lane3, currentSongOffset, missCount, distance);
-			drawLaneNotes(4, lane4, currentSongOffset, missCount, distance);
-			drawLaneNotes(5, lane5, currentSongOffset, missCount, distance);
-			drawWheelNotes(wheel, currentSongOffset, missCount, distance);
-			OpenGLSprite::popMatrix();
-
-			// Draw all text
-			glUseProgram(textShader.getProgram());
-			songTitle->render(PROJECTION::ORTHOGRAPHIC, gameState.getSongPlaying().getTitle(), ALIGNMENT::LEFT, 1.f, 1.f, 1.f, 1.5f);
-			scoreText->render(PROJECTION::ORTHOGRAPHIC, getScoreString(score), ALIGNMENT::LEFT, 1.f, 1.f, 1.f, 1.5f);
-			if (controllerInput.getKeyboardState().getKeyState(6)) {
-				speedText->render(PROJECTION::ORTHOGRAPHIC, to_wstring(gameState.getSpeed()), ALIGNMENT::LEFT, 0.f, 1.f, 0.f, 1.5f);
-			}
-			else {
-				speedText->render(PROJECTION::ORTHOGRAPHIC, to_wstring(gameState.getSpeed()), ALIGNMENT::LEFT, 1.f, 1.f, 1.f, 1.5f);
+			{
+				ProfileScope displayScope(ZONE_DISPLAY);
+				latencyMonitor.submitted();
+				framePacer.present(gameWindow);
+				latencyMonitor.swapped();
 			}
+		}
+	}
+	// End of Song
+	screenRenderer.gameEnded = true;
 
-			gameWindow->display();
+	// Report how evenly the frames were presented
+	FramePacer::Report pacing = framePacer.endReport();
+	logger.log("Frame pacing: " + to_string(pacing.frameCount) + " frames, target " + to_string(pacing.targetMs) + " ms, average "
+		+ to_string(pacing.averageMs) + " ms, std dev " + to_string(pacing.stdDevMs) + " ms, p99 " + to_string(pacing.p99Ms)
+		+ " ms, max " + to_string(pacing.maxMs) + " ms, " + to_string(pacing.lateFrames) + " late, GPU wait average "
+		+ to_string(pacing.averageGpuWaitMs) + " ms, max " + to_string(pacing.maxGpuWaitMs) + " ms");
 
-			// Handle speed change
-			if (oldSpeed != gameState.getSpeed()) {
-				// Update Distance
-				updateScreenTime(distance);
+	// Save the input latency measured so far this session
+	if (latencyMonitor.getSampleCount() > 0) {
+		latencyMonitor.exportSamples();
+	}
 
-				// Update the appear times for each lane
-				updateAppearTime(lane1);
-				updateAppearTime(lane2);
-				updateAppearTime(lane3);
-				updateAppearTime(lane4);
-				updateAppearTime(lane5);
-				updateAppearTime(wheel);
+	// Let go of anything the bot was still holding
+	if (autoplay.isEnabled()) {
+		autoplay.releaseAll();
+	}
 
-				oldSpeed = gameState.getSpeed();
-			}
-		}
+	// Report how well the background video kept up, then stop its decoder
+	if (backgroundVideo) {
+		logger.log(L"Background video frames: " + to_wstring(backgroundVideo->getPresentedFrameCount()) + L" presented, "
+			+ to_wstring(backgroundVideo->getDroppedFrameCount()) + L" dropped, "
+			+ to_wstring(backgroundVideo->getRepeatedFrameCount()) + L" repeated");
+		delete backgroundVideo;
+		backgroundVideo = NULL;
 	}
-	// End of Song
-	screenRenderer.gameEnded = true;
 
 	// Only save the status of the song when the service button wasn't pressed
 	if (!gameState.checkService() && gameState.getGameState() != GameState::CurrentState::SHUTDOWN) {
@@ -1237,134 +595,46 @@ void GameRenderer::render(sf::RenderWindow* gameWindow) {
 		logger.log(L"Song Ended - Game Renderer Shutting Down.");
 
 		// Make a new results object based on how the player did on that song
-		Results songResult(gameState.getSongPlaying(), gameState.getSongPlayingDifficulty(), (int)score, perfectCount, nearCount, missCount);
+		Results songResult(gameState.getSongPlaying(), gameState.getSongPlayingDifficulty(), (int)judgement.getScore(),
+			judgement.getPerfectCount(), judgement.getNearCount(), judgement.getMissCount());
 
 		// Store the results in the game state
 		gameState.results.push_back(songResult);
 
 		logger.log(L"Results of song saved.");
-	}
-
-	// Need to clear the VAO to clean it up after drawing
-	glBindVertexArray(0);
-	gameWindow->pushGLStates();
-
-	// Set the game window to false
-	gameWindow->setActive(false);
-
-	// Return back to the screen renderer
-}
-
-/**
- * Read in notes from a file.
- * 
- * @param lane Lane vector to store the notes in
- * @param LaneNum Lane number to get the notes about
- * @param songPath Path of the song
- * @param diffNumber Difficulty of the song
- * @param bpm BPM of the song
- */
-void parseInNotes(vector<Note>& lane, int LaneNum, string songPath, int diffNumber, int bpm) {
-	string fPath = songPath + "charts/" + to_string(diffNumber) + "/L" + to_string(LaneNum) + ".txt";
-	inputFile.open(fPath);
-
-	string line = "";
-	const char delim = ':';
-	if (inputFile) {
-		while (inputFile >> line) {
-			std::vector<std::string> out;
-			tokenize2(line, delim, out);
-
-			bool hold = false;
-			if (out[1] == "1") {
-				hold = true;
-			}
 
-			Note temp(stof(out[0]), hold, stof(out[2]), stoi(out[3]), bpm);
-			
-			lane.push_back(temp);
+		// Save the replay of this play
+		replay.finish(judgement);
+		filesystem::create_directories("Replays");
+		string replayPath = "Replays/" + Replay::makeFileName(gameState.getSongPlaying().getSongID(), gameState.getSongPlayingDifficulty());
+		if (replay.save(replayPath)) {
+			logger.log("Replay saved to ", replayPath);
 		}
-	}
-	inputFile.close();
-	logger.log(L"Lane " + to_wstring(LaneNum) + L" is ready.");
-}
-
-/**
- * Readin the wheel notes from a file.
- * 
- * @param wheel WheelNote vector to store the notes in
- * @param songPath path of the song
- * @param diffNumber difficulty of the song
- * @param bpm BPM of the song
- */
-void parseInWheel(vector<WheelNote>& wheel, string songPath, int diffNumber, int bpm) {
-	string fPath = songPath + "charts/" + to_string(diffNumber) + "/Wheel.txt";
-	inputFile.open(fPath);
-
-	string line = "";
-	const char delim = ':';
-	if (inputFile) {
-		while (inputFile >> line) {
-			std::vector<std::string> out;
-			tokenize2(line, delim, out);
-
-			bool slam = false;
-			if (out[1] == "1") {
-				slam = true;
-			}
-			
-			WheelNote temp(stof(out[0]), slam, stoi(out[2]), stoi(out[3]), stoi(out[4]), stof(out[5]), stoi(out[6]), bpm);
-			
-			wheel.push_back(temp);
+		else {
+			logger.logError("Failed to save replay to ", replayPath);
 		}
-	}
-	inputFile.close();
-	logger.log(L"Lane Wheel is Ready.");
-}
 
-/**
- * Split the string based on the delim char.
- * 
- * @param str Original String
- * @param delim char to split based on
- * @param out Vector string split into
- */
-void tokenize2(std::string const& str, const char delim, std::vector<std::string>& out) {
-
-	size_t start;
-	size_t end = 0;
+		// Keep the score until the server has it (automated plays aren't real scores)
+		if (!autoplay.isEnabled()) {
+			scoreQueue.add(songResult, userData.getCardNumber(), replay.getHash());
+		}
 
-	while ((start = str.find_first_not_of(delim, end)) != std::string::npos)
-	{
-		end = str.find(delim, start);
-		out.push_back(str.substr(start, end - start));
+		// Store the statistics of this play for the soak test report
+		if (soakTest.isEnabled()) {
+			soakTest.endPlay(gameState.getSongPlaying().getSongID(), gameState.getSongPlaying().getPath(), gameState.getSongPlayingDifficulty(),
+				judgement.getTotalNotes(), judgement.getPerfectCount(), judgement.getNearCount(), judgement.getMissCount());
+		}
 	}
-}
 
-/**
- * Update when the notes appear on screen.
- * 
- * @param lane Lane to adjust the notes of
- */
-void updateAppearTime(vector<Note>& lane) {
-	for (size_t i = 0; i < lane.size(); i++) {
-		lane[i].speedChangeAppearTime(gameState.getSpeed());
-	}
-}
+	// Need to clear the VAO to clean it up after drawing (resetting rather than saving SFML's states,
+	// saves were never restored so every song left one more on the OpenGL attribute stack)
+	glBindVertexArray(0);
+	gameWindow->resetGLStates();
 
-void updateAppearTime(vector<WheelNote>& lane) {
-	for (size_t i = 0; i < lane.size(); i++) {
-		lane[i].speedChangeAppearTime(gameState.getSpeed());
-	}
-}
+	// SFML resets texture bindings when resetting its states
+	TextureLoader::Inst()->InvalidateBindings();
 
-/**
- * Calculate the distance of the note.
- * 
- * @param distance
- */
-void updateScreenTime(float& distance) {
-	distance = (float)(453075.9705 / pow(gameState.getSpeed(), 1.004140998));
+	// Return back to the screen renderer
 }
 
 /**
@@ -1372,9 +642,9 @@ void updateScreenTime(float& distance) {
  * 
  * @param wheel the vector holding the wheel notes
  * @param currentSongOffset current time in the song
- * @param missCount reference to the count of missed notes in this song																										
+ * @param distance time (in milliseconds) a note is on screen before the perfect line
  */
-void GameRenderer::drawWheelNotes(vector<WheelNote>& wheel, std::chrono::milliseconds currentSongOffset, int& missCount, float distance) {
+void GameRenderer::drawWheelNotes(vector<WheelNote>& wheel, std::chrono::milliseconds currentSongOffset, float distance) {
 	// First check if the lane is empty
 	if (wheel.empty()) {
 		return;
@@ -1471,9 +741,9 @@ void GameRenderer::drawWheelNotes(vector<WheelNote>& wheel, std::chrono::millise
  * @param laneNum the current lane number
  * @param lane the vector holding the notes
  * @param currentSongOffset current time in the song
- * @param missCount reference to the count of missed notes in this song
+ * @param distance time (in milliseconds) a note is on screen before the perfect line
  */
-void GameRenderer::drawLaneNotes(int laneNum, vector<Note> &lane, std::chrono::milliseconds currentSongOffset, int &missCount, float distance) {
+void GameRenderer::drawLaneNotes(int laneNum, vector<Note> &lane, std::chrono::milliseconds currentSongOffset, float distance) {
 	// First check if the lane is empty
 	if (lane.empty()) {
 		return;
@@ -1512,9 +782,6 @@ void GameRenderer::drawLaneNotes(int laneNum, vector<Note> &lane, std::chrono::m
 
 				holdPixelNote->setPositionY(yPos);
 
-				// Store that yPos onto the note itself for input calculations
-				lane[i].setYPos(yPos);
-
 				holdPixelNote->render(PROJECTION::PERSPECTIVE);
 			}
 			else {
@@ -1548,9 +815,6 @@ void GameRenderer::drawLaneNotes(int laneNum, vector<Note> &lane, std::chrono::m
 				// Set the Y position
 				laneNote->setPositionY(yPos);
 
-				// Store that yPos onto the note itself for input calculations
-				lane[i].setYPos(yPos);
-
 				// Draw the note
 				laneNote->render(PROJECTION::PERSPECTIVE);
 			}
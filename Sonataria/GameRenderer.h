@@ -6,25 +6,24 @@
  * @author Julia Butenhoff
  */
 #pragma once
+#include <chrono>
 #include <vector>
 using namespace std;
 
 #include "SpriteShader.h"
 #include "TextShader.h"
+#include "VideoShader.h"
 
-#include "Note.h"
-#include "WheelNote.h"
+#include "JudgementEngine.h"
 
+class OpenGLText;
 class QuadSprite;
-
-enum JUDGEMENT {
-	PERFECT_HIT,
-	NEAR_HIT,
-	MISS
-};
+class VideoSprite;
 
 /**
- * Handles all rendering when in the GAME state
+ * Handles all rendering when in the GAME state. One is kept for the whole run, so
+ * its shaders, sprites and text are only set up once and each song only resets
+ * what belongs to that song.
  */
 class GameRenderer {
 	private:
@@ -33,9 +32,11 @@ class GameRenderer {
 		// Shaders
 		SpriteShader spriteShader;
 		TextShader textShader;
+		VideoShader videoShader;
 
 		// Sprites
 		QuadSprite* Audience;
+		VideoSprite* backgroundVideo;
 
 		QuadSprite* track;
 		QuadSprite* laneNote;
@@ -47,13 +48,20 @@ class GameRenderer {
 
 		QuadSprite* noteJudgement;
 
+		// Text
+		OpenGLText* songTitle;
+		OpenGLText* scoreText;
+		OpenGLText* speedText;
+		OpenGLText* profilerText;
+
 	public:
 		GameRenderer();
 		~GameRenderer();
+		void init();
 		void render(sf::RenderWindow*);
 
 	protected:
-		void drawLaneNotes(int laneNum, vector<Note>& lane, std::chrono::milliseconds currentSongOffset, int& missCount, float distance);
-		void drawWheelNotes(vector<WheelNote>& wheel, std::chrono::milliseconds currentSongOffset, int& missCount, float distance);
+		void drawLaneNotes(int laneNum, vector<Note>& lane, std::chrono::milliseconds currentSongOffset, float distance);
+		void drawWheelNotes(vector<WheelNote>& wheel, std::chrono::milliseconds currentSongOffset, float distance);
 		void drawJudgement(JUDGEMENT judgement, std::chrono::milliseconds currentSOngOffset, float& clearTime);
 };
\ No newline at end of file
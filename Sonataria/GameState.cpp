@@ -6,6 +6,7 @@
 #include "RFIDCardReader.h"
 #include "ScreenRenderer.h"
 #include <thread>
+#include "Tracer.h"
 #include "UserData.h"
 
 GameState gameState;
@@ -82,6 +83,10 @@ void GameState::DoneSwitchingStates() {
 }
 
 void GameStateChangeThread(GameState::CurrentState oldState, GameState::CurrentState newState) {
+	tracer.setThreadName("State Change");
+	string traceDetail = to_string((int)oldState) + " -> " + to_string((int)newState);
+	TraceScope changeTrace("State change", "state", traceDetail.c_str());
+
 	// Close Curtains
 	thread delay;
 	if (!gameState.isInServiceGameState() && !gameState.isInServiceGameState(newState)) {
@@ -96,13 +101,19 @@ void GameStateChangeThread(GameState::CurrentState oldState, GameState::CurrentS
 	}
 
 	// Unload the State
-	gameState.onStateUnload(oldState);
+	{
+		TraceScope trace("Unload state", "state");
+		gameState.onStateUnload(oldState);
+	}
 
 	// Switch the State
 	gameState.state = newState;
 
 	// Handle loading the state
-	gameState.onStateLoad(newState);
+	{
+		TraceScope trace("Load state", "state");
+		gameState.onStateLoad(newState);
+	}
 
 	// Open Curtains
 	if (!gameState.isInServiceGameState() && !gameState.isInServiceGameState(newState)) {
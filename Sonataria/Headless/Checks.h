@@ -0,0 +1,35 @@
+/**
+ * @file Checks.h
+ *
+ * @brief Headless Checks
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <cstdio>
+#include <string>
+using namespace std;
+
+/**
+ * Print the outcome of one case of a check.
+ *
+ * @param passed true if the case passed
+ * @param what what the case tests
+ * @param failures counted up if it failed
+ * @return passed
+ */
+inline bool reportCase(bool passed, const string& what, int& failures) {
+	printf("%s  %s\n", passed ? "PASS" : "FAIL", what.c_str());
+	fflush(stdout);
+	if (!passed) {
+		failures++;
+	}
+	return passed;
+}
+
+int runNetClientCheck();
+int runUpdateCheck();
+int runScoreQueueCheck(const string& self);
+int runScoreQueueWriter(const string& directory, int count);
+int runPeerCheck(const string& self);
+int runPeerNode(const string& origin, const string& folder, int index);
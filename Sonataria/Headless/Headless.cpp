@@ -0,0 +1,96 @@
+/**
+ * @file Headless.cpp
+ * Entry point for the headless checks on platforms other than Windows.
+ * Sonataria.exe runs the same checks through its own command line; this
+ * file is not part of the Visual Studio project. Build it from the
+ * Sonataria folder with:
+ *
+ *   g++ -std=c++17 -O2 -I. Headless/Headless.cpp Replay.cpp JudgementEngine.cpp
+ *       Note.cpp WheelNote.cpp Checksum.cpp Tracer.cpp Logger.cpp ZipExtractor.cpp
+ *       unzip.cpp NetSocket.cpp NetClient.cpp Signature.cpp UpdateDownloader.cpp
+ *       UpdateStager.cpp PeerExchange.cpp Networking.cpp ProfileCache.cpp UserData.cpp
+ *       ScoreQueue.cpp Results.cpp Song.cpp Chart.cpp Headless/StandInServer.cpp
+ *       Headless/NetClientCheck.cpp Headless/UpdateCheck.cpp Headless/ScoreQueueCheck.cpp
+ *       Headless/PeerCheck.cpp -I../dependencies/JSON/single_include -lpthread -o headless
+ *
+ * The network checks (--net-check, --update-check, --score-check, --peer-check)
+ * run against stand-in servers on local ports and are only built here.
+ *
+ * @author Julia Butenhoff
+ */
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include "Replay.h"
+#include "ZipExtractor.h"
+#include "Checks.h"
+
+using namespace std;
+
+/**
+ * Run a headless check.
+ * (headless --replay <file>... [--iterations N], headless --benchmark-unzip <zip> <folder> [threads]
+ * or headless --net-check / --update-check / --score-check / --peer-check)
+ *
+ * @param argc the number of arguments
+ * @param argv the arguments
+ * @return EXIT_SUCCESS if the check passed
+ */
+int main(int argc, char* argv[]) {
+	// The log writes wide text to the same stdout, which would shut out printf if it wrote first
+	fwide(stdout, -1);
+
+	if (argc >= 4 && string(argv[1]) == "--benchmark-unzip") {
+		return ZipExtractor::benchmark(argv[2], argv[3], argc >= 5 ? atoi(argv[4]) : 0) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	if (argc >= 2 && string(argv[1]) == "--net-check") {
+		return runNetClientCheck() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (argc >= 2 && string(argv[1]) == "--update-check") {
+		return runUpdateCheck() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (argc >= 2 && string(argv[1]) == "--score-check") {
+		return runScoreQueueCheck(argv[0]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Run by --score-check as the cabinet that crashes
+	if (argc >= 4 && string(argv[1]) == "--score-writer") {
+		return runScoreQueueWriter(argv[2], atoi(argv[3]));
+	}
+
+	if (argc >= 2 && string(argv[1]) == "--peer-check") {
+		return runPeerCheck(argv[0]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Run by --peer-check as each cabinet of the venue
+	if (argc >= 5 && string(argv[1]) == "--peer-node") {
+		return runPeerNode(argv[2], argv[3], atoi(argv[4]));
+	}
+
+	if (argc >= 3 && string(argv[1]) == "--replay") {
+		vector<string> replayFiles;
+		int iterations = 1;
+		for (int i = 2; i < argc; i++) {
+			if (string(argv[i]) == "--iterations" && i + 1 < argc) {
+				iterations = atoi(argv[++i]);
+				if (iterations < 1) iterations = 1;
+			} else {
+				replayFiles.push_back(argv[i]);
+			}
+		}
+		return runReplayCheck(replayFiles, iterations) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	printf("Usage: %s --replay <file>... [--iterations N]\n", argv[0]);
+	printf("       %s --benchmark-unzip <zip> <folder> [threads]\n", argv[0]);
+	printf("       %s --net-check\n", argv[0]);
+	printf("       %s --update-check\n", argv[0]);
+	printf("       %s --score-check\n", argv[0]);
+	printf("       %s --peer-check\n", argv[0]);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,165 @@
+#include "Checks.h"
+#include "StandInServer.h"
+#include "NetClient.h"
+
+#include <atomic>
+#include <chrono>
+
+// Size of the update download that runs alongside a profile request
+const size_t NET_CHECK_DOWNLOAD_SIZE = 5 * 1024 * 1024;
+
+/**
+ * Send a request and wait for the response.
+ *
+ * @param request the request
+ * @return the response
+ */
+static NetResponse sendAndWait(NetRequest request) {
+	return netClient.send(request).get();
+}
+
+/**
+ * Check the network client against stand-in servers: keep-alive reuse, chunked
+ * replies, retries after 5xx replies and dropped connections, timeouts, refused
+ * connections, and a large command download that mustn't hold up other requests.
+ *
+ * @return the number of cases that failed
+ */
+int runNetClientCheck() {
+	int failures = 0;
+	atomic<int> retryCalls(0);
+	atomic<int> dropCalls(0);
+
+	StandInServer profileServer(true, [&](const StandInRequest& request) {
+		StandInReply reply;
+		if (request.path == "/chunked") {
+			reply.chunked = true;
+			for (int i = 0; i < 5000; i++) {
+				reply.body += (char)('a' + i % 26);
+			}
+		}
+		else if (request.path == "/retry") {
+			reply.status = retryCalls++ == 0 ? 503 : 200;
+			reply.body = reply.status == 200 ? "recovered" : "busy";
+		}
+		else if (request.path == "/drop") {
+			reply.body = "whole reply";
+			if (dropCalls++ == 0) {
+				reply.dropAfter = 20;
+			}
+		}
+		else if (request.path == "/slow") {
+			reply.delayMs = 1500;
+			reply.body = "late";
+		}
+		else {
+			reply.body = "profile " + request.path;
+		}
+		return reply;
+	});
+
+	string download(NET_CHECK_DOWNLOAD_SIZE, '\0');
+	for (size_t i = 0; i < download.size(); i++) {
+		download[i] = (char)(i * 31 % 251);
+	}
+	StandInServer gameServer(false, [&](const StandInRequest& request) {
+		StandInReply reply;
+		if (request.body.rfind("DLUpdate", 0) == 0) {
+			reply.body = standInLengthPrefixed(download);
+			reply.paceMs = 5;
+		}
+		else {
+			reply.body = standInLengthPrefixed("unknown command");
+		}
+		return reply;
+	});
+
+	if (!profileServer.start() || !gameServer.start()) {
+		reportCase(false, "stand-in servers started", failures);
+		return failures;
+	}
+	string profileUrl = "http://" + profileServer.getAddress();
+
+	// Keep-alive
+	NetRequest request;
+	request.url = profileUrl + "/first";
+	NetResponse first = sendAndWait(request);
+	request.url = profileUrl + "/second";
+	NetResponse second = sendAndWait(request);
+	reportCase(first.ok() && first.body == "profile /first" && second.ok() && second.body == "profile /second",
+		"two requests answered", failures);
+	reportCase(second.reusedConnection && profileServer.getConnectionCount() == 1,
+		"second request reused the connection (" + to_string(profileServer.getConnectionCount()) + " connections)", failures);
+
+	// Chunked transfer encoding
+	request.url = profileUrl + "/chunked";
+	NetResponse chunked = sendAndWait(request);
+	reportCase(chunked.ok() && chunked.body.size() == 5000 && chunked.body.substr(0, 3) == "abc" && chunked.body.back() == (char)('a' + 4999 % 26),
+		"chunked reply put back together (" + to_string(chunked.body.size()) + " bytes)", failures);
+
+	// Retries
+	request.url = profileUrl + "/retry";
+	request.retries = 2;
+	NetResponse retried = sendAndWait(request);
+	reportCase(retried.ok() && retried.body == "recovered" && retried.attempts == 2,
+		"503 retried with backoff (" + to_string(retried.attempts) + " attempts)", failures);
+
+	request.url = profileUrl + "/drop";
+	NetResponse dropped = sendAndWait(request);
+	reportCase(dropped.ok() && dropped.body == "whole reply" && dropped.attempts == 2,
+		"reply cut off mid-way retried (" + to_string(dropped.attempts) + " attempts)", failures);
+
+	// Timeouts and refused connections
+	request.url = profileUrl + "/slow";
+	request.retries = 0;
+	request.timeoutMs = 300;
+	auto start = chrono::steady_clock::now();
+	NetResponse slow = sendAndWait(request);
+	long long waited = (long long)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+	reportCase(!slow.completed && slow.error.find("timed out") != string::npos && waited < 1200,
+		"stalled request timed out after " + to_string(waited) + " ms", failures);
+
+	NetSocket unused;
+	string error;
+	unused.listen(0, error);
+	int closedPort = unused.getLocalPort();
+	unused.close();
+	request.url = "http://127.0.0.1:" + to_string(closedPort) + "/refused";
+	request.timeoutMs = 2000;
+	NetResponse refused = sendAndWait(request);
+	reportCase(!refused.completed && !refused.error.empty(), "refused connection reported (" + refused.error + ")", failures);
+
+	// A large download doesn't hold up a profile request sent after it
+	NetRequest downloadRequest;
+	downloadRequest.protocol = NET_COMMAND;
+	downloadRequest.url = gameServer.getAddress();
+	downloadRequest.body = "DLUpdate 0 " + to_string(NET_CHECK_DOWNLOAD_SIZE);
+	downloadRequest.lengthPrefixed = true;
+	size_t sunk = 0;
+	bool matched = true;
+	downloadRequest.sink = [&](const char* data, size_t length) {
+		matched &= download.compare(sunk, length, data, length) == 0;
+		sunk += length;
+		return true;
+	};
+	future<NetResponse> downloading = netClient.send(downloadRequest);
+
+	request.url = profileUrl + "/during";
+	request.timeoutMs = 5000;
+	NetResponse during = sendAndWait(request);
+	bool downloadStillRunning = downloading.wait_for(chrono::seconds(0)) != future_status::ready;
+	NetResponse downloaded = downloading.get();
+	reportCase(during.ok() && during.body == "profile /during" && downloadStillRunning,
+		"profile request answered while the download ran", failures);
+	reportCase(downloaded.ok() && sunk == NET_CHECK_DOWNLOAD_SIZE && matched,
+		"5 MB length-prefixed download intact (" + to_string(sunk) + " bytes)", failures);
+
+	NetClient::Stats stats = netClient.getStats();
+	printf("%llu requests, %llu connections opened, %llu reused, %llu retries, %llu failures\n",
+		(unsigned long long)stats.requests, (unsigned long long)stats.connectionsOpened, (unsigned long long)stats.connectionsReused,
+		(unsigned long long)stats.retries, (unsigned long long)stats.failures);
+
+	profileServer.stop();
+	gameServer.stop();
+	return failures;
+}
@@ -0,0 +1,212 @@
+#include "Checks.h"
+#include "StandInServer.h"
+#include "Checksum.h"
+#include "PeerExchange.h"
+#include "UpdateDownloader.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <thread>
+
+using json = nlohmann::json;
+
+// Cabinets started on this machine
+const int PEER_CHECK_NODES = 3;
+
+// Size of the update they share, and of its chunks
+const uint64_t PEER_CHECK_SIZE = 12 * 1024 * 1024;
+const uint64_t PEER_CHECK_CHUNK_SIZE = 1024 * 1024;
+
+// How long a cabinet waits to find the others, and for the whole check to finish
+const int PEER_CHECK_DISCOVERY_MS = 15000;
+const int PEER_CHECK_TIMEOUT_MS = 90000;
+
+/**
+ * Check a file exists.
+ *
+ * @param path the file
+ * @return true if it does
+ */
+static bool fileExists(const string& path) {
+	error_code error;
+	return filesystem::exists(path, error);
+}
+
+/**
+ * Be one cabinet of the venue: find the others, download the update through the
+ * peer exchange, then keep serving chunks until the check says to stop. Run as its
+ * own process by runPeerCheck().
+ *
+ * @param origin the stand-in game server (host:port)
+ * @param folder the check's folder, with manifest.json
+ * @param index which cabinet this is
+ * @return EXIT_SUCCESS if the update downloaded and verified
+ */
+int runPeerNode(const string& origin, const string& folder, int index) {
+	string nodeFolder = folder + "/node" + to_string(index);
+	string resultPath = nodeFolder + "/result.json";
+	json result;
+	result["Downloaded"] = false;
+
+	UpdateDownloader::Manifest manifest;
+	try {
+		ifstream in(folder + "/manifest.json");
+		json fields = json::parse(in);
+		manifest.version = fields["Version"];
+		manifest.size = fields["Size"];
+		manifest.sha256 = fields["SHA256"];
+		manifest.chunkSize = fields["ChunkSize"];
+		manifest.chunks = fields["Chunks"].get<vector<string>>();
+	}
+	catch (const std::exception& e) {
+		result["Error"] = string("bad manifest: ") + e.what();
+	}
+
+	// Any free port on the loopback interface, so the cabinets can share one machine
+	peerExchange.setPort(0);
+	peerExchange.setInterface("127.0.0.1");
+	peerExchange.setStoreFolder(nodeFolder + "/chunks");
+	peerExchange.setOrigin(origin);
+	peerExchange.setVersion(manifest.version);
+
+	if (!result.contains("Error") && !peerExchange.start()) {
+		result["Error"] = "peer exchange didn't start";
+	}
+
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(PEER_CHECK_DISCOVERY_MS);
+	while (!result.contains("Error") && peerExchange.getStats().peers < PEER_CHECK_NODES - 1) {
+		if (chrono::steady_clock::now() >= deadline) {
+			result["Error"] = "found " + to_string(peerExchange.getStats().peers) + " other cabinets";
+			break;
+		}
+		this_thread::sleep_for(chrono::milliseconds(100));
+	}
+
+	if (!result.contains("Error")) {
+		UpdateDownloader downloader;
+		downloader.setServer(origin);
+		result["Downloaded"] = downloader.download(manifest, nodeFolder + "/Update.zip");
+		result["FromPeers"] = downloader.getProgress().fromPeers;
+	}
+
+	// Written in one step, so the check never reads half a result
+	{
+		ofstream out(resultPath + ".tmp");
+		out << result.dump();
+	}
+	error_code error;
+	filesystem::rename(resultPath + ".tmp", resultPath, error);
+
+	// The others may still need chunks this cabinet owns
+	deadline = chrono::steady_clock::now() + chrono::milliseconds(PEER_CHECK_TIMEOUT_MS);
+	while (!fileExists(folder + "/stop") && chrono::steady_clock::now() < deadline) {
+		this_thread::sleep_for(chrono::milliseconds(100));
+	}
+	peerExchange.stop();
+
+	return result["Downloaded"].get<bool>() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Check the peer exchange with several cabinets on this machine, each its own
+ * process on the loopback interface, downloading the same update from a stand-in
+ * game server. Each should verify the update, get part of it from the others, and
+ * between them pull each chunk from the game server once.
+ *
+ * @param self the headless program, to start the cabinets
+ * @return the number of cases that failed
+ */
+int runPeerCheck(const string& self) {
+	int failures = 0;
+	string folder = (filesystem::temp_directory_path() / "sonataria-peer-check").generic_string();
+	error_code error;
+	filesystem::remove_all(folder, error);
+	filesystem::create_directories(folder, error);
+
+	string payload((size_t)PEER_CHECK_SIZE, '\0');
+	uint32_t seed = 54321;
+	for (size_t i = 0; i < payload.size(); i++) {
+		seed = seed * 1664525 + 1013904223;
+		payload[i] = (char)(seed >> 24);
+	}
+
+	json fields;
+	fields["Version"] = "20991231-J-01";
+	fields["Size"] = PEER_CHECK_SIZE;
+	fields["SHA256"] = [&payload]() { Sha256 hash; hash.update(payload.data(), payload.size()); return hash.finishHex(); }();
+	fields["ChunkSize"] = PEER_CHECK_CHUNK_SIZE;
+	vector<string> chunks;
+	for (uint64_t offset = 0; offset < PEER_CHECK_SIZE; offset += PEER_CHECK_CHUNK_SIZE) {
+		Sha256 hash;
+		hash.update(payload.data() + offset, (size_t)PEER_CHECK_CHUNK_SIZE);
+		chunks.push_back(hash.finishHex());
+	}
+	fields["Chunks"] = chunks;
+	ofstream(folder + "/manifest.json") << fields.dump();
+
+	// The game server counts how often each part of the update is asked for
+	mutex countLock;
+	map<uint64_t, int> requests;
+	StandInServer gameServer(false, [&](const StandInRequest& request) {
+		StandInReply reply;
+		unsigned long long offset = 0, count = 0;
+		if (sscanf(request.body.c_str(), "DLUpdate %llu %llu", &offset, &count) != 2 || offset > payload.size()) {
+			reply.body = standInLengthPrefixed("");
+			return reply;
+		}
+		{
+			lock_guard<mutex> lock(countLock);
+			requests[offset]++;
+		}
+		reply.body = standInLengthPrefixed(payload.substr((size_t)offset, (size_t)count));
+		return reply;
+	});
+	if (!gameServer.start()) {
+		reportCase(false, "stand-in game server started", failures);
+		return failures;
+	}
+
+	vector<int> exitCodes(PEER_CHECK_NODES, -1);
+	vector<thread> nodes;
+	for (int i = 0; i < PEER_CHECK_NODES; i++) {
+		string command = "\"" + self + "\" --peer-node " + gameServer.getAddress() + " \"" + folder + "\" " + to_string(i);
+		nodes.push_back(thread([command, i, &exitCodes]() { exitCodes[i] = system(command.c_str()); }));
+	}
+
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(PEER_CHECK_TIMEOUT_MS);
+	for (int i = 0; i < PEER_CHECK_NODES; i++) {
+		while (!fileExists(folder + "/node" + to_string(i) + "/result.json") && chrono::steady_clock::now() < deadline) {
+			this_thread::sleep_for(chrono::milliseconds(100));
+		}
+	}
+	ofstream(folder + "/stop") << "stop";
+	for (size_t i = 0; i < nodes.size(); i++) {
+		nodes[i].join();
+	}
+
+	for (int i = 0; i < PEER_CHECK_NODES; i++) {
+		json result = json::parse(ifstream(folder + "/node" + to_string(i) + "/result.json"), nullptr, false);
+		bool downloaded = !result.is_discarded() && result.value("Downloaded", false);
+		uint64_t fromPeers = result.is_discarded() ? 0 : result.value("FromPeers", (uint64_t)0);
+		string detail = result.is_discarded() ? "no result" : result.value("Error", to_string(fromPeers) + " bytes from other cabinets");
+		reportCase(downloaded && fromPeers > 0 && exitCodes[i] == 0, "cabinet " + to_string(i) + " verified the update (" + detail + ")", failures);
+	}
+
+	int most = 0;
+	int total = 0;
+	for (const auto& part : requests) {
+		most = max(most, part.second);
+		total += part.second;
+	}
+	reportCase(requests.size() == chunks.size() && most == 1,
+		"game server sent each chunk once (" + to_string(total) + " requests for " + to_string(chunks.size()) + " chunks)", failures);
+
+	gameServer.stop();
+	filesystem::remove_all(folder, error);
+	return failures;
+}
@@ -0,0 +1,255 @@
+#include "Checks.h"
+#include "StandInServer.h"
+#include "Results.h"
+#include "ScoreQueue.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <sstream>
+
+using json = nlohmann::json;
+
+// Card of a play the stand-in score server refuses
+const char REJECTED_CARD[] = "E004-REJECT";
+
+// The end of the log as a power cut leaves it, part way through a line
+const char TORN_LINE[] = "5f3a9c0e12b4d7a8 {\"Add\":{\"CardID\":\"E004-";
+
+/**
+ * How the stand-in score server behaves
+ */
+enum SCORE_SERVER_MODE {
+	SCORE_SERVER_UP,
+	SCORE_SERVER_DOWN,			// Drops every connection
+	SCORE_SERVER_LOSES_REPLY	// Keeps the next batch but drops the connection instead of replying
+};
+
+/**
+ * What the stand-in score server has been sent
+ */
+struct ScoreServerState {
+	mutex lock;
+	SCORE_SERVER_MODE mode = SCORE_SERVER_UP;
+	map<string, int> received;		// Times each play ID arrived
+	size_t stored = 0;				// Plays kept, each ID once
+	int posts = 0;
+};
+
+/**
+ * Answer a batch of scores the way the score server does: each play ID is only
+ * counted once, and a batch with a play it doesn't accept is refused whole.
+ *
+ * @param state what the server has been sent
+ * @param request the request
+ * @return the reply
+ */
+static StandInReply serveScores(ScoreServerState& state, const StandInRequest& request) {
+	lock_guard<mutex> lock(state.lock);
+	StandInReply reply;
+	state.posts++;
+	if (state.mode == SCORE_SERVER_DOWN) {
+		reply.drop = true;
+		return reply;
+	}
+
+	json batch = json::parse(request.body, nullptr, false);
+	if (request.method != "POST" || batch.is_discarded() || !batch.contains("Scores")) {
+		reply.status = 400;
+		return reply;
+	}
+	for (const json& score : batch["Scores"]) {
+		if (score.value("CardID", "") == REJECTED_CARD) {
+			reply.status = 422;
+			reply.body = "{\"Error\":\"score not accepted\"}";
+			return reply;
+		}
+	}
+	for (const json& score : batch["Scores"]) {
+		if (state.received[score["ID"].get<string>()]++ == 0) {
+			state.stored++;
+		}
+	}
+
+	if (state.mode == SCORE_SERVER_LOSES_REPLY) {
+		state.mode = SCORE_SERVER_UP;
+		reply.drop = true;
+		return reply;
+	}
+	reply.body = "{\"Accepted\":" + to_string(batch["Scores"].size()) + "}";
+	return reply;
+}
+
+/**
+ * Wait for something to happen.
+ *
+ * @param done true once it has
+ * @param timeoutMs how long to wait
+ * @return true if it happened in time
+ */
+static bool waitUntil(function<bool()> done, int timeoutMs) {
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+	while (!done()) {
+		if (chrono::steady_clock::now() >= deadline) {
+			return false;
+		}
+		this_thread::sleep_for(chrono::milliseconds(20));
+	}
+	return true;
+}
+
+/**
+ * Gets the contents of a file.
+ *
+ * @param path the file
+ * @return the contents, empty if it can't be read
+ */
+static string readFile(const string& path) {
+	ifstream in(path, ios::binary);
+	stringstream contents;
+	contents << in.rdbuf();
+	return contents.str();
+}
+
+/**
+ * Queue plays and close at once without cleaning up, like a cabinet losing power
+ * before it could upload them. Run as its own process by runScoreQueueCheck().
+ *
+ * @param directory where the queue is kept
+ * @param count how many plays to add
+ * @return never returns
+ */
+int runScoreQueueWriter(const string& directory, int count) {
+	ScoreQueue* queue = new ScoreQueue();
+	queue->setDirectory(directory);
+	for (int i = 0; i < count; i++) {
+		Results results(Song(), 2, 900000 + i, 300 + i, 4, 1);
+		queue->add(results, "E004-CRASH" + to_string(i), "replay" + to_string(i));
+	}
+	quick_exit(EXIT_SUCCESS);
+}
+
+/**
+ * Check the score queue against a stand-in score server: plays left by a run that
+ * crashed before uploading, a log cut off part way through a line, an outage the
+ * queue backs off from, a batch sent twice because its reply was lost, and a play
+ * the server refuses.
+ *
+ * @param self the headless program, to run the crashing writer
+ * @return the number of cases that failed
+ */
+int runScoreQueueCheck(const string& self) {
+	int failures = 0;
+	string directory = (filesystem::temp_directory_path() / "sonataria-score-check").generic_string();
+	error_code error;
+	filesystem::remove_all(directory, error);
+
+	ScoreServerState state;
+	StandInServer scoreServer(true, [&state](const StandInRequest& request) { return serveScores(state, request); });
+	if (!scoreServer.start()) {
+		reportCase(false, "stand-in score server started", failures);
+		return failures;
+	}
+	string url = "http://" + scoreServer.getAddress() + "/scores";
+	auto stored = [&state]() { lock_guard<mutex> lock(state.lock); return state.stored; };
+
+	// A run that crashed before uploading, its log ending part way through a line
+	string command = "\"" + self + "\" --score-writer \"" + directory + "\" 3";
+	int exitCode = system(command.c_str());
+	ofstream(directory + "/queue.log", ios::app | ios::binary) << TORN_LINE;
+
+	{
+		ScoreQueue queue;
+		queue.setDirectory(directory);
+		queue.setServer(url);
+		queue.start();
+		bool sent = waitUntil([&]() { return stored() == 3 && queue.getStats().waiting == 0; }, 5000);
+		reportCase(exitCode == 0 && sent, "3 plays from a run that crashed before uploading were sent", failures);
+		reportCase(stored() == 3 && readFile(directory + "/queue.log").find(TORN_LINE) == string::npos,
+			"line cut off by the crash skipped and dropped from the log", failures);
+		queue.stop();
+	}
+
+	// An outage, backed off from and sent as soon as the server is back
+	{
+		ScoreQueue queue;
+		queue.setDirectory(directory);
+		queue.setServer(url);
+		state.lock.lock();
+		state.mode = SCORE_SERVER_DOWN;
+		state.posts = 0;
+		state.lock.unlock();
+
+		queue.start();
+		for (int i = 0; i < 2; i++) {
+			Results results(Song(), 1, 800000 + i, 200, 10, 3);
+			queue.add(results, "E004-OUTAGE" + to_string(i), "replay");
+		}
+		this_thread::sleep_for(chrono::milliseconds(3000));
+		ScoreQueue::Stats stats = queue.getStats();
+		int posts;
+		{
+			lock_guard<mutex> lock(state.lock);
+			posts = state.posts;
+			state.mode = SCORE_SERVER_UP;
+		}
+		reportCase(stats.waiting == 2 && stats.failedAttempts >= 1 && stats.failedAttempts <= 3 && posts <= 6,
+			"backed off during the outage (" + to_string(stats.failedAttempts) + " failed uploads, " + to_string(posts) + " requests in 3 s)", failures);
+
+		queue.wake();
+		bool sent = waitUntil([&]() { return stored() == 5 && queue.getStats().waiting == 0; }, 3000);
+		reportCase(sent, "plays sent as soon as the server was back", failures);
+		queue.stop();
+	}
+
+	// The server kept a batch but its reply was lost, so the batch is sent again
+	{
+		ScoreQueue queue;
+		queue.setDirectory(directory);
+		queue.setServer(url);
+		state.lock.lock();
+		state.mode = SCORE_SERVER_LOSES_REPLY;
+		state.lock.unlock();
+
+		queue.start();
+		Results results(Song(), 3, 990000, 500, 0, 0);
+		queue.add(results, "E004-LOSTREPLY", "replay");
+		bool sent = waitUntil([&]() { return queue.getStats().waiting == 0; }, 5000);
+
+		int duplicates = 0;
+		{
+			lock_guard<mutex> lock(state.lock);
+			for (const auto& play : state.received) {
+				duplicates += play.second > 1 ? 1 : 0;
+			}
+		}
+		reportCase(sent && duplicates == 1 && stored() == 6, "batch whose reply was lost was sent again and counted once", failures);
+		queue.stop();
+	}
+
+	// A play the server refuses is set aside without holding up the others
+	{
+		ScoreQueue queue;
+		queue.setDirectory(directory);
+		queue.setServer(url);
+		for (int i = 0; i < 3; i++) {
+			Results results(Song(), 2, 700000 + i, 250, 20, 5);
+			queue.add(results, i == 1 ? REJECTED_CARD : "E004-GOOD" + to_string(i), "replay");
+		}
+		queue.start();
+		bool sent = waitUntil([&]() { return queue.getStats().waiting == 0; }, 5000);
+		ScoreQueue::Stats stats = queue.getStats();
+		reportCase(sent && stats.rejected == 1 && stored() == 8 && readFile(directory + "/rejected.log").find(REJECTED_CARD) != string::npos,
+			"refused play set aside in rejected.log, the other 2 sent", failures);
+		queue.stop();
+	}
+
+	scoreServer.stop();
+	filesystem::remove_all(directory, error);
+	return failures;
+}
@@ -0,0 +1,379 @@
+#include "StandInServer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+// How long a connection waits for the rest of a request before it is dropped
+const int STAND_IN_READ_TIMEOUT_MS = 10000;
+
+// How long a command connection has to be quiet before what arrived counts as one command
+const int STAND_IN_COMMAND_QUIET_MS = 20;
+
+/**
+ * Default constructor.
+ *
+ * @param http true to speak HTTP, false for the game server's commands
+ * @param handler picks the reply to each request (called from the connection threads)
+ */
+StandInServer::StandInServer(bool http, Handler handler) {
+	this->http = http;
+	this->handler = handler;
+	this->running = false;
+	this->connectionCount = 0;
+	this->requestCount = 0;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+StandInServer::~StandInServer() {
+	stop();
+}
+
+/**
+ * Start listening and serving connections.
+ *
+ * @param port the port to listen on, or 0 for any free one
+ * @return true if listening
+ */
+bool StandInServer::start(int port) {
+	string error;
+	if (!this->listener.listen(port, error)) {
+		printf("Stand-in server: %s\n", error.c_str());
+		return false;
+	}
+	this->running = true;
+	this->acceptThread = thread(&StandInServer::acceptLoop, this);
+	return true;
+}
+
+/**
+ * Stop listening and close every connection.
+ *
+ */
+void StandInServer::stop() {
+	if (!this->running.exchange(false)) {
+		return;
+	}
+	if (this->acceptThread.joinable()) {
+		this->acceptThread.join();
+	}
+	this->listener.close();
+
+	vector<thread> threads;
+	{
+		lock_guard<mutex> lock(this->threadLock);
+		threads.swap(this->connectionThreads);
+	}
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+}
+
+/**
+ * Gets the port the server listens on.
+ *
+ * @return the port
+ */
+int StandInServer::getPort() {
+	return this->listener.getLocalPort();
+}
+
+/**
+ * Gets the address to give the game for this server.
+ *
+ * @return 127.0.0.1:port
+ */
+string StandInServer::getAddress() {
+	return "127.0.0.1:" + to_string(getPort());
+}
+
+/**
+ * Gets how many connections have been made to the server.
+ *
+ * @return the connection count
+ */
+int StandInServer::getConnectionCount() {
+	return this->connectionCount;
+}
+
+/**
+ * Gets how many requests the server has answered or dropped.
+ *
+ * @return the request count
+ */
+int StandInServer::getRequestCount() {
+	return this->requestCount;
+}
+
+/**
+ * Hand each new connection its own thread until the server stops.
+ *
+ */
+void StandInServer::acceptLoop() {
+	while (this->running) {
+		vector<NetPollEntry> entries(1);
+		entries[0].handle = this->listener.getHandle();
+		entries[0].wantRead = true;
+		entries[0].wantWrite = false;
+		netPoll(entries, 50);
+
+		NetSocket* client = new NetSocket();
+		if (!this->listener.accept(*client)) {
+			delete client;
+			continue;
+		}
+		int connection = ++this->connectionCount;
+		lock_guard<mutex> lock(this->threadLock);
+		this->connectionThreads.push_back(thread(&StandInServer::serve, this, client, connection));
+	}
+}
+
+/**
+ * Answer the requests of one connection until either side closes it.
+ *
+ * @param socket the connection (deleted when done)
+ * @param connection the number of the connection
+ */
+void StandInServer::serve(NetSocket* socket, int connection) {
+	string buffer;
+	while (this->running && socket->isOpen()) {
+		StandInRequest request;
+		request.connection = connection;
+		bool received = this->http ? readHttpRequest(*socket, buffer, request) : readCommand(*socket, request);
+		if (!received) {
+			break;
+		}
+		if (!this->http && request.body == "EndConn") {
+			break;
+		}
+
+		StandInReply reply = this->handler(request);
+		this->requestCount++;
+		if (reply.drop) {
+			break;
+		}
+		if (reply.delayMs > 0) {
+			this_thread::sleep_for(chrono::milliseconds(reply.delayMs));
+		}
+
+		string data;
+		if (this->http) {
+			data = "HTTP/1.1 " + to_string(reply.status) + " Stand-in\r\n";
+			if (reply.chunked) {
+				data += "Transfer-Encoding: chunked\r\n";
+			}
+			else {
+				data += "Content-Length: " + to_string(reply.body.size()) + "\r\n";
+			}
+			if (reply.close) {
+				data += "Connection: close\r\n";
+			}
+			data += "\r\n";
+			if (reply.chunked) {
+				// Uneven pieces, so the client has to put chunks back together across reads
+				size_t offset = 0;
+				size_t piece = 1;
+				while (offset < reply.body.size()) {
+					size_t length = min(piece, reply.body.size() - offset);
+					char size[32];
+					snprintf(size, sizeof(size), "%zx\r\n", length);
+					data += size + reply.body.substr(offset, length) + "\r\n";
+					offset += length;
+					piece = piece * 3 + 1;
+				}
+				data += "0\r\n\r\n";
+			}
+			else {
+				data += reply.body;
+			}
+		}
+		else {
+			data = reply.body;
+		}
+
+		if (!sendReply(*socket, data, reply) || reply.close) {
+			break;
+		}
+	}
+	socket->close();
+	delete socket;
+}
+
+/**
+ * Wait for a connection to have something to read.
+ *
+ * @param socket the connection
+ * @param timeoutMs how long to wait
+ * @return true if there is something to read (or the other side closed)
+ */
+bool StandInServer::waitReadable(NetSocket& socket, int timeoutMs) {
+	vector<NetPollEntry> entries(1);
+	entries[0].handle = socket.getHandle();
+	entries[0].wantRead = true;
+	entries[0].wantWrite = false;
+	return netPoll(entries, timeoutMs) > 0;
+}
+
+/**
+ * Read the next HTTP request of a connection.
+ *
+ * @param socket the connection
+ * @param buffer what has been read past the last request
+ * @param request set to the request
+ * @return false if the connection closed or stalled first
+ */
+bool StandInServer::readHttpRequest(NetSocket& socket, string& buffer, StandInRequest& request) {
+	char data[16 * 1024];
+	size_t headerEnd = string::npos;
+	size_t contentLength = 0;
+	int waitedMs = 0;
+
+	while (this->running) {
+		if (headerEnd == string::npos) {
+			headerEnd = buffer.find("\r\n\r\n");
+			if (headerEnd != string::npos) {
+				size_t lineEnd = buffer.find("\r\n");
+				string line = buffer.substr(0, lineEnd);
+				size_t space = line.find(' ');
+				request.method = line.substr(0, space);
+				request.path = line.substr(space + 1, line.find(' ', space + 1) - space - 1);
+
+				size_t position = lineEnd + 2;
+				while (position < headerEnd) {
+					size_t next = buffer.find("\r\n", position);
+					string header = buffer.substr(position, next - position);
+					size_t colon = header.find(':');
+					if (colon != string::npos) {
+						string name = header.substr(0, colon);
+						transform(name.begin(), name.end(), name.begin(), ::tolower);
+						string value = header.substr(colon + 1);
+						value.erase(0, value.find_first_not_of(' '));
+						request.headers[name] = value;
+					}
+					position = next + 2;
+				}
+				if (request.headers.count("content-length")) {
+					contentLength = (size_t)strtoull(request.headers["content-length"].c_str(), NULL, 10);
+				}
+			}
+		}
+		if (headerEnd != string::npos && buffer.size() >= headerEnd + 4 + contentLength) {
+			request.body = buffer.substr(headerEnd + 4, contentLength);
+			buffer.erase(0, headerEnd + 4 + contentLength);
+			return true;
+		}
+
+		if (!waitReadable(socket, 50)) {
+			waitedMs += 50;
+			if (waitedMs >= STAND_IN_READ_TIMEOUT_MS) {
+				return false;
+			}
+			continue;
+		}
+		int received = socket.receiveSome(data, sizeof(data));
+		if (received == NET_WOULD_BLOCK) {
+			continue;
+		}
+		if (received <= 0) {
+			return false;
+		}
+		buffer.append(data, received);
+		waitedMs = 0;
+	}
+	return false;
+}
+
+/**
+ * Read the next command of a connection.
+ *
+ * @param socket the connection
+ * @param request set to the command, without any line break at the end
+ * @return false if the connection closed or stalled first
+ */
+bool StandInServer::readCommand(NetSocket& socket, StandInRequest& request) {
+	char data[4096];
+	int waitedMs = 0;
+
+	while (this->running) {
+		if (!waitReadable(socket, request.body.empty() ? 50 : STAND_IN_COMMAND_QUIET_MS)) {
+			if (!request.body.empty()) {
+				while (!request.body.empty() && (request.body.back() == '\n' || request.body.back() == '\r')) {
+					request.body.pop_back();
+				}
+				return true;
+			}
+			waitedMs += 50;
+			if (waitedMs >= STAND_IN_READ_TIMEOUT_MS) {
+				return false;
+			}
+			continue;
+		}
+		int received = socket.receiveSome(data, sizeof(data));
+		if (received == NET_WOULD_BLOCK) {
+			continue;
+		}
+		if (received <= 0) {
+			return false;
+		}
+		request.body.append(data, received);
+	}
+	return false;
+}
+
+/**
+ * Send a reply, putting in the faults it asks for.
+ *
+ * @param socket the connection
+ * @param data the whole reply
+ * @param reply the faults to put in
+ * @return false if the connection is closed afterwards
+ */
+bool StandInServer::sendReply(NetSocket& socket, const string& data, const StandInReply& reply) {
+	size_t length = min(data.size(), reply.dropAfter);
+	size_t sent = 0;
+	size_t sinceWait = 0;
+
+	while (sent < length && this->running) {
+		size_t piece = min(length - sent, (size_t)STAND_IN_PACE_BYTES - sinceWait);
+		int result = socket.sendSome(data.data() + sent, piece);
+		if (result == NET_WOULD_BLOCK) {
+			vector<NetPollEntry> entries(1);
+			entries[0].handle = socket.getHandle();
+			entries[0].wantRead = false;
+			entries[0].wantWrite = true;
+			netPoll(entries, 50);
+			continue;
+		}
+		if (result < 0) {
+			return false;
+		}
+		sent += result;
+		sinceWait += result;
+		if (sinceWait >= STAND_IN_PACE_BYTES) {
+			sinceWait = 0;
+			if (reply.paceMs > 0) {
+				this_thread::sleep_for(chrono::milliseconds(reply.paceMs));
+			}
+		}
+	}
+	return sent == data.size();
+}
+
+/**
+ * Put the 4 byte big-endian length of a command reply in front of it.
+ *
+ * @param data the reply
+ * @return the reply as sent
+ */
+string standInLengthPrefixed(const string& data) {
+	uint32_t length = (uint32_t)data.size();
+	string prefix(4, '\0');
+	prefix[0] = (char)(length >> 24);
+	prefix[1] = (char)(length >> 16);
+	prefix[2] = (char)(length >> 8);
+	prefix[3] = (char)length;
+	return prefix + data;
+}
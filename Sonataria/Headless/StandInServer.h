@@ -0,0 +1,94 @@
+/**
+ * @file StandInServer.h
+ *
+ * @brief Stand-in Server
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "NetSocket.h"
+
+/**
+ * A request as the stand-in server saw it
+ */
+struct StandInRequest {
+	string method;				// HTTP only
+	string path;				// HTTP only
+	map<string, string> headers;	// HTTP only, names in lower case
+	string body;				// HTTP body, or the command text
+	int connection;				// The connection it came on, counted from 1
+};
+
+/**
+ * What the stand-in server does with a request
+ */
+struct StandInReply {
+	int status = 200;			// HTTP only
+	string body;
+	bool chunked = false;		// HTTP only: send the body with chunked transfer encoding
+	bool close = false;			// Close the connection after the reply
+	bool drop = false;			// Close the connection without replying
+	size_t dropAfter = SIZE_MAX;	// Close the connection after this many bytes of the reply
+	int delayMs = 0;			// Wait before replying
+	int paceMs = 0;				// Wait after every STAND_IN_PACE_BYTES of the reply
+};
+
+// Bytes sent between the waits of a paced reply
+#define STAND_IN_PACE_BYTES (64 * 1024)
+
+/**
+ * A local server for the headless checks that stands in for the profile, score
+ * and game servers. Every request goes to a handler, which picks the reply and
+ * any fault to put in it, so a check can drop connections, stall, or answer
+ * with errors at exactly the point it wants to test.
+ *
+ * Commands are told apart by the client waiting for each reply before it sends
+ * the next one, so whatever arrives before the connection goes quiet is one command.
+ */
+class StandInServer {
+
+	public:
+		typedef function<StandInReply(const StandInRequest&)> Handler;
+
+	private:
+		bool http;
+		Handler handler;
+		NetSocket listener;
+		thread acceptThread;
+		mutex threadLock;
+		vector<thread> connectionThreads;
+		atomic<bool> running;
+		atomic<int> connectionCount;
+		atomic<int> requestCount;
+
+		void acceptLoop();
+		void serve(NetSocket* socket, int connection);
+		bool waitReadable(NetSocket& socket, int timeoutMs);
+		bool readHttpRequest(NetSocket& socket, string& buffer, StandInRequest& request);
+		bool readCommand(NetSocket& socket, StandInRequest& request);
+		bool sendReply(NetSocket& socket, const string& data, const StandInReply& reply);
+
+	public:
+		StandInServer(bool http, Handler handler);
+		~StandInServer();
+
+		bool start(int port = 0);
+		void stop();
+
+		int getPort();
+		string getAddress();
+		int getConnectionCount();
+		int getRequestCount();
+};
+
+string standInLengthPrefixed(const string& data);
@@ -0,0 +1,290 @@
+#include "Checks.h"
+#include "StandInServer.h"
+#include "Checksum.h"
+#include "Networking.h"
+#include "Signature.h"
+#include "UpdateDownloader.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// Test signing key (2048 bit RSA, only for this check): modulus
+const char TEST_KEY_MODULUS[] =
+	"bc8cfc78f3ff93a3ddb5be752f57b6534a418e9a373ba05a56e782638c7190244cdee05f1b4338649d58217953d588b4"
+	"c81994fddccc91565084f0737e9b0f6fd3e28b32ce15f8cf021e55221313f10dc187be08563c8da07b79b9b4bdeedb1c"
+	"10ff52cec635af4806e6c829d71cfdec0e9c654f4a1d112f336c160f7e0c84cbe80d86a4d759ec440dac1ca4eeed83d1"
+	"399a34f6a45835a06d93aab0b2f5eb1a59df9ef43ec3cd29ca5226535f72f135cdd629cad2e57e11119102fde9508bbf"
+	"33f448d2f6dfc20450982a7323f0dc7daf49e723a21989778823a4bc8e8e877ffb7c29a4fac5f687667c671aadcbba82"
+	"d6e0583ddefce5b5506dd74198a74dbd";
+
+// Test signing key: private exponent
+const char TEST_KEY_PRIVATE[] =
+	"0293eadfbc76420e7b7980a1198499798a0a5b68c0589058abd77e70ddfaaf7dcf8f3c82105d5ae8053eaf36796ef1ef"
+	"86ccd2bca5c8263487e549644ad6d3df33866560cc70807654111618e129e4a1cb838f958d9846576b58beb139e78a17"
+	"5824257dae380dad6e6ab951d91f0c59add975891ffa45c1df721adb1b5e1072b33764845bf2142b29922ad5a5b089e5"
+	"dd6e2c937582dda770c99704622d0ee84f1c316857816eb2282ac1bd3488f825b32a20a1de3d92d1e53c8b2a5c8d56fd"
+	"14892d028a6a370bdb6e012ba91b470bada18d6aa729e4f1d6930f92e3b689b64e4db73430b3c29ec8da46e418f9f8cb"
+	"763e9c29bef9965ad1eaf4d5823721";
+
+// Modulus of a different key, for a manifest checked against the wrong key
+const char OTHER_KEY_MODULUS[] =
+	"d91dccaa78fd3cd2e26a73d317c5fc2d22e351dcbb04aee1b6d6b1b381f05f0a4b665305ba103aefe212a775ccf81f31"
+	"7ca1c9f8b5bb004f0ce5c855acea404920bb88fc048f957b78e7d20512f6080d67ddad8514752da0a0e792a1d74253a4"
+	"31a4960c21af51278c3e49d612879ffbd15f74fec9b6486463595439e306c70587aab574b696e7f2b89c5c5a179a2f9b"
+	"a402d1e3d38ba6827d9a23e7a6b7c308b76f3c06895ad047671afb13514bf7abc4a08e5b6852885c38f7099c2867dc27"
+	"2b7d4f7db1691bea252eaf01dd360f5cb7c4ad7bd78d922b0aa4dba1b99af74966fa37c81a5cf9ce22875e12c95928d9"
+	"270d2a51fcfeb7ccb05d43ad9c410f63";
+
+// Size of the update the stand-in game server offers
+const uint64_t UPDATE_CHECK_SIZE = 16 * 1024 * 1024;
+
+// Chunk size of its manifest
+const uint64_t UPDATE_CHECK_CHUNK_SIZE = 1024 * 1024;
+
+// Version of its manifest
+const char UPDATE_CHECK_VERSION[] = "20991231-J-01";
+
+/**
+ * What the stand-in game server offers and the faults it puts in
+ */
+struct UpdateServerState {
+	mutex lock;
+	string payload;
+	string manifestReply;
+	int dropEvery = 0;					// Cut every nth DLUpdate reply off half way, 0 for never
+	uint64_t corruptOffset = UINT64_MAX;	// A byte flipped in every reply that covers it
+	bool corruptOnce = false;			// Only flip it the first time
+	int requests = 0;
+	int dropped = 0;
+	int corrupted = 0;
+	uint64_t served = 0;				// Bytes of the update sent
+};
+
+/**
+ * Answer a command the way the game server does, putting in the faults asked for.
+ *
+ * @param state what to serve
+ * @param request the command
+ * @return the reply
+ */
+static StandInReply serveUpdate(UpdateServerState& state, const StandInRequest& request) {
+	lock_guard<mutex> lock(state.lock);
+	StandInReply reply;
+	if (request.body == "UpdateManifest") {
+		reply.body = standInLengthPrefixed(state.manifestReply);
+		return reply;
+	}
+
+	unsigned long long offset = 0, count = 0;
+	if (sscanf(request.body.c_str(), "DLUpdate %llu %llu", &offset, &count) != 2 || offset > state.payload.size()) {
+		reply.body = standInLengthPrefixed("");
+		return reply;
+	}
+	string data = state.payload.substr((size_t)offset, (size_t)count);
+	state.requests++;
+
+	if (state.corruptOffset >= offset && state.corruptOffset < offset + data.size()) {
+		data[(size_t)(state.corruptOffset - offset)] ^= 0x5a;
+		state.corrupted++;
+		if (state.corruptOnce) {
+			state.corruptOffset = UINT64_MAX;
+		}
+	}
+
+	reply.body = standInLengthPrefixed(data);
+	if (state.dropEvery > 0 && state.requests % state.dropEvery == 0) {
+		reply.dropAfter = 4 + data.size() / 2;
+		state.served += data.size() / 2;
+		state.dropped++;
+	}
+	else {
+		state.served += data.size();
+	}
+	return reply;
+}
+
+/**
+ * Sign a manifest with the test key, the way the update server does.
+ *
+ * @param fields the manifest
+ * @param tamper change the manifest after signing it
+ * @return the reply to UpdateManifest
+ */
+static string signManifest(const json& fields, bool tamper) {
+	vector<uint8_t> modulus, privateExponent;
+	fromHex(TEST_KEY_MODULUS, modulus);
+	fromHex(TEST_KEY_PRIVATE, privateExponent);
+
+	string text = fields.dump();
+	Sha256 hash;
+	hash.update(text.data(), text.size());
+	uint8_t digest[32];
+	hash.finish(digest);
+	vector<uint8_t> signature = rsaPower(rsaSha256Padding(digest, modulus.size()), privateExponent, modulus);
+
+	if (tamper) {
+		json changed = fields;
+		changed["Size"] = fields["Size"].get<uint64_t>() + 1;
+		text = changed.dump();
+	}
+
+	json reply;
+	reply["Manifest"] = text;
+	reply["Signature"] = toHex(signature.data(), signature.size());
+	return reply.dump();
+}
+
+/**
+ * Gets the SHA-256 of a file.
+ *
+ * @param path the file
+ * @return the hash as lowercase hex, or empty if it can't be read
+ */
+static string hashFile(const string& path) {
+	ifstream in(path, ios::binary);
+	if (!in.is_open()) {
+		return "";
+	}
+	Sha256 hash;
+	vector<char> buffer(1024 * 1024);
+	while (in) {
+		in.read(buffer.data(), (streamsize)buffer.size());
+		hash.update(buffer.data(), (size_t)in.gcount());
+	}
+	return hash.finishHex();
+}
+
+/**
+ * Check the update download against a stand-in game server: the manifest signature
+ * (good, tampered with, and checked against the wrong key), a manifest for another
+ * version, replies cut off part way, a download stopped and carried on by a new
+ * downloader, and damaged data with and without chunk hashes.
+ *
+ * @return the number of cases that failed
+ */
+int runUpdateCheck() {
+	int failures = 0;
+	filesystem::path folder = filesystem::temp_directory_path() / "sonataria-update-check";
+	error_code error;
+	filesystem::remove_all(folder, error);
+	filesystem::create_directories(folder, error);
+	string keyPath = (folder / "UpdateKey.txt").generic_string();
+	string otherKeyPath = (folder / "OtherKey.txt").generic_string();
+	ofstream(keyPath) << TEST_KEY_MODULUS << "\n010001\n";
+	ofstream(otherKeyPath) << OTHER_KEY_MODULUS << "\n010001\n";
+	string destination = (folder / "Update.zip").generic_string();
+
+	UpdateServerState state;
+	state.payload.resize((size_t)UPDATE_CHECK_SIZE);
+	uint32_t seed = 12345;
+	for (size_t i = 0; i < state.payload.size(); i++) {
+		seed = seed * 1664525 + 1013904223;
+		state.payload[i] = (char)(seed >> 24);
+	}
+
+	json fields;
+	fields["Version"] = UPDATE_CHECK_VERSION;
+	fields["Size"] = UPDATE_CHECK_SIZE;
+	Sha256 hash;
+	hash.update(state.payload.data(), state.payload.size());
+	string payloadHash = hash.finishHex();
+	fields["SHA256"] = payloadHash;
+	fields["ChunkSize"] = UPDATE_CHECK_CHUNK_SIZE;
+	vector<string> chunks;
+	for (uint64_t offset = 0; offset < UPDATE_CHECK_SIZE; offset += UPDATE_CHECK_CHUNK_SIZE) {
+		Sha256 chunkHash;
+		chunkHash.update(state.payload.data() + offset, (size_t)UPDATE_CHECK_CHUNK_SIZE);
+		chunks.push_back(chunkHash.finishHex());
+	}
+	fields["Chunks"] = chunks;
+	state.manifestReply = signManifest(fields, false);
+
+	StandInServer gameServer(false, [&state](const StandInRequest& request) { return serveUpdate(state, request); });
+	if (!gameServer.start()) {
+		reportCase(false, "stand-in game server started", failures);
+		return failures;
+	}
+
+	// The manifest
+	UpdateDownloader downloader;
+	downloader.setServer(gameServer.getAddress());
+	downloader.setKeyPath(keyPath);
+	UpdateDownloader::Manifest manifest;
+	bool fetched = downloader.fetchManifest(manifest);
+	reportCase(fetched && manifest.version == UPDATE_CHECK_VERSION && manifest.size == UPDATE_CHECK_SIZE && manifest.chunks.size() == chunks.size(),
+		"signed manifest accepted", failures);
+
+	UpdateDownloader::Manifest refused;
+	state.manifestReply = signManifest(fields, true);
+	reportCase(!downloader.fetchManifest(refused), "manifest changed after signing refused", failures);
+	state.manifestReply = signManifest(fields, false);
+
+	UpdateDownloader wrongKey;
+	wrongKey.setServer(gameServer.getAddress());
+	wrongKey.setKeyPath(otherKeyPath);
+	reportCase(!wrongKey.fetchManifest(refused), "manifest checked against the wrong key refused", failures);
+
+	network.setGameServer(gameServer.getAddress());
+	network.setUpdateKey(keyPath);
+	UPDATE_RESULT result = network.downloadUpdate("20991231-J-02");
+	reportCase(result == UPDATE_FAILED && state.requests == 0, "manifest for another version refused before downloading", failures);
+
+	// Replies cut off part way carry on from the last byte received
+	state.dropEvery = 5;
+	bool downloaded = downloader.download(manifest, destination);
+	reportCase(downloaded && hashFile(destination) == payloadHash && state.dropped > 0 && state.served <= UPDATE_CHECK_SIZE + UPDATE_CHECK_CHUNK_SIZE,
+		"download survived " + to_string(state.dropped) + " cut-off replies (" + to_string(state.served) + " bytes served)", failures);
+	state.dropEvery = 0;
+	filesystem::remove(destination, error);
+
+	// Stopped part way, then carried on by a new downloader as after a restart
+	UpdateDownloader stopped;
+	stopped.setServer(gameServer.getAddress());
+	uint64_t written = 0;
+	stopped.setThrottle([&written](size_t bytes) {
+		written += bytes;
+		return written < UPDATE_CHECK_SIZE / 3;
+	});
+	bool stoppedFinished = stopped.download(manifest, destination);
+	uint64_t kept = filesystem::file_size(destination + ".part", error);
+
+	UpdateDownloader restarted;
+	restarted.setServer(gameServer.getAddress());
+	state.served = 0;
+	downloaded = restarted.download(manifest, destination);
+	UpdateDownloader::Progress progress = restarted.getProgress();
+	reportCase(!stoppedFinished && kept > 0 && downloaded && progress.resumedFrom == kept && hashFile(destination) == payloadHash
+		&& state.served <= UPDATE_CHECK_SIZE - kept + UPDATE_CHECK_CHUNK_SIZE,
+		"restart carried on from " + to_string(kept) + " bytes (" + to_string(state.served) + " bytes served after)", failures);
+	filesystem::remove(destination, error);
+
+	// A damaged chunk is caught by its hash and asked for again
+	UpdateDownloader damagedChunk;
+	damagedChunk.setServer(gameServer.getAddress());
+	state.corruptOffset = 5 * UPDATE_CHECK_CHUNK_SIZE + 100;
+	state.corruptOnce = true;
+	state.corrupted = 0;
+	downloaded = damagedChunk.download(manifest, destination);
+	reportCase(downloaded && state.corrupted == 1 && hashFile(destination) == payloadHash, "damaged chunk caught and downloaded again", failures);
+	filesystem::remove(destination, error);
+
+	// Without chunk hashes damage is only caught at the end, and nothing is kept
+	UpdateDownloader damagedFile;
+	damagedFile.setServer(gameServer.getAddress());
+	UpdateDownloader::Manifest unchunked = manifest;
+	unchunked.chunks.clear();
+	state.corruptOffset = 7 * UPDATE_CHECK_CHUNK_SIZE + 100;
+	state.corruptOnce = false;
+	downloaded = damagedFile.download(unchunked, destination);
+	reportCase(!downloaded && !filesystem::exists(destination, error) && !filesystem::exists(destination + ".part", error),
+		"damaged update refused and discarded", failures);
+
+	gameServer.stop();
+	filesystem::remove_all(folder, error);
+	return failures;
+}
@@ -0,0 +1,613 @@
+#include <cmath>
+#include <fstream>
+
+#include "JudgementEngine.h"
+#include "Tracer.h"
+
+void tokenize2(std::string const& str, const char delim, std::vector<std::string>& out);
+
+/**
+ * Default constructor.
+ *
+ */
+JudgementEngine::JudgementEngine() {
+	this->speed = 0;
+	this->distance = 0.f;
+	this->totalNotes = 0;
+
+	this->score = 0.f;
+	this->perfectNoteScore = 0.f;
+	this->nearNoteScore = 0.f;
+	this->perfectCount = 0;
+	this->nearCount = 0;
+	this->missCount = 0;
+
+	this->wheelMovement = 0;
+	this->wheelReset = false;
+	this->judged = false;
+	this->lastJudgement = JUDGEMENT::MISS;
+	this->judgedButton = 0;
+	this->judgedCapture = 0;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+JudgementEngine::~JudgementEngine() {
+
+}
+
+/**
+ * Read in a chart and reset all scoring for a new play.
+ *
+ * @param songPath Path of the song
+ * @param diffNumber Difficulty of the song
+ * @param speed Note speed the song starts at
+ * @return true if every lane and the wheel were read
+ */
+bool JudgementEngine::loadChart(string songPath, int diffNumber, int speed) {
+	TraceScope trace("Parse chart", "load", songPath.c_str());
+	bool loaded = true;
+
+	for (int i = 0; i < LANE_COUNT; i++) {
+		this->lanes[i].clear();
+		loaded &= parseInNotes(this->lanes[i], i + 1, songPath, diffNumber, speed);
+	}
+	this->wheel.clear();
+	loaded &= parseInWheel(this->wheel, songPath, diffNumber, speed);
+
+	// Calculate the total notes by adding each lane together
+	this->totalNotes = 0;
+	for (int i = 0; i < LANE_COUNT; i++) {
+		for (size_t j = 0; j < this->lanes[i].size(); j++) {
+			if (this->lanes[i][j].isHold()) {
+				this->totalNotes += this->lanes[i][j].getHoldNoteQuantity();
+			}
+			else {
+				this->totalNotes += 1;
+			}
+		}
+	}
+	for (size_t i = 0; i < this->wheel.size(); i++) {
+		if (this->wheel[i].isSlam()) {
+			this->totalNotes += 1;
+		}
+		else {
+			this->totalNotes += this->wheel[i].getNoteQuantity();
+		}
+	}
+
+	// Calculate the value that each note is worth based on the total notes
+	this->perfectNoteScore = 1000000.f / (float)this->totalNotes;
+	this->nearNoteScore = this->perfectNoteScore / 2.f;
+
+	this->speed = speed;
+	this->distance = calculateScreenTime(speed);
+
+	this->score = 0.f;
+	this->perfectCount = 0;
+	this->nearCount = 0;
+	this->missCount = 0;
+	this->judged = false;
+	this->wheelReset = false;
+
+	return loaded;
+}
+
+/**
+ * Run the judgement for one frame.
+ *
+ * @param input everything read from the controller this frame
+ */
+void JudgementEngine::step(const FrameInput& input) {
+	this->judged = false;
+	this->wheelReset = false;
+	this->wheelMovement = input.wheelMovement;
+	this->judgedButton = 0;
+	this->judgedCapture = 0;
+
+	// Handle an input that was pulled off the queue
+	if (input.button >= 1 && input.button <= LANE_COUNT) {
+		handleButton(input.button, input.songOffset);
+
+		// Nothing else has been judged yet this frame, so a judgement now came from this press
+		if (this->judged) {
+			this->judgedButton = input.button;
+			this->judgedCapture = input.captureMicros;
+		}
+	}
+
+	// Handle the remaining parts of the hold notes next
+	for (int laneNum = 1; laneNum <= LANE_COUNT; laneNum++) {
+		handleHold(laneNum, input.songOffset, (input.heldMask & (1 << (laneNum - 1))) != 0);
+	}
+
+	// Wheel Input
+	handleWheel(input.songOffset);
+
+	// Delete notes if too far
+	removePassedNotes(input.songOffset);
+
+	// Update where every note is for the next frame's hit checks
+	positionNotes(input.songOffset);
+
+	// Handle speed change
+	if (input.speed != this->speed) {
+		changeSpeed(input.speed);
+	}
+}
+
+/**
+ * Record a judgement for this frame.
+ *
+ * @param judgement the judgement that was made
+ */
+void JudgementEngine::judge(JUDGEMENT judgement) {
+	this->judged = true;
+	this->lastJudgement = judgement;
+}
+
+/**
+ * Reset the last wheel position so later checks this frame see no movement.
+ *
+ */
+void JudgementEngine::resetWheel() {
+	this->wheelMovement = 0;
+	this->wheelReset = true;
+}
+
+/**
+ * Judge a button press against the front note of its lane.
+ *
+ * @param laneNum the lane the button belongs to
+ * @param songOffset current time in the song
+ */
+void JudgementEngine::handleButton(int laneNum, int64_t songOffset) {
+	vector<Note>& lane = this->lanes[laneNum - 1];
+
+	// Note (not hold)
+	if (!lane.empty() && !lane[0].isHold() && lane[0].getYPos() + MISS_WINDOW >= DISTANCE_TO_PERFECT) {
+		float dist = lane[0].perfectTime - songOffset;
+
+		if (dist <= PERFECT_WINDOW && dist >= -PERFECT_WINDOW) {
+			// Perfect hit window
+			this->score += this->perfectNoteScore;
+			this->perfectCount++;
+
+			judge(JUDGEMENT::PERFECT_HIT);
+
+			// Remove note
+			lane.erase(lane.begin());
+		}
+		else if (dist <= NEAR_WINDOW && dist >= -NEAR_WINDOW) {
+			// Near hit window
+			this->score += this->nearNoteScore;
+			this->nearCount++;
+
+			judge(JUDGEMENT::NEAR_HIT);
+
+			// Remove note
+			lane.erase(lane.begin());
+		}
+		else if (dist <= MISS_WINDOW) {
+			// Miss window
+			this->missCount++;
+
+			judge(JUDGEMENT::MISS);
+
+			// Remove note
+			lane.erase(lane.begin());
+		}
+	}
+	else if (!lane.empty() && lane[0].isHold()) { // Hold Note
+		float dist = lane[0].perfectTime - songOffset;
+
+		if (dist >= 0) { // Hold hasn't started yet
+			if (dist <= NEAR_WINDOW) { // Inside window to start hold
+				this->score += this->perfectNoteScore;
+				this->perfectCount++;
+
+				// Lane 5 has always bumped the note value here, keep it so existing scores still match
+				if (laneNum == 5) {
+					this->perfectNoteScore++;
+				}
+
+				judge(JUDGEMENT::PERFECT_HIT);
+
+				lane[0].subtractHold();
+				lane[0].setHitHold(true);
+			}
+			else if (dist <= MISS_WINDOW) { // Miss window to start hold
+				this->missCount++;
+
+				judge(JUDGEMENT::MISS);
+
+				lane[0].subtractHold();
+				lane[0].setHitHold(false);
+			}
+		}
+	}
+}
+
+/**
+ * Score the hold ticks of the front note of a lane and track if it is held.
+ *
+ * @param laneNum the lane to check
+ * @param songOffset current time in the song
+ * @param held if the lane's button is down
+ */
+void JudgementEngine::handleHold(int laneNum, int64_t songOffset, bool held) {
+	vector<Note>& lane = this->lanes[laneNum - 1];
+
+	if (lane.empty() || !lane[0].isHold()) {
+		return;
+	}
+
+	float dist = lane[0].perfectTime - songOffset;
+	if (!(lane[0].getHoldNotesRemaining() <= 0)) { // Check if the hold has any notes remaining
+		// Now that we know there are notes remaining
+		// Check if holding or dropped
+
+		float nextNote = lane[0].perfectTime + (lane[0].getHoldNoteDistance() * (float)lane[0].getHoldNotesUsed());
+		float pastDist = nextNote - songOffset;
+
+		if (dist < 0 && lane[0].didHitHold()) { // Hold has started, and holding
+			if (pastDist <= 0) {
+				this->score += this->perfectNoteScore;
+				this->perfectCount++;
+
+				judge(JUDGEMENT::PERFECT_HIT);
+
+				lane[0].subtractHold();
+			}
+		}
+		else if (dist < 0 && !lane[0].didHitHold()) { // Hold has started, and not holding
+			if (pastDist <= 0) {
+				this->missCount++;
+
+				judge(JUDGEMENT::MISS);
+
+				lane[0].subtractHold();
+			}
+		}
+
+		// Update hold status
+		if (songOffset > lane[0].perfectTime && songOffset <= lane[0].getEndTime()) {
+			if (held) { // Button Pressed
+				if (!lane[0].didHitHold()) {
+					lane[0].setHitHold(true);
+				}
+			}
+			else { // Button Released
+				if (lane[0].didHitHold()) {
+					lane[0].setHitHold(false);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Judge the front wheel note against the wheel movement.
+ *
+ * @param songOffset current time in the song
+ */
+void JudgementEngine::handleWheel(int64_t songOffset) {
+	if (this->wheel.empty()) {
+		return;
+	}
+
+	float dist = this->wheel[0].perfectTime - songOffset;
+	if (this->wheel[0].isSlam()) { // Slam Notes
+		// If note is within range
+		if (dist <= SLAM_RANGE && dist >= -SLAM_RANGE) {
+			int direction = this->wheel[0].getDirection();
+			if (direction == 1 || direction == -1) {
+				if (this->wheelMovement == direction) {
+					this->score += this->perfectNoteScore;
+					this->perfectCount++;
+
+					judge(JUDGEMENT::PERFECT_HIT);
+				}
+				else {
+					this->missCount++;
+
+					judge(JUDGEMENT::MISS);
+				}
+
+				// Remove Note
+				this->wheel.erase(this->wheel.begin());
+
+				// If there are no more wheel notes on screen, reset the last wheel position
+				if (this->wheel.empty()) {
+					resetWheel();
+				}
+			}
+		}
+	}
+	else { // Continuous Notes
+		if (!(this->wheel[0].getHoldNotesRemaining() <= 0)) {
+			if (dist < 0) {
+				float nextNote = this->wheel[0].perfectTime + (this->wheel[0].getHoldNoteDistance() * (float)this->wheel[0].getHoldNotesUsed());
+				float pastDist = nextNote - songOffset;
+
+				if (pastDist <= 0) {
+					if (this->wheel[0].getDirection() == this->wheelMovement) {
+						this->score += this->perfectNoteScore;
+						this->perfectCount++;
+
+						judge(JUDGEMENT::PERFECT_HIT);
+
+						this->wheel[0].subtractHold();
+					}
+					else {
+						this->missCount++;
+
+						judge(JUDGEMENT::MISS);
+
+						this->wheel[0].subtractHold();
+					}
+
+					// Reset the last wheel position before the next note check
+					resetWheel();
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Remove notes that have scrolled past the miss window.
+ *
+ * @param songOffset current time in the song
+ */
+void JudgementEngine::removePassedNotes(int64_t songOffset) {
+	for (int i = 0; i < LANE_COUNT; i++) {
+		vector<Note>& lane = this->lanes[i];
+
+		// Note
+		while (!lane.empty() && !lane[0].isHold() && lane[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && songOffset > lane[0].getEndTime() + MISS_WINDOW) {
+			this->missCount++;
+
+			judge(JUDGEMENT::MISS);
+
+			lane.erase(lane.begin());
+		}
+
+		// Hold
+		while (!lane.empty() && lane[0].isHold() && lane[0].getYPos() > DISTANCE_TO_PERFECT + MISS_WINDOW && songOffset > lane[0].getEndTime() + MISS_WINDOW) {
+			// Don't need to apply a miss as the holds miss are taken care of elsewhere
+
+			lane.erase(lane.begin());
+		}
+	}
+
+	// Wheel Continuous
+	while (!this->wheel.empty() && !this->wheel[0].isSlam() && songOffset > this->wheel[0].getEndTime()) {
+		// Don't need to apply a miss as the miss is taken care of elsewhere
+
+		this->wheel.erase(this->wheel.begin());
+
+		// Reset controller last
+		resetWheel();
+	}
+
+	// Wheel slams are taken care of in the input section
+}
+
+/**
+ * Store where each visible note is on screen for the hit checks.
+ *
+ * @param songOffset current time in the song
+ */
+void JudgementEngine::positionNotes(int64_t songOffset) {
+	for (int i = 0; i < LANE_COUNT; i++) {
+		vector<Note>& lane = this->lanes[i];
+		for (size_t j = 0; j < lane.size(); j++) {
+			// Check if on screen yet
+			if (lane[j].appearTime <= ((float)songOffset)) {
+				lane[j].setYPos(1080.f - (DISTANCE_TO_PERFECT * ((songOffset - lane[j].appearTime) / this->distance)));
+			}
+		}
+	}
+}
+
+/**
+ * Update the screen time and the appear times of every note for a new speed.
+ *
+ * @param newSpeed the new note speed
+ */
+void JudgementEngine::changeSpeed(int newSpeed) {
+	this->speed = newSpeed;
+	this->distance = calculateScreenTime(newSpeed);
+
+	for (int i = 0; i < LANE_COUNT; i++) {
+		for (size_t j = 0; j < this->lanes[i].size(); j++) {
+			this->lanes[i][j].speedChangeAppearTime(newSpeed);
+		}
+	}
+	for (size_t i = 0; i < this->wheel.size(); i++) {
+		this->wheel[i].speedChangeAppearTime(newSpeed);
+	}
+}
+
+vector<Note>& JudgementEngine::getLane(int laneNum) {
+	return this->lanes[laneNum - 1];
+}
+
+vector<WheelNote>& JudgementEngine::getWheel() {
+	return this->wheel;
+}
+
+float JudgementEngine::getDistance() {
+	return this->distance;
+}
+
+int JudgementEngine::getTotalNotes() {
+	return this->totalNotes;
+}
+
+float JudgementEngine::getScore() {
+	return this->score;
+}
+
+int JudgementEngine::getPerfectCount() {
+	return this->perfectCount;
+}
+
+int JudgementEngine::getNearCount() {
+	return this->nearCount;
+}
+
+int JudgementEngine::getMissCount() {
+	return this->missCount;
+}
+
+/**
+ * Gets if anything was judged during the last frame.
+ *
+ * @return true if a judgement was made
+ */
+bool JudgementEngine::didJudge() {
+	return this->judged;
+}
+
+/**
+ * Gets the most recent judgement.
+ *
+ * @return the last judgement made
+ */
+JUDGEMENT JudgementEngine::getLastJudgement() {
+	return this->lastJudgement;
+}
+
+/**
+ * Gets if the controller's last wheel position should be reset after the last frame.
+ *
+ * @return true if the wheel was reset
+ */
+bool JudgementEngine::didResetWheel() {
+	return this->wheelReset;
+}
+
+/**
+ * Gets the button whose press was judged during the last frame.
+ *
+ * @return the button (1-5) or 0 if no press was judged
+ */
+int JudgementEngine::getJudgedButton() {
+	return this->judgedButton;
+}
+
+/**
+ * Gets when the press judged during the last frame was captured, so its
+ * latency can be followed to the screen.
+ *
+ * @return the capture time tagged on the input, or 0 if none
+ */
+int64_t JudgementEngine::getJudgedCapture() {
+	return this->judgedCapture;
+}
+
+/**
+ * Read in notes from a file.
+ *
+ * @param lane Lane vector to store the notes in
+ * @param laneNum Lane number to get the notes about
+ * @param songPath Path of the song
+ * @param diffNumber Difficulty of the song
+ * @param bpm BPM of the song
+ * @return true if the lane file was opened
+ */
+bool parseInNotes(vector<Note>& lane, int laneNum, string songPath, int diffNumber, int bpm) {
+	string fPath = songPath + "charts/" + to_string(diffNumber) + "/L" + to_string(laneNum) + ".txt";
+	TraceScope trace("Parse lane", "load", fPath.c_str());
+	ifstream inputFile(fPath);
+
+	string line = "";
+	const char delim = ':';
+	if (!inputFile) {
+		return false;
+	}
+
+	while (inputFile >> line) {
+		std::vector<std::string> out;
+		tokenize2(line, delim, out);
+
+		bool hold = false;
+		if (out[1] == "1") {
+			hold = true;
+		}
+
+		Note temp(stof(out[0]), hold, stof(out[2]), stoi(out[3]), bpm);
+
+		lane.push_back(temp);
+	}
+	return true;
+}
+
+/**
+ * Read in the wheel notes from a file.
+ *
+ * @param wheel Wheel vector to store the notes in
+ * @param songPath Path of the song
+ * @param diffNumber Difficulty of the song
+ * @param bpm BPM of the song
+ * @return true if the wheel file was opened
+ */
+bool parseInWheel(vector<WheelNote>& wheel, string songPath, int diffNumber, int bpm) {
+	string fPath = songPath + "charts/" + to_string(diffNumber) + "/Wheel.txt";
+	TraceScope trace("Parse wheel", "load", fPath.c_str());
+	ifstream inputFile(fPath);
+
+	string line = "";
+	const char delim = ':';
+	if (!inputFile) {
+		return false;
+	}
+
+	while (inputFile >> line) {
+		std::vector<std::string> out;
+		tokenize2(line, delim, out);
+
+		bool slam = false;
+		if (out[1] == "1") {
+			slam = true;
+		}
+
+		WheelNote temp(stof(out[0]), slam, stoi(out[2]), stoi(out[3]), stoi(out[4]), stof(out[5]), stoi(out[6]), bpm);
+
+		wheel.push_back(temp);
+	}
+	return true;
+}
+
+/**
+ * Split the string based on the delim char.
+ *
+ * @param str Original String
+ * @param delim char to split based on
+ * @param out Vector string split into
+ */
+void tokenize2(std::string const& str, const char delim, std::vector<std::string>& out) {
+
+	size_t start;
+	size_t end = 0;
+
+	while ((start = str.find_first_not_of(delim, end)) != std::string::npos)
+	{
+		end = str.find(delim, start);
+		out.push_back(str.substr(start, end - start));
+	}
+}
+
+/**
+ * Calculate how long (in milliseconds) a note is on screen before the perfect line.
+ *
+ * @param speed the note speed
+ * @return the screen time
+ */
+float calculateScreenTime(int speed) {
+	return (float)(453075.9705 / pow(speed, 1.004140998));
+}
@@ -0,0 +1,110 @@
+/**
+ * @file JudgementEngine.h
+ *
+ * @brief Judgement Engine
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Note.h"
+#include "WheelNote.h"
+
+enum JUDGEMENT {
+	PERFECT_HIT,
+	NEAR_HIT,
+	MISS
+};
+
+// These only represent one side of the window
+const float PERFECT_WINDOW = 45.f;
+const float NEAR_WINDOW = 90.f;
+const float MISS_WINDOW = 135.f;
+const float SLAM_RANGE = 1.f;
+
+// Where the perfect line is on screen
+const float DISTANCE_TO_PERFECT = 921.f;
+
+// Number of button lanes
+const int LANE_COUNT = 5;
+
+/**
+ * Everything the judgement reads from the controller during one frame
+ */
+struct FrameInput {
+	int64_t songOffset;		// Milliseconds since the song started
+	int button;				// Button pressed this frame (1-5) or 0 for none
+	uint8_t heldMask;		// Bit (n - 1) set while button n is held
+	int wheelMovement;		// -1, 0 or 1
+	int speed;				// Note speed at the end of the frame
+	int64_t captureMicros;	// When the button was captured, or 0 if not tagged
+};
+
+/**
+ * Judges a chart against frame by frame input. Has no window, audio or
+ * OpenGL dependencies so plays can be re-simulated headless.
+ */
+class JudgementEngine {
+
+	private:
+		vector<Note> lanes[LANE_COUNT];
+		vector<WheelNote> wheel;
+
+		int speed;
+		float distance;
+		int totalNotes;
+
+		float score;
+		float perfectNoteScore;
+		float nearNoteScore;
+		int perfectCount;
+		int nearCount;
+		int missCount;
+
+		// Per frame outputs
+		int wheelMovement;
+		bool wheelReset;
+		bool judged;
+		JUDGEMENT lastJudgement;
+		int judgedButton;
+		int64_t judgedCapture;
+
+		void judge(JUDGEMENT judgement);
+		void resetWheel();
+		void handleButton(int laneNum, int64_t songOffset);
+		void handleHold(int laneNum, int64_t songOffset, bool held);
+		void handleWheel(int64_t songOffset);
+		void removePassedNotes(int64_t songOffset);
+		void positionNotes(int64_t songOffset);
+		void changeSpeed(int newSpeed);
+
+	public:
+		JudgementEngine();
+		~JudgementEngine();
+		bool loadChart(string songPath, int diffNumber, int speed);
+		void step(const FrameInput& input);
+
+		vector<Note>& getLane(int laneNum);
+		vector<WheelNote>& getWheel();
+		float getDistance();
+		int getTotalNotes();
+
+		float getScore();
+		int getPerfectCount();
+		int getNearCount();
+		int getMissCount();
+
+		bool didJudge();
+		JUDGEMENT getLastJudgement();
+		bool didResetWheel();
+		int getJudgedButton();
+		int64_t getJudgedCapture();
+};
+
+bool parseInNotes(vector<Note>& lane, int laneNum, string songPath, int diffNumber, int bpm);
+bool parseInWheel(vector<WheelNote>& wheel, string songPath, int diffNumber, int bpm);
+float calculateScreenTime(int speed);
@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+
+#include <windows.h>
+
+#include "LatencyMonitor.h"
+#include "Logger.h"
+#include "Networking.h"
+
+LatencyMonitor latencyMonitor;
+
+// Characters used to draw each histogram bucket, from empty to the fullest bucket
+const char HISTOGRAM_LEVELS[] = " .:-=+*#";
+
+/**
+ * Default constructor.
+ *
+ */
+LatencyMonitor::LatencyMonitor() {
+	this->songID = -1;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+LatencyMonitor::~LatencyMonitor() {
+
+}
+
+/**
+ * Set the song the next samples come from.
+ *
+ * @param id ID of the song being played
+ */
+void LatencyMonitor::setSong(int id) {
+	lock_guard<mutex> lock(this->samplesLock);
+	this->songID = id;
+	this->pending.clear();
+}
+
+/**
+ * A button press was just judged and its result will be drawn this frame.
+ *
+ * @param button the button that was pressed (1-5)
+ * @param captureMicros when the press was captured
+ */
+void LatencyMonitor::judged(int button, int64_t captureMicros) {
+	if (captureMicros <= 0) {
+		return;
+	}
+
+	lock_guard<mutex> lock(this->samplesLock);
+	this->pending.push_back({ button, captureMicros, nowMicros(), 0 });
+}
+
+/**
+ * The frame is about to be submitted.
+ *
+ */
+void LatencyMonitor::submitted() {
+	lock_guard<mutex> lock(this->samplesLock);
+	int64_t now = nowMicros();
+	for (size_t i = 0; i < this->pending.size(); i++) {
+		this->pending[i].submitMicros = now;
+	}
+}
+
+/**
+ * The swap returned, so every press judged this frame is complete.
+ *
+ */
+void LatencyMonitor::swapped() {
+	lock_guard<mutex> lock(this->samplesLock);
+	if (this->pending.empty()) {
+		return;
+	}
+
+	int64_t now = nowMicros();
+	for (size_t i = 0; i < this->pending.size(); i++) {
+		const Pending& p = this->pending[i];
+		if (p.submitMicros == 0) {
+			continue;
+		}
+
+		Sample sample;
+		sample.button = p.button;
+		sample.songID = this->songID;
+		sample.captureToJudgeMs = (p.judgeMicros - p.captureMicros) / 1000.f;
+		sample.judgeToSubmitMs = (p.submitMicros - p.judgeMicros) / 1000.f;
+		sample.submitToSwapMs = (now - p.submitMicros) / 1000.f;
+		this->samples.push_back(sample);
+	}
+	this->pending.clear();
+}
+
+/**
+ * Summarize the total latency of one button.
+ *
+ * @param button the button (1-5)
+ * @return the percentiles and histogram of that button
+ */
+LatencyMonitor::ButtonSummary LatencyMonitor::summarizeButton(int button) {
+	ButtonSummary summary = {};
+
+	vector<float> totals;
+	{
+		lock_guard<mutex> lock(this->samplesLock);
+		for (size_t i = 0; i < this->samples.size(); i++) {
+			const Sample& s = this->samples[i];
+			if (s.button == button) {
+				totals.push_back(s.captureToJudgeMs + s.judgeToSubmitMs + s.submitToSwapMs);
+			}
+		}
+	}
+
+	summary.count = totals.size();
+	for (size_t i = 0; i < totals.size(); i++) {
+		int bucket = (int)(totals[i] / LATENCY_BUCKET_MS);
+		if (bucket >= LATENCY_BUCKETS) {
+			bucket = LATENCY_BUCKETS - 1;
+		}
+		summary.histogram[bucket]++;
+	}
+	summary.p50Ms = percentile(totals, 50);
+	summary.p99Ms = percentile(totals, 99);
+
+	return summary;
+}
+
+/**
+ * Summarize each stage of the latency over every button.
+ *
+ * @param averages average of capture to judge, judge to submit and submit to swap
+ * @param p99s 99th percentile of each stage
+ */
+void LatencyMonitor::summarizeStages(float averages[3], float p99s[3]) {
+	vector<float> stages[3];
+	{
+		lock_guard<mutex> lock(this->samplesLock);
+		for (size_t i = 0; i < this->samples.size(); i++) {
+			stages[0].push_back(this->samples[i].captureToJudgeMs);
+			stages[1].push_back(this->samples[i].judgeToSubmitMs);
+			stages[2].push_back(this->samples[i].submitToSwapMs);
+		}
+	}
+
+	for (int stage = 0; stage < 3; stage++) {
+		double total = 0.0;
+		for (size_t i = 0; i < stages[stage].size(); i++) {
+			total += stages[stage][i];
+		}
+		averages[stage] = stages[stage].empty() ? 0.f : (float)(total / stages[stage].size());
+		p99s[stage] = percentile(stages[stage], 99);
+	}
+}
+
+/**
+ * Gets how many presses have been measured.
+ *
+ * @return the number of samples
+ */
+size_t LatencyMonitor::getSampleCount() {
+	lock_guard<mutex> lock(this->samplesLock);
+	return this->samples.size();
+}
+
+/**
+ * Write every sample of this session to a CSV file in the Latency folder,
+ * tagged with the build and cabinet so files from different machines can be compared.
+ *
+ * @return true if the file was written
+ */
+bool LatencyMonitor::exportSamples() {
+	lock_guard<mutex> lock(this->samplesLock);
+
+	// One file per session, rewritten as samples are added
+	if (this->sessionStamp.empty()) {
+		char timeStamp[32];
+		time_t now = time(NULL);
+		tm local = {};
+		localtime_s(&local, &now);
+		strftime(timeStamp, sizeof(timeStamp), "%Y%m%d-%H%M%S", &local);
+		this->sessionStamp = timeStamp;
+	}
+
+	char computerName[MAX_COMPUTERNAME_LENGTH + 1] = {};
+	DWORD nameLength = sizeof(computerName);
+	if (!GetComputerNameA(computerName, &nameLength)) {
+		computerName[0] = '\0';
+	}
+	string build = network.getLocalVersion();
+
+	filesystem::create_directories("Latency");
+	string exportPath = "Latency/latency_" + this->sessionStamp + ".csv";
+
+	ofstream csv(exportPath, ios::out | ios::trunc);
+	if (!csv.is_open()) {
+		logger.logError("Failed to write latency samples to ", exportPath);
+		return false;
+	}
+
+	csv << "build,cabinet,song_id,button,capture_to_judge_ms,judge_to_submit_ms,submit_to_swap_ms,total_ms\n";
+	csv << std::fixed << std::setprecision(3);
+	for (size_t i = 0; i < this->samples.size(); i++) {
+		const Sample& s = this->samples[i];
+		csv << build << "," << computerName << "," << s.songID << "," << s.button << ","
+			<< s.captureToJudgeMs << "," << s.judgeToSubmitMs << "," << s.submitToSwapMs << ","
+			<< (s.captureToJudgeMs + s.judgeToSubmitMs + s.submitToSwapMs) << "\n";
+	}
+	csv.close();
+
+	logger.log("Latency samples written to ", exportPath);
+	return true;
+}
+
+/**
+ * Get a percentile of some values.
+ *
+ * @param values the values (they are sorted in place)
+ * @param percent the percentile to find (0-100)
+ * @return the percentile or 0 if there are no values
+ */
+float LatencyMonitor::percentile(vector<float>& values, int percent) {
+	if (values.empty()) {
+		return 0.f;
+	}
+	sort(values.begin(), values.end());
+	return values[(values.size() - 1) * percent / 100];
+}
+
+/**
+ * Draw a histogram as one line of text, one character per bucket.
+ *
+ * @param summary the summary of a button
+ * @return the histogram
+ */
+string LatencyMonitor::getHistogramString(const ButtonSummary& summary) {
+	uint32_t fullest = 0;
+	for (int b = 0; b < LATENCY_BUCKETS; b++) {
+		if (summary.histogram[b] > fullest) {
+			fullest = summary.histogram[b];
+		}
+	}
+
+	const int levels = (int)sizeof(HISTOGRAM_LEVELS) - 2;
+	string line = "[";
+	for (int b = 0; b < LATENCY_BUCKETS; b++) {
+		int level = 0;
+		if (fullest > 0 && summary.histogram[b] > 0) {
+			// Any bucket with samples shows at least the first mark
+			level = 1 + (int)((levels - 1) * (uint64_t)summary.histogram[b] / fullest);
+		}
+		line += HISTOGRAM_LEVELS[level];
+	}
+	line += "]";
+
+	return line;
+}
+
+/**
+ * Gets a microsecond timestamp on the same clock input is captured with.
+ *
+ * @return microseconds since an arbitrary point
+ */
+int64_t LatencyMonitor::nowMicros() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
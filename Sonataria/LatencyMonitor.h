@@ -0,0 +1,88 @@
+/**
+ * @file LatencyMonitor.h
+ *
+ * @brief Latency Monitor
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Histogram buckets for the total latency of a button
+#define LATENCY_BUCKETS 16
+
+// Width of each histogram bucket in milliseconds
+#define LATENCY_BUCKET_MS 2.f
+
+/**
+ * Measures how long it takes from a button being captured to its judgement
+ * reaching the screen, split into capture to judge, judge to submit and
+ * submit to swap return
+ */
+class LatencyMonitor {
+
+	public:
+		/**
+		 * One button press followed from capture to the screen
+		 */
+		struct Sample {
+			int button;
+			int songID;
+			float captureToJudgeMs;
+			float judgeToSubmitMs;
+			float submitToSwapMs;
+		};
+
+		/**
+		 * Percentiles and histogram of the samples of one button
+		 */
+		struct ButtonSummary {
+			size_t count;
+			float p50Ms;
+			float p99Ms;
+			uint32_t histogram[LATENCY_BUCKETS];
+		};
+
+	private:
+		/**
+		 * A judged press waiting for its frame to be presented
+		 */
+		struct Pending {
+			int button;
+			int64_t captureMicros;
+			int64_t judgeMicros;
+			int64_t submitMicros;
+		};
+
+		mutex samplesLock;
+		vector<Sample> samples;
+		vector<Pending> pending;
+		int songID;
+
+		string sessionStamp;
+
+		static float percentile(vector<float>& values, int percent);
+
+	public:
+		LatencyMonitor();
+		~LatencyMonitor();
+
+		void setSong(int);
+		void judged(int button, int64_t captureMicros);
+		void submitted();
+		void swapped();
+
+		ButtonSummary summarizeButton(int button);
+		void summarizeStages(float averages[3], float p99s[3]);
+		size_t getSampleCount();
+		bool exportSamples();
+
+		static string getHistogramString(const ButtonSummary& summary);
+		static int64_t nowMicros();
+};
+
+extern LatencyMonitor latencyMonitor;
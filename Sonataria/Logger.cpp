@@ -1,19 +1,491 @@
 #include "Logger.h"
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#ifdef _WIN32
 #include <io.h>
+#endif
 #include <fcntl.h>
 #include <locale.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
 #include <wincon.h>
+#endif
 using namespace std;
 
 Logger logger;
 
+// Messages below this level are skipped before they are built
+atomic<int> Logger::minLevel(LOG_INFO);
+
+// Messages waiting to be written (must be a power of two)
+const size_t LOG_RING_SIZE = 4096;
+
+// How often the writer checks for new messages when nothing wakes it
+const int WRITER_POLL_MS = 10;
+
+// Defaults for the rotating log file
+const char* DEFAULT_LOG_PATH = "Logs/sonataria.log";
+const size_t DEFAULT_LOG_MAX_BYTES = 5 * 1024 * 1024;
+const int DEFAULT_LOG_KEEP_FILES = 5;
+
+/**
+ * Gets the OS's ID for the calling thread.
+ *
+ * @return the thread ID
+ */
+static uint32_t currentThreadId() {
+#ifdef _WIN32
+	return (uint32_t)GetCurrentThreadId();
+#else
+	return (uint32_t)syscall(SYS_gettid);
+#endif
+}
+
+/**
+ * One message in the ring. The sequence tells producers and the writer whose turn the slot is.
+ */
+struct LogEntry {
+	atomic<size_t> sequence;
+	LOG_LEVEL level;
+	int64_t timeMicros;
+	uint32_t threadId;
+	wstring text;
+};
+
+/**
+ * Bounded lock-free ring of messages, drained by a background thread into the
+ * log file and console. Created the first time anything is logged, so logging
+ * from other globals' constructors is safe.
+ */
+class LogSink {
+
+	private:
+		LogEntry entries[LOG_RING_SIZE];
+		atomic<size_t> enqueuePos;
+		atomic<size_t> dequeuePos;
+		atomic<uint64_t> dropped;
+
+		thread writer;
+		atomic<bool> stopping;
+		mutex wakeLock;
+		condition_variable wake;
+
+		// Output settings, changed rarely
+		mutex settingsLock;
+		atomic<bool> consoleEnabled;
+		string filePath;
+		size_t maxFileBytes;
+		int keepFiles;
+		bool reopenFile;
+
+		// Only touched by the writer thread
+		ofstream file;
+		size_t fileBytes;
+		string utf8Line;
+		uint64_t reportedDropped;
+		time_t cachedSecond;
+		char cachedDate[32];
+
+		LogSink();
+		~LogSink();
+
+		void run();
+		size_t drain();
+		void checkFileSettings();
+		void writeEntry(const LogEntry& entry);
+		void openFile();
+		void rotateFiles();
+
+	public:
+		static LogSink& get();
+		static atomic<bool> destroyed;
+
+		bool push(LOG_LEVEL level, const wstring& text);
+		void flush();
+		uint64_t getDroppedCount();
+
+		void setConsoleEnabled(bool enabled);
+		void setLogFile(string path, size_t maxBytes, int keepFiles);
+};
+
+atomic<bool> LogSink::destroyed(false);
+
+/**
+ * Gets the sink, creating it and its writer thread the first time.
+ *
+ * @return the sink
+ */
+LogSink& LogSink::get() {
+	static LogSink sink;
+	return sink;
+}
+
+/**
+ * Default constructor.
+ *
+ */
+LogSink::LogSink() {
+	for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+		this->entries[i].sequence.store(i, memory_order_relaxed);
+	}
+	this->enqueuePos = 0;
+	this->dequeuePos = 0;
+	this->dropped = 0;
+	this->stopping = false;
+
+	this->consoleEnabled = true;
+	this->filePath = DEFAULT_LOG_PATH;
+	this->maxFileBytes = DEFAULT_LOG_MAX_BYTES;
+	this->keepFiles = DEFAULT_LOG_KEEP_FILES;
+	this->reopenFile = true;
+	this->fileBytes = 0;
+	this->reportedDropped = 0;
+	this->cachedSecond = -1;
+	this->cachedDate[0] = '\0';
+
+	this->writer = thread(&LogSink::run, this);
+}
+
+/**
+ * Default deconstructor. Writes out anything still queued.
+ *
+ */
+LogSink::~LogSink() {
+	this->stopping = true;
+	this->wake.notify_one();
+	if (this->writer.joinable()) {
+		this->writer.join();
+	}
+	destroyed = true;
+}
+
+/**
+ * Queue a message. Never blocks; if the ring is full the message is dropped and counted.
+ *
+ * @param level the level of the message
+ * @param text the message
+ * @return true if the message was queued
+ */
+bool LogSink::push(LOG_LEVEL level, const wstring& text) {
+	size_t pos = this->enqueuePos.load(memory_order_relaxed);
+	LogEntry* entry = NULL;
+
+	// Claim a slot
+	for (;;) {
+		entry = &this->entries[pos & (LOG_RING_SIZE - 1)];
+		size_t sequence = entry->sequence.load(memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+		if (diff == 0) {
+			if (this->enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			// The writer hasn't freed this slot yet, so the ring is full
+			this->dropped.fetch_add(1, memory_order_relaxed);
+			return false;
+		}
+		else {
+			pos = this->enqueuePos.load(memory_order_relaxed);
+		}
+	}
+
+	// The slot's string keeps its capacity between uses, so this rarely allocates
+	entry->level = level;
+	entry->timeMicros = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+	entry->threadId = currentThreadId();
+	entry->text.assign(text);
+	entry->sequence.store(pos + 1, memory_order_release);
+
+	// Warnings are written right away, everything else waits for the next poll
+	if (level >= LOG_WARN) {
+		this->wake.notify_one();
+	}
+	return true;
+}
+
+/**
+ * Wait until everything queued so far has been written.
+ *
+ */
+void LogSink::flush() {
+	size_t target = this->enqueuePos.load(memory_order_acquire);
+	this->wake.notify_one();
+
+	// Give up after a second rather than hang if the writer is stuck
+	for (int waited = 0; waited < 1000 && this->dequeuePos.load(memory_order_acquire) < target; waited++) {
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+}
+
+uint64_t LogSink::getDroppedCount() {
+	return this->dropped.load(memory_order_relaxed);
+}
+
+/**
+ * Turn writing to the console on or off.
+ *
+ * @param enabled true to write to the console
+ */
+void LogSink::setConsoleEnabled(bool enabled) {
+	this->consoleEnabled = enabled;
+}
+
+/**
+ * Change the log file (takes effect before the next message is written).
+ *
+ * @param path path of the log file, older files get .1, .2, ... added
+ * @param maxBytes size at which the file is rotated
+ * @param keep number of old files to keep
+ */
+void LogSink::setLogFile(string path, size_t maxBytes, int keep) {
+	lock_guard<mutex> lock(this->settingsLock);
+	this->filePath = path;
+	this->maxFileBytes = maxBytes;
+	this->keepFiles = keep < 0 ? 0 : keep;
+	this->reopenFile = true;
+}
+
+/**
+ * Writer thread, drains the ring until the sink is destroyed.
+ *
+ */
+void LogSink::run() {
+	while (!this->stopping) {
+		if (drain() == 0) {
+			unique_lock<mutex> lock(this->wakeLock);
+			this->wake.wait_for(lock, chrono::milliseconds(WRITER_POLL_MS));
+		}
+	}
+
+	// Write whatever was queued before shutting down
+	drain();
+}
+
+/**
+ * Write every message that is ready.
+ *
+ * @return the number of messages written
+ */
+size_t LogSink::drain() {
+	size_t written = 0;
+	bool wroteConsole = false;
+
+	for (;;) {
+		size_t pos = this->dequeuePos.load(memory_order_relaxed);
+		LogEntry& entry = this->entries[pos & (LOG_RING_SIZE - 1)];
+
+		// Stop at a slot that hasn't been filled in yet
+		if (entry.sequence.load(memory_order_acquire) != pos + 1) {
+			break;
+		}
+
+		// The file is only opened once there is something to write
+		if (written == 0) {
+			checkFileSettings();
+		}
+
+		writeEntry(entry);
+		wroteConsole |= this->consoleEnabled;
+
+		// Hand the slot back to the producers
+		entry.sequence.store(pos + LOG_RING_SIZE, memory_order_release);
+		this->dequeuePos.store(pos + 1, memory_order_release);
+		written++;
+	}
+
+	// Report messages lost to a full ring
+	uint64_t droppedNow = this->dropped.load(memory_order_relaxed);
+	if (droppedNow != this->reportedDropped) {
+		LogEntry notice;
+		notice.level = LOG_WARN;
+		notice.timeMicros = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+		notice.threadId = currentThreadId();
+		notice.text = to_wstring(droppedNow - this->reportedDropped) + L" log messages dropped (queue full)";
+		writeEntry(notice);
+		this->reportedDropped = droppedNow;
+		written++;
+	}
+
+	// One flush per batch instead of one per line
+	if (written > 0) {
+		if (this->file.is_open()) {
+			this->file.flush();
+		}
+		if (wroteConsole) {
+			wcout.flush();
+			wcerr.flush();
+		}
+	}
+
+	return written;
+}
+
+/**
+ * Open the log file if it hasn't been yet or was changed.
+ *
+ */
+void LogSink::checkFileSettings() {
+	lock_guard<mutex> lock(this->settingsLock);
+	if (this->reopenFile) {
+		this->reopenFile = false;
+		openFile();
+	}
+}
+
+/**
+ * Write one message to the log file and console.
+ *
+ * @param entry the message
+ */
+void LogSink::writeEntry(const LogEntry& entry) {
+	const wchar_t* tag = L"[LOG]  | ";
+	const char* fileTag = "LOG ";
+	if (entry.level == LOG_WARN) {
+		tag = L"[WARN] | ";
+		fileTag = "WARN";
+	}
+	else if (entry.level == LOG_DEBUG) {
+		tag = L"[DBG]  | ";
+		fileTag = "DBG ";
+	}
+
+	if (this->consoleEnabled) {
+		if (entry.level == LOG_WARN) {
+			wcerr << tag << entry.text << L'\n';
+		}
+		else {
+			wcout << tag << entry.text << L'\n';
+		}
+	}
+
+	if (!this->file.is_open()) {
+		return;
+	}
+
+	// Timestamp (the date only changes once a second), level and thread
+	time_t seconds = (time_t)(entry.timeMicros / 1000000);
+	if (seconds != this->cachedSecond) {
+		tm local = {};
+#ifdef _WIN32
+		localtime_s(&local, &seconds);
+#else
+		localtime_r(&seconds, &local);
+#endif
+		strftime(this->cachedDate, sizeof(this->cachedDate), "%Y-%m-%d %H:%M:%S", &local);
+		this->cachedSecond = seconds;
+	}
+	char prefix[80];
+	snprintf(prefix, sizeof(prefix), "%s.%03d %s [%5u] ", this->cachedDate,
+		(int)((entry.timeMicros / 1000) % 1000), fileTag, entry.threadId);
+
+	// The file is UTF-8
+	this->utf8Line = prefix;
+#ifdef _WIN32
+	if (!entry.text.empty()) {
+		int length = WideCharToMultiByte(CP_UTF8, 0, entry.text.c_str(), (int)entry.text.size(), NULL, 0, NULL, NULL);
+		size_t start = this->utf8Line.size();
+		this->utf8Line.resize(start + length);
+		WideCharToMultiByte(CP_UTF8, 0, entry.text.c_str(), (int)entry.text.size(), &this->utf8Line[start], length, NULL, NULL);
+	}
+#else
+	// wchar_t holds whole code points outside Windows
+	for (size_t i = 0; i < entry.text.size(); i++) {
+		uint32_t c = (uint32_t)entry.text[i];
+		if (c < 0x80) {
+			this->utf8Line += (char)c;
+		}
+		else if (c < 0x800) {
+			this->utf8Line += (char)(0xC0 | (c >> 6));
+			this->utf8Line += (char)(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000) {
+			this->utf8Line += (char)(0xE0 | (c >> 12));
+			this->utf8Line += (char)(0x80 | ((c >> 6) & 0x3F));
+			this->utf8Line += (char)(0x80 | (c & 0x3F));
+		}
+		else {
+			this->utf8Line += (char)(0xF0 | (c >> 18));
+			this->utf8Line += (char)(0x80 | ((c >> 12) & 0x3F));
+			this->utf8Line += (char)(0x80 | ((c >> 6) & 0x3F));
+			this->utf8Line += (char)(0x80 | (c & 0x3F));
+		}
+	}
+#endif
+	this->utf8Line += '\n';
+
+	if (this->maxFileBytes > 0 && this->fileBytes + this->utf8Line.size() > this->maxFileBytes) {
+		lock_guard<mutex> lock(this->settingsLock);
+		rotateFiles();
+	}
+
+	this->file.write(this->utf8Line.data(), this->utf8Line.size());
+	this->fileBytes += this->utf8Line.size();
+}
+
+/**
+ * Start a fresh log file, moving the last one aside (settingsLock must be held).
+ *
+ */
+void LogSink::openFile() {
+	if (this->file.is_open()) {
+		this->file.close();
+	}
+	if (this->filePath.empty()) {
+		return;
+	}
+
+	rotateFiles();
+}
+
+/**
+ * Shift the old log files up by one, dropping the oldest, and open a new file (settingsLock must be held).
+ *
+ */
+void LogSink::rotateFiles() {
+	if (this->file.is_open()) {
+		this->file.close();
+	}
+
+	error_code error;
+	filesystem::path path(this->filePath);
+	if (path.has_parent_path()) {
+		filesystem::create_directories(path.parent_path(), error);
+	}
+
+	if (this->keepFiles > 0) {
+		filesystem::remove(this->filePath + "." + to_string(this->keepFiles), error);
+		for (int i = this->keepFiles - 1; i >= 1; i--) {
+			filesystem::rename(this->filePath + "." + to_string(i), this->filePath + "." + to_string(i + 1), error);
+		}
+		filesystem::rename(this->filePath, this->filePath + ".1", error);
+	}
+
+	this->file.open(this->filePath, ios::out | ios::trunc | ios::binary);
+	this->fileBytes = 0;
+}
+
 /**
  * Base constructor.  Handles console setup for japanese characters
- * 
+ *
  */
 Logger::Logger() {
+#ifdef _WIN32
     HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
 
     char* a = setlocale(LC_ALL, "japanese");
@@ -30,26 +502,222 @@ Logger::Logger() {
     std::copy(myFont, myFont + (sizeof(myFont) / sizeof(wchar_t)), fontInfo.FaceName);
 
     SetCurrentConsoleFontEx(hConsole, false, &fontInfo);
-
-	cached_content = L"";
+#endif
 }
 
 /**
  * Default deconstructor.
- * 
+ *
  */
 Logger::~Logger() {
+	flush();
+}
+
+/**
+ * Gets the calling thread's buffer for building messages (keeps its capacity between messages).
+ *
+ * @return the buffer
+ */
+wstring& Logger::stagingBuffer() {
+	static thread_local wstring buffer;
+	return buffer;
+}
+
+/**
+ * Hand a built message to the writer.
+ *
+ * @param level the level of the message
+ * @param message the message
+ */
+void Logger::submit(LOG_LEVEL level, wstring& message) {
+	// Anything logged while the program is exiting after the writer stopped is lost
+	if (LogSink::destroyed.load(memory_order_relaxed)) {
+		return;
+	}
+	LogSink::get().push(level, message);
+}
+
+void Logger::append(wstring& out, const wstring& content) {
+	out += content;
+}
+
+void Logger::append(wstring& out, const string& content) {
+	out.append(content.begin(), content.end());
+}
 
+void Logger::append(wstring& out, const wchar_t* content) {
+	if (content) {
+		out += content;
+	}
 }
 
-void Logger::log()
-{
-	wcout << L"[LOG]  | " << cached_content << endl;
-    cached_content = L"";
+void Logger::append(wstring& out, const char* content) {
+	if (content) {
+		while (*content) {
+			out += (wchar_t)(unsigned char)*content++;
+		}
+	}
 }
 
-void Logger::logError()
-{
-    wcerr << L"[WARN] | " << cached_content << endl;
-	cached_content = L"";
+/**
+ * Set the lowest level that is logged.
+ *
+ * @param level the level (LOG_OFF to log nothing)
+ */
+void Logger::setLevel(LOG_LEVEL level) {
+	minLevel.store(level, memory_order_relaxed);
+}
+
+LOG_LEVEL Logger::getLevel() {
+	return (LOG_LEVEL)minLevel.load(memory_order_relaxed);
+}
+
+/**
+ * Turn writing to the console on or off (the log file is always written).
+ *
+ * @param enabled true to write to the console
+ */
+void Logger::setConsoleEnabled(bool enabled) {
+	LogSink::get().setConsoleEnabled(enabled);
+}
+
+/**
+ * Change where the log file is written.
+ *
+ * @param path path of the log file (empty for no file)
+ * @param maxBytes size at which the file is rotated (0 to never rotate)
+ * @param keepFiles number of old files to keep
+ */
+void Logger::setLogFile(string path, size_t maxBytes, int keepFiles) {
+	LogSink::get().setLogFile(path, maxBytes, keepFiles);
+}
+
+/**
+ * Wait until every message logged so far has been written.
+ *
+ */
+void Logger::flush() {
+	if (!LogSink::destroyed.load(memory_order_relaxed)) {
+		LogSink::get().flush();
+	}
+}
+
+/**
+ * Gets how many messages were lost because the queue was full.
+ *
+ * @return the number of dropped messages
+ */
+uint64_t Logger::getDroppedCount() {
+	return LogSink::get().getDroppedCount();
+}
+
+/**
+ * Gets a level from its name.
+ *
+ * @param name debug, info, warn or off
+ * @return the level (LOG_INFO if the name isn't known)
+ */
+LOG_LEVEL Logger::getLevelFromName(string name) {
+	transform(name.begin(), name.end(), name.begin(), ::tolower);
+	if (name == "debug") {
+		return LOG_DEBUG;
+	}
+	else if (name == "warn") {
+		return LOG_WARN;
+	}
+	else if (name == "off") {
+		return LOG_OFF;
+	}
+	return LOG_INFO;
+}
+
+/**
+ * Print percentiles of how long each call took.
+ *
+ * @param name what was measured
+ * @param times nanoseconds of each call
+ */
+static void printCallTimes(const char* name, vector<int64_t>& times) {
+	sort(times.begin(), times.end());
+	printf("%-32s p50 %7lld ns   p99 %7lld ns   max %9lld ns\n", name,
+		(long long)times[times.size() / 2], (long long)times[(times.size() - 1) * 99 / 100], (long long)times.back());
+}
+
+/**
+ * Measure how long logging calls take on the calling thread, compared to writing
+ * each line synchronously like the old logger did.
+ * (Sonataria.exe --benchmark-log [calls])
+ *
+ * @param calls number of calls per test
+ * @return 0 on success
+ */
+int Logger::benchmark(int calls) {
+	typedef chrono::steady_clock Clock;
+	if (calls < 100) {
+		calls = 100;
+	}
+
+	logger.setConsoleEnabled(false);
+	logger.setLogFile("Logs/benchmark.log", DEFAULT_LOG_MAX_BYTES, 1);
+	logger.setLevel(LOG_INFO);
+
+	string songPath = "Songs/benchmark/";
+	vector<int64_t> times(calls);
+
+	// Disabled level, should only cost the level check
+	for (int i = 0; i < calls; i++) {
+		Clock::time_point start = Clock::now();
+		logger.logDebug(L"Benchmark debug message for ", songPath);
+		times[i] = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+	}
+	printCallTimes("disabled level (logDebug)", times);
+
+	// Enabled level, paced so the writer keeps up
+	for (int i = 0; i < calls; i++) {
+		Clock::time_point start = Clock::now();
+		logger.log(L"Benchmark message for ", songPath);
+		times[i] = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+		if (i % 256 == 255) {
+			logger.flush();
+		}
+	}
+	printCallTimes("enabled level (log)", times);
+
+	// Several threads logging at once
+	const int threadCount = 4;
+	vector<vector<int64_t>> threadTimes(threadCount, vector<int64_t>(calls / threadCount));
+	vector<thread> threads;
+	uint64_t droppedBefore = logger.getDroppedCount();
+	for (int t = 0; t < threadCount; t++) {
+		threads.push_back(thread([&threadTimes, &songPath, t]() {
+			for (size_t i = 0; i < threadTimes[t].size(); i++) {
+				Clock::time_point start = Clock::now();
+				logger.log(L"Benchmark message from a thread for ", songPath);
+				threadTimes[t][i] = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+			}
+		}));
+	}
+	for (int t = 0; t < threadCount; t++) {
+		threads[t].join();
+	}
+	vector<int64_t> allThreadTimes;
+	for (int t = 0; t < threadCount; t++) {
+		allThreadTimes.insert(allThreadTimes.end(), threadTimes[t].begin(), threadTimes[t].end());
+	}
+	printCallTimes("4 threads at once (log)", allThreadTimes);
+	printf("%-32s %llu of %d\n", "dropped while bursting", (unsigned long long)(logger.getDroppedCount() - droppedBefore), (int)allThreadTimes.size());
+	logger.flush();
+
+	// What every call used to cost: build the line and flush it before returning
+	wofstream syncFile("Logs/benchmark_sync.log", ios::out | ios::trunc);
+	for (int i = 0; i < calls; i++) {
+		Clock::time_point start = Clock::now();
+		wstring line = L"Benchmark message for ";
+		line.append(songPath.begin(), songPath.end());
+		syncFile << L"[LOG]  | " << line << endl;
+		times[i] = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+	}
+	printCallTimes("synchronous write + endl", times);
+
+	return 0;
 }
@@ -1,84 +1,119 @@
 #pragma once
 
+#include <atomic>
+#include <stdint.h>
 #include <string>
 
+/**
+ * How important a message is, messages below the logger's level are skipped
+ */
+enum LOG_LEVEL {
+	LOG_DEBUG,
+	LOG_INFO,
+	LOG_WARN,
+	LOG_OFF
+};
+
+/**
+ * Logs messages without blocking the calling thread. Each thread builds its message in
+ * its own buffer and hands it to a lock-free ring; a background thread writes the ring
+ * to a rotating log file and, optionally, the console.
+ */
 class Logger {
 	private:
-		std::wstring cached_content;
-		void log();
-		void logError();
+		static std::atomic<int> minLevel;
+
+		static std::wstring& stagingBuffer();
+		static void submit(LOG_LEVEL level, std::wstring& message);
+
+		static void append(std::wstring& out, const std::wstring& content);
+		static void append(std::wstring& out, const std::string& content);
+		static void append(std::wstring& out, const wchar_t* content);
+		static void append(std::wstring& out, const char* content);
+
+		template <typename... Types>
+		void write(LOG_LEVEL level, const Types&... content);
 
 	public:
 		Logger();
 		~Logger();
 
 		template <typename... Types>
-		void log(std::wstring content, Types... rest);
-
-		template <typename... Types>
-		void log(std::string content, Types... rest);
+		void log(const Types&... content);
 
 		template <typename... Types>
-		void logError(std::wstring content, Types... rest);
+		void logError(const Types&... content);
 
 		template <typename... Types>
-		void logError(std::string content, Types... rest);
+		void logDebug(const Types&... content);
+
+		/**
+		 * Gets if messages of a level are logged (cheap enough to check before building a message).
+		 *
+		 * @param level the level to check
+		 * @return true if messages of that level are logged
+		 */
+		inline bool isEnabled(LOG_LEVEL level) const { return (int)level >= minLevel.load(std::memory_order_relaxed); }
+
+		void setLevel(LOG_LEVEL level);
+		LOG_LEVEL getLevel();
+		void setConsoleEnabled(bool enabled);
+		void setLogFile(std::string path, size_t maxBytes, int keepFiles);
+		void flush();
+		uint64_t getDroppedCount();
+
+		static LOG_LEVEL getLevelFromName(std::string name);
+		static int benchmark(int calls);
 };
 
 extern Logger logger;
 
 
 /**
- * Output a message as a wide string.
- * 
- * @param content the string to output
+ * Build a message in the calling thread's buffer and queue it.
+ *
+ * @param level the level of the message
+ * @param content the parts of the message (narrow or wide strings)
  */
 template <typename... Types>
-void Logger::log(std::wstring content, Types... rest) {
-	cached_content += content;
+void Logger::write(LOG_LEVEL level, const Types&... content) {
+	if (!isEnabled(level)) {
+		return;
+	}
+
+	std::wstring& message = stagingBuffer();
+	message.clear();
+	(append(message, content), ...);
 
-    log(rest...);
+	submit(level, message);
 }
 
 /**
- * Output a message as a wide string.
- * 
- * @param content the string to output
+ * Output a message.
+ *
+ * @param content the parts of the message (narrow or wide strings)
  */
 template <typename... Types>
-void Logger::log(std::string content, Types... rest) {
-    std::wstring wContent;
-    wContent.assign(content.begin(), content.end());
-    cached_content += wContent; 
-
-    log(rest...);
+void Logger::log(const Types&... content) {
+	write(LOG_INFO, content...);
 }
 
-
 /**
- * Output a error message as a wide string.
- * 
- * @param content the string to output
+ * Output an error message.
+ *
+ * @param content the parts of the message (narrow or wide strings)
  */
 template <typename... Types>
-void Logger::logError(std::wstring content, Types... rest)
-{
-	cached_content += content;
-
-    logError(rest...);
+void Logger::logError(const Types&... content) {
+	write(LOG_WARN, content...);
 }
 
 /**
- * Output a error message as a narrow string.
- * 
- * @param content the string to output
+ * Output a message only useful when debugging (skipped unless the level is DEBUG).
+ *
+ * @param content the parts of the message (narrow or wide strings)
  */
 template <typename... Types>
-void Logger::logError(std::string content, Types... rest)
-{
-    std::wstring wContent;
-    wContent.assign(content.begin(), content.end());
-    cached_content += wContent; 
-
-    logError(rest...);
+void Logger::logDebug(const Types&... content) {
+	write(LOG_DEBUG, content...);
 }
@@ -0,0 +1,829 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+#include "Logger.h"
+#include "NetClient.h"
+#include "Tracer.h"
+
+NetClient netClient;
+
+// Idle connections are closed after this long
+const int64_t IDLE_TIMEOUT_MS = 30000;
+
+// Idle connections kept for each server
+const size_t MAX_IDLE_PER_SERVER = 4;
+
+// Backoff before the first retry, doubled for each one after (with some jitter)
+const int64_t RETRY_BACKOFF_MS = 500;
+const int64_t MAX_RETRY_BACKOFF_MS = 10000;
+
+// Size of each read from a socket
+const size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+// Reads per connection before the others get a turn, so a download can't starve a login
+const int MAX_READS_PER_STEP = 16;
+
+// Longest the I/O thread sleeps when nothing is due
+const int MAX_POLL_MS = 1000;
+
+// Sent to the game server before closing one of its connections
+const char COMMAND_END[] = "EndConn";
+
+/**
+ * Where a request is up to
+ */
+enum JOB_STAGE {
+	STAGE_WAITING,
+	STAGE_CONNECTING,
+	STAGE_SENDING,
+	STAGE_RECEIVING,
+	STAGE_DONE
+};
+
+/**
+ * How the body of a reply is framed
+ */
+enum BODY_MODE {
+	BODY_NONE,
+	BODY_LENGTH,
+	BODY_CHUNKED,
+	BODY_UNTIL_CLOSE
+};
+
+/**
+ * Where a chunked body is up to
+ */
+enum CHUNK_STAGE {
+	CHUNK_SIZE,
+	CHUNK_DATA,
+	CHUNK_DATA_END,
+	CHUNK_TRAILER
+};
+
+/**
+ * A request and everything about its progress
+ */
+struct NetClient::Job {
+	NetRequest request;
+	NetCallback callback;
+	NetResponse response;
+
+	string host;
+	int port = 0;
+	string path;
+	string key;
+
+	NetSocket socket;
+	JOB_STAGE stage = STAGE_WAITING;
+	bool prepared = false;
+	bool reused = false;
+	bool receivedAny = false;
+	bool sinkUsed = false;
+	int attempt = 0;
+	int64_t retryAtMs = 0;
+	int64_t deadlineMs = 0;
+	int64_t startMicros = 0;
+
+	string outgoing;
+	size_t sent = 0;
+
+	string incoming;
+	bool headersDone = false;
+	bool keepAlive = true;
+	BODY_MODE bodyMode = BODY_NONE;
+	uint64_t bodyRemaining = 0;
+	CHUNK_STAGE chunkStage = CHUNK_SIZE;
+};
+
+/**
+ * Make a string lower case.
+ *
+ * @param text the string
+ * @return the lower case string
+ */
+static string toLower(string text) {
+	transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)tolower(c); });
+	return text;
+}
+
+/**
+ * Split "host:port" into its parts.
+ *
+ * @param address the address
+ * @param defaultPort port to use if there isn't one
+ * @param host set to the host
+ * @param port set to the port
+ * @return true if the address is valid
+ */
+static bool splitHostPort(const string& address, int defaultPort, string& host, int& port) {
+	size_t colon = address.rfind(':');
+	if (colon == string::npos) {
+		host = address;
+		port = defaultPort;
+	}
+	else {
+		host = address.substr(0, colon);
+		port = atoi(address.substr(colon + 1).c_str());
+	}
+	return !host.empty() && port > 0 && port < 65536;
+}
+
+/**
+ * Gets a header of the reply.
+ *
+ * @param name name of the header (any case)
+ * @return the value, or an empty string if it wasn't sent
+ */
+string NetResponse::getHeader(const string& name) const {
+	map<string, string>::const_iterator it = this->headers.find(toLower(name));
+	return it == this->headers.end() ? "" : it->second;
+}
+
+/**
+ * Default constructor.
+ *
+ */
+NetClient::NetClient() {
+	this->running = false;
+	this->requestCount = 0;
+	this->openedCount = 0;
+	this->reusedCount = 0;
+	this->retryCount = 0;
+	this->failureCount = 0;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+NetClient::~NetClient() {
+	if (this->running) {
+		this->running = false;
+		this->waker.wake();
+		if (this->ioThread.joinable()) {
+			this->ioThread.join();
+		}
+	}
+}
+
+/**
+ * Start the I/O thread (done on the first request so nothing runs during static setup).
+ *
+ */
+void NetClient::start() {
+	if (!this->waker.open()) {
+		logger.logError("Network client could not create its wake up socket");
+	}
+	this->receiveBuffer.resize(RECEIVE_BUFFER_SIZE);
+	this->running = true;
+	this->ioThread = thread(&NetClient::run, this);
+}
+
+/**
+ * Queue a request. The callback runs on the I/O thread, so it should be quick.
+ *
+ * @param request the request
+ * @param callback called with the response once the request succeeds or gives up
+ */
+void NetClient::send(NetRequest request, NetCallback callback) {
+	call_once(this->startFlag, [this]() { start(); });
+
+	unique_ptr<Job> job(new Job());
+	job->request = move(request);
+	job->callback = move(callback);
+	job->startMicros = Tracer::nowMicros();
+	this->requestCount++;
+
+	{
+		lock_guard<mutex> lock(this->queueLock);
+		this->queued.push_back(move(job));
+	}
+	this->waker.wake();
+}
+
+/**
+ * Queue a request.
+ *
+ * @param request the request
+ * @return the response once the request succeeds or gives up
+ */
+future<NetResponse> NetClient::send(NetRequest request) {
+	shared_ptr<promise<NetResponse>> result = make_shared<promise<NetResponse>>();
+	future<NetResponse> response = result->get_future();
+
+	send(move(request), [result](NetResponse& reply) {
+		result->set_value(reply);
+	});
+
+	return response;
+}
+
+/**
+ * Gets counters of everything the client has done.
+ *
+ * @return the counters
+ */
+NetClient::Stats NetClient::getStats() {
+	Stats stats;
+	stats.requests = this->requestCount;
+	stats.connectionsOpened = this->openedCount;
+	stats.connectionsReused = this->reusedCount;
+	stats.retries = this->retryCount;
+	stats.failures = this->failureCount;
+	return stats;
+}
+
+/**
+ * The I/O thread: moves every request forward and sleeps until a socket needs attention.
+ *
+ */
+void NetClient::run() {
+	tracer.setThreadName("Network I/O");
+
+	vector<NetPollEntry> entries;
+	while (this->running) {
+		{
+			lock_guard<mutex> lock(this->queueLock);
+			for (size_t i = 0; i < this->queued.size(); i++) {
+				this->active.push_back(move(this->queued[i]));
+			}
+			this->queued.clear();
+		}
+
+		int64_t now = nowMs();
+		for (size_t i = 0; i < this->active.size(); i++) {
+			step(*this->active[i], now);
+		}
+		this->active.erase(remove_if(this->active.begin(), this->active.end(), [](const unique_ptr<Job>& job) {
+			return job->stage == STAGE_DONE;
+		}), this->active.end());
+
+		// Close connections that have sat in the pool too long
+		for (size_t i = 0; i < this->idle.size();) {
+			if (now - this->idle[i].idleSinceMs >= IDLE_TIMEOUT_MS) {
+				closeIdle(this->idle[i]);
+				this->idle.erase(this->idle.begin() + i);
+			}
+			else {
+				i++;
+			}
+		}
+
+		// Sleep until a socket is ready or something is due
+		int64_t wakeAt = now + MAX_POLL_MS;
+		entries.clear();
+		if (this->waker.getHandle() != NET_INVALID_HANDLE) {
+			entries.push_back({ this->waker.getHandle(), true, false, false });
+		}
+		for (size_t i = 0; i < this->active.size(); i++) {
+			Job& job = *this->active[i];
+			if (job.stage == STAGE_WAITING) {
+				wakeAt = min(wakeAt, job.retryAtMs);
+				continue;
+			}
+			wakeAt = min(wakeAt, job.deadlineMs);
+			entries.push_back({ job.socket.getHandle(), job.stage == STAGE_RECEIVING,
+				job.stage == STAGE_CONNECTING || job.stage == STAGE_SENDING, false });
+		}
+		size_t firstIdle = entries.size();
+		for (size_t i = 0; i < this->idle.size(); i++) {
+			wakeAt = min(wakeAt, this->idle[i].idleSinceMs + IDLE_TIMEOUT_MS);
+			entries.push_back({ this->idle[i].socket.getHandle(), true, false, false });
+		}
+
+		netPoll(entries, (int)max<int64_t>(0, wakeAt - now));
+		this->waker.drain();
+
+		// An idle connection with something to read was closed by the server
+		for (size_t i = this->idle.size(); i-- > 0;) {
+			if (entries[firstIdle + i].ready && this->idle[i].socket.isStale()) {
+				this->idle[i].socket.close();
+				this->idle.erase(this->idle.begin() + i);
+			}
+		}
+	}
+
+	// Anything still waiting fails rather than leaving its caller blocked forever
+	{
+		lock_guard<mutex> lock(this->queueLock);
+		for (size_t i = 0; i < this->queued.size(); i++) {
+			this->active.push_back(move(this->queued[i]));
+		}
+		this->queued.clear();
+	}
+	for (size_t i = 0; i < this->active.size(); i++) {
+		this->active[i]->response.error = "network client stopped";
+		finish(*this->active[i]);
+	}
+	this->active.clear();
+
+	for (size_t i = 0; i < this->idle.size(); i++) {
+		closeIdle(this->idle[i]);
+	}
+	this->idle.clear();
+}
+
+/**
+ * Move a request forward as far as it can go without blocking.
+ *
+ * @param job the request
+ * @param now the current time
+ */
+void NetClient::step(Job& job, int64_t now) {
+	if (job.stage == STAGE_WAITING) {
+		if (now < job.retryAtMs) {
+			return;
+		}
+		beginAttempt(job, now);
+	}
+
+	if (job.stage == STAGE_CONNECTING) {
+		string error;
+		int result = job.socket.pollConnect(error);
+		if (result < 0) {
+			failAttempt(job, error, true, now);
+			return;
+		}
+		if (result > 0) {
+			job.stage = STAGE_SENDING;
+			job.deadlineMs = now + job.request.timeoutMs;
+		}
+	}
+
+	if (job.stage == STAGE_SENDING) {
+		while (job.sent < job.outgoing.size()) {
+			int sent = job.socket.sendSome(job.outgoing.data() + job.sent, job.outgoing.size() - job.sent);
+			if (sent == NET_WOULD_BLOCK) {
+				break;
+			}
+			if (sent < 0) {
+				failAttempt(job, "could not send to " + job.key, true, now);
+				return;
+			}
+			job.sent += sent;
+			job.deadlineMs = now + job.request.timeoutMs;
+		}
+		if (job.sent == job.outgoing.size()) {
+			job.stage = STAGE_RECEIVING;
+		}
+	}
+
+	if (job.stage == STAGE_RECEIVING) {
+		receive(job, now);
+	}
+
+	if (job.stage != STAGE_WAITING && job.stage != STAGE_DONE && now >= job.deadlineMs) {
+		failAttempt(job, "timed out waiting for " + job.key, true, now);
+	}
+}
+
+/**
+ * Start a try of a request on a pooled connection or a new one.
+ *
+ * @param job the request
+ * @param now the current time
+ */
+void NetClient::beginAttempt(Job& job, int64_t now) {
+	if (!job.prepared) {
+		bool valid = false;
+		if (job.request.protocol == NET_HTTP) {
+			const string scheme = "http://";
+			if (job.request.url.compare(0, scheme.size(), scheme) == 0) {
+				string rest = job.request.url.substr(scheme.size());
+				size_t slash = rest.find('/');
+				job.path = slash == string::npos ? "/" : rest.substr(slash);
+				valid = splitHostPort(rest.substr(0, slash), 80, job.host, job.port);
+			}
+		}
+		else {
+			valid = splitHostPort(job.request.url, 0, job.host, job.port);
+		}
+
+		if (!valid) {
+			job.response.error = "invalid address " + job.request.url;
+			this->failureCount++;
+			finish(job);
+			return;
+		}
+		job.key = job.host + ":" + to_string(job.port);
+
+		// Build what is sent once, it is the same for every try
+		if (job.request.protocol == NET_HTTP) {
+			job.outgoing = job.request.method + " " + job.path + " HTTP/1.1\r\n";
+			job.outgoing += "Host: " + job.key + "\r\n";
+			job.outgoing += "Connection: keep-alive\r\n";
+			for (size_t i = 0; i < job.request.headers.size(); i++) {
+				job.outgoing += job.request.headers[i].first + ": " + job.request.headers[i].second + "\r\n";
+			}
+			if (!job.request.body.empty() || job.request.method == "POST" || job.request.method == "PUT") {
+				job.outgoing += "Content-Length: " + to_string(job.request.body.size()) + "\r\n";
+			}
+			job.outgoing += "\r\n";
+			job.outgoing += job.request.body;
+		}
+		else {
+			job.outgoing = job.request.body;
+		}
+		job.prepared = true;
+	}
+
+	job.attempt++;
+	job.response = NetResponse();
+	job.response.attempts = job.attempt;
+	job.sent = 0;
+	job.incoming.clear();
+	job.headersDone = false;
+	job.keepAlive = true;
+	job.bodyMode = BODY_NONE;
+	job.bodyRemaining = 0;
+	job.chunkStage = CHUNK_SIZE;
+	job.receivedAny = false;
+	job.reused = false;
+	job.deadlineMs = now + job.request.timeoutMs;
+
+	// Reuse a pooled connection to the same server if it is still good
+	for (size_t i = this->idle.size(); i-- > 0;) {
+		if (this->idle[i].key != job.key || this->idle[i].protocol != job.request.protocol) {
+			continue;
+		}
+		NetSocket socket = move(this->idle[i].socket);
+		this->idle.erase(this->idle.begin() + i);
+		if (socket.isStale()) {
+			continue;
+		}
+
+		job.socket = move(socket);
+		job.reused = true;
+		job.response.reusedConnection = true;
+		job.stage = STAGE_SENDING;
+		this->reusedCount++;
+		return;
+	}
+
+	string error;
+	if (!job.socket.startConnect(job.host, job.port, error)) {
+		failAttempt(job, error, true, now);
+		return;
+	}
+	job.stage = STAGE_CONNECTING;
+	this->openedCount++;
+}
+
+/**
+ * Read whatever has arrived for a request.
+ *
+ * @param job the request
+ * @param now the current time
+ */
+void NetClient::receive(Job& job, int64_t now) {
+	for (int reads = 0; reads < MAX_READS_PER_STEP && job.stage == STAGE_RECEIVING; reads++) {
+		int received = job.socket.receiveSome(this->receiveBuffer.data(), this->receiveBuffer.size());
+		if (received == NET_WOULD_BLOCK) {
+			return;
+		}
+		if (received == NET_ERROR) {
+			failAttempt(job, "connection to " + job.key + " failed", true, now);
+			return;
+		}
+		if (received == 0) {
+			// Closing is how a reply without a length ends
+			if (job.headersDone && job.bodyMode == BODY_UNTIL_CLOSE) {
+				job.keepAlive = false;
+				complete(job, now);
+			}
+			else {
+				failAttempt(job, "connection to " + job.key + " closed", true, now);
+			}
+			return;
+		}
+
+		job.receivedAny = true;
+		job.response.bytesReceived += received;
+		job.deadlineMs = now + job.request.timeoutMs;
+		job.incoming.append(this->receiveBuffer.data(), received);
+		parse(job);
+
+		if (job.stage == STAGE_DONE) {
+			return;
+		}
+		if (job.headersDone && job.bodyMode == BODY_NONE) {
+			complete(job, now);
+			return;
+		}
+		if (job.headersDone && job.bodyMode == BODY_LENGTH && job.bodyRemaining == 0) {
+			complete(job, now);
+			return;
+		}
+	}
+}
+
+/**
+ * Use up as much of the received data as possible.
+ *
+ * @param job the request
+ */
+void NetClient::parse(Job& job) {
+	if (!job.headersDone) {
+		if (job.request.protocol == NET_COMMAND) {
+			if (!job.request.lengthPrefixed) {
+				// Plain replies are whatever arrives first
+				job.headersDone = true;
+				job.bodyMode = BODY_UNTIL_CLOSE;
+				deliverBody(job, job.incoming.data(), job.incoming.size());
+				job.incoming.clear();
+				job.bodyMode = BODY_NONE;
+				return;
+			}
+			if (job.incoming.size() < 4) {
+				return;
+			}
+			const unsigned char* length = (const unsigned char*)job.incoming.data();
+			job.bodyRemaining = ((uint64_t)length[0] << 24) | ((uint64_t)length[1] << 16) | ((uint64_t)length[2] << 8) | (uint64_t)length[3];
+			job.bodyMode = BODY_LENGTH;
+			job.headersDone = true;
+			job.incoming.erase(0, 4);
+		}
+		else {
+			parseHeaders(job);
+			if (!job.headersDone || job.stage == STAGE_DONE) {
+				return;
+			}
+		}
+	}
+
+	if (job.bodyMode == BODY_LENGTH) {
+		size_t take = (size_t)min<uint64_t>(job.bodyRemaining, job.incoming.size());
+		deliverBody(job, job.incoming.data(), take);
+		job.bodyRemaining -= take;
+		job.incoming.erase(0, take);
+	}
+	else if (job.bodyMode == BODY_UNTIL_CLOSE) {
+		deliverBody(job, job.incoming.data(), job.incoming.size());
+		job.incoming.clear();
+	}
+	else if (job.bodyMode == BODY_CHUNKED) {
+		while (job.stage != STAGE_DONE) {
+			if (job.chunkStage == CHUNK_SIZE) {
+				size_t lineEnd = job.incoming.find("\r\n");
+				if (lineEnd == string::npos) {
+					return;
+				}
+				job.bodyRemaining = strtoull(job.incoming.substr(0, lineEnd).c_str(), NULL, 16);
+				job.incoming.erase(0, lineEnd + 2);
+				job.chunkStage = job.bodyRemaining == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+			}
+			else if (job.chunkStage == CHUNK_DATA) {
+				size_t take = (size_t)min<uint64_t>(job.bodyRemaining, job.incoming.size());
+				deliverBody(job, job.incoming.data(), take);
+				job.bodyRemaining -= take;
+				job.incoming.erase(0, take);
+				if (job.bodyRemaining > 0) {
+					return;
+				}
+				job.chunkStage = CHUNK_DATA_END;
+			}
+			else if (job.chunkStage == CHUNK_DATA_END) {
+				if (job.incoming.size() < 2) {
+					return;
+				}
+				job.incoming.erase(0, 2);
+				job.chunkStage = CHUNK_SIZE;
+			}
+			else {
+				// Skip any trailers up to the blank line that ends the body
+				size_t lineEnd = job.incoming.find("\r\n");
+				if (lineEnd == string::npos) {
+					return;
+				}
+				job.incoming.erase(0, lineEnd + 2);
+				if (lineEnd == 0) {
+					job.bodyMode = BODY_NONE;
+					return;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Read the status line and headers of an HTTP reply once they have all arrived.
+ *
+ * @param job the request
+ */
+void NetClient::parseHeaders(Job& job) {
+	size_t headerEnd = job.incoming.find("\r\n\r\n");
+	if (headerEnd == string::npos) {
+		return;
+	}
+
+	string head = job.incoming.substr(0, headerEnd);
+	job.incoming.erase(0, headerEnd + 4);
+
+	// "HTTP/1.1 200 OK"
+	size_t lineEnd = head.find("\r\n");
+	string statusLine = head.substr(0, lineEnd);
+	size_t space = statusLine.find(' ');
+	if (statusLine.compare(0, 5, "HTTP/") != 0 || space == string::npos) {
+		job.keepAlive = false;
+		failAttempt(job, "bad reply from " + job.key, false, nowMs());
+		return;
+	}
+	bool http10 = statusLine.compare(0, 8, "HTTP/1.0") == 0;
+	job.response.status = atoi(statusLine.c_str() + space + 1);
+
+	while (lineEnd != string::npos) {
+		size_t start = lineEnd + 2;
+		lineEnd = head.find("\r\n", start);
+		string line = head.substr(start, lineEnd == string::npos ? string::npos : lineEnd - start);
+
+		size_t colon = line.find(':');
+		if (colon == string::npos) {
+			continue;
+		}
+		size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+		job.response.headers[toLower(line.substr(0, colon))] = valueStart == string::npos ? "" : line.substr(valueStart);
+	}
+
+	string connection = toLower(job.response.getHeader("Connection"));
+	job.keepAlive = http10 ? connection == "keep-alive" : connection != "close";
+
+	int status = job.response.status;
+	if (job.request.method == "HEAD" || (status >= 100 && status < 200) || status == 204 || status == 304) {
+		job.bodyMode = BODY_NONE;
+	}
+	else if (toLower(job.response.getHeader("Transfer-Encoding")).find("chunked") != string::npos) {
+		job.bodyMode = BODY_CHUNKED;
+	}
+	else if (!job.response.getHeader("Content-Length").empty()) {
+		job.bodyMode = BODY_LENGTH;
+		job.bodyRemaining = strtoull(job.response.getHeader("Content-Length").c_str(), NULL, 10);
+	}
+	else {
+		job.bodyMode = BODY_UNTIL_CLOSE;
+		job.keepAlive = false;
+	}
+	job.headersDone = true;
+}
+
+/**
+ * Hand part of a reply's body to the sink, or keep it in the response.
+ *
+ * @param job the request
+ * @param data the data
+ * @param length how many bytes
+ */
+void NetClient::deliverBody(Job& job, const char* data, size_t length) {
+	if (length == 0) {
+		return;
+	}
+
+	// Only successful replies go to the sink, error pages are kept for the caller to log
+	bool successful = job.request.protocol == NET_COMMAND || (job.response.status >= 200 && job.response.status < 300);
+	if (job.request.sink && successful) {
+		job.sinkUsed = true;
+		if (!job.request.sink(data, length)) {
+			job.keepAlive = false;
+			failAttempt(job, "cancelled", false, nowMs());
+		}
+		return;
+	}
+
+	job.response.body.append(data, length);
+}
+
+/**
+ * A try of a request failed, try again if it may.
+ *
+ * @param job the request
+ * @param error why it failed
+ * @param retryable true if trying again could help
+ * @param now the current time
+ */
+void NetClient::failAttempt(Job& job, string error, bool retryable, int64_t now) {
+	job.socket.close();
+
+	// A pooled connection the server dropped, go again on a new one straight away
+	if (job.reused && !job.receivedAny && retryable) {
+		job.stage = STAGE_WAITING;
+		job.retryAtMs = now;
+		job.attempt--;
+		this->reusedCount--;
+		return;
+	}
+
+	// Nothing can be retried once part of it has been handed to the sink
+	if (retryable && !job.sinkUsed && job.attempt <= job.request.retries) {
+		static minstd_rand jitter((unsigned int)chrono::steady_clock::now().time_since_epoch().count());
+		int64_t backoff = min(MAX_RETRY_BACKOFF_MS, RETRY_BACKOFF_MS << min(job.attempt - 1, 5));
+		backoff = backoff * 3 / 4 + (int64_t)(jitter() % (unsigned int)(backoff / 2 + 1));
+
+		logger.logDebug("Network request to ", job.key, " failed (", error, "), retrying in ", to_string(backoff), " ms");
+		job.stage = STAGE_WAITING;
+		job.retryAtMs = now + backoff;
+		this->retryCount++;
+		return;
+	}
+
+	job.response.completed = false;
+	job.response.error = error;
+	this->failureCount++;
+	finish(job);
+}
+
+/**
+ * A reply has fully arrived.
+ *
+ * @param job the request
+ * @param now the current time
+ */
+void NetClient::complete(Job& job, int64_t now) {
+	releaseConnection(job, now);
+
+	// Server errors may be temporary
+	if (job.response.status >= 500 && !job.sinkUsed && job.attempt <= job.request.retries) {
+		job.reused = false;
+		failAttempt(job, "server replied " + to_string(job.response.status), true, now);
+		return;
+	}
+
+	job.response.completed = true;
+	finish(job);
+}
+
+/**
+ * Hand the response to the caller.
+ *
+ * @param job the request
+ */
+void NetClient::finish(Job& job) {
+	job.stage = STAGE_DONE;
+	job.socket.close();
+
+	if (tracer.isEnabled()) {
+		tracer.record(job.request.protocol == NET_HTTP ? "HTTP request" : "Server command", "network",
+			job.startMicros, Tracer::nowMicros(), job.request.url.c_str());
+	}
+
+	if (job.callback) {
+		try {
+			job.callback(job.response);
+		}
+		catch (const exception& e) {
+			logger.logError("Network callback failed: ", e.what());
+		}
+	}
+}
+
+/**
+ * Put a finished request's connection in the pool if it can be used again.
+ *
+ * @param job the request
+ * @param now the current time
+ */
+void NetClient::releaseConnection(Job& job, int64_t now) {
+	if (!job.socket.isOpen()) {
+		return;
+	}
+	if (!job.keepAlive || !job.incoming.empty()) {
+		job.socket.close();
+		return;
+	}
+
+	size_t pooled = 0;
+	for (size_t i = 0; i < this->idle.size(); i++) {
+		if (this->idle[i].key == job.key && this->idle[i].protocol == job.request.protocol) {
+			pooled++;
+		}
+	}
+	if (pooled >= MAX_IDLE_PER_SERVER) {
+		IdleConnection extra = { job.key, job.request.protocol, move(job.socket), now };
+		closeIdle(extra);
+		return;
+	}
+
+	this->idle.push_back({ job.key, job.request.protocol, move(job.socket), now });
+}
+
+/**
+ * Close a pooled connection, telling the game server first.
+ *
+ * @param connection the connection
+ */
+void NetClient::closeIdle(IdleConnection& connection) {
+	if (connection.protocol == NET_COMMAND && connection.socket.isOpen()) {
+		connection.socket.sendSome(COMMAND_END, strlen(COMMAND_END));
+	}
+	connection.socket.close();
+}
+
+/**
+ * Gets a millisecond timestamp for timeouts.
+ *
+ * @return milliseconds since an arbitrary point
+ */
+int64_t NetClient::nowMs() {
+	return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
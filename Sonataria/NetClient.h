@@ -0,0 +1,158 @@
+/**
+ * @file NetClient.h
+ *
+ * @brief Net Client
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <atomic>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "NetSocket.h"
+
+/**
+ * What a request speaks to the server
+ */
+enum NET_PROTOCOL {
+	NET_HTTP,		// HTTP/1.1 with keep-alive (url is http://host:port/path)
+	NET_COMMAND		// The game server's plain text commands (url is host:port)
+};
+
+/**
+ * A request to send to a server
+ */
+struct NetRequest {
+	NET_PROTOCOL protocol = NET_HTTP;
+	string method = "GET";
+	string url;
+	vector<pair<string, string>> headers;
+
+	// HTTP body, or the command text
+	string body;
+
+	// How long the request may go without any progress before it is given up on
+	int timeoutMs = 5000;
+
+	// How many more times to try after a failed connection, a timeout or a 5xx reply
+	int retries = 0;
+
+	// Commands only: the reply is a 4 byte big-endian length then that many bytes
+	bool lengthPrefixed = false;
+
+	// Optional target for a successful reply's body as it arrives (return false to cancel),
+	// otherwise the body is kept in the response
+	function<bool(const char*, size_t)> sink;
+};
+
+/**
+ * The result of a request
+ */
+struct NetResponse {
+	bool completed = false;
+	int status = 0;
+	map<string, string> headers;
+	string body;
+	string error;
+	uint64_t bytesReceived = 0;
+	int attempts = 0;
+	bool reusedConnection = false;
+
+	/**
+	 * Gets if the request got a successful reply (commands have no status).
+	 *
+	 * @return true if successful
+	 */
+	inline bool ok() const { return this->completed && (this->status == 0 || (this->status >= 200 && this->status < 300)); }
+
+	string getHeader(const string& name) const;
+};
+
+typedef function<void(NetResponse&)> NetCallback;
+
+/**
+ * Sends every request of the game from one background I/O thread. Connections are
+ * non-blocking and kept open between requests to the same server, requests time out
+ * when they stop making progress and failed requests are retried with backoff.
+ */
+class NetClient {
+
+	public:
+		/**
+		 * Counters of everything the client has done
+		 */
+		struct Stats {
+			uint64_t requests;
+			uint64_t connectionsOpened;
+			uint64_t connectionsReused;
+			uint64_t retries;
+			uint64_t failures;
+		};
+
+	private:
+		struct Job;
+
+		/**
+		 * A connection waiting in the pool for the next request to its server
+		 */
+		struct IdleConnection {
+			string key;
+			NET_PROTOCOL protocol;
+			NetSocket socket;
+			int64_t idleSinceMs;
+		};
+
+		once_flag startFlag;
+		atomic<bool> running;
+		thread ioThread;
+		NetWaker waker;
+
+		mutex queueLock;
+		vector<unique_ptr<Job>> queued;
+
+		// Only touched by the I/O thread
+		vector<unique_ptr<Job>> active;
+		vector<IdleConnection> idle;
+		vector<char> receiveBuffer;
+
+		atomic<uint64_t> requestCount;
+		atomic<uint64_t> openedCount;
+		atomic<uint64_t> reusedCount;
+		atomic<uint64_t> retryCount;
+		atomic<uint64_t> failureCount;
+
+		void start();
+		void run();
+		void step(Job& job, int64_t now);
+		void beginAttempt(Job& job, int64_t now);
+		void receive(Job& job, int64_t now);
+		void parse(Job& job);
+		void parseHeaders(Job& job);
+		void deliverBody(Job& job, const char* data, size_t length);
+		void failAttempt(Job& job, string error, bool retryable, int64_t now);
+		void complete(Job& job, int64_t now);
+		void finish(Job& job);
+		void releaseConnection(Job& job, int64_t now);
+		void closeIdle(IdleConnection& connection);
+
+	public:
+		NetClient();
+		~NetClient();
+
+		void send(NetRequest request, NetCallback callback);
+		future<NetResponse> send(NetRequest request);
+		Stats getStats();
+
+		static int64_t nowMs();
+};
+
+extern NetClient netClient;
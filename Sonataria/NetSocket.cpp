@@ -0,0 +1,661 @@
+#ifdef _WIN32
+// Room for every pooled connection in one select
+#define FD_SETSIZE 256
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment (lib, "WS2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include <mutex>
+
+#include "NetSocket.h"
+
+#ifdef _WIN32
+typedef int SocketLength;
+#define NET_SOCKET(handle) ((SOCKET)(handle))
+#else
+typedef socklen_t SocketLength;
+#define NET_SOCKET(handle) ((int)(handle))
+#endif
+
+/**
+ * Gets the error of the last socket call.
+ *
+ * @return the error code
+ */
+static int lastSocketError() {
+#ifdef _WIN32
+	return WSAGetLastError();
+#else
+	return errno;
+#endif
+}
+
+/**
+ * Gets if an error only means the call would have blocked.
+ *
+ * @param error the error code
+ * @return true if the call should just be tried again later
+ */
+static bool isWouldBlock(int error) {
+#ifdef _WIN32
+	return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+#else
+	return error == EWOULDBLOCK || error == EAGAIN || error == EINPROGRESS || error == EINTR;
+#endif
+}
+
+/**
+ * Close a raw socket handle.
+ *
+ * @param handle the socket
+ */
+static void closeHandle(NetHandle handle) {
+#ifdef _WIN32
+	closesocket(NET_SOCKET(handle));
+#else
+	::close(NET_SOCKET(handle));
+#endif
+}
+
+/**
+ * Stop a socket from blocking the calling thread.
+ *
+ * @param handle the socket
+ * @return true if successful
+ */
+static bool setNonBlocking(NetHandle handle) {
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	return ioctlsocket(NET_SOCKET(handle), FIONBIO, &nonBlocking) == 0;
+#else
+	int flags = fcntl(NET_SOCKET(handle), F_GETFL, 0);
+	return flags != -1 && fcntl(NET_SOCKET(handle), F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+/**
+ * Start the socket library (only needed once for the whole game).
+ *
+ * @return true if sockets can be used
+ */
+bool NetSocket::startup() {
+#ifdef _WIN32
+	static once_flag started;
+	static bool ready = false;
+	call_once(started, []() {
+		WSADATA wsaData;
+		ready = WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+	});
+	return ready;
+#else
+	return true;
+#endif
+}
+
+/**
+ * Default constructor.
+ *
+ */
+NetSocket::NetSocket() {
+	this->handle = NET_INVALID_HANDLE;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+NetSocket::~NetSocket() {
+	close();
+}
+
+/**
+ * Take over another socket's connection.
+ *
+ * @param other the socket to take the connection from
+ */
+NetSocket::NetSocket(NetSocket&& other) noexcept {
+	this->handle = other.handle;
+	other.handle = NET_INVALID_HANDLE;
+}
+
+/**
+ * Take over another socket's connection, closing this one's.
+ *
+ * @param other the socket to take the connection from
+ * @return this socket
+ */
+NetSocket& NetSocket::operator=(NetSocket&& other) noexcept {
+	if (this != &other) {
+		close();
+		this->handle = other.handle;
+		other.handle = NET_INVALID_HANDLE;
+	}
+	return *this;
+}
+
+/**
+ * Start connecting without waiting for the connection to finish.
+ *
+ * @param host name or address of the server
+ * @param port port of the server
+ * @param error set to why it failed
+ * @return true if the connection was started
+ */
+bool NetSocket::startConnect(const string& host, int port, string& error) {
+	close();
+
+	if (!startup()) {
+		error = "socket library unavailable";
+		return false;
+	}
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	addrinfo* addresses = NULL;
+	if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &addresses) != 0 || !addresses) {
+		error = "could not resolve " + host;
+		return false;
+	}
+
+	NetHandle newHandle = (NetHandle)socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+	if (newHandle == NET_INVALID_HANDLE) {
+		error = "could not create socket (" + to_string(lastSocketError()) + ")";
+		freeaddrinfo(addresses);
+		return false;
+	}
+
+	// Requests are small, send them straight away
+	int noDelay = 1;
+	setsockopt(NET_SOCKET(newHandle), IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+	if (!setNonBlocking(newHandle)) {
+		error = "could not make socket non-blocking (" + to_string(lastSocketError()) + ")";
+		closeHandle(newHandle);
+		freeaddrinfo(addresses);
+		return false;
+	}
+
+	int result = connect(NET_SOCKET(newHandle), addresses->ai_addr, (SocketLength)addresses->ai_addrlen);
+	int connectError = lastSocketError();
+	freeaddrinfo(addresses);
+
+	if (result != 0 && !isWouldBlock(connectError)) {
+		error = "could not connect to " + host + ":" + to_string(port) + " (" + to_string(connectError) + ")";
+		closeHandle(newHandle);
+		return false;
+	}
+
+	this->handle = newHandle;
+	return true;
+}
+
+/**
+ * Check if a started connection has finished.
+ *
+ * @param error set to why it failed
+ * @return 1 if connected, 0 if still connecting, -1 if it failed
+ */
+int NetSocket::pollConnect(string& error) {
+	if (!isOpen()) {
+		error = "not connected";
+		return -1;
+	}
+
+	vector<NetPollEntry> entry = { { this->handle, false, true, false } };
+	if (netPoll(entry, 0) <= 0 || !entry[0].ready) {
+		return 0;
+	}
+
+	int socketError = 0;
+	SocketLength length = sizeof(socketError);
+	if (getsockopt(NET_SOCKET(this->handle), SOL_SOCKET, SO_ERROR, (char*)&socketError, &length) != 0) {
+		socketError = lastSocketError();
+	}
+
+	if (socketError != 0) {
+		error = "could not connect (" + to_string(socketError) + ")";
+		close();
+		return -1;
+	}
+
+	return 1;
+}
+
+/**
+ * Start accepting connections from other machines.
+ *
+ * @param port port to listen on (0 for any free port)
+ * @param error set to why it failed
+ * @return true if listening
+ */
+bool NetSocket::listen(int port, string& error) {
+	close();
+
+	if (!startup()) {
+		error = "socket library unavailable";
+		return false;
+	}
+
+	NetHandle newHandle = (NetHandle)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (newHandle == NET_INVALID_HANDLE) {
+		error = "could not create socket (" + to_string(lastSocketError()) + ")";
+		return false;
+	}
+
+#ifndef _WIN32
+	// A restart can listen again straight away (on Windows this would let another program take the port)
+	int reuse = 1;
+	setsockopt(NET_SOCKET(newHandle), SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+#endif
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((uint16_t)port);
+
+	if (bind(NET_SOCKET(newHandle), (sockaddr*)&address, sizeof(address)) != 0
+		|| ::listen(NET_SOCKET(newHandle), SOMAXCONN) != 0
+		|| !setNonBlocking(newHandle)) {
+		error = "could not listen on port " + to_string(port) + " (" + to_string(lastSocketError()) + ")";
+		closeHandle(newHandle);
+		return false;
+	}
+
+	this->handle = newHandle;
+	return true;
+}
+
+/**
+ * Take the next waiting connection of a listening socket.
+ *
+ * @param client set to the connection
+ * @return true if there was one
+ */
+bool NetSocket::accept(NetSocket& client) {
+	if (!isOpen()) {
+		return false;
+	}
+
+	NetHandle newHandle = (NetHandle)::accept(NET_SOCKET(this->handle), NULL, NULL);
+	if (newHandle == NET_INVALID_HANDLE) {
+		return false;
+	}
+	if (!setNonBlocking(newHandle)) {
+		closeHandle(newHandle);
+		return false;
+	}
+
+	int noDelay = 1;
+	setsockopt(NET_SOCKET(newHandle), IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+	client.close();
+	client.handle = newHandle;
+	return true;
+}
+
+/**
+ * Gets the port the socket is bound to, such as the one picked for listen(0).
+ *
+ * @return the port, or 0 if it isn't bound
+ */
+int NetSocket::getLocalPort() {
+	sockaddr_in address = {};
+	SocketLength length = sizeof(address);
+	if (!isOpen() || getsockname(NET_SOCKET(this->handle), (sockaddr*)&address, &length) != 0) {
+		return 0;
+	}
+	return ntohs(address.sin_port);
+}
+
+/**
+ * Send as much as the connection takes right now.
+ *
+ * @param data the data to send
+ * @param length how many bytes to send
+ * @return bytes sent, NET_WOULD_BLOCK or NET_ERROR
+ */
+int NetSocket::sendSome(const char* data, size_t length) {
+#ifdef _WIN32
+	int sent = send(NET_SOCKET(this->handle), data, (int)length, 0);
+#else
+	int sent = (int)send(NET_SOCKET(this->handle), data, length, MSG_NOSIGNAL);
+#endif
+	if (sent >= 0) {
+		return sent;
+	}
+	return isWouldBlock(lastSocketError()) ? NET_WOULD_BLOCK : NET_ERROR;
+}
+
+/**
+ * Receive whatever has arrived.
+ *
+ * @param buffer where to put the data
+ * @param length size of the buffer
+ * @return bytes received, 0 if the other side closed, NET_WOULD_BLOCK or NET_ERROR
+ */
+int NetSocket::receiveSome(char* buffer, size_t length) {
+	int received = (int)recv(NET_SOCKET(this->handle), buffer, (int)length, 0);
+	if (received >= 0) {
+		return received;
+	}
+	return isWouldBlock(lastSocketError()) ? NET_WOULD_BLOCK : NET_ERROR;
+}
+
+/**
+ * Check an idle connection before reusing it. It is stale if the server closed it
+ * or sent something nobody asked for.
+ *
+ * @return true if it shouldn't be reused
+ */
+bool NetSocket::isStale() {
+	if (!isOpen()) {
+		return true;
+	}
+
+	char peek;
+	int result = (int)recv(NET_SOCKET(this->handle), &peek, 1, MSG_PEEK);
+	if (result < 0) {
+		return !isWouldBlock(lastSocketError());
+	}
+	return true;
+}
+
+/**
+ * Close the connection.
+ *
+ */
+void NetSocket::close() {
+	if (this->handle != NET_INVALID_HANDLE) {
+		closeHandle(this->handle);
+		this->handle = NET_INVALID_HANDLE;
+	}
+}
+
+/**
+ * Default constructor.
+ *
+ */
+NetWaker::NetWaker() {
+	this->handle = NET_INVALID_HANDLE;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+NetWaker::~NetWaker() {
+	if (this->handle != NET_INVALID_HANDLE) {
+		closeHandle(this->handle);
+	}
+}
+
+/**
+ * Open a loopback UDP socket connected to itself, so sending to it wakes the poll
+ * (works the same on Winsock, which can't poll a pipe).
+ *
+ * @return true if successful
+ */
+bool NetWaker::open() {
+	if (!NetSocket::startup()) {
+		return false;
+	}
+
+	NetHandle newHandle = (NetHandle)socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (newHandle == NET_INVALID_HANDLE) {
+		return false;
+	}
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+
+	SocketLength length = sizeof(address);
+	if (bind(NET_SOCKET(newHandle), (sockaddr*)&address, sizeof(address)) != 0
+		|| getsockname(NET_SOCKET(newHandle), (sockaddr*)&address, &length) != 0
+		|| connect(NET_SOCKET(newHandle), (sockaddr*)&address, sizeof(address)) != 0
+		|| !setNonBlocking(newHandle)) {
+		closeHandle(newHandle);
+		return false;
+	}
+
+	this->handle = newHandle;
+	return true;
+}
+
+/**
+ * Wake the thread polling this waker.
+ *
+ */
+void NetWaker::wake() {
+	if (this->handle != NET_INVALID_HANDLE) {
+		char signal = 1;
+		send(NET_SOCKET(this->handle), &signal, 1, 0);
+	}
+}
+
+/**
+ * Clear every wake up that has been sent.
+ *
+ */
+void NetWaker::drain() {
+	char buffer[64];
+	while (this->handle != NET_INVALID_HANDLE && recv(NET_SOCKET(this->handle), buffer, sizeof(buffer), 0) > 0) {
+	}
+}
+
+/**
+ * Default constructor.
+ *
+ */
+NetDatagram::NetDatagram() {
+	this->handle = NET_INVALID_HANDLE;
+	this->port = 0;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+NetDatagram::~NetDatagram() {
+	close();
+}
+
+/**
+ * Join a multicast group. Every socket in the group on the same port gets each
+ * message sent to it, including other programs on the same machine.
+ *
+ * @param group address of the group (239.x.x.x stays inside the LAN)
+ * @param port port of the group
+ * @param interfaceAddress address of the network card to use, or empty for the default one
+ * @param error set to why it failed
+ * @return true if the socket joined the group
+ */
+bool NetDatagram::openMulticast(const string& group, int port, const string& interfaceAddress, string& error) {
+	close();
+
+	if (!NetSocket::startup()) {
+		error = "socket library unavailable";
+		return false;
+	}
+
+	ip_mreq membership = {};
+	if (inet_pton(AF_INET, group.c_str(), &membership.imr_multiaddr) != 1) {
+		error = "invalid group " + group;
+		return false;
+	}
+	membership.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (!interfaceAddress.empty() && inet_pton(AF_INET, interfaceAddress.c_str(), &membership.imr_interface) != 1) {
+		error = "invalid interface " + interfaceAddress;
+		return false;
+	}
+
+	NetHandle newHandle = (NetHandle)socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (newHandle == NET_INVALID_HANDLE) {
+		error = "could not create socket (" + to_string(lastSocketError()) + ")";
+		return false;
+	}
+
+	// Several programs can share the port, each gets its own copy of every message
+	int reuse = 1;
+	setsockopt(NET_SOCKET(newHandle), SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((uint16_t)port);
+
+	// One hop, so messages never leave the LAN, and looped back for programs on this machine
+	int hops = 1;
+	int loop = 1;
+	if (bind(NET_SOCKET(newHandle), (sockaddr*)&address, sizeof(address)) != 0
+		|| setsockopt(NET_SOCKET(newHandle), IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&membership, sizeof(membership)) != 0
+		|| setsockopt(NET_SOCKET(newHandle), IPPROTO_IP, IP_MULTICAST_IF, (const char*)&membership.imr_interface, sizeof(membership.imr_interface)) != 0
+		|| setsockopt(NET_SOCKET(newHandle), IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&hops, sizeof(hops)) != 0
+		|| setsockopt(NET_SOCKET(newHandle), IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loop, sizeof(loop)) != 0
+		|| !setNonBlocking(newHandle)) {
+		error = "could not join " + group + ":" + to_string(port) + " (" + to_string(lastSocketError()) + ")";
+		closeHandle(newHandle);
+		return false;
+	}
+
+	this->handle = newHandle;
+	this->group = group;
+	this->port = port;
+	return true;
+}
+
+/**
+ * Send a message to everyone in the group.
+ *
+ * @param message the message (one datagram)
+ * @return true if it was sent
+ */
+bool NetDatagram::sendToGroup(const string& message) {
+	if (!isOpen()) {
+		return false;
+	}
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons((uint16_t)this->port);
+	inet_pton(AF_INET, this->group.c_str(), &address.sin_addr);
+
+	return sendto(NET_SOCKET(this->handle), message.data(), (int)message.size(), 0, (sockaddr*)&address, sizeof(address)) == (int)message.size();
+}
+
+/**
+ * Receive the next message, if one has arrived.
+ *
+ * @param buffer where to put the message
+ * @param length size of the buffer
+ * @param address set to the address it came from
+ * @return bytes received, NET_WOULD_BLOCK or NET_ERROR
+ */
+int NetDatagram::receiveFrom(char* buffer, size_t length, string& address) {
+	sockaddr_in from = {};
+	SocketLength fromLength = sizeof(from);
+	int received = (int)recvfrom(NET_SOCKET(this->handle), buffer, (int)length, 0, (sockaddr*)&from, &fromLength);
+	if (received < 0) {
+		return isWouldBlock(lastSocketError()) ? NET_WOULD_BLOCK : NET_ERROR;
+	}
+
+	char text[INET_ADDRSTRLEN] = {};
+	inet_ntop(AF_INET, &from.sin_addr, text, sizeof(text));
+	address = text;
+	return received;
+}
+
+/**
+ * Leave the group and close the socket.
+ *
+ */
+void NetDatagram::close() {
+	if (this->handle != NET_INVALID_HANDLE) {
+		closeHandle(this->handle);
+		this->handle = NET_INVALID_HANDLE;
+	}
+}
+
+/**
+ * Wait until any of the sockets can be read or written, or a connection failed.
+ *
+ * @param entries the sockets, ready is set on each one that needs attention
+ * @param timeoutMs how long to wait at most
+ * @return the number of ready sockets, or -1 on error
+ */
+int netPoll(vector<NetPollEntry>& entries, int timeoutMs) {
+#ifdef _WIN32
+	// select, as WSAPoll doesn't report failed connections on older versions of Windows
+	fd_set readSet, writeSet, errorSet;
+	FD_ZERO(&readSet);
+	FD_ZERO(&writeSet);
+	FD_ZERO(&errorSet);
+
+	for (size_t i = 0; i < entries.size() && i < FD_SETSIZE; i++) {
+		entries[i].ready = false;
+		if (entries[i].wantRead) {
+			FD_SET(NET_SOCKET(entries[i].handle), &readSet);
+		}
+		if (entries[i].wantWrite) {
+			FD_SET(NET_SOCKET(entries[i].handle), &writeSet);
+		}
+		FD_SET(NET_SOCKET(entries[i].handle), &errorSet);
+	}
+
+	if (entries.empty()) {
+		Sleep(timeoutMs);
+		return 0;
+	}
+
+	timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+
+	int result = select(0, &readSet, &writeSet, &errorSet, &timeout);
+	if (result <= 0) {
+		return result < 0 ? -1 : 0;
+	}
+
+	int ready = 0;
+	for (size_t i = 0; i < entries.size() && i < FD_SETSIZE; i++) {
+		SOCKET s = NET_SOCKET(entries[i].handle);
+		entries[i].ready = FD_ISSET(s, &readSet) || FD_ISSET(s, &writeSet) || FD_ISSET(s, &errorSet);
+		ready += entries[i].ready ? 1 : 0;
+	}
+	return ready;
+#else
+	vector<pollfd> fds(entries.size());
+	for (size_t i = 0; i < entries.size(); i++) {
+		fds[i].fd = NET_SOCKET(entries[i].handle);
+		fds[i].events = (short)((entries[i].wantRead ? POLLIN : 0) | (entries[i].wantWrite ? POLLOUT : 0));
+		fds[i].revents = 0;
+		entries[i].ready = false;
+	}
+
+	int result = poll(fds.data(), (nfds_t)fds.size(), timeoutMs);
+	if (result <= 0) {
+		return result < 0 && errno != EINTR ? -1 : 0;
+	}
+
+	for (size_t i = 0; i < entries.size(); i++) {
+		entries[i].ready = fds[i].revents != 0;
+	}
+	return result;
+#endif
+}
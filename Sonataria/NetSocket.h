@@ -0,0 +1,141 @@
+/**
+ * @file NetSocket.h
+ *
+ * @brief Net Socket
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// A socket handle that fits both Winsock's SOCKET and a POSIX file descriptor
+// (winsock2.h is only included by NetSocket.cpp so it can't clash with windows.h)
+typedef intptr_t NetHandle;
+#define NET_INVALID_HANDLE ((NetHandle)-1)
+
+// Returned by sendSome and receiveSome when nothing could be moved yet
+#define NET_WOULD_BLOCK -1
+
+// Returned by sendSome and receiveSome when the connection failed
+#define NET_ERROR -2
+
+/**
+ * A non-blocking TCP connection that builds on both Winsock and POSIX sockets
+ */
+class NetSocket {
+
+	private:
+		NetHandle handle;
+
+	public:
+		NetSocket();
+		~NetSocket();
+
+		NetSocket(const NetSocket&) = delete;
+		NetSocket& operator=(const NetSocket&) = delete;
+		NetSocket(NetSocket&& other) noexcept;
+		NetSocket& operator=(NetSocket&& other) noexcept;
+
+		bool startConnect(const string& host, int port, string& error);
+		int pollConnect(string& error);
+		bool listen(int port, string& error);
+		bool accept(NetSocket& client);
+		int getLocalPort();
+		int sendSome(const char* data, size_t length);
+		int receiveSome(char* buffer, size_t length);
+		bool isStale();
+		void close();
+
+		/**
+		 * Gets if the socket is open.
+		 *
+		 * @return true if open
+		 */
+		inline bool isOpen() const { return this->handle != NET_INVALID_HANDLE; }
+
+		/**
+		 * Gets the handle of the socket for polling.
+		 *
+		 * @return the handle
+		 */
+		inline NetHandle getHandle() const { return this->handle; }
+
+		static bool startup();
+};
+
+/**
+ * A socket to wait on and what to wait for
+ */
+struct NetPollEntry {
+	NetHandle handle;
+	bool wantRead;
+	bool wantWrite;
+	bool ready;
+};
+
+/**
+ * Wakes a thread sleeping in netPoll from any other thread
+ */
+class NetWaker {
+
+	private:
+		NetHandle handle;
+
+	public:
+		NetWaker();
+		~NetWaker();
+
+		bool open();
+		void wake();
+		void drain();
+
+		/**
+		 * Gets the handle to add to a poll.
+		 *
+		 * @return the handle
+		 */
+		inline NetHandle getHandle() const { return this->handle; }
+};
+
+/**
+ * A non-blocking UDP socket in a multicast group, for finding other machines on the LAN
+ */
+class NetDatagram {
+
+	private:
+		NetHandle handle;
+		string group;
+		int port;
+
+	public:
+		NetDatagram();
+		~NetDatagram();
+
+		NetDatagram(const NetDatagram&) = delete;
+		NetDatagram& operator=(const NetDatagram&) = delete;
+
+		bool openMulticast(const string& group, int port, const string& interfaceAddress, string& error);
+		bool sendToGroup(const string& message);
+		int receiveFrom(char* buffer, size_t length, string& address);
+		void close();
+
+		/**
+		 * Gets if the socket is open.
+		 *
+		 * @return true if open
+		 */
+		inline bool isOpen() const { return this->handle != NET_INVALID_HANDLE; }
+
+		/**
+		 * Gets the handle of the socket for polling.
+		 *
+		 * @return the handle
+		 */
+		inline NetHandle getHandle() const { return this->handle; }
+};
+
+int netPoll(vector<NetPollEntry>& entries, int timeoutMs);
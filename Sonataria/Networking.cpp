@@ -1,27 +1,33 @@
-#define _WINSOCK_DEPRECATED_NO_WARNINGS
 #define _CRT_SECURE_NO_WARNINGS
 
 
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
 #include "Logger.h"
+#include "NetClient.h"
 #include "Networking.h"
-#include <winsock2.h>
-#include "HTTPRequest.hpp"
+#include "PeerExchange.h"
+#include "ProfileCache.h"
+#include "Tracer.h"
 #include "UserData.h"
 using namespace std;
 
 Networking network;
 
-string convertToString(char* a, int size);
-bool readfile(SOCKET sock, FILE* f);
-bool readdata(SOCKET sock, void* buf, int buflen);
-bool readlong(SOCKET sock, long* value);
+string convertToString(const char* a, int size);
 
-#pragma comment (lib, "WS2_32.lib")
+// The game server's address (the status check stays off unless one is given)
+const char GAME_SERVER[] = "47.41.144.77:57015";
 
-// The IP and PORT to connect to
-const char IP[] = "47.41.144.77";
-const int PORT = 57015;
+// Where the update is downloaded to
+const char UPDATE_FILE[] = "C:/SNA_UPDATE/Update.zip";
+
+// Where each version of the game is installed (C:/<version>)
+const char INSTALL_FOLDER[] = "C:/";
+
+// A full update is extracted here (C:/<version>.staging) and only its version folder is moved into place
+const char STAGING_SUFFIX[] = ".staging";
 
 /**
  * Default constructor.
@@ -33,6 +39,10 @@ Networking::Networking() {
 
 	// Set the information for connecting to the server
 	this->ServerAddress = "http://127.0.0.1:3000";
+	this->GameServerAddress = GAME_SERVER;
+	this->statusCheckEnabled = false;
+	this->updater.setServer(GAME_SERVER);
+	peerExchange.setOrigin(GAME_SERVER);
 }
 
 /**
@@ -52,346 +62,404 @@ string Networking::getLocalVersion() {
 	return this->version;
 }
 
-bool Networking::GetProfileData(string cardID) {
-	try {
-		// Build the URL for the connection
-		string URL = this->ServerAddress + "/data/profile/" + cardID;
-		http::Request request{ URL };
+/**
+ * Use another profile server, such as a local stand-in for testing.
+ *
+ * @param url base URL of the server (http://host:port)
+ */
+void Networking::setProfileServer(string url) {
+	this->ServerAddress = url;
+}
 
-		logger.log("Attempting to retrieve profile data... [" + URL + "]");
+/**
+ * Use another game server, such as a local stand-in for testing. This also turns on the status check.
+ *
+ * @param address address of the server (host:port)
+ */
+void Networking::setGameServer(string address) {
+	this->GameServerAddress = address;
+	this->statusCheckEnabled = true;
+	this->updater.setServer(address);
+	peerExchange.setOrigin(address);
+}
 
-		// Set a GET Request
-		try {
-			const auto response = request.send("GET", "", {}, std::chrono::seconds(5));
+bool Networking::GetProfileData(string cardID) {
+	TraceScope trace("Get profile", "network");
 
-			if (response.status.code == http::Status::Ok) {
-				// Store the response into data
-				string data = string{ response.body.begin(), response.body.end() };
+	NetResponse response = netClient.send(buildProfileRequest(cardID)).get();
+	if (!response.completed) {
+		logger.logError("Failed to contact server. (", response.error, ")");
+		return false;
+	}
 
-				// Set the user settings
-				userData.setUserData(data);
+	string profile;
+	if (response.status == 304 && profileCache.lookup(cardID, profile)) {
+		// The cached copy is still current
+		profileCache.touch(cardID);
+	}
+	else if (response.status == 200) {
+		profile = response.body;
+	}
+	else {
+		logger.logError("Invalid HTTP Status Code: " + to_string(response.status));
+		return false;
+	}
 
-				return true;
-			}
-			else {
-				logger.logError("Invalid HTTP Status Code: " + to_string(response.status.code));
-				return false;
-			}
-		}
-		catch (const std::exception& e) {
-			logger.logError("Failed to contact server.");
-			return false;
-		}
+	try {
+		// Set the user settings
+		userData.setUserData(profile);
 	}
 	catch (const std::exception& e) {
 		logger.logError("Login Request Failed: ");
 		logger.logError(e.what());
 		return false;
 	}
+
+	if (response.status == 200) {
+		profileCache.store(cardID, profile, response.getHeader("ETag"));
+	}
+	syncPendingProfiles();
+	return true;
 }
 
 /**
- * Check the server for it's status.
- * 
- * @return the status of the server
+ * Check a cached profile against the server without waiting, and use the
+ * server's copy if it changed while the card is still logged in.
+ *
+ * @param cardID the card
  */
-int Networking::checkConnection() {
-	return 2;
-	WSADATA wsaData;
-	SOCKET s;
-	sockaddr_in server;
-
-	logger.log(L"Initializing Winsock...");
-	// Initialize WinSock
-	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-		wstring errorMsg = L"Failed. Error code: " + WSAGetLastError();
-		logger.logError(errorMsg);
-		WSACleanup();
-		return 2;
+void Networking::revalidateProfile(string cardID) {
+	// Changes made here go to the server before anything comes back from it
+	vector<ProfileCache::Entry> pending = profileCache.getPending();
+	if (!pending.empty()) {
+		syncPendingProfiles();
 	}
-
-	logger.log(L"Winsock Initialized.");
-
-	// Create a socket
-	if ((s = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET) {
-		wstring errorMsg = L"Could not create socket: " + WSAGetLastError();
-		logger.logError(errorMsg);
-		WSACleanup();
-		return 2;
+	for (size_t i = 0; i < pending.size(); i++) {
+		if (pending[i].cardID == cardID) {
+			return;
+		}
 	}
 
-	logger.log(L"Socket created.");
-
-	// Set the server connection data
-	server.sin_addr.S_un.S_addr = inet_addr(IP);
-	server.sin_family = AF_INET;
-	server.sin_port = htons(PORT);
+	netClient.send(buildProfileRequest(cardID), [cardID](NetResponse& response) {
+		if (!response.completed) {
+			logger.log("Server unreachable, playing on the cached profile.");
+			return;
+		}
+		if (response.status == 304) {
+			profileCache.touch(cardID);
+			return;
+		}
+		if (response.status != 200) {
+			logger.logError("Could not revalidate the cached profile: HTTP " + to_string(response.status));
+			return;
+		}
 
-	// Attempt to connect to the server
-	if (connect(s, (sockaddr*)&server, sizeof(server)) < 0) {
-		logger.logError(L"Could not connect to server.");
-		WSACleanup();
-		return 2;
-	}
+		string cached;
+		bool changed = !profileCache.lookup(cardID, cached) || cached != response.body;
+		if (!profileCache.store(cardID, response.body, response.getHeader("ETag")) || !changed) {
+			return;
+		}
 
-	logger.log(L"Connected.");
+		logger.log("Cached profile was out of date, using the server's copy.");
+		if (userData.getCardNumber() == cardID) {
+			try {
+				userData.setUserData(response.body);
+			}
+			catch (const std::exception& e) {
+				logger.logError("Server sent a bad profile: ", e.what());
+			}
+		}
+	});
+}
 
-	char SEND[] = "Status";
-	// Send data to the server asking for the status
-	if (send(s, SEND, strlen(SEND), 0) == SOCKET_ERROR) {
-		logger.logError(L"Could not send message.");
-		closesocket(s);
-		WSACleanup();
-		return 2;
+/**
+ * Send every profile changed on this cabinet to the server without waiting.
+ * The server's copy wins if it changed since the profile was cached.
+ *
+ */
+void Networking::syncPendingProfiles() {
+	vector<ProfileCache::Entry> pending = profileCache.getPending();
+	for (size_t i = 0; i < pending.size(); i++) {
+		ProfileCache::Entry entry = pending[i];
+
+		NetRequest request;
+		request.method = "PUT";
+		request.url = this->ServerAddress + "/data/profile/" + entry.cardID;
+		request.headers.push_back({ "Content-Type", "application/json" });
+		if (!entry.etag.empty()) {
+			request.headers.push_back({ "If-Match", entry.etag });
+		}
+		request.body = entry.profile;
+		request.timeoutMs = 5000;
+		request.retries = 2;
+
+		netClient.send(request, [this, entry](NetResponse& response) {
+			if (response.ok()) {
+				profileCache.clearPending(entry.cardID, entry.profile, response.getHeader("ETag"));
+				logger.log("Sent cached profile changes to the server.");
+			}
+			else if (response.status == 409 || response.status == 412) {
+				// Changed on the server too, take the server's copy
+				logger.logError("Profile changed on the server as well, keeping the server's copy.");
+				profileCache.clearPending(entry.cardID, entry.profile, "");
+				revalidateProfile(entry.cardID);
+			}
+			else {
+				// Still pending, tried again the next time the server is reached
+				logger.logError("Could not send cached profile changes. (", response.completed ? "HTTP " + to_string(response.status) : response.error, ")");
+			}
+		});
 	}
+}
 
-	logger.log(L"Bytes sent.");
-
-	const int recvBuffSize = 50;
-	char recvBuffer[recvBuffSize] = "";
-	// Try to receive the server status
-	if (recv(s, recvBuffer, recvBuffSize, 0) <= 0) {
-		logger.logError(L"Failed to receive data.");
-		closesocket(s);
-		WSACleanup();
-		return 2;
+/**
+ * Build the request for a card's profile, asking only for changes if it is cached.
+ *
+ * @param cardID the card
+ * @return the request
+ */
+NetRequest Networking::buildProfileRequest(string cardID) {
+	NetRequest request;
+	request.url = this->ServerAddress + "/data/profile/" + cardID;
+	request.timeoutMs = 5000;
+
+	string etag = profileCache.getETag(cardID);
+	if (!etag.empty()) {
+		request.headers.push_back({ "If-None-Match", etag });
 	}
 
-	//cout << "RECEIVED CONN: [" << recvBuffer << "]" << endl;
-	logger.log(L"Received connection.");
-
-	string sStatus;
-	sStatus = (char)recvBuffer[0];
-	int status = stoi(sStatus);
-	
-	char SEND2[] = "EndConn";
-	// Send that we are done with the server
-	if (send(s, SEND2, strlen(SEND2), 0) == SOCKET_ERROR) {
-		logger.logError(L"Could not send message.");
-		closesocket(s);
-		WSACleanup();
-		return 2;
-	}
-	
-	logger.log(L"Bytes sent.");
+	logger.log("Attempting to retrieve profile data... [" + request.url + "]");
+	return request;
+}
 
-	//1-online 2-offline 3-maint
+/**
+ * Check the server for it's status, waiting for the answer.
+ * 
+ * @return the status of the server (1 online, 2 offline, 3 maintenance)
+ */
+int Networking::checkConnection() {
+	TraceScope trace("Check connection", "network");
+
+	promise<int> status;
+	future<int> result = status.get_future();
+	checkConnection([&status](int serverStatus) {
+		status.set_value(serverStatus);
+	});
+	return result.get();
+}
 
-	// Close the socket
-	if (closesocket(s) == SOCKET_ERROR) {
-		logger.logError(L"Could not close socket.");
-		WSACleanup();
-		return 2;
+/**
+ * Check the server for it's status without waiting.
+ *
+ * @param callback called with the status of the server (1 online, 2 offline, 3 maintenance) on the network thread
+ */
+void Networking::checkConnection(function<void(int)> callback) {
+	// Report offline without asking when there is no server to ask
+	if (!this->statusCheckEnabled) {
+		callback(2);
+		return;
 	}
 
-	logger.log(L"Socket Closed.");
+	NetRequest request;
+	request.protocol = NET_COMMAND;
+	request.url = this->GameServerAddress;
+	request.body = "Status";
+	request.timeoutMs = 3000;
+	request.retries = 1;
+
+	netClient.send(request, [callback](NetResponse& response) {
+		if (!response.completed || response.body.empty()) {
+			logger.logError("Could not get the server status. (", response.error, ")");
+			callback(2);
+			return;
+		}
 
-	// Clean up and return the status
-	WSACleanup();
-	return status;
+		//1-online 2-offline 3-maint
+		int status = response.body[0] - '0';
+		if (status < 1 || status > 3) {
+			logger.logError("Unknown server status: " + response.body.substr(0, 1));
+			status = 2;
+		}
+		callback(status);
+	});
 }
 
 /**
- * Check the server if there are updates availible.
+ * Check the server if there are updates availible, waiting for the answer.
  * 
- * @return the version stored on the server
+ * @return the version stored on the server, or NONE if it couldn't be reached
  */
 string Networking::checkForUpdates() {
+	TraceScope trace("Check for updates", "network");
+
+	promise<string> version;
+	future<string> result = version.get_future();
+	checkForUpdates([&version](string serverVersion) {
+		version.set_value(serverVersion);
+	});
+	return result.get();
+}
 
-	WSADATA wsaData;
-	SOCKET s;
-	sockaddr_in server;
-
-	logger.log(L"Initializing Winsock...");
-	// Initialize WinSock
-	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-		wstring errorMsg = L"Failed. Error code: " + WSAGetLastError();
-		logger.logError(errorMsg);
-		WSACleanup();
-		return "NONE";
-	}
-
-	logger.log(L"Initialized.");
-
-	// Create a socket
-	if ((s = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET) {
-		wstring errorMsg = L"Could not create socket: " + WSAGetLastError();
-		logger.logError(errorMsg);
-		WSACleanup();
-		return "NONE";
-	}
+/**
+ * Check the server if there are updates availible without waiting.
+ *
+ * @param callback called with the version stored on the server, or NONE if it couldn't be reached, on the network thread
+ */
+void Networking::checkForUpdates(function<void(string)> callback) {
+	NetRequest request;
+	request.protocol = NET_COMMAND;
+	request.url = this->GameServerAddress;
+	request.body = "Version";
+	request.timeoutMs = 5000;
+	request.retries = 2;
+
+	netClient.send(request, [callback](NetResponse& response) {
+		if (!response.completed) {
+			logger.logError("Could not get the server version. (", response.error, ")");
+			callback("NONE");
+			return;
+		}
 
-	logger.log(L"Socket created.");
+		logger.log(L"Received Version.");
+		callback(convertToString(response.body.data(), (int)response.body.size()));
+	});
+}
 
-	// Set the info for the connection
-	server.sin_addr.S_un.S_addr = inet_addr(IP);
-	server.sin_family = AF_INET;
-	server.sin_port = htons(PORT);
+/**
+ * Download the update, carrying on from an earlier attempt if there is one. When
+ * the server lists the files of the new version only the changed ones are downloaded
+ * and the new version's folder is built straight away.
+ * 
+ * @param version the version the server said it has
+ * @return how the update was downloaded
+ */
+UPDATE_RESULT Networking::downloadUpdate(string version) {
+	logger.log(L"Downloading...");
 
-	// Attempt to connect
-	if (connect(s, (sockaddr*)&server, sizeof(server)) < 0) {
-		logger.logError(L"Could not connect to server.");
-		WSACleanup();
-		return "NONE";
+	UpdateDownloader::Manifest manifest;
+	if (!this->updater.fetchManifest(manifest)) {
+		return UPDATE_FAILED;
 	}
-
-	logger.log(L"Connected.");
-
-	char SEND[] = "Version";
-	// Send data asking for the version
-	if (send(s, SEND, strlen(SEND), 0) == SOCKET_ERROR) {
-		logger.logError(L"Could not send message.");
-		closesocket(s);
-		WSACleanup();
-		return "NONE";
+	// An older signed manifest can't be used to roll the game back
+	if (manifest.version != version) {
+		logger.logError("Update manifest is for version ", manifest.version, " but the server has ", version);
+		return UPDATE_FAILED;
 	}
 
-	logger.log(L"Bytes sent.");
+	// Chunks kept for other cabinets are only for this version
+	peerExchange.setVersion(version);
 
-	const int recvBuffSize = 50;
-	char recvBuffer[recvBuffSize] = "";
-	// Receive the version
-	if (recv(s, recvBuffer, recvBuffSize, 0) <= 0) {
-		logger.logError(L"Failed to receive data.");
-		closesocket(s);
-		WSACleanup();
-		return "NONE";
+	if (!manifest.files.empty()) {
+		string currentFolder = filesystem::current_path().generic_string();
+		if (this->stager.stage(this->updater, manifest, currentFolder, INSTALL_FOLDER + version)) {
+			logger.log(L"Delta update staged!");
+			return UPDATE_STAGED;
+		}
+		if (manifest.size == 0) {
+			return UPDATE_FAILED;
+		}
+		logger.logError("Delta update failed, downloading the full update instead");
 	}
 
-	string sVersion = convertToString(recvBuffer, recvBuffSize);
-
-	//cout << "RECEIVED VER: [" << sVersion << "]" << endl;
-	logger.log(L"Received Version.");
-
-	char SEND2[] = "EndConn";
-	// Send that we are done with connection
-	if (send(s, SEND2, strlen(SEND2), 0) == SOCKET_ERROR) {
-		logger.logError(L"Could not send message.");
-		closesocket(s);
-		WSACleanup();
-		return "NONE";
+	// Entries are extracted into a staging folder, finishing in extractUpdate() once the whole file has matched the manifest
+	this->updateVersion = version;
+	string stagingFolder = INSTALL_FOLDER + version + STAGING_SUFFIX;
+	error_code error;
+	filesystem::remove_all(stagingFolder, error);
+	this->extractor.begin(stagingFolder);
+
+	// Entries can only be extracted as they download when every chunk is checked as it arrives
+	if (!manifest.chunks.empty()) {
+		this->updater.setDataListener([this](uint64_t offset, const uint8_t* data, size_t size) {
+			this->extractor.write(offset, data, size);
+		});
 	}
-
-	logger.log(L"Bytes sent.");
-
-	// Close the socket
-	if (closesocket(s) == SOCKET_ERROR) {
-		logger.logError(L"Could not close socket.");
-		WSACleanup();
-		return "NONE";
+	bool downloaded = this->updater.download(manifest, UPDATE_FILE);
+	this->updater.setDataListener(nullptr);
+	if (!downloaded) {
+		this->extractor.cancel();
+		return UPDATE_FAILED;
 	}
 
-	logger.log(L"Socket Closed.");
-
-	// Close the connection and return the version
-	WSACleanup();
-	return sVersion;
+	logger.log(L"Download success!");
+	return UPDATE_FULL;
 }
 
 /**
- * Download the update.
- * 
- * @return true if successful
+ * Extract the rest of a full update once it has downloaded, checking every file's CRC,
+ * then move the new version's folder into place.
+ *
+ * @return true if the whole update was extracted
  */
-bool Networking::downloadUpdate() {
-	WSADATA wsaData;
-	SOCKET s;
-	sockaddr_in server;
+bool Networking::extractUpdate() {
+	string stagingFolder = INSTALL_FOLDER + this->updateVersion + STAGING_SUFFIX;
+	string stagedVersion = stagingFolder + "/" + this->updateVersion;
+	string targetFolder = INSTALL_FOLDER + this->updateVersion;
 
-	logger.log(L"Downloading...");
-
-	logger.log(L"Initializing Winsock...");
-	// Initialize WinSock
-	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-		wstring errorMsg = L"Failed. Error code: " + WSAGetLastError();
-		logger.logError(errorMsg);
-		WSACleanup();
+	if (!this->extractor.finish(UPDATE_FILE)) {
+		this->extractor.cancel();
 		return false;
 	}
 
-	logger.log(L"Initialized.");
-
-	// Create a socket
-	if ((s = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET) {
-		wstring errorMsg = L"Could not create socket: " + WSAGetLastError();
-		logger.logError(errorMsg);
-		WSACleanup();
+	// Anything in the archive outside the new version's folder is left behind
+	error_code error;
+	if (!filesystem::is_directory(stagedVersion, error)) {
+		logger.logError("The update has no ", this->updateVersion, " folder");
+		filesystem::remove_all(stagingFolder, error);
 		return false;
 	}
 
-	logger.log(L"Socket created.");
-
-	// Set data for the connection
-	server.sin_addr.S_un.S_addr = inet_addr(IP);
-	server.sin_family = AF_INET;
-	server.sin_port = htons(PORT);
-
-	// Attempt to connect
-	if (connect(s, (sockaddr*)&server, sizeof(server)) < 0) {
-		logger.logError(L"Could not connect to server.");
-		WSACleanup();
+	filesystem::remove_all(targetFolder, error);
+	filesystem::rename(stagedVersion, targetFolder, error);
+	if (error) {
+		logger.logError("Could not move the extracted update to ", targetFolder, ": ", error.message());
+		filesystem::remove_all(stagingFolder, error);
 		return false;
 	}
+	filesystem::remove_all(stagingFolder, error);
 
-	logger.log(L"Connected.");
-
-	char SEND[] = "DLUpdate";
-	// Send that we want to download the update
-	if (send(s, SEND, strlen(SEND), 0) == SOCKET_ERROR) {
-		logger.logError(L"Could not send message.");
-		closesocket(s);
-		WSACleanup();
-		return false;
-	}
-
-	logger.log(L"Bytes sent.");
-
-	//Create a new file that we will write to in binary
-	FILE* filehandle = fopen("C:/SNA_UPDATE/Update.zip", "wb+");
-	if (filehandle != NULL)
-	{
-		// Read from the server and save to the file
-		bool ok = readfile(s, filehandle);
-		fclose(filehandle);
-
-		if (ok)
-		{
-			logger.log(L"Download success!");
-		}
-		else {
-			logger.logError(L"Error Downloading File!");
-			return false;
-		}
-	}
-
-	char SEND2[] = "EndConn";
-	// Send that we are done with the connection
-	if (send(s, SEND2, strlen(SEND2), 0) == SOCKET_ERROR) {
-		logger.logError(L"Could not send message.");
-		closesocket(s);
-		WSACleanup();
-		return false;
-	}
-
-	logger.log(L"Bytes sent.");
+	logger.log("Update extracted to ", targetFolder);
+	return true;
+}
 
-	// Close the socket
-	if (closesocket(s) == SOCKET_ERROR) {
-		logger.logError(L"Could not close socket.");
-		WSACleanup();
-		// don't return false as not a fatal error
-		// still success in downloading the update file
-	}
-	else {
-		logger.log(L"Socket Closed.");
-	}
+/**
+ * Gets how far the update download has got.
+ *
+ * @return the progress
+ */
+UpdateDownloader::Progress Networking::getDownloadProgress() {
+	return this->updater.getProgress();
+}
 
-	// Clean up and return that we downloaded successfully
-	WSACleanup();
+/**
+ * Gets how far the update extraction has got.
+ *
+ * @return the progress
+ */
+ZipExtractor::Progress Networking::getExtractProgress() {
+	return this->extractor.getProgress();
+}
 
-	logger.log(L"Done downloading...");
+/**
+ * Keep update work out of the game's way. Extraction moves to one background priority
+ * thread, and downloading, hashing and extracting are all paced by the throttle.
+ *
+ * @param throttle called with the size of each block of work, may sleep, and returns false if the work should stop
+ */
+void Networking::runUpdatesInBackground(function<bool(size_t)> throttle) {
+	this->updater.setThrottle(throttle);
+	this->extractor.setThrottle(throttle);
+	this->extractor.setLowPriority(true);
+	peerExchange.setThrottle(throttle);
+}
 
-	return true;
+/**
+ * Check update manifests with another key, such as a test key.
+ *
+ * @param path the key file
+ */
+void Networking::setUpdateKey(string path) {
+	this->updater.setKeyPath(path);
 }
 
 /**
@@ -401,7 +469,7 @@ bool Networking::downloadUpdate() {
  * @param size size of array
  * @return the string
  */
-string convertToString(char* a, int size)
+string convertToString(const char* a, int size)
 {
 	int i;
 	string s = "";
@@ -413,87 +481,3 @@ string convertToString(char* a, int size)
 	}
 	return s;
 }
-
-/**
- * Read data in from a file.
- * 
- * @param sock Socket to connect to
- * @param f File to read from
- * @return true if successful
- */
-bool readfile(SOCKET sock, FILE* f)
-{
-	long filesize;
-	if (!readlong(sock, &filesize))
-		return false;
-	if (filesize > 0)
-	{
-		char buffer[1024];
-		do
-		{
-			int num = min(filesize, sizeof(buffer));
-			if (!readdata(sock, buffer, num))
-				return false;
-			int offset = 0;
-			do
-			{
-				size_t written = fwrite(&buffer[offset], 1, num - offset, f);
-				if (written < 1)
-					return false;
-				offset += written;
-			} while (offset < num);
-			filesize -= num;
-		} while (filesize > 0);
-	}
-	return true;
-}
-
-/**
- * Not my function, used for readFile()
- * 
- * @param sock
- * @param buf
- * @param buflen
- * @return 
- */
-bool readdata(SOCKET sock, void* buf, int buflen)
-{
-	char* pbuf = (char*)buf;
-
-	while (buflen > 0)
-	{
-		int num = recv(sock, pbuf, buflen, 0);
-		if (num == SOCKET_ERROR)
-		{
-			if (WSAGetLastError() == WSAEWOULDBLOCK)
-			{
-				// optional: use select() to check for timeout to fail the read
-				continue;
-			}
-			return false;
-		}
-		else if (num == 0)
-			return false;
-
-		pbuf += num;
-		buflen -= num;
-	}
-
-	return true;
-}
-
-/**
- * Not my function, used for readFile()
- *
- * @param sock
- * @param buf
- * @param buflen
- * @return
- */
-bool readlong(SOCKET sock, long* value)
-{
-	if (!readdata(sock, value, sizeof(value)))
-		return false;
-	*value = ntohl(*value);
-	return true;
-}
\ No newline at end of file
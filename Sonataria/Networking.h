@@ -5,10 +5,26 @@
  *
  * @author Julia Butenhoff
  */
+#include <functional>
 #include <string>
 using namespace std;
 #pragma once
 
+#include "UpdateDownloader.h"
+#include "UpdateStager.h"
+#include "ZipExtractor.h"
+
+struct NetRequest;
+
+/**
+ * How an update was downloaded
+ */
+enum UPDATE_RESULT {
+	UPDATE_FAILED,
+	UPDATE_FULL,		// Update.zip is ready to be extracted
+	UPDATE_STAGED		// The new version's folder is already in place
+};
+
 /**
  * Takes care of online features and connecting to the server
  */
@@ -20,16 +36,36 @@ class Networking {
 
 		string getLocalVersion();
 
+		void setProfileServer(string url);
+		void setGameServer(string address);
+
 		bool GetProfileData(string);
+		void revalidateProfile(string cardID);
+		void syncPendingProfiles();
 
 		int checkConnection();
+		void checkConnection(function<void(int)> callback);
 		string checkForUpdates();
-		bool downloadUpdate();
-		
+		void checkForUpdates(function<void(string)> callback);
+		UPDATE_RESULT downloadUpdate(string version);
+		UpdateDownloader::Progress getDownloadProgress();
+		bool extractUpdate();
+		ZipExtractor::Progress getExtractProgress();
+		void runUpdatesInBackground(function<bool(size_t)> throttle);
+		void setUpdateKey(string path);
+
 
 	private:
+		NetRequest buildProfileRequest(string cardID);
+
 		string version;
+		string updateVersion;
 		string ServerAddress;
+		string GameServerAddress;
+		bool statusCheckEnabled;
+		UpdateDownloader updater;
+		UpdateStager stager;
+		ZipExtractor extractor;
 };
 
 extern Networking network;
@@ -23,6 +23,9 @@ Note::Note(float t, bool isH, float hDur, int nDen, int bpm) {
 
 	this->hitHold = false;
 
+	// Start at the top of the screen until the note is first positioned
+	this->yPos = 1080.f;
+
 	this->notesRemaining = this->noteDensity;
 	this->holdNoteDistance = (float)this->holdLength / ((float)this->noteDensity - 1.f);
 	this->notesUsed = 0;
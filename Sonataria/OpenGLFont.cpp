@@ -4,6 +4,7 @@
 
 #include <iostream>
 #include "Logger.h"
+#include "TextureLoader.h"
 using namespace std;
 
 FT_Library OpenGLFont::ftLib = nullptr;
@@ -63,7 +64,7 @@ void OpenGLFont::buildTextures(FT_Face ftFace, unsigned long characterCount) {
         // generate texture
         unsigned int texture;
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        TextureLoader::Inst()->BindTextureUnit(0, texture);
         glTexImage2D(
             GL_TEXTURE_2D,
             0,
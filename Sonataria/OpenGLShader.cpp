@@ -1,11 +1,28 @@
 #include "OpenGLShader.h"
 
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdint.h>
 #include <string>
+#include <vector>
+#include "Checksum.h"
 #include "Logger.h"
 #include <sstream>
 using namespace std;
 
-OpenGLShader::OpenGLShader(int vShaderResID, int fShaderResID) {
+// Resources are used unless a folder is given, outside Windows there are none
+#ifdef _WIN32
+string OpenGLShader::shaderFolder = "";
+#else
+string OpenGLShader::shaderFolder = ".";
+#endif
+string OpenGLShader::cacheFolder = SHADER_CACHE_FOLDER;
+
+// First line of a cached program, changed whenever the file layout is
+#define SHADER_CACHE_MAGIC "SNASHADER 1"
+
+OpenGLShader::OpenGLShader(int vShaderResID, int fShaderResID, const char* vShaderFile, const char* fShaderFile) {
 	this->shaderInitialized = false;
 	this->vertShader = 0;
 	this->fragShader = 0;
@@ -13,6 +30,8 @@ OpenGLShader::OpenGLShader(int vShaderResID, int fShaderResID) {
 
 	this->vShaderResID = vShaderResID;
 	this->fShaderResID = fShaderResID;
+	this->vShaderFile = vShaderFile;
+	this->fShaderFile = fShaderFile;
 }
 
 OpenGLShader::~OpenGLShader() {
@@ -21,23 +40,76 @@ OpenGLShader::~OpenGLShader() {
 	glDeleteProgram(this->shaderProgram);
 }
 
+/**
+ * Read shader source from files in a folder instead of the executable's resources.
+ *
+ * @param folder the folder, empty to use the resources
+ */
+void OpenGLShader::setShaderFolder(string folder) {
+	shaderFolder = folder;
+}
+
+/**
+ * Set where linked programs are saved, so later boots can skip compiling them.
+ *
+ * @param folder the folder, empty to turn the cache off
+ */
+void OpenGLShader::setCacheFolder(string folder) {
+	cacheFolder = folder;
+}
+
 bool OpenGLShader::initShader() {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
 	// Vertex Shader
-	char* vertex_shader = LoadShader(vShaderResID);
-	if (vertex_shader == nullptr) {
+	string vertexSource;
+	if (!LoadShader(vShaderResID, vShaderFile, vertexSource)) {
 		logger.logError(L"Error Loading Vertex Shader");
 		return false;
 	}
 	logger.log(L"Vertex shader code loaded");
 
 	// Fragment Shader
-	char* fragment_shader = LoadShader(fShaderResID);
-	if (fragment_shader == nullptr) {
+	string fragmentSource;
+	if (!LoadShader(fShaderResID, fShaderFile, fragmentSource)) {
 		logger.logError(L"Error Loading Fragment Shader");
 		return false;
 	}
 	logger.log(L"Fragment shader code loaded");
 
+	// Use the program linked on an earlier boot if it was made by the same driver from the same source
+	string key = getCacheKey(vertexSource, fragmentSource);
+	bool cached = loadCachedProgram(key);
+	if (!cached) {
+		if (!compileProgram(vertexSource, fragmentSource)) {
+			return false;
+		}
+		saveCachedProgram(key);
+	}
+	glUseProgram(this->shaderProgram);
+
+	// Setup shader uniform variables (a program binary doesn't keep their values)
+	this->initUniforms();
+
+	int64_t tookMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+	logger.log(cached ? "Loaded " : "Compiled ", vShaderFile, " + ", fShaderFile, cached ? " from the shader cache in " : " in ", to_string(tookMs), "ms");
+
+	// Finish and indicate success
+	this->shaderInitialized = true;
+	return true;
+}
+
+/**
+ * Compile the shaders and link them into the program.
+ *
+ * @param vertexSource source of the vertex shader
+ * @param fragmentSource source of the fragment shader
+ * @return true if the program linked
+ */
+bool OpenGLShader::compileProgram(const string& vertexSource, const string& fragmentSource) {
+	const char* vertex_shader = vertexSource.c_str();
+	const char* fragment_shader = fragmentSource.c_str();
+
 	// Compile Shaders
 	vertShader = glCreateShader(GL_VERTEX_SHADER);
 	glShaderSource(vertShader, 1, &vertex_shader, NULL);
@@ -57,23 +129,177 @@ bool OpenGLShader::initShader() {
 	// Bind attribute index values (must happen before linking)
 	this->initAttributes();
 
+	// Ask for a binary that can be saved to the cache
+	if (isCacheSupported()) {
+		glProgramParameteri(this->shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
 	// Link the shaders into a usable program
 	glLinkProgram(this->shaderProgram);
 	checkProgramLog(this->shaderProgram);
-	glUseProgram(this->shaderProgram);
 
-	// Free the shader resources that were malloc'd
-	free(vertex_shader);
-	free(fragment_shader);
+	GLint linked = GL_FALSE;
+	glGetProgramiv(this->shaderProgram, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE) {
+		logger.logError("Failed to link ", vShaderFile, " + ", fShaderFile);
+		return false;
+	}
+	return true;
+}
 
-	// Setup shader uniform variables
-	this->initUniforms();
+/**
+ * Check if the driver can hand out linked programs and take them back.
+ *
+ * @return true if programs can be cached
+ */
+bool OpenGLShader::isCacheSupported() {
+	if (cacheFolder.empty() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)) {
+		return false;
+	}
 
-	// Finish and indicate success
-	this->shaderInitialized = true;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+/**
+ * Where this program is cached.
+ *
+ * @return path of the cache file
+ */
+string OpenGLShader::getCachePath() const {
+	return cacheFolder + "/" + filesystem::path(vShaderFile).stem().string() + "+" + filesystem::path(fShaderFile).stem().string() + ".bin";
+}
+
+/**
+ * Make the key a cached program has to match to be used. A binary only works with the
+ * driver that made it, so a driver update or a different GPU means compiling again.
+ *
+ * @param vertexSource source of the vertex shader
+ * @param fragmentSource source of the fragment shader
+ * @return the key
+ */
+string OpenGLShader::getCacheKey(const string& vertexSource, const string& fragmentSource) {
+	const char* vendor = (const char*)glGetString(GL_VENDOR);
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	const char* version = (const char*)glGetString(GL_VERSION);
+
+	uint64_t sourceHash = fnv1a64(vertexSource);
+	sourceHash = fnv1a64("", 1, sourceHash);
+	sourceHash = fnv1a64(fragmentSource.data(), fragmentSource.size(), sourceHash);
+
+	string key = string(vendor != nullptr ? vendor : "") + "|" + (renderer != nullptr ? renderer : "") + "|" + (version != nullptr ? version : "") + "|" + toHex(sourceHash);
+
+	// The key is one line of the cache file
+	for (size_t i = 0; i < key.size(); i++) {
+		if (key[i] == '\r' || key[i] == '\n') {
+			key[i] = ' ';
+		}
+	}
+	return key;
+}
+
+/**
+ * Load the program from the cache.
+ *
+ * @param key the key the cached program has to match
+ * @return true if the program was loaded, otherwise it has to be compiled
+ */
+bool OpenGLShader::loadCachedProgram(const string& key) {
+	if (!isCacheSupported()) {
+		return false;
+	}
+
+	string path = getCachePath();
+	ifstream in(path, ios::binary);
+	if (!in) {
+		return false;
+	}
+
+	string magic, savedKey;
+	getline(in, magic);
+	getline(in, savedKey);
+	if (magic != SHADER_CACHE_MAGIC || savedKey != key) {
+		logger.log("Cached ", path, " is from another driver or source, compiling again");
+		return false;
+	}
+
+	uint32_t format = 0;
+	uint32_t length = 0;
+	in.read((char*)&format, sizeof(format));
+	in.read((char*)&length, sizeof(length));
+	vector<char> binary(length);
+	in.read(binary.data(), length);
+	if (!in || length == 0) {
+		logger.logError("Cached ", path, " is cut short, compiling again");
+		return false;
+	}
+
+	this->shaderProgram = glCreateProgram();
+	glProgramBinary(this->shaderProgram, (GLenum)format, binary.data(), (GLsizei)length);
+
+	// The driver may still turn it down, its own version isn't always in the version string
+	GLint linked = GL_FALSE;
+	glGetProgramiv(this->shaderProgram, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE) {
+		logger.log("Driver turned down cached ", path, ", compiling again");
+		glDeleteProgram(this->shaderProgram);
+		this->shaderProgram = 0;
+		return false;
+	}
 	return true;
 }
 
+/**
+ * Save the linked program to the cache. Nothing is lost if this fails, the next boot
+ * just compiles again.
+ *
+ * @param key the key the program is saved under
+ */
+void OpenGLShader::saveCachedProgram(const string& key) {
+	if (!isCacheSupported()) {
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(this->shaderProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+
+	vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(this->shaderProgram, length, &written, &format, binary.data());
+	if (written <= 0) {
+		return;
+	}
+
+	error_code error;
+	filesystem::create_directories(cacheFolder, error);
+
+	// Written next to it first so a power cut can't leave half a file
+	string path = getCachePath();
+	{
+		ofstream out(path + ".tmp", ios::binary | ios::trunc);
+		uint32_t savedFormat = (uint32_t)format;
+		uint32_t savedLength = (uint32_t)written;
+		out << SHADER_CACHE_MAGIC << "\n" << key << "\n";
+		out.write((const char*)&savedFormat, sizeof(savedFormat));
+		out.write((const char*)&savedLength, sizeof(savedLength));
+		out.write(binary.data(), written);
+		if (!out) {
+			logger.logError("Could not write ", path);
+			return;
+		}
+	}
+
+	filesystem::rename(path + ".tmp", path, error);
+	if (error) {
+		logger.logError("Could not save ", path, ": ", error.message());
+	}
+}
+
 void OpenGLShader::checkShaderLog(GLuint shader)
 {
 	GLsizei logLength;
@@ -94,6 +320,7 @@ void OpenGLShader::checkProgramLog(GLuint shader)
 	logger.log(outputBuilder.str());
 }
 
+#ifdef _WIN32
 // Utility function to log the most recent WIN32 error
 void logLastWin32Error() {
 	LPTSTR lpMsgBuf = nullptr;
@@ -147,27 +374,51 @@ bool OpenGLShader::LoadShaderInResource(int name, DWORD& size, const char*& data
 	data = static_cast<const char*>(::LockResource(rcData));
 	return true;
 }
+#endif
 
 /**
- * Load a shader with a given resouce id.
+ * Read a shader from a file.
+ *
+ * @param path the file
+ * @param source the source read
+ * @return true if it was read
+ */
+bool OpenGLShader::LoadShaderFile(const string& path, string& source) {
+	ifstream in(path, ios::binary);
+	if (!in) {
+		logger.logError("Failed to open ", path);
+		return false;
+	}
+
+	stringstream contents;
+	contents << in.rdbuf();
+	source = contents.str();
+	return true;
+}
+
+/**
+ * Load a shader, from the shader folder if one is set, otherwise from the resource
+ * with the given id.
  *
  * @param id of the shader resource to load
- * @return the char* of data of the shader
+ * @param file name of the shader in the shader folder
+ * @param source the source of the shader
+ * @return true if it was loaded
  */
-char* OpenGLShader::LoadShader(int id) {
+bool OpenGLShader::LoadShader(int id, const string& file, string& source) {
+	if (!shaderFolder.empty()) {
+		if (LoadShaderFile(shaderFolder + "/" + file, source)) {
+			return true;
+		}
+	}
+
+#ifdef _WIN32
 	DWORD vshader_size;
 	const char* vertex_shader_ptr = nullptr;
-	char* vertex_shader = nullptr;
 	if (LoadShaderInResource(id, vshader_size, vertex_shader_ptr, "GLSLShader")) {
-		size_t size = vshader_size + 1;
-		vertex_shader = (char*)malloc(size);
-		memcpy_s((void*)vertex_shader, vshader_size, vertex_shader_ptr, vshader_size);
-		vertex_shader[vshader_size] = '\0';
-
-		return vertex_shader;
-	}
-	else
-	{
-		return nullptr;
+		source.assign(vertex_shader_ptr, vshader_size);
+		return true;
 	}
+#endif
+	return false;
 }
@@ -1,13 +1,22 @@
 #pragma once
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <GL/glew.h>
+#include <string>
+
+// Folder linked programs are kept in between boots, see OpenGLShader::setCacheFolder()
+#define SHADER_CACHE_FOLDER "ShaderCache"
 
 class OpenGLShader
 {
 public:
-	OpenGLShader(int vShaderResID, int fShaderResID);
+	OpenGLShader(int vShaderResID, int fShaderResID, const char* vShaderFile, const char* fShaderFile);
 	~OpenGLShader();
 
+	static void setShaderFolder(std::string folder);
+	static void setCacheFolder(std::string folder);
+
 	bool initShader();
 
 	bool isValid() const { return shaderInitialized;  }
@@ -16,6 +25,7 @@ public:
 protected:
 	bool shaderInitialized;
 	int vShaderResID, fShaderResID;
+	std::string vShaderFile, fShaderFile;
 	GLuint vertShader, fragShader, shaderProgram;
 
 	// Override in children
@@ -25,6 +35,20 @@ protected:
 	// General Shader helper functions
 	static void checkShaderLog(GLuint shader);
 	static void checkProgramLog(GLuint shader);
-	static char* LoadShader(int id);
+	static bool LoadShader(int id, const std::string& file, std::string& source);
+	static bool LoadShaderFile(const std::string& path, std::string& source);
+#ifdef _WIN32
 	static bool LoadShaderInResource(int name, DWORD & size, const char*& data, const char* type);
+#endif
+
+	// Program binary cache
+	static std::string shaderFolder;
+	static std::string cacheFolder;
+
+	std::string getCachePath() const;
+	static std::string getCacheKey(const std::string& vertexSource, const std::string& fragmentSource);
+	static bool isCacheSupported();
+	bool loadCachedProgram(const std::string& key);
+	void saveCachedProgram(const std::string& key);
+	bool compileProgram(const std::string& vertexSource, const std::string& fragmentSource);
 };
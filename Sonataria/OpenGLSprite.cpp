@@ -1,5 +1,9 @@
 #include "OpenGLSprite.h"
 #include "TextureLoader.h"
+#include "SpriteBatch.h"
+#include "StreamBuffer.h"
+#include <cfloat>
+#include <cstring>
 
 #include "Logger.h"
 
@@ -17,6 +21,10 @@ OpenGLSprite::OpenGLSprite(const wstring& newName) : name(newName) {
 	renderType = GL_TRIANGLES;
 	program = 0;
 	vertexDataChanged = false;
+	drawn = streamed = false;
+	streamVao = 0;
+	streamFirst = 0;
+	streamFrame = 0;
 
 	enableStretch = false;
 	xStretch[0] = 1.0f;
@@ -36,8 +44,7 @@ void OpenGLSprite::createAttribPointer(GLuint attribIndex, int count, int stride
 
 void OpenGLSprite::bindTexture() const
 {
-	// Bind texture for use
-	glActiveTexture(GL_TEXTURE0);
+	// Bind texture for use on unit 0
 	TextureLoader::Inst()->BindTexture(managerTexID);
 }
 
@@ -66,16 +73,23 @@ void OpenGLSprite::initSprite(GLuint program)
 	this->program = program;
 }
 
-void OpenGLSprite::refreshSprite() const {
-	// Length of one cluster of vertex data (in bytes)
-	int stride = (3 + (hasColors ? 3 : 0) + (hasUVs ? 2 : 0)) * sizeof(float);
+int OpenGLSprite::getStride() const {
+	return (3 + (hasColors ? 3 : 0) + (hasUVs ? 2 : 0)) * sizeof(float);
+}
 
+void OpenGLSprite::refreshSprite() const {
 	// Bind previouly generate VAO
 	glBindVertexArray(vao);
 
 	// Pass data into vertex buffer (copies into GPU memory)
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, vertCount * stride, pointData, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertCount * getStride(), pointData, GL_STATIC_DRAW);
+
+	createAttribPointers();
+}
+
+void OpenGLSprite::createAttribPointers() const {
+	int stride = getStride();
 
 	// Set pointers to different vertex attributes
 	createAttribPointer(ATTRIB_POSITION_INDEX, 3, stride, 0); // Position
@@ -87,6 +101,31 @@ void OpenGLSprite::refreshSprite() const {
 	}
 }
 
+bool OpenGLSprite::streamVertices(GLint& first) const {
+	// Written once a frame, or again whenever they change within it
+	if (vertexDataChanged || streamFrame != streamBuffer.getFrame()) {
+		int stride = getStride();
+		GLintptr offset;
+		if (!streamBuffer.write(pointData, vertCount * stride, stride, offset)) {
+			return false;
+		}
+		streamFirst = (GLint)(offset / stride);
+		streamFrame = streamBuffer.getFrame();
+		vertexDataChanged = false;
+	}
+
+	// The pointers start at the beginning of the stream buffer, the draw picks the vertices
+	if (streamVao == 0) {
+		glGenVertexArrays(1, &streamVao);
+		glBindVertexArray(streamVao);
+		glBindBuffer(GL_ARRAY_BUFFER, streamBuffer.getBuffer());
+		createAttribPointers();
+	}
+
+	first = streamFirst;
+	return true;
+}
+
 void OpenGLSprite::setTextureID(GLuint managerTexID)
 {
 	// Initialize texture
@@ -116,15 +155,87 @@ void OpenGLSprite::popMatrix()
 	}
 }
 
+bool OpenGLSprite::addToBatch(const Matrix4& mT, const Matrix4& mProj) const {
+	// Sprites without their own texture draw with whatever is bound, so can't be moved
+	if (managerTexID == 0 || !hasColors || !hasUVs || vertCount < 3 || (renderType != GL_TRIANGLE_FAN && renderType != GL_TRIANGLES)) {
+		return false;
+	}
+
+	// Account for model hierarchy
+	Matrix4 modelTrans = mT;
+	if (!matrixStack.empty())
+	{
+		modelTrans = matrixStack.top() * modelTrans;
+	}
+
+	// Do what the vertex shader would do with the model matrix and stretching
+	static vector<float> transformed;
+	transformed.resize(vertCount * SPRITE_BATCH_VERTEX_FLOATS);
+	SpriteBatch::Bounds bounds = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX };
+	bool behind = false;
+	for (long i = 0; i < vertCount; i++) {
+		const float* in = pointData + i * SPRITE_BATCH_VERTEX_FLOATS;
+		float* out = transformed.data() + i * SPRITE_BATCH_VERTEX_FLOATS;
+
+		Vector4 localPos(in[0], in[1], in[2], 1.0f);
+		if (enableStretch) {
+			localPos.x = localPos.x * xStretch[0] + xStretch[1];
+			localPos.y = localPos.y * yStretch[0] + yStretch[1];
+		}
+		Vector4 worldPos = modelTrans * localPos;
+
+		out[0] = worldPos.x;
+		out[1] = worldPos.y;
+		out[2] = worldPos.z;
+		memcpy(out + 3, in + 3, 5 * sizeof(float));
+
+		// Where it ends up on screen, to know what it may be drawn out of order with
+		Vector4 clipPos = mProj * worldPos;
+		if (clipPos.w <= 0.0f) {
+			behind = true;
+			continue;
+		}
+		float x = clipPos.x / clipPos.w;
+		float y = clipPos.y / clipPos.w;
+		bounds.left = x < bounds.left ? x : bounds.left;
+		bounds.right = x > bounds.right ? x : bounds.right;
+		bounds.bottom = y < bounds.bottom ? y : bounds.bottom;
+		bounds.top = y > bounds.top ? y : bounds.top;
+	}
+
+	// Crossing behind the camera could cover anything
+	if (behind) {
+		bounds = { -FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX };
+	}
+
+	spriteBatch.add(managerTexID, opacity, mProj, renderType, transformed.data(), vertCount, bounds);
+	return true;
+}
+
 void OpenGLSprite::render(const Matrix4& mT, const Matrix4& mProj) const
 {
-	if (vertexDataChanged) {
+	// Collected into as few draws as possible, anything else keeps its place by drawing what was collected first
+	if (spriteBatch.isBatching(this->program) && addToBatch(mT, mProj)) {
+		return;
+	}
+	spriteBatch.flush();
+
+	// Vertices changing once the sprite has been drawn will likely keep changing (like notes),
+	// so stop re-specifying this sprite's buffer and use the stream buffer
+	if (vertexDataChanged && drawn) {
+		streamed = true;
+	}
+
+	GLint first = 0;
+	bool fromStream = streamed && streamVertices(first);
+	if (!fromStream && (vertexDataChanged || streamed)) {
 		refreshSprite();
 		vertexDataChanged = false;
 	}
+	drawn = true;
 
 	// Bind and configure the array/buffer objects
-	glBindVertexArray(vao);
+	glBindVertexArray(fromStream ? streamVao : vao);
 	glEnableVertexAttribArray(ATTRIB_POSITION_INDEX);
 	if (hasColors) { glEnableVertexAttribArray(ATTRIB_COLOR_INDEX); }
 	if (hasUVs) { glEnableVertexAttribArray(ATTRIB_TEX_UV_INDEX); }
@@ -167,7 +278,7 @@ void OpenGLSprite::render(const Matrix4& mT, const Matrix4& mProj) const
 	glProgramUniformMatrix4fv(this->program, projectionLoc, 1, GL_FALSE, mProj.get());
 
 	// Draw points from the bound VAO with the bound shader program
-	glDrawArrays(renderType, 0, vertCount);
+	glDrawArrays(renderType, first, vertCount);
 }
 
 void OpenGLSprite::setOpacity(float newOpacity) {
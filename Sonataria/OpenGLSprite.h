@@ -3,6 +3,7 @@
 #include <GL/glew.h>
 #include "Matrices.h"
 #include <cstdio>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <stack>
@@ -46,6 +47,18 @@ protected:
 	// Setup a new attribute pointer for the currently bound VAO
 	static void createAttribPointer(GLuint attribIndex, int count, int stride, int offset);
 
+	// Setup all the attribute pointers for the currently bound VAO and buffer
+	void createAttribPointers() const;
+
+	// Length of one cluster of vertex data (in bytes)
+	int getStride() const;
+
+	// Write the vertices to the shared stream buffer, giving the index of the first one
+	bool streamVertices(GLint& first) const;
+
+	// Hand the transformed vertices to the sprite batch instead of drawing them
+	bool addToBatch(const Matrix4& mT, const Matrix4& mProj) const;
+
 	// Bind current texture for rendering
 	void bindTexture() const;
 
@@ -78,6 +91,12 @@ protected:
 	// The OpenGL array and buffer objects
 	GLuint vao, vbo;
 
+	// Vertices that change after the first frame are written to the stream buffer instead of vbo
+	mutable bool drawn, streamed;
+	mutable GLuint streamVao;
+	mutable GLint streamFirst;
+	mutable uint64_t streamFrame;
+
 	// The geometry render type passed to glDraw
 	GLuint renderType;
 
@@ -1,4 +1,5 @@
 #include "OpenGLText.h"
+#include "TextureLoader.h"
 #include "Logger.h"
 
 using namespace std;
@@ -83,10 +84,8 @@ void OpenGLText::render(PROJECTION projection, const string& text, ALIGNMENT ali
         float w = ch.Size.x;
         float h = ch.Size.y;
 
-        glActiveTexture(GL_TEXTURE0);
-
         // render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
+        TextureLoader::Inst()->BindTextureUnit(0, ch.TextureID);
 
         mScale.x = w * baseScale.x * scale;
         mScale.y = h * -baseScale.y;
@@ -101,7 +100,7 @@ void OpenGLText::render(PROJECTION projection, const string& text, ALIGNMENT ali
         xOffset += (ch.Advance >> 6) * pack; // bitshift by 6 to get value in pixels (2^6 = 64)
     }
     glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    TextureLoader::Inst()->BindTextureUnit(0, 0);
 
     mScale = baseScale;
     mPosition = baseTranslate;
@@ -142,10 +141,8 @@ void OpenGLText::render(PROJECTION projection, const wstring& text, ALIGNMENT al
         float w = ch.Size.x;
         float h = ch.Size.y;
         
-        glActiveTexture(GL_TEXTURE0);
-
         // render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
+        TextureLoader::Inst()->BindTextureUnit(0, ch.TextureID);
         
         mScale.x = w * baseScale.x * scale;
         mScale.y = h * -baseScale.y;
@@ -160,7 +157,7 @@ void OpenGLText::render(PROJECTION projection, const wstring& text, ALIGNMENT al
         xOffset += (ch.Advance >> 6) * pack; // bitshift by 6 to get value in pixels (2^6 = 64)
     }
     glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    TextureLoader::Inst()->BindTextureUnit(0, 0);
 
     mScale = baseScale;
     mPosition = baseTranslate;
@@ -0,0 +1,843 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#ifdef _WIN32
+// Keep std::min usable
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include "Checksum.h"
+#include "Logger.h"
+#include "NetClient.h"
+#include "PeerExchange.h"
+#include "Tracer.h"
+
+PeerExchange peerExchange;
+
+// Largest chunk a cabinet asks for (the largest chunk size a manifest may ask for)
+const uint64_t PEER_MAX_CHUNK_SIZE = 64 * 1024 * 1024;
+
+// Longest command line, anything longer isn't from a cabinet
+const size_t PEER_MAX_LINE = 512;
+
+// Bytes sent to a cabinet at a time
+const size_t PEER_SEND_SIZE = 1024 * 1024;
+
+/**
+ * Gets the SHA-256 of a chunk.
+ *
+ * @param data the chunk
+ * @return the hash as lowercase hex
+ */
+static string hashChunk(const string& data) {
+	Sha256 hash;
+	hash.update(data.data(), data.size());
+	return hash.finishHex();
+}
+
+/**
+ * Default constructor.
+ *
+ */
+PeerExchange::PeerExchange() {
+	// A new id each run, so a restarted cabinet doesn't get mixed up with its old self
+	random_device random;
+	this->id = toHex(((uint64_t)random() << 32) | (uint64_t)random());
+
+	this->port = PEER_PORT;
+	this->storeFolder = "C:/SNA_UPDATE/chunks";
+	this->enabled = true;
+	this->running = false;
+	this->nextConnectionId = 1;
+	this->chunksServed = 0;
+	this->bytesServed = 0;
+	this->chunksFetchedForPeers = 0;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+PeerExchange::~PeerExchange() {
+	stop();
+}
+
+/**
+ * Set the port chunks are served on (0 for any free port, such as for several
+ * copies of the game on one machine).
+ *
+ * @param port the port
+ */
+void PeerExchange::setPort(int port) {
+	this->port = port;
+}
+
+/**
+ * Set the network card cabinets are looked for on.
+ *
+ * @param address address of the card, or empty for the default one
+ */
+void PeerExchange::setInterface(string address) {
+	this->interfaceAddress = address;
+}
+
+/**
+ * Set where chunks fetched for other cabinets are kept.
+ *
+ * @param folder the folder
+ */
+void PeerExchange::setStoreFolder(string folder) {
+	this->storeFolder = folder;
+}
+
+/**
+ * Set the game server chunks are fetched from.
+ *
+ * @param address the server as host:port
+ */
+void PeerExchange::setOrigin(string address) {
+	this->originAddress = address;
+}
+
+/**
+ * Turn sharing with other cabinets on or off, before start().
+ *
+ * @param enabled true to share
+ */
+void PeerExchange::setEnabled(bool enabled) {
+	this->enabled = enabled;
+}
+
+/**
+ * Set what is called with the size of each chunk sent to another cabinet.
+ *
+ * @param throttle may sleep, and returns false if sharing should stop
+ */
+void PeerExchange::setThrottle(function<bool(size_t bytes)> throttle) {
+	this->throttleHook = throttle;
+}
+
+/**
+ * Start serving chunks and looking for other cabinets.
+ *
+ * @return true if sharing started
+ */
+bool PeerExchange::start() {
+	if (!this->enabled || this->running) {
+		return this->running;
+	}
+
+	string error;
+	if (!this->listener.listen(this->port, error)) {
+		logger.logError("Could not share updates with other cabinets: ", error);
+		return false;
+	}
+	if (!this->discovery.openMulticast(PEER_DISCOVERY_GROUP, PEER_DISCOVERY_PORT, this->interfaceAddress, error)) {
+		logger.logError("Could not look for other cabinets: ", error);
+		this->listener.close();
+		return false;
+	}
+	if (!this->waker.open()) {
+		logger.logError("Could not share updates with other cabinets: no waker");
+		this->listener.close();
+		this->discovery.close();
+		return false;
+	}
+
+	logger.log("Sharing updates with other cabinets on port ", to_string(this->listener.getLocalPort()), " as ", this->id);
+	this->running = true;
+	this->exchangeThread = thread(&PeerExchange::run, this);
+	return true;
+}
+
+/**
+ * Stop sharing. Cabinets that were asking for chunks get them from the game server.
+ *
+ */
+void PeerExchange::stop() {
+	if (!this->running.exchange(false)) {
+		return;
+	}
+
+	this->waker.wake();
+	if (this->exchangeThread.joinable()) {
+		this->exchangeThread.join();
+	}
+	this->connections.clear();
+	this->listener.close();
+	this->discovery.close();
+}
+
+/**
+ * Set the version being downloaded. Chunks kept for an older version are thrown away.
+ *
+ * @param version the version
+ */
+void PeerExchange::setVersion(string version) {
+	{
+		lock_guard<mutex> lock(this->peerLock);
+		if (this->version == version) {
+			return;
+		}
+		this->version = version;
+	}
+
+	// The store outlives a restart, as long as it is for the same version
+	string versionPath = this->storeFolder + "/version.txt";
+	string storedVersion;
+	{
+		ifstream in(versionPath);
+		in >> storedVersion;
+	}
+	if (storedVersion == version) {
+		error_code error;
+		for (const filesystem::directory_entry& entry : filesystem::directory_iterator(this->storeFolder, error)) {
+			string name = entry.path().filename().string();
+			if (name.size() == 64 && entry.is_regular_file(error)) {
+				addChunk(name, entry.path().generic_string(), 0, (uint64_t)entry.file_size(error));
+			}
+		}
+		return;
+	}
+
+	error_code error;
+	filesystem::remove_all(this->storeFolder, error);
+	filesystem::create_directories(this->storeFolder, error);
+	ofstream out(versionPath, ios::out | ios::trunc);
+	out << version;
+}
+
+/**
+ * Find which cabinet to ask for a chunk. That is the cabinet that owns it, or if
+ * this one does, the next in line, as a cabinet that joined late may find the
+ * others already have it.
+ *
+ * @param sha256 hash of the chunk
+ * @param address set to host:port of the cabinet to ask
+ * @param owner set to true if that cabinet owns the chunk and will fetch it if it has to
+ * @return true if there is another cabinet to ask
+ */
+bool PeerExchange::findSource(const string& sha256, string& address, bool& owner) {
+	lock_guard<mutex> lock(this->peerLock);
+	if (!this->running) {
+		return false;
+	}
+
+	// Every cabinet works out the same owner without having to agree on anything, and
+	// any cabinet can fetch a chunk, whichever version it is running
+	int64_t now = NetClient::nowMs();
+	const Peer* best = NULL;
+	uint64_t bestScore = 0;
+	for (map<string, Peer>::const_iterator it = this->peers.begin(); it != this->peers.end(); it++) {
+		if (now - it->second.lastSeenMs > PEER_EXPIRY_MS) {
+			continue;
+		}
+		uint64_t score = fnv1a64(it->first + sha256);
+		if (best == NULL || score > bestScore) {
+			best = &it->second;
+			bestScore = score;
+		}
+	}
+
+	if (best == NULL) {
+		return false;
+	}
+	address = best->address;
+	owner = bestScore > fnv1a64(this->id + sha256);
+	return true;
+}
+
+/**
+ * Stop asking a cabinet that sent a chunk which didn't match its hash.
+ *
+ * @param address host:port of the cabinet
+ */
+void PeerExchange::distrust(const string& address) {
+	lock_guard<mutex> lock(this->peerLock);
+	if (!this->distrusted.insert(address).second) {
+		return;
+	}
+	logger.logError("Cabinet at ", address, " sent a damaged chunk, no longer asking it");
+
+	for (map<string, Peer>::iterator it = this->peers.begin(); it != this->peers.end();) {
+		if (it->second.address == address) {
+			it = this->peers.erase(it);
+		}
+		else {
+			it++;
+		}
+	}
+}
+
+/**
+ * Forget a cabinet that couldn't be reached, so its chunks go to the others until
+ * it announces itself again.
+ *
+ * @param address host:port of the cabinet
+ */
+void PeerExchange::forget(const string& address) {
+	lock_guard<mutex> lock(this->peerLock);
+	for (map<string, Peer>::iterator it = this->peers.begin(); it != this->peers.end();) {
+		if (it->second.address == address) {
+			logger.log("Cabinet at ", address, " can't be reached");
+			it = this->peers.erase(it);
+		}
+		else {
+			it++;
+		}
+	}
+}
+
+/**
+ * Read a chunk this cabinet already has, checking it against its hash.
+ *
+ * @param sha256 hash of the chunk
+ * @param length size of the chunk
+ * @param data set to the chunk
+ * @return true if the chunk was found and is intact
+ */
+bool PeerExchange::readChunk(const string& sha256, uint64_t length, string& data) {
+	Location location;
+	{
+		lock_guard<mutex> lock(this->storeLock);
+		map<string, Location>::iterator it = this->chunks.find(sha256);
+		if (it == this->chunks.end() || it->second.length != length) {
+			return false;
+		}
+		location = it->second;
+	}
+
+	ifstream in(location.path, ios::binary);
+	data.resize((size_t)length);
+	if (in.seekg((streamoff)location.offset) && in.read(&data[0], (streamsize)length) && hashChunk(data) == sha256) {
+		return true;
+	}
+
+	// Moved, removed or changed since, so it's no use any more
+	data.clear();
+	lock_guard<mutex> lock(this->storeLock);
+	map<string, Location>::iterator it = this->chunks.find(sha256);
+	if (it != this->chunks.end() && it->second.path == location.path && it->second.offset == location.offset) {
+		this->chunks.erase(it);
+	}
+	return false;
+}
+
+/**
+ * Note a verified chunk that can be shared.
+ *
+ * @param sha256 hash of the chunk
+ * @param path file the chunk is in
+ * @param offset where in the file it starts
+ * @param length size of the chunk
+ */
+void PeerExchange::addChunk(const string& sha256, const string& path, uint64_t offset, uint64_t length) {
+	lock_guard<mutex> lock(this->storeLock);
+	Location location = { path, offset, length };
+	this->chunks[sha256] = location;
+}
+
+/**
+ * Note every chunk of a verified file that can be shared.
+ *
+ * @param path the file
+ * @param size size of the file
+ * @param chunkSize size of its chunks
+ * @param chunkHashes hash of each chunk, in order
+ */
+void PeerExchange::addFile(const string& path, uint64_t size, uint64_t chunkSize, const vector<string>& chunkHashes) {
+	if (chunkSize == 0 || chunkHashes.size() != (size + chunkSize - 1) / chunkSize) {
+		return;
+	}
+	for (size_t i = 0; i < chunkHashes.size(); i++) {
+		uint64_t offset = i * chunkSize;
+		addChunk(chunkHashes[i], path, offset, min(chunkSize, size - offset));
+	}
+}
+
+/**
+ * Keep sharing the chunks of a file that was moved.
+ *
+ * @param from where the file was
+ * @param to where the file is now
+ */
+void PeerExchange::moveFile(const string& from, const string& to) {
+	lock_guard<mutex> lock(this->storeLock);
+	for (map<string, Location>::iterator it = this->chunks.begin(); it != this->chunks.end(); it++) {
+		if (it->second.path == from) {
+			it->second.path = to;
+		}
+	}
+}
+
+/**
+ * Stop sharing the chunks of a file that is being removed.
+ *
+ * @param path the file
+ */
+void PeerExchange::removeFile(const string& path) {
+	lock_guard<mutex> lock(this->storeLock);
+	for (map<string, Location>::iterator it = this->chunks.begin(); it != this->chunks.end();) {
+		if (it->second.path == path) {
+			it = this->chunks.erase(it);
+		}
+		else {
+			it++;
+		}
+	}
+}
+
+/**
+ * Gets what sharing has done.
+ *
+ * @return the stats
+ */
+PeerExchange::Stats PeerExchange::getStats() {
+	Stats stats;
+	{
+		lock_guard<mutex> lock(this->peerLock);
+		stats.peers = this->peers.size();
+	}
+	stats.chunksServed = this->chunksServed;
+	stats.bytesServed = this->bytesServed;
+	stats.chunksFetchedForPeers = this->chunksFetchedForPeers;
+	return stats;
+}
+
+/**
+ * Announce this cabinet, answer announcements and serve chunks until stopped.
+ *
+ */
+void PeerExchange::run() {
+	tracer.setThreadName("Peers");
+
+	// Serving other cabinets must not cost this one frames
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+
+	int64_t nextAnnounce = 0;
+	while (this->running) {
+		int64_t now = NetClient::nowMs();
+		if (now >= nextAnnounce) {
+			announce();
+			nextAnnounce = now + PEER_ANNOUNCE_INTERVAL_MS;
+		}
+
+		vector<NetPollEntry> entries;
+		entries.push_back({ this->waker.getHandle(), true, false, false });
+		entries.push_back({ this->listener.getHandle(), true, false, false });
+		entries.push_back({ this->discovery.getHandle(), true, false, false });
+		for (size_t i = 0; i < this->connections.size(); i++) {
+			Connection& connection = *this->connections[i];
+			entries.push_back({ connection.socket.getHandle(), !connection.waiting, connection.sent < connection.outgoing.size(), false });
+		}
+		netPoll(entries, (int)max<int64_t>(0, nextAnnounce - now));
+		this->waker.drain();
+
+		if (entries[1].ready) {
+			acceptConnections();
+		}
+		if (entries[2].ready) {
+			receiveAnnouncements();
+		}
+		finishFetches();
+
+		for (size_t i = 0; i < this->connections.size();) {
+			if (serve(*this->connections[i])) {
+				i++;
+			}
+			else {
+				this->connections.erase(this->connections.begin() + i);
+			}
+		}
+	}
+}
+
+/**
+ * Tell the other cabinets this one is here, and forget the ones that went quiet.
+ *
+ */
+void PeerExchange::announce() {
+	{
+		lock_guard<mutex> lock(this->peerLock);
+		int64_t now = NetClient::nowMs();
+		for (map<string, Peer>::iterator it = this->peers.begin(); it != this->peers.end();) {
+			if (now - it->second.lastSeenMs > PEER_EXPIRY_MS) {
+				logger.log("Cabinet at ", it->second.address, " has gone");
+				it = this->peers.erase(it);
+			}
+			else {
+				it++;
+			}
+		}
+	}
+
+	this->discovery.sendToGroup("SNAPEER 1 " + this->id + " " + to_string(this->listener.getLocalPort()));
+}
+
+/**
+ * Read every announcement that has arrived.
+ *
+ */
+void PeerExchange::receiveAnnouncements() {
+	char buffer[512];
+	string address;
+	int received;
+	while ((received = this->discovery.receiveFrom(buffer, sizeof(buffer), address)) > 0) {
+		istringstream in(string(buffer, received));
+		string magic, protocol, peerId;
+		int peerPort = 0;
+		if (!(in >> magic >> protocol >> peerId >> peerPort) || magic != "SNAPEER" || protocol != "1"
+			|| peerId == this->id || peerPort <= 0 || peerPort > 65535) {
+			continue;
+		}
+
+		lock_guard<mutex> lock(this->peerLock);
+		if (this->distrusted.count(address + ":" + to_string(peerPort)) > 0) {
+			continue;
+		}
+		Peer& peer = this->peers[peerId];
+		if (peer.address.empty()) {
+			logger.log("Found a cabinet at ", address, ":", to_string(peerPort));
+		}
+		peer.address = address + ":" + to_string(peerPort);
+		peer.lastSeenMs = NetClient::nowMs();
+	}
+}
+
+/**
+ * Take every cabinet waiting to connect.
+ *
+ */
+void PeerExchange::acceptConnections() {
+	unique_ptr<Connection> connection(new Connection());
+	while (this->listener.accept(connection->socket)) {
+		if (this->connections.size() >= PEER_MAX_CONNECTIONS) {
+			connection->socket.close();
+			continue;
+		}
+
+		connection->id = this->nextConnectionId++;
+		connection->sent = 0;
+		connection->waiting = false;
+		this->connections.push_back(move(connection));
+		connection.reset(new Connection());
+	}
+}
+
+/**
+ * Send and receive what a connection can take right now.
+ *
+ * @param connection the connection
+ * @return false if the connection is finished with
+ */
+bool PeerExchange::serve(Connection& connection) {
+	while (connection.sent < connection.outgoing.size()) {
+		int sent = connection.socket.sendSome(connection.outgoing.data() + connection.sent,
+			min(connection.outgoing.size() - connection.sent, PEER_SEND_SIZE));
+		if (sent == NET_WOULD_BLOCK) {
+			return true;
+		}
+		if (sent < 0) {
+			return false;
+		}
+		connection.sent += (size_t)sent;
+	}
+	connection.outgoing.clear();
+	connection.sent = 0;
+
+	// Cabinets ask for one chunk at a time on a connection
+	if (connection.waiting) {
+		return true;
+	}
+
+	size_t lineEnd = connection.incoming.find('\n');
+	if (lineEnd == string::npos) {
+		char buffer[1024];
+		int received = connection.socket.receiveSome(buffer, sizeof(buffer));
+		if (received == 0 || received == NET_ERROR) {
+			return false;
+		}
+		if (received > 0) {
+			connection.incoming.append(buffer, (size_t)received);
+		}
+
+		lineEnd = connection.incoming.find('\n');
+		if (lineEnd == string::npos) {
+			return connection.incoming.size() <= PEER_MAX_LINE;
+		}
+	}
+
+	string line = connection.incoming.substr(0, lineEnd);
+	connection.incoming.erase(0, lineEnd + 1);
+	if (!line.empty() && line.back() == '\r') {
+		line.pop_back();
+	}
+	handleCommand(connection, line);
+	return connection.socket.isOpen();
+}
+
+/**
+ * Answer a command from another cabinet.
+ *
+ * @param connection the connection it came on
+ * @param line the command
+ */
+void PeerExchange::handleCommand(Connection& connection, const string& line) {
+	istringstream in(line);
+	string name, sha256, command;
+	uint64_t length = 0;
+	in >> name >> sha256 >> length;
+	getline(in >> ws, command);
+
+	if (name != "PeerChunk" || sha256.size() != 64 || length == 0 || length > PEER_MAX_CHUNK_SIZE) {
+		reply(connection, "");
+		return;
+	}
+
+	string data;
+	if (readChunk(sha256, length, data)) {
+		reply(connection, data);
+		return;
+	}
+	fetchForPeer(connection, sha256, length, command);
+}
+
+/**
+ * Fetch a chunk this cabinet owns from the game server, sharing the request with
+ * any other cabinet asking for the same chunk.
+ *
+ * @param sha256 hash of the chunk
+ * @param length size of the chunk
+ * @param command the command that gets it from the game server
+ * @param callback called with the chunk once it arrives (not checked yet), on the network thread
+ * @return false if sharing isn't running and the caller should fetch the chunk itself
+ */
+bool PeerExchange::fetch(const string& sha256, uint64_t length, const string& command, function<void(bool ok, const string& data)> callback) {
+	if (!this->running || this->originAddress.empty()) {
+		return false;
+	}
+
+	shared_ptr<Fetch> finished;
+	{
+		lock_guard<mutex> lock(this->fetchLock);
+		shared_ptr<Fetch> fetch = joinFetch(sha256, length, command);
+		if (!fetch->done) {
+			fetch->listeners.push_back(callback);
+			return true;
+		}
+		finished = fetch;
+	}
+
+	// It came back moments ago
+	callback(finished->completed, finished->data);
+	return true;
+}
+
+/**
+ * Fetch a chunk from the game server for another cabinet.
+ *
+ * @param connection the connection asking
+ * @param sha256 hash of the chunk
+ * @param length size of the chunk
+ * @param command the command that gets it from the game server
+ */
+void PeerExchange::fetchForPeer(Connection& connection, const string& sha256, uint64_t length, const string& command) {
+	// Only update downloads of exactly this chunk are passed on to the game server
+	istringstream in(command);
+	string name;
+	in >> name;
+	string suffix = " " + to_string(length);
+	bool valid = (name == "DLUpdate" || name == "DLObject") && command.size() > suffix.size()
+		&& command.compare(command.size() - suffix.size(), suffix.size(), suffix) == 0;
+	if (!valid || this->originAddress.empty()) {
+		reply(connection, "");
+		return;
+	}
+
+	lock_guard<mutex> lock(this->fetchLock);
+	joinFetch(sha256, length, command)->waiting.push_back(connection.id);
+	connection.waiting = true;
+}
+
+/**
+ * Find the request for a chunk that is on its way, or start one. Must be called
+ * with the fetch lock held.
+ *
+ * @param sha256 hash of the chunk
+ * @param length size of the chunk
+ * @param command the command that gets it from the game server
+ * @return the request
+ */
+shared_ptr<PeerExchange::Fetch> PeerExchange::joinFetch(const string& sha256, uint64_t length, const string& command) {
+	map<string, shared_ptr<Fetch>>::iterator it = this->fetching.find(sha256);
+	if (it != this->fetching.end()) {
+		return it->second;
+	}
+
+	shared_ptr<Fetch> fetch = make_shared<Fetch>();
+	fetch->sha256 = sha256;
+	fetch->length = length;
+	fetch->completed = false;
+	fetch->done = false;
+	this->fetching[sha256] = fetch;
+
+	NetRequest request;
+	request.protocol = NET_COMMAND;
+	request.url = this->originAddress;
+	request.body = command;
+	request.lengthPrefixed = true;
+	request.timeoutMs = 15000;
+	request.retries = 2;
+	request.sink = [fetch](const char* data, size_t size) {
+		if (fetch->data.size() + size > fetch->length) {
+			return false;
+		}
+		fetch->data.append(data, size);
+		return true;
+	};
+
+	netClient.send(request, [this, fetch](NetResponse& response) {
+		vector<function<void(bool, const string&)>> listeners;
+		{
+			lock_guard<mutex> lock(this->fetchLock);
+			fetch->completed = response.completed && fetch->data.size() == fetch->length;
+			fetch->done = true;
+			listeners.swap(fetch->listeners);
+			this->fetched.push_back(fetch);
+		}
+
+		// This cabinet's downloads check the chunk themselves
+		for (size_t i = 0; i < listeners.size(); i++) {
+			listeners[i](fetch->completed, fetch->data);
+		}
+		this->waker.wake();
+	});
+	return fetch;
+}
+
+/**
+ * Keep the chunks that came back from the game server and answer the cabinets
+ * waiting on them.
+ *
+ */
+void PeerExchange::finishFetches() {
+	deque<shared_ptr<Fetch>> done;
+	{
+		lock_guard<mutex> lock(this->fetchLock);
+		done.swap(this->fetched);
+	}
+
+	for (size_t i = 0; i < done.size(); i++) {
+		Fetch& fetch = *done[i];
+		bool ok = fetch.completed && hashChunk(fetch.data) == fetch.sha256;
+
+		// Kept until the request is forgotten, so nobody asks the server for it again
+		bool shared;
+		{
+			lock_guard<mutex> lock(this->peerLock);
+			shared = !this->peers.empty();
+		}
+		if (ok && (shared || !fetch.waiting.empty())) {
+			storeChunk(fetch.sha256, fetch.data);
+		}
+
+		vector<uint64_t> waiting;
+		{
+			lock_guard<mutex> lock(this->fetchLock);
+			this->fetching.erase(fetch.sha256);
+			waiting.swap(fetch.waiting);
+		}
+
+		if (!waiting.empty()) {
+			if (ok) {
+				this->chunksFetchedForPeers++;
+			}
+			else {
+				logger.logError("Could not fetch chunk ", fetch.sha256, " for another cabinet");
+			}
+		}
+		for (size_t j = 0; j < waiting.size(); j++) {
+			Connection* connection = findConnection(waiting[j]);
+			if (connection != NULL) {
+				connection->waiting = false;
+				reply(*connection, ok ? fetch.data : "");
+			}
+		}
+	}
+}
+
+/**
+ * Queue a reply to a command.
+ *
+ * @param connection the connection to answer
+ * @param data the reply, empty if the chunk couldn't be had
+ */
+void PeerExchange::reply(Connection& connection, const string& data) {
+	if (!data.empty() && this->throttleHook && !this->throttleHook(data.size())) {
+		connection.socket.close();
+		return;
+	}
+
+	uint32_t length = (uint32_t)data.size();
+	connection.outgoing.clear();
+	connection.outgoing.push_back((char)(length >> 24));
+	connection.outgoing.push_back((char)(length >> 16));
+	connection.outgoing.push_back((char)(length >> 8));
+	connection.outgoing.push_back((char)length);
+	connection.outgoing += data;
+	connection.sent = 0;
+
+	if (!data.empty()) {
+		this->chunksServed++;
+		this->bytesServed += data.size();
+	}
+}
+
+/**
+ * Find a connection that may have closed while it waited.
+ *
+ * @param id id of the connection
+ * @return the connection, or NULL if it is gone
+ */
+PeerExchange::Connection* PeerExchange::findConnection(uint64_t id) {
+	for (size_t i = 0; i < this->connections.size(); i++) {
+		if (this->connections[i]->id == id) {
+			return this->connections[i].get();
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Keep a chunk fetched for another cabinet in the store.
+ *
+ * @param sha256 hash of the chunk
+ * @param data the chunk
+ * @return true if it was kept
+ */
+bool PeerExchange::storeChunk(const string& sha256, const string& data) {
+	error_code error;
+	filesystem::create_directories(this->storeFolder, error);
+
+	// Written under another name first, so the store never has half a chunk
+	string path = this->storeFolder + "/" + sha256;
+	{
+		ofstream out(path + ".part", ios::binary | ios::trunc);
+		if (!out.write(data.data(), (streamsize)data.size())) {
+			return false;
+		}
+	}
+	filesystem::rename(path + ".part", path, error);
+	if (error) {
+		return false;
+	}
+
+	addChunk(sha256, path, 0, data.size());
+	return true;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file PeerExchange.h
+ *
+ * @brief Peer Exchange
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "NetSocket.h"
+
+// Port other cabinets ask for chunks on
+#define PEER_PORT 35117
+
+// Multicast group and port the cabinets of a venue announce themselves on
+#define PEER_DISCOVERY_GROUP "239.255.83.78"
+#define PEER_DISCOVERY_PORT 35118
+
+// Time between announcements, and without one before a cabinet is forgotten
+#define PEER_ANNOUNCE_INTERVAL_MS 2000
+#define PEER_EXPIRY_MS 10000
+
+// Most cabinets served at the same time
+#define PEER_MAX_CONNECTIONS 32
+
+/**
+ * Shares update chunks between the cabinets of a venue, so the WAN link only
+ * carries each chunk once.
+ *
+ * Cabinets find each other by announcing themselves to a multicast group. Every
+ * chunk is named by its SHA-256 from the signed manifest, and of the cabinets one
+ * owns each chunk (the highest FNV-1a of its id and the hash). Only the owner pulls
+ * a chunk from the game server, everyone else asks the owner, who fetches it first
+ * if it has to. Requests for a chunk already on its way from the server wait for
+ * it instead of asking again. A chunk from another cabinet is checked against its
+ * hash before it is used, so a bad cabinet can't damage an install, only slow it
+ * down.
+ *
+ * Announcement (one datagram):
+ *   SNAPEER 1 <id> <port>
+ *
+ * Command (a line, the reply is a 4 byte big-endian length then that many bytes,
+ * empty if the chunk couldn't be had):
+ *   PeerChunk <sha256> <length> <command for the game server, or - if it shouldn't be fetched>
+ */
+class PeerExchange {
+
+	public:
+		/**
+		 * Counters for the system information page
+		 */
+		struct Stats {
+			size_t peers;
+			uint64_t chunksServed;
+			uint64_t bytesServed;
+			uint64_t chunksFetchedForPeers;
+		};
+
+	private:
+		/**
+		 * Another cabinet on the LAN
+		 */
+		struct Peer {
+			string address;		// host:port for chunk requests
+			int64_t lastSeenMs;
+		};
+
+		/**
+		 * Where a chunk can be read from
+		 */
+		struct Location {
+			string path;
+			uint64_t offset;
+			uint64_t length;
+		};
+
+		/**
+		 * A cabinet connected to ask for chunks
+		 */
+		struct Connection {
+			uint64_t id;
+			NetSocket socket;
+			string incoming;
+			string outgoing;
+			size_t sent;
+			bool waiting;		// For a chunk being fetched from the game server
+		};
+
+		/**
+		 * A chunk on its way from the game server, for this cabinet or others
+		 */
+		struct Fetch {
+			string sha256;
+			uint64_t length;
+			string data;
+			bool completed;
+			bool done;
+			vector<uint64_t> waiting;	// Connections to answer
+			vector<function<void(bool, const string&)>> listeners;	// This cabinet's downloads
+		};
+
+		string id;
+		int port;
+		string interfaceAddress;
+		string storeFolder;
+		string originAddress;
+		bool enabled;
+		function<bool(size_t)> throttleHook;
+
+		thread exchangeThread;
+		atomic<bool> running;
+		NetWaker waker;
+		NetSocket listener;
+		NetDatagram discovery;
+
+		mutex peerLock;
+		map<string, Peer> peers;
+		set<string> distrusted;		// Addresses that sent a bad chunk
+		string version;
+
+		mutex storeLock;
+		map<string, Location> chunks;
+
+		// Only touched by the exchange thread
+		vector<unique_ptr<Connection>> connections;
+		uint64_t nextConnectionId;
+
+		mutex fetchLock;
+		map<string, shared_ptr<Fetch>> fetching;
+		deque<shared_ptr<Fetch>> fetched;
+
+		atomic<uint64_t> chunksServed;
+		atomic<uint64_t> bytesServed;
+		atomic<uint64_t> chunksFetchedForPeers;
+
+		void run();
+		void announce();
+		void receiveAnnouncements();
+		void acceptConnections();
+		bool serve(Connection& connection);
+		void handleCommand(Connection& connection, const string& line);
+		void fetchForPeer(Connection& connection, const string& sha256, uint64_t length, const string& command);
+		shared_ptr<Fetch> joinFetch(const string& sha256, uint64_t length, const string& command);
+		void finishFetches();
+		void reply(Connection& connection, const string& data);
+		Connection* findConnection(uint64_t id);
+		bool storeChunk(const string& sha256, const string& data);
+
+	public:
+		PeerExchange();
+		~PeerExchange();
+
+		void setPort(int port);
+		void setInterface(string address);
+		void setStoreFolder(string folder);
+		void setOrigin(string address);
+		void setEnabled(bool enabled);
+		void setThrottle(function<bool(size_t bytes)> throttle);
+
+		bool start();
+		void stop();
+		void setVersion(string version);
+
+		bool findSource(const string& sha256, string& address, bool& owner);
+		void distrust(const string& address);
+		void forget(const string& address);
+		bool fetch(const string& sha256, uint64_t length, const string& command, function<void(bool ok, const string& data)> callback);
+		bool readChunk(const string& sha256, uint64_t length, string& data);
+		void addChunk(const string& sha256, const string& path, uint64_t offset, uint64_t length);
+		void addFile(const string& path, uint64_t size, uint64_t chunkSize, const vector<string>& chunkHashes);
+		void moveFile(const string& from, const string& to);
+		void removeFile(const string& path);
+
+		Stats getStats();
+};
+
+extern PeerExchange peerExchange;
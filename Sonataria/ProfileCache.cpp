@@ -0,0 +1,342 @@
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+
+#include "Logger.h"
+#include "ProfileCache.h"
+
+using json = nlohmann::json;
+
+ProfileCache profileCache;
+
+// Where the profiles are kept, outside the version folder so an update doesn't delete edits still waiting to be sent
+const char PROFILE_FOLDER[] = "C:/SNA_DATA/Profiles";
+
+/**
+ * Default constructor.
+ *
+ */
+ProfileCache::ProfileCache() {
+	this->loaded = false;
+	this->directory = PROFILE_FOLDER;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+ProfileCache::~ProfileCache() {
+
+}
+
+/**
+ * Keep the profiles in another folder (before the cache is first used).
+ *
+ * @param path the folder
+ */
+void ProfileCache::setDirectory(string path) {
+	lock_guard<mutex> lock(this->entriesLock);
+	this->directory = path;
+	this->entries.clear();
+	this->loaded = false;
+}
+
+/**
+ * Get the cached profile of a card and mark it as just used.
+ *
+ * @param cardID the card
+ * @param profile set to the profile JSON
+ * @return true if the card has a cached profile
+ */
+bool ProfileCache::lookup(const string& cardID, string& profile) {
+	lock_guard<mutex> lock(this->entriesLock);
+	loadAll();
+
+	map<string, Entry>::iterator it = this->entries.find(cardID);
+	if (it == this->entries.end()) {
+		return false;
+	}
+
+	it->second.lastUsed = now();
+	save(it->second);
+
+	profile = it->second.profile;
+	return true;
+}
+
+/**
+ * Gets the server's version of a cached profile.
+ *
+ * @param cardID the card
+ * @return the ETag, or an empty string if there isn't one
+ */
+string ProfileCache::getETag(const string& cardID) {
+	lock_guard<mutex> lock(this->entriesLock);
+	loadAll();
+
+	map<string, Entry>::iterator it = this->entries.find(cardID);
+	return it == this->entries.end() ? "" : it->second.etag;
+}
+
+/**
+ * Keep a profile the server sent. A profile with changes the server hasn't
+ * seen yet is left alone until they are sent.
+ *
+ * @param cardID the card
+ * @param profile the profile JSON
+ * @param etag the server's version of the profile
+ * @return true if it was stored
+ */
+bool ProfileCache::store(const string& cardID, const string& profile, const string& etag) {
+	lock_guard<mutex> lock(this->entriesLock);
+	loadAll();
+
+	Entry& entry = this->entries[cardID];
+	if (entry.pending) {
+		return false;
+	}
+
+	entry.cardID = cardID;
+	entry.profile = profile;
+	entry.etag = etag;
+	entry.fetchedAt = now();
+	entry.lastUsed = entry.fetchedAt;
+	save(entry);
+
+	evict();
+	return true;
+}
+
+/**
+ * Keep a profile changed on this cabinet, to be sent to the server once it can be reached.
+ *
+ * @param cardID the card
+ * @param profile the changed profile JSON
+ */
+void ProfileCache::storeLocalChange(const string& cardID, const string& profile) {
+	lock_guard<mutex> lock(this->entriesLock);
+	loadAll();
+
+	Entry& entry = this->entries[cardID];
+	entry.cardID = cardID;
+	entry.profile = profile;
+	entry.lastUsed = now();
+	entry.pending = true;
+	save(entry);
+
+	evict();
+}
+
+/**
+ * Mark a cached profile as still current (the server said it hasn't changed).
+ *
+ * @param cardID the card
+ */
+void ProfileCache::touch(const string& cardID) {
+	lock_guard<mutex> lock(this->entriesLock);
+	loadAll();
+
+	map<string, Entry>::iterator it = this->entries.find(cardID);
+	if (it != this->entries.end()) {
+		it->second.fetchedAt = now();
+		save(it->second);
+	}
+}
+
+/**
+ * Gets every profile with changes the server hasn't seen.
+ *
+ * @return the profiles
+ */
+vector<ProfileCache::Entry> ProfileCache::getPending() {
+	lock_guard<mutex> lock(this->entriesLock);
+	loadAll();
+
+	vector<Entry> pending;
+	for (map<string, Entry>::iterator it = this->entries.begin(); it != this->entries.end(); it++) {
+		if (it->second.pending) {
+			pending.push_back(it->second);
+		}
+	}
+	return pending;
+}
+
+/**
+ * The server accepted a profile's changes.
+ *
+ * @param cardID the card
+ * @param pushedProfile the profile that was sent (newer changes stay pending)
+ * @param etag the server's new version of the profile
+ */
+void ProfileCache::clearPending(const string& cardID, const string& pushedProfile, const string& etag) {
+	lock_guard<mutex> lock(this->entriesLock);
+	loadAll();
+
+	map<string, Entry>::iterator it = this->entries.find(cardID);
+	if (it == this->entries.end()) {
+		return;
+	}
+
+	it->second.etag = etag;
+	it->second.fetchedAt = now();
+	if (it->second.profile == pushedProfile) {
+		it->second.pending = false;
+	}
+	save(it->second);
+}
+
+/**
+ * Gets how many profiles are cached.
+ *
+ * @return the number of profiles
+ */
+size_t ProfileCache::size() {
+	lock_guard<mutex> lock(this->entriesLock);
+	loadAll();
+	return this->entries.size();
+}
+
+/**
+ * Read every cached profile the first time the cache is used.
+ *
+ */
+void ProfileCache::loadAll() {
+	if (this->loaded) {
+		return;
+	}
+	this->loaded = true;
+
+	error_code error;
+	if (!filesystem::is_directory(this->directory, error)) {
+		return;
+	}
+
+	for (const filesystem::directory_entry& file : filesystem::directory_iterator(this->directory, error)) {
+		if (file.path().extension() != ".json") {
+			continue;
+		}
+
+		try {
+			ifstream in(file.path());
+			json j = json::parse(in);
+
+			Entry entry;
+			entry.cardID = j["CardID"];
+			entry.profile = j["Profile"];
+			entry.etag = j["ETag"];
+			entry.fetchedAt = j["FetchedAt"];
+			entry.lastUsed = j["LastUsed"];
+			entry.pending = j["Pending"];
+			this->entries[entry.cardID] = entry;
+		}
+		catch (const std::exception& e) {
+			// A damaged entry is only a cache miss
+			logger.logError("Skipping damaged cached profile ", file.path().string(), ": ", e.what());
+		}
+	}
+
+	logger.log("Profile cache loaded " + to_string(this->entries.size()) + " profiles.");
+}
+
+/**
+ * Write a profile to its file, replacing the old one in a single step so a
+ * power cut leaves either the old or the new profile.
+ *
+ * @param entry the profile
+ * @return true if it was written
+ */
+bool ProfileCache::save(const Entry& entry) {
+	json j;
+	j["CardID"] = entry.cardID;
+	j["Profile"] = entry.profile;
+	j["ETag"] = entry.etag;
+	j["FetchedAt"] = entry.fetchedAt;
+	j["LastUsed"] = entry.lastUsed;
+	j["Pending"] = entry.pending;
+
+	error_code error;
+	filesystem::create_directories(this->directory, error);
+
+	string path = getPath(entry.cardID);
+	string tempPath = path + ".tmp";
+	{
+		ofstream out(tempPath, ios::out | ios::trunc);
+		if (!out.is_open()) {
+			logger.logError("Failed to write cached profile ", tempPath);
+			return false;
+		}
+		out << j.dump();
+		out.flush();
+		if (!out) {
+			logger.logError("Failed to write cached profile ", tempPath);
+			return false;
+		}
+	}
+
+	filesystem::rename(tempPath, path, error);
+	if (error) {
+		logger.logError("Failed to replace cached profile ", path, ": ", error.message());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Drop the least recently used profiles once there are too many. Profiles with
+ * changes the server hasn't seen are never dropped.
+ *
+ */
+void ProfileCache::evict() {
+	while (this->entries.size() > PROFILE_CACHE_SIZE) {
+		map<string, Entry>::iterator oldest = this->entries.end();
+		for (map<string, Entry>::iterator it = this->entries.begin(); it != this->entries.end(); it++) {
+			if (!it->second.pending && (oldest == this->entries.end() || it->second.lastUsed < oldest->second.lastUsed)) {
+				oldest = it;
+			}
+		}
+		if (oldest == this->entries.end()) {
+			return;
+		}
+
+		error_code error;
+		filesystem::remove(getPath(oldest->first), error);
+		this->entries.erase(oldest);
+	}
+}
+
+/**
+ * Gets the file of a card's profile (anything but letters and digits is hex encoded).
+ *
+ * @param cardID the card
+ * @return the path
+ */
+string ProfileCache::getPath(const string& cardID) {
+	ostringstream name;
+	name << this->directory << "/";
+	for (size_t i = 0; i < cardID.size(); i++) {
+		unsigned char c = (unsigned char)cardID[i];
+		if (isalnum(c)) {
+			name << (char)c;
+		}
+		else {
+			char hex[4];
+			snprintf(hex, sizeof(hex), "_%02X", c);
+			name << hex;
+		}
+	}
+	name << ".json";
+	return name.str();
+}
+
+/**
+ * Gets the wall clock time, so ages survive restarts.
+ *
+ * @return milliseconds since the epoch
+ */
+int64_t ProfileCache::now() {
+	return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
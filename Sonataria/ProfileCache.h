@@ -0,0 +1,69 @@
+/**
+ * @file ProfileCache.h
+ *
+ * @brief Profile Cache
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Profiles kept on disk before the least recently used are dropped
+#define PROFILE_CACHE_SIZE 500
+
+/**
+ * Keeps the last profile the server sent for each card on disk, so a tapped card
+ * logs in straight away and still works while the server can't be reached
+ */
+class ProfileCache {
+
+	public:
+		/**
+		 * A cached profile
+		 */
+		struct Entry {
+			string cardID;
+			string profile;		// The profile JSON as the server sent it
+			string etag;		// The server's version of the profile, if it sent one
+			int64_t fetchedAt;
+			int64_t lastUsed;
+			bool pending;		// Changed here and not on the server yet
+		};
+
+	private:
+		mutex entriesLock;
+		map<string, Entry> entries;
+		bool loaded;
+		string directory;
+
+		void loadAll();
+		bool save(const Entry& entry);
+		void evict();
+		string getPath(const string& cardID);
+
+		static int64_t now();
+
+	public:
+		ProfileCache();
+		~ProfileCache();
+
+		void setDirectory(string path);
+
+		bool lookup(const string& cardID, string& profile);
+		string getETag(const string& cardID);
+		bool store(const string& cardID, const string& profile, const string& etag);
+		void storeLocalChange(const string& cardID, const string& profile);
+		void touch(const string& cardID);
+
+		vector<Entry> getPending();
+		void clearPending(const string& cardID, const string& pushedProfile, const string& etag);
+
+		size_t size();
+};
+
+extern ProfileCache profileCache;
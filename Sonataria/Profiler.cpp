@@ -0,0 +1,383 @@
+#include <cmath>
+#include <cstdio>
+
+#include "OpenGLText.h"
+#include "Profiler.h"
+
+Profiler profiler;
+
+// How often the summary shown on screen is rebuilt
+const int64_t SUMMARY_INTERVAL_MS = 250;
+
+// Threads that haven't recorded anything for this long are left out of the summary
+const int64_t STALE_RING_MS = 2000;
+
+/**
+ * Gives a thread's ring back to the profiler when the thread exits so a
+ * later thread can reuse it instead of a new ring being made
+ */
+struct ThreadRingOwner {
+	Profiler::ThreadRing* ring = NULL;
+
+	~ThreadRingOwner() {
+		if (ring) {
+			profiler.releaseThreadRing(ring);
+		}
+	}
+};
+
+thread_local ThreadRingOwner threadRingOwner;
+
+/**
+ * Default constructor.
+ *
+ */
+Profiler::Profiler() {
+	this->enabled = false;
+	this->overlayVisible = false;
+	this->pageVisible = false;
+	this->lastSummaryMs = 0;
+
+	for (int i = 0; i < ZONE_COUNT; i++) {
+		this->summary[i] = { 0, 0.f, 0.f, 0.f };
+	}
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+Profiler::~Profiler() {
+	// The rings are left for the OS to free, threads may still be writing to them while the game exits
+}
+
+/**
+ * Show or hide the overlay.
+ *
+ */
+void Profiler::toggleOverlay() {
+	setOverlayVisible(!this->overlayVisible);
+}
+
+/**
+ * Set if the overlay is drawn on top of every screen.
+ *
+ * @param visible true to draw the overlay
+ */
+void Profiler::setOverlayVisible(bool visible) {
+	this->overlayVisible = visible;
+	updateEnabled();
+}
+
+bool Profiler::isOverlayVisible() {
+	return this->overlayVisible;
+}
+
+/**
+ * Set if the system information page is showing the frame times.
+ *
+ * @param visible true while the page is on screen
+ */
+void Profiler::setPageVisible(bool visible) {
+	if (this->pageVisible != visible) {
+		this->pageVisible = visible;
+		updateEnabled();
+	}
+}
+
+/**
+ * Only record samples while something is showing them.
+ *
+ */
+void Profiler::updateEnabled() {
+	this->enabled.store(this->overlayVisible || this->pageVisible, memory_order_relaxed);
+}
+
+/**
+ * Get the ring for the calling thread, claiming one the first time.
+ *
+ * @return the thread's ring
+ */
+Profiler::ThreadRing* Profiler::getThreadRing() {
+	if (threadRingOwner.ring) {
+		return threadRingOwner.ring;
+	}
+
+	lock_guard<mutex> lock(this->ringsLock);
+
+	// Reuse the ring of a thread that has exited
+	ThreadRing* ring = NULL;
+	for (size_t i = 0; i < this->rings.size(); i++) {
+		if (!this->rings[i]->inUse) {
+			ring = this->rings[i];
+			break;
+		}
+	}
+
+	if (!ring) {
+		ring = new ThreadRing();
+		ring->head = 0;
+		this->rings.push_back(ring);
+	}
+
+	ring->inUse = true;
+	ring->lastWriteMs = nowMs();
+	threadRingOwner.ring = ring;
+	return ring;
+}
+
+/**
+ * Give a ring back once its thread has exited.
+ *
+ * @param ring the ring to release
+ */
+void Profiler::releaseThreadRing(ThreadRing* ring) {
+	lock_guard<mutex> lock(this->ringsLock);
+	ring->inUse = false;
+}
+
+/**
+ * Store a sample in the calling thread's ring (only that thread ever writes to it).
+ *
+ * @param zone the part of the frame that was timed
+ * @param micros how long it took in microseconds
+ */
+void Profiler::record(PROFILE_ZONE zone, uint32_t micros) {
+	ThreadRing* ring = getThreadRing();
+
+	uint32_t head = ring->head.load(memory_order_relaxed);
+	ring->samples[head & (PROFILE_RING_SIZE - 1)] = { (uint32_t)zone, micros };
+	ring->head.store(head + 1, memory_order_release);
+
+	// Only needs to be roughly right, so refresh it once per frame
+	if (zone == ZONE_FRAME) {
+		ring->lastWriteMs.store(nowMs(), memory_order_relaxed);
+	}
+}
+
+/**
+ * Build percentiles for every zone from the recent samples of all active threads.
+ * Samples are put in log scale buckets so the percentiles are within a quarter doubling.
+ *
+ * @param out summary for each zone
+ */
+void Profiler::summarize(ZoneSummary out[ZONE_COUNT]) {
+	uint32_t buckets[ZONE_COUNT][PROFILE_BUCKETS] = {};
+	uint32_t maxMicros[ZONE_COUNT] = {};
+	uint32_t counts[ZONE_COUNT] = {};
+	static Sample copied[PROFILE_RING_SIZE];	// Only used while ringsLock is held
+
+	int64_t now = nowMs();
+	{
+		lock_guard<mutex> lock(this->ringsLock);
+		for (size_t r = 0; r < this->rings.size(); r++) {
+			ThreadRing* ring = this->rings[r];
+			if (now - ring->lastWriteMs.load(memory_order_relaxed) > STALE_RING_MS) {
+				continue;
+			}
+
+			uint32_t head = ring->head.load(memory_order_acquire);
+			uint32_t available = head < PROFILE_RING_SIZE ? head : PROFILE_RING_SIZE;
+			for (uint32_t i = 0; i < available; i++) {
+				copied[i] = ring->samples[(head - available + i) & (PROFILE_RING_SIZE - 1)];
+			}
+
+			// Anything the owner overwrote while it was being copied may be torn, so leave it out
+			atomic_thread_fence(memory_order_acquire);
+			uint32_t newHead = ring->head.load(memory_order_relaxed);
+			uint32_t oldest = head - available;
+			uint32_t firstIntact = newHead - PROFILE_RING_SIZE + 1;
+			uint32_t torn = 0;
+			if (newHead >= PROFILE_RING_SIZE && (int32_t)(firstIntact - oldest) > 0) {
+				torn = firstIntact - oldest;
+				if (torn > available) {
+					torn = available;
+				}
+			}
+
+			for (uint32_t i = torn; i < available; i++) {
+				Sample sample = copied[i];
+				if (sample.zone >= ZONE_COUNT) {
+					continue;
+				}
+
+				int bucket = (int)(4.f * log2f((float)sample.micros + 1.f));
+				if (bucket >= PROFILE_BUCKETS) {
+					bucket = PROFILE_BUCKETS - 1;
+				}
+
+				buckets[sample.zone][bucket]++;
+				counts[sample.zone]++;
+				if (sample.micros > maxMicros[sample.zone]) {
+					maxMicros[sample.zone] = sample.micros;
+				}
+			}
+		}
+	}
+
+	for (int z = 0; z < ZONE_COUNT; z++) {
+		out[z].count = counts[z];
+		out[z].maxMs = maxMicros[z] / 1000.f;
+		out[z].p50Ms = 0.f;
+		out[z].p99Ms = 0.f;
+		if (counts[z] == 0) {
+			continue;
+		}
+
+		// Walk the buckets until the percentile's sample is reached, reporting the top of that bucket
+		uint32_t p50Rank = (counts[z] * 50 + 99) / 100;
+		uint32_t p99Rank = (counts[z] * 99 + 99) / 100;
+		uint32_t seen = 0;
+		for (int b = 0; b < PROFILE_BUCKETS; b++) {
+			uint32_t before = seen;
+			seen += buckets[z][b];
+			float bucketTopMs = (exp2f((b + 1) / 4.f) - 1.f) / 1000.f;
+			if (before < p50Rank && seen >= p50Rank) {
+				out[z].p50Ms = bucketTopMs;
+			}
+			if (before < p99Rank && seen >= p99Rank) {
+				out[z].p99Ms = bucketTopMs;
+				break;
+			}
+		}
+
+		// The top of a bucket can overshoot the largest sample
+		if (out[z].p50Ms > out[z].maxMs) {
+			out[z].p50Ms = out[z].maxMs;
+		}
+		if (out[z].p99Ms > out[z].maxMs) {
+			out[z].p99Ms = out[z].maxMs;
+		}
+	}
+}
+
+/**
+ * Rebuild the summary shown on screen if it is out of date.
+ *
+ */
+void Profiler::refreshSummary() {
+	int64_t now = nowMs();
+	if (now - this->lastSummaryMs < SUMMARY_INTERVAL_MS) {
+		return;
+	}
+	this->lastSummaryMs = now;
+	summarize(this->summary);
+}
+
+/**
+ * Draw a table of the percentiles of each zone.
+ *
+ * @param text text object to draw with (the text shader must be in use)
+ * @param x left edge of the table
+ * @param y position of the heading row
+ * @param lineHeight distance between rows
+ * @param scale size of the text
+ */
+void Profiler::drawStats(OpenGLText* text, float x, float y, float lineHeight, float scale) {
+	lock_guard<mutex> lock(this->summaryLock);
+	refreshSummary();
+
+	const float columns[3] = { x + 1500.f * scale, x + 2100.f * scale, x + 2700.f * scale };
+
+	text->reset();
+	text->translate(x, y, 0.f);
+	text->scale(scale);
+	text->render(PROJECTION::ORTHOGRAPHIC, L"FRAME TIMES (MS)", ALIGNMENT::LEFT, 1.f, 1.f, 0.f);
+
+	const wchar_t* headings[3] = { L"P50", L"P99", L"MAX" };
+	for (int c = 0; c < 3; c++) {
+		text->reset();
+		text->translate(columns[c], y, 0.f);
+		text->scale(scale);
+		text->render(PROJECTION::ORTHOGRAPHIC, headings[c], ALIGNMENT::RIGHT, 1.f, 1.f, 0.f);
+	}
+
+	int row = 1;
+	for (int z = 0; z < ZONE_COUNT; z++) {
+		if (this->summary[z].count == 0) {
+			continue;
+		}
+
+		float rowY = y - lineHeight * row;
+		row++;
+
+		text->reset();
+		text->translate(x, rowY, 0.f);
+		text->scale(scale);
+		text->render(PROJECTION::ORTHOGRAPHIC, getZoneName((PROFILE_ZONE)z), ALIGNMENT::LEFT);
+
+		float values[3] = { this->summary[z].p50Ms, this->summary[z].p99Ms, this->summary[z].maxMs };
+		for (int c = 0; c < 3; c++) {
+			char value[16];
+			snprintf(value, sizeof(value), "%.2f", values[c]);
+
+			// Anything over a 60 fps frame is shown in red
+			float gb = values[c] > 16.7f ? 0.f : 1.f;
+
+			text->reset();
+			text->translate(columns[c], rowY, 0.f);
+			text->scale(scale);
+			text->render(PROJECTION::ORTHOGRAPHIC, string(value), ALIGNMENT::RIGHT, 1.f, gb, gb);
+		}
+	}
+}
+
+/**
+ * Draw the frame times in the top left corner of the screen.
+ *
+ * @param text text object to draw with (the text shader must be in use)
+ */
+void Profiler::drawOverlay(OpenGLText* text) {
+	drawStats(text, -3700.f, 600.f, 55.f, 0.35f);
+}
+
+/**
+ * Gets the name of a zone for display.
+ *
+ * @param zone the zone
+ * @return the name of the zone
+ */
+const wchar_t* Profiler::getZoneName(PROFILE_ZONE zone) {
+	switch (zone) {
+		case ZONE_FRAME: return L"FRAME";
+		case ZONE_INPUT: return L"INPUT";
+		case ZONE_JUDGEMENT: return L"JUDGEMENT";
+		case ZONE_BACKGROUND: return L"BACKGROUND";
+		case ZONE_SPRITES: return L"SPRITES";
+		case ZONE_NOTES: return L"NOTES";
+		case ZONE_TEXT: return L"TEXT";
+		case ZONE_DISPLAY: return L"DISPLAY";
+		case ZONE_GPU_WAIT: return L"GPU WAIT";
+		default: return L"UNKNOWN";
+	}
+}
+
+/**
+ * Gets the name of a zone for traces.
+ *
+ * @param zone the zone
+ * @return the name of the zone
+ */
+const char* Profiler::getZoneTraceName(PROFILE_ZONE zone) {
+	switch (zone) {
+		case ZONE_FRAME: return "Frame";
+		case ZONE_INPUT: return "Input";
+		case ZONE_JUDGEMENT: return "Judgement";
+		case ZONE_BACKGROUND: return "Background";
+		case ZONE_SPRITES: return "Sprites";
+		case ZONE_NOTES: return "Notes";
+		case ZONE_TEXT: return "Text";
+		case ZONE_DISPLAY: return "Display";
+		case ZONE_GPU_WAIT: return "GPU Wait";
+		default: return "Unknown";
+	}
+}
+
+/**
+ * Gets a millisecond timestamp for ageing out idle threads.
+ *
+ * @return milliseconds since an arbitrary point
+ */
+int64_t Profiler::nowMs() {
+	return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
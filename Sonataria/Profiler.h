@@ -0,0 +1,152 @@
+/**
+ * @file Profiler.h
+ *
+ * @brief Profiler
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Tracer.h"
+using namespace std;
+
+class OpenGLText;
+
+/**
+ * The parts of a frame that are timed
+ */
+enum PROFILE_ZONE {
+	ZONE_FRAME,
+	ZONE_INPUT,
+	ZONE_JUDGEMENT,
+	ZONE_BACKGROUND,
+	ZONE_SPRITES,
+	ZONE_NOTES,
+	ZONE_TEXT,
+	ZONE_DISPLAY,
+	ZONE_GPU_WAIT,
+	ZONE_COUNT
+};
+
+// Samples kept for each thread (must be a power of two)
+#define PROFILE_RING_SIZE 4096
+
+// Histogram buckets, four per doubling of the time in microseconds
+#define PROFILE_BUCKETS 96
+
+/**
+ * Collects how long each part of a frame takes. Each thread writes to its own
+ * ring of samples without locking; summaries are built from the recent samples.
+ */
+class Profiler {
+
+	public:
+		/**
+		 * One timed run of a zone
+		 */
+		struct Sample {
+			uint32_t zone;
+			uint32_t micros;
+		};
+
+		/**
+		 * Samples written by a single thread
+		 */
+		struct ThreadRing {
+			Sample samples[PROFILE_RING_SIZE];
+			atomic<uint32_t> head;
+			atomic<int64_t> lastWriteMs;
+			bool inUse;
+		};
+
+		/**
+		 * Percentiles of a zone over the recent samples
+		 */
+		struct ZoneSummary {
+			uint32_t count;
+			float p50Ms;
+			float p99Ms;
+			float maxMs;
+		};
+
+	private:
+		atomic<bool> enabled;
+		atomic<bool> overlayVisible;
+		atomic<bool> pageVisible;
+
+		mutex ringsLock;
+		vector<ThreadRing*> rings;
+
+		// Summaries are only rebuilt a few times a second
+		mutex summaryLock;
+		ZoneSummary summary[ZONE_COUNT];
+		int64_t lastSummaryMs;
+
+		ThreadRing* getThreadRing();
+		void updateEnabled();
+		void refreshSummary();
+
+	public:
+		Profiler();
+		~Profiler();
+
+		/**
+		 * Gets if samples are being recorded (cheap enough to check in every scope).
+		 *
+		 * @return true if recording
+		 */
+		inline bool isEnabled() const { return this->enabled.load(memory_order_relaxed); }
+
+		void toggleOverlay();
+		void setOverlayVisible(bool);
+		bool isOverlayVisible();
+		void setPageVisible(bool);
+
+		void record(PROFILE_ZONE zone, uint32_t micros);
+		void summarize(ZoneSummary out[ZONE_COUNT]);
+		void releaseThreadRing(ThreadRing* ring);
+
+		void drawStats(OpenGLText* text, float x, float y, float lineHeight, float scale);
+		void drawOverlay(OpenGLText* text);
+
+		static const wchar_t* getZoneName(PROFILE_ZONE zone);
+		static const char* getZoneTraceName(PROFILE_ZONE zone);
+		static int64_t nowMs();
+};
+
+extern Profiler profiler;
+
+/**
+ * Times the scope it is declared in and records it to the profiler and the tracer
+ */
+class ProfileScope {
+
+	private:
+		PROFILE_ZONE zone;
+		bool active;
+		int64_t start;
+
+	public:
+		inline ProfileScope(PROFILE_ZONE zone) : zone(zone), active(profiler.isEnabled() || tracer.isEnabled()), start(0) {
+			if (this->active) {
+				this->start = Tracer::nowMicros();
+			}
+		}
+
+		inline ~ProfileScope() {
+			if (this->active) {
+				int64_t end = Tracer::nowMicros();
+				if (profiler.isEnabled()) {
+					profiler.record(this->zone, (uint32_t)(end - this->start));
+				}
+				if (tracer.isEnabled()) {
+					tracer.record(Profiler::getZoneTraceName(this->zone), "frame", this->start, end);
+				}
+			}
+		}
+};
@@ -0,0 +1,435 @@
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <stdio.h>
+
+#include "Checksum.h"
+#include "Replay.h"
+
+// File layout version, bump when the frame encoding changes
+const uint16_t REPLAY_VERSION = 1;
+const char REPLAY_MAGIC[4] = { 'S', 'N', 'R', 'P' };
+
+// Frame flag bits (the low three bits hold the button number)
+const uint8_t FRAME_BUTTON_MASK = 0x07;
+const uint8_t FRAME_WHEEL_RIGHT = 0x08;
+const uint8_t FRAME_WHEEL_LEFT = 0x10;
+const uint8_t FRAME_HELD_CHANGED = 0x20;
+const uint8_t FRAME_SPEED_CHANGED = 0x40;
+
+// Little endian helpers so files are the same on every platform
+static void writeU32(vector<uint8_t>& out, uint32_t value) {
+	for (int i = 0; i < 4; i++) {
+		out.push_back((uint8_t)(value >> (8 * i)));
+	}
+}
+
+static void writeVarint(vector<uint8_t>& out, int64_t value) {
+	// Zig-zag so small negative deltas stay small
+	uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+	while (zigzag >= 0x80) {
+		out.push_back((uint8_t)(zigzag | 0x80));
+		zigzag >>= 7;
+	}
+	out.push_back((uint8_t)zigzag);
+}
+
+static bool readU32(const vector<uint8_t>& in, size_t& pos, uint32_t& value) {
+	if (pos + 4 > in.size()) {
+		return false;
+	}
+	value = 0;
+	for (int i = 0; i < 4; i++) {
+		value |= (uint32_t)in[pos++] << (8 * i);
+	}
+	return true;
+}
+
+static bool readVarint(const vector<uint8_t>& in, size_t& pos, int64_t& value) {
+	uint64_t zigzag = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (pos >= in.size()) {
+			return false;
+		}
+		uint8_t byte = in[pos++];
+		zigzag |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Compare two results exactly (score by its bits).
+ *
+ * @param other results to compare with
+ * @return true if identical
+ */
+bool ReplayResults::operator==(const ReplayResults& other) const {
+	return scoreBits == other.scoreBits && perfectCount == other.perfectCount &&
+		nearCount == other.nearCount && missCount == other.missCount;
+}
+
+/**
+ * Default constructor.
+ *
+ */
+Replay::Replay() {
+	this->songID = -1;
+	this->songPath = "";
+	this->difficulty = 0;
+	this->startSpeed = 0;
+	this->results = { 0, 0, 0, 0 };
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+Replay::~Replay() {
+
+}
+
+/**
+ * Start recording a new play.
+ *
+ * @param songID id of the song being played
+ * @param songPath folder of the song (holds the charts)
+ * @param difficulty difficulty being played
+ * @param startSpeed note speed at the start of the song
+ */
+void Replay::begin(int songID, string songPath, int difficulty, int startSpeed) {
+	this->songID = songID;
+	this->songPath = songPath;
+	this->difficulty = difficulty;
+	this->startSpeed = startSpeed;
+	this->frames.clear();
+	this->results = { 0, 0, 0, 0 };
+}
+
+/**
+ * Record the input of one frame.
+ *
+ * @param frame the input the judgement engine was given
+ */
+void Replay::addFrame(const FrameInput& frame) {
+	this->frames.push_back(frame);
+}
+
+/**
+ * Store the outcome of the play once it has ended.
+ *
+ * @param engine the engine that judged the play
+ */
+void Replay::finish(JudgementEngine& engine) {
+	this->results = resultsOf(engine);
+}
+
+/**
+ * Write the replay to a file.
+ *
+ * @param filePath where to write the replay
+ * @return true if the file was written
+ */
+bool Replay::save(string filePath) {
+	vector<uint8_t> out = serialize();
+
+	ofstream outFile(filePath, ios::binary);
+	if (!outFile) {
+		return false;
+	}
+	outFile.write((const char*)out.data(), out.size());
+	return outFile.good();
+}
+
+/**
+ * Gets a hash of the replay as it is saved, so a submitted score can be matched to its replay.
+ *
+ * @return the hash as hex digits
+ */
+string Replay::getHash() {
+	vector<uint8_t> out = serialize();
+	return toHex(fnv1a64(out.data(), out.size()));
+}
+
+/**
+ * Encode the replay in its file format.
+ *
+ * @return the bytes of the file
+ */
+vector<uint8_t> Replay::serialize() {
+	vector<uint8_t> out;
+	out.reserve(64 + this->songPath.size() + this->frames.size() * 2);
+
+	// Header
+	out.insert(out.end(), REPLAY_MAGIC, REPLAY_MAGIC + 4);
+	out.push_back((uint8_t)(REPLAY_VERSION & 0xFF));
+	out.push_back((uint8_t)(REPLAY_VERSION >> 8));
+	writeU32(out, (uint32_t)this->songID);
+	writeU32(out, (uint32_t)this->difficulty);
+	writeU32(out, (uint32_t)this->startSpeed);
+	writeU32(out, (uint32_t)this->songPath.size());
+	out.insert(out.end(), this->songPath.begin(), this->songPath.end());
+
+	// Results
+	writeU32(out, this->results.scoreBits);
+	writeU32(out, (uint32_t)this->results.perfectCount);
+	writeU32(out, (uint32_t)this->results.nearCount);
+	writeU32(out, (uint32_t)this->results.missCount);
+
+	// Frames: time delta, a flag byte, then only the fields that changed
+	writeU32(out, (uint32_t)this->frames.size());
+	int64_t lastOffset = 0;
+	uint8_t lastHeld = 0;
+	int lastSpeed = this->startSpeed;
+	for (size_t i = 0; i < this->frames.size(); i++) {
+		const FrameInput& frame = this->frames[i];
+
+		uint8_t flags = (uint8_t)(frame.button & FRAME_BUTTON_MASK);
+		if (frame.wheelMovement > 0) { flags |= FRAME_WHEEL_RIGHT; }
+		if (frame.wheelMovement < 0) { flags |= FRAME_WHEEL_LEFT; }
+		if (frame.heldMask != lastHeld) { flags |= FRAME_HELD_CHANGED; }
+		if (frame.speed != lastSpeed) { flags |= FRAME_SPEED_CHANGED; }
+
+		writeVarint(out, frame.songOffset - lastOffset);
+		out.push_back(flags);
+		if (flags & FRAME_HELD_CHANGED) {
+			out.push_back(frame.heldMask);
+		}
+		if (flags & FRAME_SPEED_CHANGED) {
+			writeVarint(out, (int64_t)frame.speed - lastSpeed);
+		}
+
+		lastOffset = frame.songOffset;
+		lastHeld = frame.heldMask;
+		lastSpeed = frame.speed;
+	}
+
+	return out;
+}
+
+/**
+ * Read a replay from a file.
+ *
+ * @param filePath the replay file
+ * @return true if the file was a valid replay
+ */
+bool Replay::load(string filePath) {
+	ifstream inFile(filePath, ios::binary);
+	if (!inFile) {
+		return false;
+	}
+	vector<uint8_t> in((istreambuf_iterator<char>(inFile)), istreambuf_iterator<char>());
+
+	// Header
+	size_t pos = 0;
+	if (in.size() < 6 || memcmp(in.data(), REPLAY_MAGIC, 4) != 0) {
+		return false;
+	}
+	uint16_t version = (uint16_t)(in[4] | (in[5] << 8));
+	if (version != REPLAY_VERSION) {
+		return false;
+	}
+	pos = 6;
+
+	uint32_t songID, difficulty, startSpeed, pathLength;
+	if (!readU32(in, pos, songID) || !readU32(in, pos, difficulty) ||
+		!readU32(in, pos, startSpeed) || !readU32(in, pos, pathLength) ||
+		pos + pathLength > in.size()) {
+		return false;
+	}
+	this->songID = (int)songID;
+	this->difficulty = (int)difficulty;
+	this->startSpeed = (int)startSpeed;
+	this->songPath.assign((const char*)in.data() + pos, pathLength);
+	pos += pathLength;
+
+	// Results
+	uint32_t perfect, nearHits, miss;
+	if (!readU32(in, pos, this->results.scoreBits) || !readU32(in, pos, perfect) ||
+		!readU32(in, pos, nearHits) || !readU32(in, pos, miss)) {
+		return false;
+	}
+	this->results.perfectCount = (int)perfect;
+	this->results.nearCount = (int)nearHits;
+	this->results.missCount = (int)miss;
+
+	// Frames
+	uint32_t frameCount;
+	if (!readU32(in, pos, frameCount)) {
+		return false;
+	}
+	this->frames.clear();
+	this->frames.reserve(frameCount);
+
+	FrameInput frame = { 0, 0, 0, 0, this->startSpeed, 0 };
+	for (uint32_t i = 0; i < frameCount; i++) {
+		int64_t delta;
+		if (!readVarint(in, pos, delta) || pos >= in.size()) {
+			return false;
+		}
+		uint8_t flags = in[pos++];
+
+		frame.songOffset += delta;
+		frame.button = flags & FRAME_BUTTON_MASK;
+		frame.wheelMovement = (flags & FRAME_WHEEL_RIGHT) ? 1 : ((flags & FRAME_WHEEL_LEFT) ? -1 : 0);
+		if (flags & FRAME_HELD_CHANGED) {
+			if (pos >= in.size()) {
+				return false;
+			}
+			frame.heldMask = in[pos++];
+		}
+		if (flags & FRAME_SPEED_CHANGED) {
+			int64_t speedDelta;
+			if (!readVarint(in, pos, speedDelta)) {
+				return false;
+			}
+			frame.speed += (int)speedDelta;
+		}
+
+		this->frames.push_back(frame);
+	}
+
+	return true;
+}
+
+/**
+ * Read the chart this replay was played on.
+ *
+ * @param engine engine to load the chart into
+ * @return true if the chart was found
+ */
+bool Replay::loadChart(JudgementEngine& engine) {
+	return engine.loadChart(this->songPath, this->difficulty, this->startSpeed);
+}
+
+/**
+ * Re-run every recorded frame through a copy of an engine with the chart loaded.
+ *
+ * @param loadedChart engine returned by loadChart (left untouched)
+ * @return the outcome of the simulated play
+ */
+ReplayResults Replay::simulate(const JudgementEngine& loadedChart) {
+	JudgementEngine engine = loadedChart;
+	for (size_t i = 0; i < this->frames.size(); i++) {
+		engine.step(this->frames[i]);
+	}
+	return resultsOf(engine);
+}
+
+int Replay::getSongID() {
+	return this->songID;
+}
+
+string Replay::getSongPath() {
+	return this->songPath;
+}
+
+int Replay::getDifficulty() {
+	return this->difficulty;
+}
+
+size_t Replay::getFrameCount() {
+	return this->frames.size();
+}
+
+ReplayResults Replay::getResults() {
+	return this->results;
+}
+
+/**
+ * Get the outcome currently held by an engine.
+ *
+ * @param engine the engine to read
+ * @return the results
+ */
+ReplayResults Replay::resultsOf(JudgementEngine& engine) {
+	ReplayResults out;
+	float score = engine.getScore();
+	memcpy(&out.scoreBits, &score, sizeof(out.scoreBits));
+	out.perfectCount = engine.getPerfectCount();
+	out.nearCount = engine.getNearCount();
+	out.missCount = engine.getMissCount();
+	return out;
+}
+
+/**
+ * Build a unique file name for a new replay.
+ *
+ * @param songID id of the song
+ * @param difficulty difficulty played
+ * @return the file name (no folder)
+ */
+string Replay::makeFileName(int songID, int difficulty) {
+	char timeStamp[32];
+	time_t now = time(NULL);
+	tm local = {};
+#ifdef _WIN32
+	localtime_s(&local, &now);
+#else
+	localtime_r(&now, &local);
+#endif
+	strftime(timeStamp, sizeof(timeStamp), "%Y%m%d-%H%M%S", &local);
+	return to_string(songID) + "_" + to_string(difficulty) + "_" + timeStamp + ".snr";
+}
+
+/**
+ * Re-simulate replays and check each reproduces its recorded results exactly.
+ * Runs each replay 'iterations' times and reports the plays per second.
+ *
+ * @param replayFiles the replay files to check
+ * @param iterations times to simulate each replay
+ * @return the number of replays that failed to load or did not match
+ */
+int runReplayCheck(const vector<string>& replayFiles, int iterations) {
+	int failures = 0;
+	long long totalPlays = 0;
+	double totalSeconds = 0.0;
+
+	for (size_t i = 0; i < replayFiles.size(); i++) {
+		Replay replay;
+		JudgementEngine chart;
+		if (!replay.load(replayFiles[i])) {
+			printf("FAIL  %s: not a valid replay file\n", replayFiles[i].c_str());
+			failures++;
+			continue;
+		}
+		if (!replay.loadChart(chart)) {
+			printf("FAIL  %s: chart not found in %s\n", replayFiles[i].c_str(), replay.getSongPath().c_str());
+			failures++;
+			continue;
+		}
+
+		// Chart parsing is left out of the timing, only the simulation is measured
+		ReplayResults simulated = {};
+		bool matched = true;
+		auto start = chrono::high_resolution_clock::now();
+		for (int j = 0; j < iterations; j++) {
+			simulated = replay.simulate(chart);
+			matched &= (simulated == replay.getResults());
+		}
+		chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - start;
+		totalPlays += iterations;
+		totalSeconds += elapsed.count();
+
+		ReplayResults expected = replay.getResults();
+		if (matched) {
+			printf("PASS  %s: %d/%d/%d (%zu frames)\n", replayFiles[i].c_str(),
+				expected.perfectCount, expected.nearCount, expected.missCount, replay.getFrameCount());
+		}
+		else {
+			printf("FAIL  %s: expected %d/%d/%d score %08x, simulated %d/%d/%d score %08x\n", replayFiles[i].c_str(),
+				expected.perfectCount, expected.nearCount, expected.missCount, expected.scoreBits,
+				simulated.perfectCount, simulated.nearCount, simulated.missCount, simulated.scoreBits);
+			failures++;
+		}
+	}
+
+	if (totalSeconds > 0.0) {
+		printf("%lld plays simulated in %.3fs (%.0f plays/s)\n", totalPlays, totalSeconds, totalPlays / totalSeconds);
+	}
+	return failures;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file Replay.h
+ *
+ * @brief Replay
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "JudgementEngine.h"
+
+/**
+ * The outcome of a play, compared exactly when a replay is re-simulated
+ */
+struct ReplayResults {
+	uint32_t scoreBits;		// Raw bits of the float score
+	int perfectCount;
+	int nearCount;
+	int missCount;
+
+	bool operator==(const ReplayResults& other) const;
+	bool operator!=(const ReplayResults& other) const { return !(*this == other); }
+};
+
+/**
+ * Records every frame of input of a play to a compact binary file and
+ * re-runs it through the judgement engine without a window
+ */
+class Replay {
+
+	private:
+		int songID;
+		string songPath;
+		int difficulty;
+		int startSpeed;
+		vector<FrameInput> frames;
+		ReplayResults results;
+
+		vector<uint8_t> serialize();
+
+	public:
+		Replay();
+		~Replay();
+		void begin(int songID, string songPath, int difficulty, int startSpeed);
+		void addFrame(const FrameInput& frame);
+		void finish(JudgementEngine& engine);
+		bool save(string filePath);
+		string getHash();
+		bool load(string filePath);
+
+		bool loadChart(JudgementEngine& engine);
+		ReplayResults simulate(const JudgementEngine& loadedChart);
+
+		int getSongID();
+		string getSongPath();
+		int getDifficulty();
+		size_t getFrameCount();
+		ReplayResults getResults();
+
+		static ReplayResults resultsOf(JudgementEngine& engine);
+		static string makeFileName(int songID, int difficulty);
+};
+
+int runReplayCheck(const vector<string>& replayFiles, int iterations);
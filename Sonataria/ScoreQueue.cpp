@@ -0,0 +1,532 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include <nlohmann/json.hpp>
+#include <random>
+#include <unordered_set>
+
+#include "Checksum.h"
+#include "Logger.h"
+#include "NetClient.h"
+#include "Networking.h"
+#include "ScoreQueue.h"
+#include "Tracer.h"
+
+using json = nlohmann::json;
+
+ScoreQueue scoreQueue;
+
+// Where the queue is kept, outside the version folder so an update doesn't delete plays still waiting to upload
+const char SCORE_FOLDER[] = "C:/SNA_DATA/Scores";
+
+// Wait before trying again after the first failed upload, doubled on each failure after that
+const int UPLOAD_BACKOFF_START_MS = 2000;
+const int UPLOAD_BACKOFF_MAX_MS = 5 * 60 * 1000;
+
+// How often a waiting upload checks if the game is shutting down
+const chrono::milliseconds UPLOAD_POLL_INTERVAL(100);
+
+/**
+ * Push everything written to a file down to the disk.
+ *
+ * @param file the file
+ * @return true if it reached the disk
+ */
+static bool syncFile(FILE* file) {
+#ifdef _WIN32
+	return fflush(file) == 0 && _commit(_fileno(file)) == 0;
+#else
+	return fflush(file) == 0 && fsync(fileno(file)) == 0;
+#endif
+}
+
+/**
+ * Default constructor.
+ *
+ */
+ScoreQueue::ScoreQueue() {
+	this->logFile = NULL;
+	this->ackedInLog = 0;
+	this->directory = SCORE_FOLDER;
+	this->serverUrl = "http://127.0.0.1:3000/scores";
+	this->running = false;
+	this->wakeRequested = false;
+	this->batchLimit = SCORE_BATCH_SIZE;
+	this->uploadedCount = 0;
+	this->failedCount = 0;
+	this->rejectedCount = 0;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+ScoreQueue::~ScoreQueue() {
+	stop();
+	if (this->logFile) {
+		fclose(this->logFile);
+	}
+}
+
+/**
+ * Keep the log in another folder (before the queue is first used).
+ *
+ * @param path the folder
+ */
+void ScoreQueue::setDirectory(string path) {
+	lock_guard<mutex> lock(this->queueLock);
+	this->directory = path;
+}
+
+/**
+ * Send scores to another server, such as a local stand-in for testing.
+ *
+ * @param url where scores are posted (http://host:port/path)
+ */
+void ScoreQueue::setServer(string url) {
+	lock_guard<mutex> lock(this->queueLock);
+	this->serverUrl = url;
+}
+
+/**
+ * Read back the plays a previous run didn't get acknowledged and start sending them.
+ *
+ */
+void ScoreQueue::start() {
+	call_once(this->loadFlag, [this]() { load(); });
+
+	if (!this->running.exchange(true)) {
+		this->uploadThread = thread(&ScoreQueue::run, this);
+	}
+}
+
+/**
+ * Stop sending. Anything not acknowledged stays in the log for the next run.
+ *
+ */
+void ScoreQueue::stop() {
+	{
+		lock_guard<mutex> lock(this->queueLock);
+		this->running = false;
+	}
+	this->queueSignal.notify_all();
+
+	if (this->uploadThread.joinable()) {
+		this->uploadThread.join();
+	}
+}
+
+/**
+ * Keep a finished play until the server has it. It is on the disk before this
+ * returns, and the upload happens in the background.
+ *
+ * @param results the results of the play
+ * @param cardID the card of the player (empty for a guest)
+ * @param replayHash the hash of the play's replay
+ * @return true if the play was written to the log
+ */
+bool ScoreQueue::add(Results& results, const string& cardID, const string& replayHash) {
+	TraceScope trace("Queue score", "network");
+	call_once(this->loadFlag, [this]() { load(); });
+
+	Song song = results.getSong();
+	int64_t playedAt = now();
+
+	json score;
+	score["CardID"] = cardID;
+	score["SongID"] = song.getSongID();
+	score["SongPath"] = song.getPath();
+	score["Difficulty"] = results.getDifficulty();
+	score["Score"] = results.getScore();
+	score["PerfectCount"] = results.getPerfectCount();
+	score["NearCount"] = results.getNearCount();
+	score["MissCount"] = results.getMissCount();
+	score["ReplayHash"] = replayHash;
+	score["PlayedAt"] = playedAt;
+	score["Version"] = network.getLocalVersion();
+
+	bool written;
+	{
+		lock_guard<mutex> lock(this->queueLock);
+
+		Record record;
+		record.id = makeId(playedAt);
+		score["ID"] = record.id;
+		record.json = score.dump();
+
+		json entry;
+		entry["Add"] = score;
+		written = appendLine(entry.dump());
+
+		// A play that couldn't be written is still sent, it just won't survive a restart
+		this->records.push_back(record);
+	}
+	this->queueSignal.notify_all();
+
+	if (!written) {
+		logger.logError("Score could not be written to the queue log, it will be lost if the game closes before it is sent");
+	}
+	return written;
+}
+
+/**
+ * Try sending right away instead of waiting out the backoff (the server came back).
+ *
+ */
+void ScoreQueue::wake() {
+	{
+		lock_guard<mutex> lock(this->queueLock);
+		this->wakeRequested = true;
+	}
+	this->queueSignal.notify_all();
+}
+
+/**
+ * Gets counters of everything the queue has done.
+ *
+ * @return the counters
+ */
+ScoreQueue::Stats ScoreQueue::getStats() {
+	Stats stats;
+	{
+		lock_guard<mutex> lock(this->queueLock);
+		stats.waiting = this->records.size();
+	}
+	stats.uploaded = this->uploadedCount;
+	stats.failedAttempts = this->failedCount;
+	stats.rejected = this->rejectedCount;
+	return stats;
+}
+
+/**
+ * Replay the log: every added play that was never acknowledged is queued again,
+ * then the log is rewritten with only those.
+ *
+ */
+void ScoreQueue::load() {
+	lock_guard<mutex> lock(this->queueLock);
+
+	vector<Record> added;
+	unordered_set<string> seen;
+	unordered_set<string> acked;
+	size_t damaged = 0;
+
+	ifstream in(getLogPath(), ios::binary);
+	string line;
+	while (getline(in, line)) {
+		// A line is the checksum of its entry, a space, then the entry
+		if (line.size() < 18 || line[16] != ' ' || line.compare(0, 16, toHex(fnv1a64(line.data() + 17, line.size() - 17))) != 0) {
+			// Usually the last line, cut short when the power went out mid-write
+			damaged++;
+			continue;
+		}
+
+		try {
+			json entry = json::parse(line.begin() + 17, line.end());
+			if (entry.contains("Add")) {
+				Record record;
+				record.id = entry["Add"]["ID"];
+				record.json = entry["Add"].dump();
+				if (seen.insert(record.id).second) {
+					added.push_back(record);
+				}
+			}
+			else if (entry.contains("Ack")) {
+				for (const json& id : entry["Ack"]) {
+					acked.insert(id.get<string>());
+				}
+			}
+		}
+		catch (const std::exception& e) {
+			damaged++;
+			logger.logError("Skipping damaged score queue entry: ", e.what());
+		}
+	}
+	in.close();
+
+	for (size_t i = 0; i < added.size(); i++) {
+		if (acked.count(added[i].id) == 0) {
+			this->records.push_back(added[i]);
+		}
+	}
+
+	if (damaged > 0) {
+		logger.logError("Score queue log had ", to_string(damaged), " damaged entries");
+	}
+	if (!this->records.empty()) {
+		logger.log("Score queue has ", to_string(this->records.size()), " plays waiting to be sent.");
+	}
+
+	// Start from a clean log so nothing is appended after a half-written line
+	compact();
+}
+
+/**
+ * Open the log for appending.
+ *
+ * @return true if it is open
+ */
+bool ScoreQueue::openLog() {
+	if (this->logFile) {
+		return true;
+	}
+
+	error_code error;
+	filesystem::create_directories(this->directory, error);
+
+	this->logFile = fopen(getLogPath().c_str(), "ab");
+	if (!this->logFile) {
+		logger.logError("Failed to open the score queue log ", getLogPath());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Add an entry to the end of the log and wait for it to reach the disk.
+ *
+ * @param json the entry
+ * @return true if it was written
+ */
+bool ScoreQueue::appendLine(const string& json) {
+	if (!openLog()) {
+		return false;
+	}
+
+	string line = toHex(fnv1a64(json)) + " " + json + "\n";
+	if (fwrite(line.data(), 1, line.size(), this->logFile) != line.size() || !syncFile(this->logFile)) {
+		// Start a fresh file next time rather than appending after a partial line
+		fclose(this->logFile);
+		this->logFile = NULL;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Rewrite the log with only the plays still waiting, replacing the old one in a
+ * single step so a power cut leaves either the old or the new log.
+ *
+ * @return true if it was rewritten
+ */
+bool ScoreQueue::compact() {
+	error_code error;
+	filesystem::create_directories(this->directory, error);
+
+	string path = getLogPath();
+	string tempPath = path + ".tmp";
+	FILE* temp = fopen(tempPath.c_str(), "wb");
+	if (!temp) {
+		logger.logError("Failed to write the score queue log ", tempPath);
+		return false;
+	}
+
+	bool written = true;
+	for (size_t i = 0; i < this->records.size() && written; i++) {
+		string entry = "{\"Add\":" + this->records[i].json + "}";
+		string line = toHex(fnv1a64(entry)) + " " + entry + "\n";
+		written = fwrite(line.data(), 1, line.size(), temp) == line.size();
+	}
+	written = written && syncFile(temp);
+	fclose(temp);
+
+	if (!written) {
+		logger.logError("Failed to write the score queue log ", tempPath);
+		filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	if (this->logFile) {
+		fclose(this->logFile);
+		this->logFile = NULL;
+	}
+
+	filesystem::rename(tempPath, path, error);
+	if (error) {
+		logger.logError("Failed to replace the score queue log ", path, ": ", error.message());
+		return false;
+	}
+
+	this->ackedInLog = 0;
+	return openLog();
+}
+
+/**
+ * Keep a play the server refused in a separate file so it can be looked at, and
+ * so it doesn't hold up the plays behind it.
+ *
+ * @param record the play
+ */
+void ScoreQueue::setAside(const Record& record) {
+	lock_guard<mutex> lock(this->queueLock);
+
+	ofstream out(this->directory + "/rejected.log", ios::app);
+	out << record.json << "\n";
+}
+
+/**
+ * The server has these plays, so drop them from the queue.
+ *
+ * @param ids the plays
+ */
+void ScoreQueue::acknowledge(const vector<string>& ids) {
+	lock_guard<mutex> lock(this->queueLock);
+
+	json entry;
+	entry["Ack"] = ids;
+
+	// If this doesn't reach the disk the plays are sent again next run, and the
+	// server counts each ID only once
+	appendLine(entry.dump());
+	this->ackedInLog += ids.size();
+
+	unordered_set<string> done(ids.begin(), ids.end());
+	this->records.erase(remove_if(this->records.begin(), this->records.end(),
+		[&done](const Record& record) { return done.count(record.id) > 0; }), this->records.end());
+
+	if (this->records.empty() || this->ackedInLog >= SCORE_COMPACT_THRESHOLD) {
+		compact();
+	}
+}
+
+/**
+ * The upload thread: sends waiting plays in batches and backs off while the server can't be reached.
+ *
+ */
+void ScoreQueue::run() {
+	tracer.setThreadName("Score Upload");
+
+	int backoffMs = 0;
+	chrono::steady_clock::time_point retryAt = chrono::steady_clock::now();
+	mt19937 jitter(random_device{}());
+
+	while (this->running) {
+		vector<Record> batch;
+		string url;
+		{
+			unique_lock<mutex> lock(this->queueLock);
+			while (this->running) {
+				if (this->wakeRequested) {
+					this->wakeRequested = false;
+					retryAt = chrono::steady_clock::now();
+				}
+				if (this->records.empty()) {
+					this->queueSignal.wait(lock);
+				}
+				else if (chrono::steady_clock::now() < retryAt) {
+					this->queueSignal.wait_until(lock, retryAt);
+				}
+				else {
+					break;
+				}
+			}
+			if (!this->running) {
+				break;
+			}
+
+			size_t count = min(this->batchLimit, this->records.size());
+			batch.assign(this->records.begin(), this->records.begin() + count);
+			url = this->serverUrl;
+		}
+
+		TraceScope trace("Upload scores", "network");
+
+		NetRequest request;
+		request.method = "POST";
+		request.url = url;
+		request.headers.push_back(make_pair("Content-Type", "application/json"));
+		request.timeoutMs = 10000;
+		request.retries = 1;
+		request.body = "{\"Scores\":[";
+		for (size_t i = 0; i < batch.size(); i++) {
+			request.body += (i > 0 ? "," : "") + batch[i].json;
+		}
+		request.body += "]}";
+
+		// Wait for the reply without holding up shutdown
+		future<NetResponse> reply = netClient.send(request);
+		while (this->running && reply.wait_for(UPLOAD_POLL_INTERVAL) != future_status::ready) {}
+		if (!this->running) {
+			break;
+		}
+
+		NetResponse response;
+		try {
+			response = reply.get();
+		}
+		catch (const future_error&) {
+			break;
+		}
+
+		vector<string> ids;
+		for (size_t i = 0; i < batch.size(); i++) {
+			ids.push_back(batch[i].id);
+		}
+
+		if (response.ok()) {
+			acknowledge(ids);
+			this->uploadedCount += ids.size();
+			backoffMs = 0;
+			this->batchLimit = SCORE_BATCH_SIZE;
+			logger.log("Sent ", to_string(ids.size()), " scores to the server.");
+		}
+		else if (response.status >= 400 && response.status < 500 && response.status != 408 && response.status != 429) {
+			if (batch.size() > 1) {
+				// Send them one at a time to find which play the server doesn't accept
+				this->batchLimit = 1;
+			}
+			else {
+				logger.logError("Server rejected score ", batch[0].id, " (", to_string(response.status), "), set aside in rejected.log");
+				setAside(batch[0]);
+				acknowledge(ids);
+				this->rejectedCount++;
+				this->batchLimit = SCORE_BATCH_SIZE;
+			}
+		}
+		else {
+			if (backoffMs == 0) {
+				logger.logError("Could not send scores (", response.error.empty() ? "status " + to_string(response.status) : response.error, "), will keep trying");
+			}
+			this->failedCount++;
+			backoffMs = backoffMs == 0 ? UPLOAD_BACKOFF_START_MS : min(backoffMs * 2, UPLOAD_BACKOFF_MAX_MS);
+			int wait = backoffMs / 2 + (int)(jitter() % (unsigned)(backoffMs / 2 + 1));
+			retryAt = chrono::steady_clock::now() + chrono::milliseconds(wait);
+		}
+	}
+}
+
+/**
+ * Make an ID no other play will have, from when it was played and a random part.
+ *
+ * @param playedAt when the play finished
+ * @return the ID
+ */
+string ScoreQueue::makeId(int64_t playedAt) {
+	static mt19937_64 generator(random_device{}() ^ (uint64_t)playedAt);
+	return toHex((uint64_t)playedAt) + "-" + toHex(generator());
+}
+
+/**
+ * Gets where the log is kept.
+ *
+ * @return the path
+ */
+string ScoreQueue::getLogPath() {
+	return this->directory + "/queue.log";
+}
+
+/**
+ * Gets the wall clock time, so play times survive restarts.
+ *
+ * @return milliseconds since the epoch
+ */
+int64_t ScoreQueue::now() {
+	return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,101 @@
+/**
+ * @file ScoreQueue.h
+ *
+ * @brief Score Queue
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "Results.h"
+
+// Most scores sent to the server in one request
+#define SCORE_BATCH_SIZE 16
+
+// Acknowledged entries allowed in the log before it is rewritten
+#define SCORE_COMPACT_THRESHOLD 64
+
+/**
+ * Keeps every finished play in an append-only log on disk until the server has
+ * acknowledged it, and sends them from a background thread in batches
+ */
+class ScoreQueue {
+
+	public:
+		/**
+		 * Counters shown on the system information page
+		 */
+		struct Stats {
+			size_t waiting;
+			uint64_t uploaded;
+			uint64_t failedAttempts;
+			uint64_t rejected;
+		};
+
+	private:
+		/**
+		 * A play waiting to be acknowledged
+		 */
+		struct Record {
+			string id;		// Unique to this play, so a score sent twice is only counted once
+			string json;	// The score as it is sent
+		};
+
+		mutex queueLock;
+		condition_variable queueSignal;
+		deque<Record> records;
+		once_flag loadFlag;
+		FILE* logFile;
+		size_t ackedInLog;
+
+		string directory;
+		string serverUrl;
+
+		thread uploadThread;
+		atomic<bool> running;
+		bool wakeRequested;
+		size_t batchLimit;
+
+		atomic<uint64_t> uploadedCount;
+		atomic<uint64_t> failedCount;
+		atomic<uint64_t> rejectedCount;
+
+		void load();
+		bool openLog();
+		bool appendLine(const string& json);
+		bool compact();
+		void setAside(const Record& record);
+		void acknowledge(const vector<string>& ids);
+
+		void run();
+		string makeId(int64_t playedAt);
+		string getLogPath();
+
+		static int64_t now();
+
+	public:
+		ScoreQueue();
+		~ScoreQueue();
+
+		void setDirectory(string path);
+		void setServer(string url);
+		void start();
+		void stop();
+
+		bool add(Results& results, const string& cardID, const string& replayHash);
+		void wake();
+
+		Stats getStats();
+};
+
+extern ScoreQueue scoreQueue;
@@ -2,17 +2,26 @@
 #include "ControllerInput.h"
 #include <filesystem>
 #include <fstream>
+#include "FramePacer.h"
 #include "GameState.h"
+#include "LatencyMonitor.h"
 #include "GameRenderer.h"
 #include "Logger.h"
 #include "Networking.h"
+#include "PeerExchange.h"
 #include "RFIDCardReader.h"
+#include "Profiler.h"
+#include "ProfileCache.h"
+#include "ScoreQueue.h"
 #include "ScreenRenderer.h"
 #include "SoundEffects.h"
+#include "SpriteBatch.h"
+#include "StartupTasks.h"
 #include "SystemSettings.h"
-#include <tchar.h>
 #include "TextureList.h"
-#include "unzip.h"
+#include "TextureLoader.h"
+#include "Tracer.h"
+#include "UpdateService.h"
 #include "UserData.h"
 #include "WindowsAudio.h"
 using namespace std;
@@ -47,63 +56,39 @@ int networkStatus = -1;
 */
 int updateCheckStatus = -2;
 
-/* UPDATE DOWNLOAD STATUS
+/* UPDATE DOWNLOAD STATUS (the update itself is staged in the background)
 *	-1 - Not started
-*	 0 - Downloading
-*	 1 - Extracting
 *	 2 - Modifying Startup
 *	 3 - Restarting
 */
 int updateDownloadStatus = -1;
 
 // Screen Size Ratio;
-const float aspect = 16.f / 9.f;
+extern const float aspect = 16.f / 9.f;
+
+// Longest wait for the old version to close after an update, and the time between tries to delete it
+const std::chrono::milliseconds OLD_VERSION_WAIT(10000);
+const std::chrono::milliseconds OLD_VERSION_RETRY_INTERVAL(250);
+
+// Time the startup check results stay on screen
+const std::chrono::milliseconds STARTUP_RESULTS_SHOWN(2000);
+
+// Textures the title screen is drawn with, preloaded ahead of everything else
+const vector<string> TITLE_TEXTURES = {
+	"Textures/TitleScreen.png",
+	"Textures/General/ClosedCurtainLeft.png",
+	"Textures/General/ClosedCurtainRight.png"
+};
 
 // Forward declarations
 void execStartupChecks();
 void execDownloadUpdate();
-void rThread(sf::RenderWindow* window);
 void checkForProfile();
 
 /**
  * Constructor for the screen renderer.
  */
 ScreenRenderer::ScreenRenderer() {
-
-	logger.log(L"Beginning Startup for Sonataria");
-
-	// Need to make sure that the game can delete stuff if needed (allows time for the old version to close after an update)
-	std::chrono::milliseconds timespan(1000);
-	this_thread::sleep_for(3 * timespan);
-
-	logger.log(L"Checking for old versions");
-	// Check for old versions of the game and delete them
-	ifstream inFile;
-	inFile.open("C:/old_version.txt");
-	if (!inFile.is_open()) {
-		logger.logError(L"Old version file NOT detected!");
-	}
-	else {
-		string contents;
-		inFile >> contents;
-		if (contents == "" || contents == " ") {
-			logger.log(L"No old versions detected.");
-		}
-		else {
-			string oldPath = "C:/" + contents;
-
-			uintmax_t n = filesystem::remove_all(oldPath);
-			logger.log(L"Cleaned up " + to_wstring(n) + L" files from the old version.");
-
-			std::ofstream ofs("C:/old_version.txt", std::ios::out | std::ios::trunc); // clear contents
-			ofs.close();
-
-			filesystem::remove("C:/SNA_UPDATE/Update.zip");
-
-			logger.log(L"Cleaned up new version zip file.");
-		}
-	}
-
 	this->testMenuPos = 0;
 	this->testMenuTotalOptions = 5;
 	this->testMenuIOChkPos = 0;
@@ -148,7 +133,8 @@ ScreenRenderer::ScreenRenderer() {
 	Frame = new QuadSprite(L"Frame");
 
 	// Backgrounds
-	//AttractTitleScreen = new VideoSprite(L"Attract Title Screen Video");
+	AttractTitleScreen = new VideoSprite(L"Attract Title Screen Video");
+	attractVideoLoaded = false;
 	SetMorning = new QuadSprite(L"Set Morning");
 	SetAfternoon = new QuadSprite(L"Set Afternoon");
 	SetEvening = new QuadSprite(L"Set Evening");
@@ -171,7 +157,157 @@ ScreenRenderer::ScreenRenderer() {
 	JacketArt4 = new QuadSprite(L"Jacket Art 4");
 	JacketArt5 = new QuadSprite(L"Jacket Art 5");
 	JacketArt6 = new QuadSprite(L"Jacket Art 6");
+}
+
+/**
+ * Start everything that has to be done before the game can be played, as a graph of
+ * tasks so that independent work overlaps. The render thread picks up the tasks that
+ * need OpenGL as soon as it is running.
+ */
+void ScreenRenderer::beginStartup() {
+	logger.log(L"Beginning Startup for Sonataria");
+
+	// Made before any task runs, so no two threads race to make them
+	TextureLoader::Inst();
+	TextureList::Inst();
+
+	startupTasks.add("Old version cleanup", {}, [this]() { cleanUpOldVersion(); });
+	startupTasks.add("Settings", {}, []() { systemSettings.initSettings(); });
+	startupTasks.add("Song index", {}, [this]() { loadSongs(); });
+	startupTasks.add("Network probe", {}, execStartupChecks);
+	startupTasks.add("Title textures", {}, []() { TextureList::Inst()->PreloadTextures(TITLE_TEXTURES); });
+	startupTasks.add("Texture preload", { "Title textures" }, []() { TextureList::Inst()->PreloadTextures(); });
+
+	startupTasks.addOnRenderThread("Shaders", {}, [this]() {
+		logger.log(L"Initializing sprite shader.");
+		if (!spriteShader.initShader()) {
+			logger.logError(L"Failed to initialize sprite shader.");
+			exit(1);
+		}
+
+		logger.log(L"Initializing text shader.");
+		if (!textShader.initShader()) {
+			logger.logError(L"Failed to initialize text shader.");
+			exit(1);
+		}
 
+		if (!videoShader.initShader()) {
+			logger.logError(L"Failed to initialize video shader.");
+			exit(1);
+		}
+		return true;
+	});
+	startupTasks.addOnRenderThread("Fonts", {}, []() {
+		TextureList::Inst()->BuildFonts();
+		return true;
+	});
+	startupTasks.addOnRenderThread("Title upload", { "Title textures" }, []() {
+		while (TextureList::Inst()->UploadPreloadedTexture());
+		return true;
+	});
+	startupTasks.addOnRenderThread("Attract video", { "Shaders" }, [this]() {
+		// Fall back to the still title screen if the video is missing
+		if (!AttractTitleScreen->loadVideo("Videos/AttractTitleScreen.mp4")) {
+			logger.logError("Failed to load video: Videos/AttractTitleScreen.mp4");
+		}
+		else {
+			attractVideoLoaded = true;
+
+			// Link video sprite and shader
+			AttractTitleScreen->initSprite(videoShader.getProgram());
+			AttractTitleScreen->enableLooping(true);
+
+			// Load the first frame
+			AttractTitleScreen->scale(2.f * aspect, -2.f, 1.f);
+			AttractTitleScreen->update(0);
+		}
+		return true;
+	});
+	startupTasks.addOnRenderThread("Texture upload", { "Texture preload" }, []() {
+		// One texture at a time, so frames keep coming while the rest is uploaded
+		return !TextureList::Inst()->UploadPreloadedTexture();
+	});
+	startupTasks.addOnRenderThread("Jacket page", { "Song index" }, [this]() {
+		// The first page of song select
+		JacketArt6->setTextureID(TextureList::Inst()->LookUpTextureID(this->currentPageSongs[5].getJacketArtPath()));
+		JacketArt1->setTextureID(TextureList::Inst()->LookUpTextureID(this->currentPageSongs[0].getJacketArtPath()));
+		JacketArt2->setTextureID(TextureList::Inst()->LookUpTextureID(this->currentPageSongs[1].getJacketArtPath()));
+		JacketArt3->setTextureID(TextureList::Inst()->LookUpTextureID(this->currentPageSongs[2].getJacketArtPath()));
+		JacketArt4->setTextureID(TextureList::Inst()->LookUpTextureID(this->currentPageSongs[3].getJacketArtPath()));
+		JacketArt5->setTextureID(TextureList::Inst()->LookUpTextureID(this->currentPageSongs[4].getJacketArtPath()));
+		return true;
+	});
+	startupTasks.addOnRenderThread("Game renderer", { "Fonts", "Texture upload" }, [this]() {
+		gameRenderer.init();
+		return true;
+	});
+
+	startupTasks.start();
+}
+
+/**
+ * Delete the version of the game that was updated from.
+ *
+ */
+void ScreenRenderer::cleanUpOldVersion() {
+	logger.log(L"Checking for old versions");
+	// Check for old versions of the game and delete them
+	ifstream inFile;
+	inFile.open("C:/old_version.txt");
+	if (!inFile.is_open()) {
+		logger.logError(L"Old version file NOT detected!");
+	}
+	else {
+		string contents;
+		inFile >> contents;
+		inFile.close();
+		if (contents == "" || contents == " ") {
+			logger.log(L"No old versions detected.");
+		}
+		else {
+			string oldPath = "C:/" + contents;
+
+			// Right after an update the old version may still be closing, its files can't be deleted until it has
+			uintmax_t n = 0;
+			error_code error;
+			chrono::steady_clock::time_point giveUpAt = chrono::steady_clock::now() + OLD_VERSION_WAIT;
+			while (true) {
+				uintmax_t removed = filesystem::remove_all(oldPath, error);
+				if (removed != static_cast<uintmax_t>(-1)) {
+					n += removed;
+				}
+				if (!error || chrono::steady_clock::now() >= giveUpAt) {
+					break;
+				}
+				this_thread::sleep_for(OLD_VERSION_RETRY_INTERVAL);
+			}
+
+			if (error) {
+				// Left in the file so the next start tries again
+				logger.logError("Couldn't clean up the old version: ", error.message());
+				return;
+			}
+			logger.log(L"Cleaned up " + to_wstring(n) + L" files from the old version.");
+
+			std::ofstream ofs("C:/old_version.txt", std::ios::out | std::ios::trunc); // clear contents
+			ofs.close();
+
+			filesystem::remove("C:/SNA_UPDATE/Update.zip", error);
+
+			// Files of a delta update are links into the new version, so they can go too
+			filesystem::remove_all("C:/SNA_UPDATE/objects", error);
+			filesystem::remove_all("C:/SNA_UPDATE/chunks", error);
+
+			logger.log(L"Cleaned up new version zip file.");
+		}
+	}
+}
+
+/**
+ * Find and read in every song.
+ *
+ */
+void ScreenRenderer::loadSongs() {
 	std::string dir = "./Songs";
 
 	logger.log(L"Reading in song paths...");
@@ -231,10 +367,6 @@ ScreenRenderer::ScreenRenderer() {
 	for (int i = 0; i < 6; i++) {
 		currentPageSongs.push_back(songs[i]);
 	}
-
-	logger.log(L"Starting to load in saved settings.");
-
-	systemSettings.initSettings();
 }
 
 /**
@@ -267,7 +399,7 @@ ScreenRenderer::~ScreenRenderer() {
 	delete Frame;
 
 	// Backgrounds
-	//delete AttractTitleScreen;
+	delete AttractTitleScreen;
 	delete SetMorning;
 	delete SetAfternoon;
 	delete SetEvening;
@@ -309,6 +441,7 @@ ScreenRenderer::~ScreenRenderer() {
  */
 void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 
+	tracer.setThreadName("Screen Renderer");
 	logger.log(L"Screen Renderer Now Active.");
 
 	// Set the game window to active
@@ -328,12 +461,9 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 		glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
 		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
 
-		// INITIALIZE SPRITE SHADER
-		logger.log(L"Initializing sprite shader.");
-		if (!spriteShader.initShader()) {
-			logger.logError(L"Failed to initialize sprite shader.");
-			exit(1);
-		}
+		// The startup screen only needs the shaders and fonts, the rest of startup carries on behind it
+		startupTasks.runUntil("Shaders");
+		startupTasks.runUntil("Fonts");
 
 		// INITIALIZE THE SPRITES
 
@@ -384,54 +514,49 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 		JacketArt5->initSprite(spriteShader.getProgram());
 		JacketArt6->initSprite(spriteShader.getProgram());
 
-		// INITIALIZE THE TEXTURES
+		// INITIALIZE THE TEXTURES (they are uploaded as they are preloaded, or when first drawn)
 
 		// General Sprites
-		TitleScreen->setTextureID(TextureList::Inst()->GetTextureID("Textures/TitleScreen.png"));
-		Stage->setTextureID(TextureList::Inst()->GetTextureID("Textures/General/Stage.png"));
-		OpenCurtains->setTextureID(TextureList::Inst()->GetTextureID("Textures/General/OpenCurtains.png"));
-		ClosedCurtainLeft->setTextureID(TextureList::Inst()->GetTextureID("Textures/General/ClosedCurtainLeft.png"));
-		ClosedCurtainRight->setTextureID(TextureList::Inst()->GetTextureID("Textures/General/ClosedCurtainRight.png"));
-		SpotlightLeft->setTextureID(TextureList::Inst()->GetTextureID("Textures/General/Spotlights/Spotlight-Left.png"));
-		SpotlightRight->setTextureID(TextureList::Inst()->GetTextureID("Textures/General/Spotlights/Spotlight-Right.png"));
-		CurvySymbol->setTextureID(TextureList::Inst()->GetTextureID("Textures/General/CurvySymbol.png"));
-		LeftBracket->setTextureID(TextureList::Inst()->GetTextureID("Textures/General/Brackets/LeftBracket.png"));
-		RightBracket->setTextureID(TextureList::Inst()->GetTextureID("Textures/General/Brackets/RightBracket.png"));
-		Thanks->setTextureID(TextureList::Inst()->GetTextureID("Textures/ThanksForPlaying/ThanksForPlaying.png"));
+		TitleScreen->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/TitleScreen.png"));
+		Stage->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/General/Stage.png"));
+		OpenCurtains->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/General/OpenCurtains.png"));
+		ClosedCurtainLeft->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/General/ClosedCurtainLeft.png"));
+		ClosedCurtainRight->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/General/ClosedCurtainRight.png"));
+		SpotlightLeft->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/General/Spotlights/Spotlight-Left.png"));
+		SpotlightRight->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/General/Spotlights/Spotlight-Right.png"));
+		CurvySymbol->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/General/CurvySymbol.png"));
+		LeftBracket->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/General/Brackets/LeftBracket.png"));
+		RightBracket->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/General/Brackets/RightBracket.png"));
+		Thanks->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/ThanksForPlaying/ThanksForPlaying.png"));
 
 		// Login
-		TapLifeLinkPass->setTextureID(TextureList::Inst()->GetTextureID("Textures/Login/TapLifeLinkPass.png"));
-		OR->setTextureID(TextureList::Inst()->GetTextureID("Textures/Login/OR.png"));
-		BeginAsGuest->setTextureID(TextureList::Inst()->GetTextureID("Textures/Login/BeginAsGuest.png"));
-		PosterA->setTextureID(TextureList::Inst()->GetTextureID("Textures/Login/PosterA.png"));
-		PosterB->setTextureID(TextureList::Inst()->GetTextureID("Textures/Login/PosterB.png"));
+		TapLifeLinkPass->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Login/TapLifeLinkPass.png"));
+		OR->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Login/OR.png"));
+		BeginAsGuest->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Login/BeginAsGuest.png"));
+		PosterA->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Login/PosterA.png"));
+		PosterB->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Login/PosterB.png"));
 
 		// UI Elements
-		Frame->setTextureID(TextureList::Inst()->GetTextureID("Textures/General/Frame.png"));
+		Frame->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/General/Frame.png"));
 
 		// Backgrounds
-		SetMorning->setTextureID(TextureList::Inst()->GetTextureID("Textures/Backgrounds/Set-Morning.png"));
-		SetAfternoon->setTextureID(TextureList::Inst()->GetTextureID("Textures/Backgrounds/Set-Afternoon.png"));
-		SetEvening->setTextureID(TextureList::Inst()->GetTextureID("Textures/Backgrounds/Set-Evening.png"));
+		SetMorning->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Backgrounds/Set-Morning.png"));
+		SetAfternoon->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Backgrounds/Set-Afternoon.png"));
+		SetEvening->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Backgrounds/Set-Evening.png"));
 
 		// PreLogin Sprites
-		LifeLinkIcon->setTextureID(TextureList::Inst()->GetTextureID("Textures/Login/LifeLink.png"));
+		LifeLinkIcon->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Login/LifeLink.png"));
 
 		// Playbills
-		Act1->setTextureID(TextureList::Inst()->GetTextureID("Textures/Playbills/Base Playbills/Playbill-Act1.png"));
-		Act1Fin->setTextureID(TextureList::Inst()->GetTextureID("Textures/Playbills/Base Playbills/Playbill-Act1Fin.png"));
-		Act2->setTextureID(TextureList::Inst()->GetTextureID("Textures/Playbills/Base Playbills/Playbill-Act2.png"));
-		Act2Fin->setTextureID(TextureList::Inst()->GetTextureID("Textures/Playbills/Base Playbills/Playbill-Act2Fin.png"));
-		Fin->setTextureID(TextureList::Inst()->GetTextureID("Textures/Playbills/Base Playbills/Playbill Fin.png"));
-		PreSelectAllBoxes->setTextureID(TextureList::Inst()->GetTextureID("Textures/Playbills/Song Preselect Boxes/AllBoxes.png"));
-		Instructions->setTextureID(TextureList::Inst()->GetTextureID("Textures/Playbills/Instructions.png"));
-
-		JacketArt6->setTextureID(TextureList::Inst()->GetTextureID(this->currentPageSongs[5].getJacketArtPath()));
-		JacketArt1->setTextureID(TextureList::Inst()->GetTextureID(this->currentPageSongs[0].getJacketArtPath()));
-		JacketArt2->setTextureID(TextureList::Inst()->GetTextureID(this->currentPageSongs[1].getJacketArtPath()));
-		JacketArt3->setTextureID(TextureList::Inst()->GetTextureID(this->currentPageSongs[2].getJacketArtPath()));
-		JacketArt4->setTextureID(TextureList::Inst()->GetTextureID(this->currentPageSongs[3].getJacketArtPath()));
-		JacketArt5->setTextureID(TextureList::Inst()->GetTextureID(this->currentPageSongs[4].getJacketArtPath()));
+		Act1->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Playbills/Base Playbills/Playbill-Act1.png"));
+		Act1Fin->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Playbills/Base Playbills/Playbill-Act1Fin.png"));
+		Act2->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Playbills/Base Playbills/Playbill-Act2.png"));
+		Act2Fin->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Playbills/Base Playbills/Playbill-Act2Fin.png"));
+		Fin->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Playbills/Base Playbills/Playbill Fin.png"));
+		PreSelectAllBoxes->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Playbills/Song Preselect Boxes/AllBoxes.png"));
+		Instructions->setTextureID(TextureList::Inst()->LookUpTextureID("Textures/Playbills/Instructions.png"));
+
+		// The jackets get their textures once the songs are indexed (the "Jacket page" startup task)
 
 		// SET THE TRANSFORMATIONS
 
@@ -497,33 +622,6 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 		JacketArt6->scale(.22f);
 		JacketArt6->translate(0.14f, -.72f, 0.f);
 
-		// INITIALIZE TEXT SHADER
-		logger.log(L"Initializing text shader.");
-		if (!textShader.initShader()) {
-			logger.logError(L"Failed to initialize text shader.");
-			exit(1);
-		}
-
-		// INITIALIZE VIDEO SHADER
-		/*if (!videoShader.initShader()) {
-			logger.logError("Failed to initialize video shader.");
-			exit(1);
-		}*/
-
-		// Initialize Videos
-		/*if (!AttractTitleScreen->loadVideo("Videos/AttractTitleScreen.mp4")) {
-			logger.logError("Failed to load video: Videos/AttractTitleScreen.mp4");
-			exit(1);
-		}*/
-
-		// Link video sprite and shader
-		//AttractTitleScreen->initSprite(videoShader.getProgram());
-		//AttractTitleScreen->enableLooping(true);
-
-		// Load the first frame
-		//AttractTitleScreen->scale(2.f * aspect, -2.f, 1.f);
-		//AttractTitleScreen->update(0);
-
 		logger.log(L"OpenGL initialized.");
 	}
 
@@ -562,11 +660,13 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 	glClearColor(0.f, 0.f, 0.f, 1.0f);
 	glViewport(0, 0, 1920, 1080);
 
-	thread startup;
-	// Call the startup thread
-	if (gameState.getGameState() == GameState::CurrentState::STARTUP) {
-		startup = thread(execStartupChecks);
-	}
+	// Pace frames using the saved settings
+	startupTasks.runUntil("Settings");
+	systemSettings.setFramePacing();
+	framePacer.apply(gameWindow);
+
+	// When the startup check results first went up on screen
+	auto checksShownSince = std::chrono::steady_clock::time_point();
 
 	thread update;
 	bool updateDownloadStarted = false;
@@ -636,6 +736,10 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 	testMenuText7->initSprite(textShader.getProgram());
 	testMenuText8->initSprite(textShader.getProgram());
 
+	// Text Object - For Frame Times
+	OpenGLText* profilerText = new OpenGLText(L"Profiler", *HonyaJi.font);
+	profilerText->initSprite(textShader.getProgram());
+
 	// Timer used for countdowns
 	bool timerRunning = false;
 
@@ -648,6 +752,9 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 	typedef std::chrono::duration<float> fsec;
 	auto startTime = Time::now();
 
+	// The attract video was drawn last frame (its clock is picked up again each time the title screen returns)
+	bool attractShown = false;
+
 	// The rendering loop
 	/*
 		The loop will break either if the ESC key is pressed switching
@@ -656,6 +763,9 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 	*/
 	while (gameWindow->isOpen() && !(gameState.getGameState() == GameState::CurrentState::SHUTDOWN) && !gameState.checkService()) {
 
+		// Wait for the frame's turn before reading the time
+		framePacer.waitForLatch();
+
 		// Set the current time
 		auto currentTime = Time::now();
 		fsec fs = currentTime - startTime;
@@ -666,6 +776,13 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 			gameEnded = false;
 		}
 
+		// Everything past the title screen needs the preloaded textures, the first page of jackets and the game renderer
+		if (gameState.getGameState() != GameState::CurrentState::STARTUP && gameState.getGameState() != GameState::CurrentState::TITLE_SCREEN
+			&& (!startupTasks.isDone("Jacket page") || !startupTasks.isDone("Game renderer"))) {
+			startupTasks.runUntil("Jacket page");
+			startupTasks.runUntil("Game renderer");
+		}
+
 		// Check if switching to the GAME game state
 		if (gameState.getGameState() == GameState::CurrentState::GAME) {
 			if (gameEnded == true) {
@@ -674,16 +791,11 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 			// Clear the buffers
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-			// Set the screen to not active
-			gameWindow->setActive(false);
+			// Play the song on this thread with the game renderer that is kept between songs
+			this->gameRenderer.render(gameWindow);
 
-			// Launch the game renderer in a new thread and wait for it to complete
-			sf::Thread thread(&rThread, gameWindow);
-			thread.launch();
-			thread.wait();
-
-			// Re-activate the game window in this thread
-			gameWindow->setActive(true);
+			// Pick the frame timeline back up
+			framePacer.apply(gameWindow);
 
 			// Transition to results since a song has now completed while making sure the shutdown key wasn't pressed to trigger the end of the thread
 			if (gameState.getGameState() != GameState::CurrentState::SHUTDOWN) {
@@ -691,6 +803,16 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 			}
 		}
 
+		// Time the whole frame for the profiler (the system information page shows the frame times too)
+		ProfileScope frameScope(ZONE_FRAME);
+		profiler.setPageVisible(gameState.getGameState() == GameState::CurrentState::TEST_MENU_SYSINFO);
+
+		// Switch to a staged update once nobody has played for a while
+		if (updateService.readyToActivate(gameState.getGameState() == GameState::CurrentState::TITLE_SCREEN)) {
+			newVersion = updateService.getStagedVersion();
+			gameState.setGameState(GameState::CurrentState::UPDATES);
+		}
+
 		// Launch update download thread if needed
 		if (gameState.getGameState() == GameState::CurrentState::UPDATES && updateDownloadStarted == false) {
 			updateDownloadStarted = true;
@@ -700,24 +822,41 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 		// Clear the buffers
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// Use the sprite shader first
+		// Use the sprite shader first, collecting its sprites into as few draws as possible
 		glUseProgram(spriteShader.getProgram());
+		spriteBatch.begin(spriteShader.getProgram());
 
 		// DRAW BACKGROUNDS / STAGE (MAIN SET)
 		{
+			ProfileScope backgroundScope(ZONE_BACKGROUND);
+
+			if (gameState.getGameState() != GameState::CurrentState::TITLE_SCREEN) {
+				attractShown = false;
+			}
+
 			if (!(gameState.getGameState() == GameState::CurrentState::RESULTS) && gameState.isInServiceGameState()) {
 				// Don't render anything background related when in a service state
 			}
 			else if (gameState.getGameState() == GameState::CurrentState::TITLE_SCREEN) {
-				// Swap to the video shader program
-				//glUseProgram(videoShader.getProgram());
+				if (attractVideoLoaded) {
+					// Swap to the video shader program
+					glUseProgram(videoShader.getProgram());
+
+					// The clock ran on while the title screen was away, so the video carries on from where it was left
+					if (!attractShown) {
+						AttractTitleScreen->resumeClock((double)fs.count());
+						attractShown = true;
+					}
 
-				// Update the current frame
-				//AttractTitleScreen->update((double)fs.count());
+					// Present the decoded frame that is due for the current time
+					AttractTitleScreen->update((double)fs.count());
 
-				// Render that frame
-				//AttractTitleScreen->render(PROJECTION::ORTHOGRAPHIC);
-				TitleScreen->render(PROJECTION::ORTHOGRAPHIC);
+					// Render that frame
+					AttractTitleScreen->render(PROJECTION::ORTHOGRAPHIC);
+				}
+				else {
+					TitleScreen->render(PROJECTION::ORTHOGRAPHIC);
+				}
 			}
 			else if (gameState.getGameState() == GameState::CurrentState::THANKS_FOR_PLAYING) {
 				Thanks->render(PROJECTION::ORTHOGRAPHIC);
@@ -814,6 +953,8 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 
 		// DRAW ALL OTHER GRAPHICS
 		{
+			ProfileScope spritesScope(ZONE_SPRITES);
+
 			if (gameState.getGameState() == GameState::CurrentState::PRELOGIN) {
 				Frame->reset();
 				Frame->scale(.6f * aspect, .6f, 1.f);
@@ -902,11 +1043,14 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 			}
 		}
 
-		// Switch over to the text shader
+		// Draw the collected sprites then switch over to the text shader
+		spriteBatch.end();
 		glUseProgram(textShader.getProgram());
 
 		// DRAW ALL TEXT
 		{
+			ProfileScope textScope(ZONE_TEXT);
+
 			if (gameState.getGameState() == GameState::CurrentState::STARTUP) {
 				int netCheck = 0;
 				int updateCheck = 0;
@@ -1053,15 +1197,73 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 				testMenuText2->scale(0.5f);
 				testMenuText2->render(PROJECTION::ORTHOGRAPHIC, "SNA:" + network.getLocalVersion(), ALIGNMENT::LEFT);
 
+				profiler.drawStats(profilerText, -1200.f, 200.f, 60.f, 0.4f);
+
+				// Where the last trace went, so it can be collected from the cabinet
+				string tracePath = tracer.getLastDumpPath();
+				if (!tracePath.empty()) {
+					profilerText->reset();
+					profilerText->translate(-1200.f, -480.f, 0.f);
+					profilerText->scale(0.4f);
+					profilerText->render(PROJECTION::ORTHOGRAPHIC, "TRACE SAVED TO " + tracePath, ALIGNMENT::LEFT);
+				}
+
+				// Scores still waiting for the server
+				ScoreQueue::Stats scoreStats = scoreQueue.getStats();
+				profilerText->reset();
+				profilerText->translate(-1200.f, -540.f, 0.f);
+				profilerText->scale(0.4f);
+				profilerText->render(PROJECTION::ORTHOGRAPHIC, "SCORES WAITING " + to_string(scoreStats.waiting) + "   SENT " + to_string(scoreStats.uploaded)
+					+ "   REJECTED " + to_string(scoreStats.rejected), ALIGNMENT::LEFT);
+
+				// What the background update is doing
+				string updateText = "UPDATE ";
+				switch (updateService.getStatus()) {
+					case UpdateService::Status::IDLE: updateText += "UP TO DATE"; break;
+					case UpdateService::Status::CHECKING: updateText += "CHECKING"; break;
+					case UpdateService::Status::STAGED: updateText += "STAGED " + updateService.getStagedVersion() + ", SWITCHING WHEN IDLE"; break;
+					case UpdateService::Status::FAILED: updateText += "FAILED, RETRYING LATER"; break;
+					case UpdateService::Status::STAGING: {
+						UpdateDownloader::Progress progress = network.getDownloadProgress();
+						ZipExtractor::Progress extraction = network.getExtractProgress();
+						updateText += "STAGING";
+						if (progress.active && progress.total > 0) {
+							updateText += " " + to_string(progress.received * 100 / progress.total) + "% OF " + to_string(progress.total / 1048576) + " MB";
+						}
+						else if (progress.active && progress.filesTotal > 0) {
+							updateText += ", CHECKING FILES " + to_string(progress.filesChecked) + " / " + to_string(progress.filesTotal);
+						}
+						else if (extraction.entriesTotal > 0) {
+							updateText += ", EXTRACTING " + to_string(extraction.entriesDone) + " / " + to_string(extraction.entriesTotal);
+						}
+						break;
+					}
+				}
+
+				// Update chunks shared with the other cabinets of the venue
+				PeerExchange::Stats peerStats = peerExchange.getStats();
+				if (peerStats.peers > 0 || peerStats.chunksServed > 0) {
+					updateText += "   CABINETS " + to_string(peerStats.peers) + "   SERVED " + to_string(peerStats.bytesServed / 1048576) + " MB";
+				}
+				profilerText->reset();
+				profilerText->translate(-1200.f, -595.f, 0.f);
+				profilerText->scale(0.4f);
+				profilerText->render(PROJECTION::ORTHOGRAPHIC, updateText, ALIGNMENT::LEFT);
+
 				testMenuText3->reset();
 				testMenuText3->translate(0.f, -650.f, 0.f);
 				testMenuText3->scale(0.5f);
 				testMenuText3->render(PROJECTION::ORTHOGRAPHIC, L"EXIT", ALIGNMENT::CENTERED, 1.f, 0.f, 0.f);
 
 				testMenuText4->reset();
-				testMenuText4->translate(0.f, -925.f, 0.f);
+				testMenuText4->translate(0.f, -850.f, 0.f);
 				testMenuText4->scale(0.35f);
 				testMenuText4->render(PROJECTION::ORTHOGRAPHIC, L"BT-START [T] | SELECT", ALIGNMENT::CENTERED);
+
+				testMenuText5->reset();
+				testMenuText5->translate(0.f, -925.f, 0.f);
+				testMenuText5->scale(0.35f);
+				testMenuText5->render(PROJECTION::ORTHOGRAPHIC, L"BT-1 [A] | SAVE TRACE", ALIGNMENT::CENTERED);
 			}
 			else if (gameState.getGameState() == GameState::CurrentState::TEST_MENU_NETWORKING) {
 				testMenuTitle->reset();
@@ -1271,6 +1473,55 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 				testMenuText1->scale(0.5f);
 				testMenuText1->render(PROJECTION::ORTHOGRAPHIC, to_string(controllerInput.getWheelPos()), ALIGNMENT::LEFT);
 
+				// Input to photon latency of each button measured during play this session
+				testMenuText2->reset();
+				testMenuText2->translate(1100.f, 450.f, 0.f);
+				testMenuText2->scale(0.35f);
+				testMenuText2->render(PROJECTION::ORTHOGRAPHIC, L"LATENCY P50 / P99 (MS)", ALIGNMENT::LEFT, 1.f, 1.f, 0.f);
+
+				testMenuText2->reset();
+				testMenuText2->translate(2300.f, 450.f, 0.f);
+				testMenuText2->scale(0.35f);
+				testMenuText2->render(PROJECTION::ORTHOGRAPHIC, L"0-32 MS", ALIGNMENT::LEFT, 1.f, 1.f, 0.f);
+
+				for (int button = 1; button <= 5; button++) {
+					LatencyMonitor::ButtonSummary latency = latencyMonitor.summarizeButton(button);
+					float rowY = 450.f - 100.f * button;
+
+					char latencyText[64];
+					if (latency.count > 0) {
+						snprintf(latencyText, sizeof(latencyText), "%.1f / %.1f  (%zu)", latency.p50Ms, latency.p99Ms, latency.count);
+					}
+					else {
+						snprintf(latencyText, sizeof(latencyText), "-");
+					}
+
+					testMenuText2->reset();
+					testMenuText2->translate(1100.f, rowY, 0.f);
+					testMenuText2->scale(0.35f);
+					testMenuText2->render(PROJECTION::ORTHOGRAPHIC, string(latencyText), ALIGNMENT::LEFT);
+
+					testMenuText2->reset();
+					testMenuText2->translate(2300.f, rowY, 0.f);
+					testMenuText2->scale(0.35f);
+					testMenuText2->render(PROJECTION::ORTHOGRAPHIC, LatencyMonitor::getHistogramString(latency), ALIGNMENT::LEFT);
+				}
+
+				// Where the time goes, over every button
+				float stageAverages[3];
+				float stageP99s[3];
+				latencyMonitor.summarizeStages(stageAverages, stageP99s);
+				const char* stageNames[3] = { "CAPTURE > JUDGE", "JUDGE > SUBMIT", "SUBMIT > SWAP" };
+				for (int stage = 0; stage < 3; stage++) {
+					char stageText[96];
+					snprintf(stageText, sizeof(stageText), "%s   AVG %.2f MS   P99 %.2f MS", stageNames[stage], stageAverages[stage], stageP99s[stage]);
+
+					testMenuText2->reset();
+					testMenuText2->translate(-1200.f, -270.f - 80.f * stage, 0.f);
+					testMenuText2->scale(0.35f);
+					testMenuText2->render(PROJECTION::ORTHOGRAPHIC, string(stageText), ALIGNMENT::LEFT);
+				}
+
 				testMenuText1->reset();
 				testMenuText1->translate(0.f, -650.f, 0.f);
 				testMenuText1->scale(0.5f);
@@ -1365,12 +1616,6 @@ void ScreenRenderer::render(sf::RenderWindow* gameWindow) {
 					case -1:
 						testMenuText1->render(PROJECTION::ORTHOGRAPHIC, L"Preparing...", ALIGNMENT::CENTERED);
 						break;
-					case 0:
-						testMenuText1->render(PROJECTION::ORTHOGRAPHIC, L"Downloading...", ALIGNMENT::CENTERED);
-						break;
-					case 1:
-testMenuText1->render(PROJECTION::ORTHOGRAPHIC, L"Extracting...", ALIGNMENT::CENTERED);
-break;
 					case 2:
 						testMenuText1->render(PROJECTION::ORTHOGRAPHIC, L"Modifying Startup...", ALIGNMENT::CENTERED);
 						break;
@@ -1522,6 +1767,7 @@ break;
 
 		// Closed Curtains For Transitions
 		glUseProgram(spriteShader.getProgram());
+		spriteBatch.begin(spriteShader.getProgram());
 		{
 			if (gameState.getGameState() != GameState::CurrentState::STARTUP) {
 				ClosedCurtainLeft->update(currentOffset.count());
@@ -1531,22 +1777,37 @@ break;
 				ClosedCurtainRight->render(PROJECTION::ORTHOGRAPHIC);
 			}
 		}
+		spriteBatch.end();
+
+		// Frame times overlay
+		if (profiler.isOverlayVisible()) {
+			glUseProgram(textShader.getProgram());
+			profiler.drawOverlay(profilerText);
+		}
 
 		// Display to the window
-		gameWindow->display();
+		{
+			ProfileScope displayScope(ZONE_DISPLAY);
+			framePacer.present(gameWindow);
+		}
+
+		// Carry on with startup work a little each frame
+		if (!startupTasks.isFinished()) {
+			startupTasks.runOnRenderThread();
+		}
 
 		// If all checks complete for startup
 		if (gameState.getGameState() == GameState::CurrentState::STARTUP && allChecksComplete == true) {
-			// Sleep for two seconds so the operator can see the status of the screen before it shifts to the next
-			std::chrono::milliseconds timespan(1000);
-			this_thread::sleep_for(2 * timespan);
-
-			if (updateCheckStatus == 1) {
-				// Since there is an update available, go to the updates screen
-				gameState.setGameState(GameState::CurrentState::UPDATES);
+			// Leave the results up for a moment so the operator can see them, then move on once the title screen can be drawn
+			if (checksShownSince == std::chrono::steady_clock::time_point()) {
+				checksShownSince = std::chrono::steady_clock::now();
 			}
-			else {
-				// Otherwise, proceed as normal and go to the title screen
+			else if (std::chrono::steady_clock::now() - checksShownSince >= STARTUP_RESULTS_SHOWN
+				&& startupTasks.isDone("Title upload") && startupTasks.isDone("Attract video")) {
+				// An available update is staged in the background while the cabinet stays playable
+				if (updateCheckStatus == 1) {
+					updateService.wake();
+				}
 				gameState.setGameState(GameState::CurrentState::TITLE_SCREEN);
 			}
 		}
@@ -1555,11 +1816,6 @@ break;
 	// When not in the render loop, we don't need control of the game window
 	gameWindow->setActive(false);
 
-	// Makes sure that the startup thread finished before terminating this thread
-	if (startup.joinable()) {
-		startup.join();
-	}
-
 	// Make sure that the update thread is also completed before terminating this thread
 	if (update.joinable()) {
 		update.join();
@@ -1908,78 +2164,25 @@ void execStartupChecks() {
 }
 
 void execDownloadUpdate() {
-	// Set var to 0 saying download is starting
-	updateDownloadStatus = 0;
-
-	logger.log(L"Starting update download...");
-	if (!network.downloadUpdate()) {
-		// The update fails to download
-		logger.logError(L"Failed to download update file!");
-		//TODO: send to error code screen - non fatal instead of title screen first
-		gameState.setGameState(GameState::CurrentState::TITLE_SCREEN);
-		return;
-	}
-	logger.log(L"Update download complete.");
-
-	// Update has finished downloading, next step is to extract it
-	updateDownloadStatus = 1;
-
-	logger.log(L"Beginning Update .ZIP Extraction...");
-
-	HZIP hz;
-
-	hz = OpenZip(_T("C:/SNA_UPDATE/Update.zip"), 0);
-	SetUnzipBaseDir(hz, _T("C:/"));
-	ZIPENTRY ze;
-	GetZipItem(hz, -1, &ze);
-	int numItems = ze.index;
-	for (int zi = 0; zi < numItems; zi++) {
-		GetZipItem(hz, zi, &ze);
-		UnzipItem(hz, zi, ze.name);
-	}
-	CloseZip(hz);
-	logger.log(L"Update .ZIP File Extracted.");
-
-	// Update done extracting, next step is to modify startup batch file
+	// The update was staged in the background, only the startup has to be switched over
 	updateDownloadStatus = 2;
 
 	logger.log(L"Modifying Startup Files...");
-
-	std::ofstream ofs("C:/Rhythm.bat", std::ios::out | std::ios::trunc); // clear contents
-
-	string startCommand = "start \"SNA\" /d C:\\" + newVersion + "\\ \"Sonataria.exe\"";
-
-	ofs << startCommand;
-
-	ofs.close();
-
-	std::ofstream ofs2("C:/old_version.txt", std::ios::out | std::ios::trunc); // clear contents
-
-	string version = network.getLocalVersion();
-
-	ofs2 << version;
-
-	ofs2.close();
-
+	if (!updateService.activate()) {
+		logger.logError(L"No staged update to switch to!");
+		gameState.setGameState(GameState::CurrentState::TITLE_SCREEN);
+		return;
+	}
 	logger.log(L"Startup Modified.");
 
 	// Startup modified, next step is to restart and launch the new game
+	updateDownloadStatus = 3;
 	logger.log(L"Restarting Game As New Version...");
 	system("start \"SNA\" /d C:\\ \"Rhythm.bat\"");
 
 	gameState.setGameState(GameState::CurrentState::SHUTDOWN);
 }
 
-/**
- * Starts the game renderer.
- *
- * @param window the game window
- */
-void rThread(sf::RenderWindow* window) {
-	GameRenderer gameRenderer;
-	gameRenderer.render(window);
-}
-
 void checkForProfile() {
 	// Grab the card ID to check for a profile
 	string cardID = RFIDCardReader::getCardReader()->getLastCardData();
@@ -1987,6 +2190,23 @@ void checkForProfile() {
 	// Clear out the last user data if any
 	userData.clearData();
 
+	// A cached profile logs in straight away, the server is asked for changes in the background
+	string cachedProfile;
+	if (profileCache.lookup(cardID, cachedProfile)) {
+		try {
+			userData.setUserData(cachedProfile);
+			screenRenderer.loginComplete = 1;
+			network.revalidateProfile(cardID);
+
+			RFIDCardReader::getCardReader()->clearLastCardData();
+			return;
+		}
+		catch (const std::exception& e) {
+			logger.logError("Cached profile is damaged, asking the server: ", e.what());
+			userData.clearData();
+		}
+	}
+
 	// Attempt to get the profile data | Set login complete when done
 	// IF SUCCESS set loginComplete = 1
 	// IF FAILED set loginComplete = 2
@@ -2015,3 +2235,12 @@ void ScreenRenderer::ToggleCurtains(bool open) {
 int ScreenRenderer::getSongHoverOver() {
 	return this->songSelectHoverOver;
 }
+
+/**
+ * Get every song in the library (including the dummy songs padding out the last page).
+ *
+ * @return the songs
+ */
+vector<Song> ScreenRenderer::getSongs() {
+	return this->songs;
+}
@@ -6,10 +6,12 @@
  * @author Julia Butenhoff
  */
 #pragma once
+#include <atomic>
 #include <SFML/Graphics.hpp>
 #include "Song.h"
 #include <vector>
 
+#include "GameRenderer.h"
 #include "OpenGLFont.h"
 #include "OpenGLText.h"
 #include "QuadSprite.h"
@@ -26,6 +28,7 @@ class ScreenRenderer {
 	public:
 		ScreenRenderer();
 		~ScreenRenderer();
+		void beginStartup();
 		void render(sf::RenderWindow*);
 
 		void testMenuPosPlus();
@@ -51,8 +54,9 @@ class ScreenRenderer {
 		vector<Song> currentPageSongs;
 		int getSongSelectHoverOver();
 		int getDifficultyHoverOver();
+		vector<Song> getSongs();
 		void reset();
-		bool isNetworkChecking;
+		atomic<bool> isNetworkChecking;
 
 		void ToggleCurtains(bool);
 
@@ -86,9 +90,15 @@ class ScreenRenderer {
 
 		bool openGLInitialized;
 
+		void cleanUpOldVersion();
+		void loadSongs();
+
 		SpriteShader spriteShader;
 		TextShader textShader;
-		//VideoShader videoShader;
+		VideoShader videoShader;
+
+		// Plays the songs, kept between them
+		GameRenderer gameRenderer;
 
 		// General Sprites
 		QuadSprite* TitleScreen;
@@ -114,7 +124,8 @@ class ScreenRenderer {
 		QuadSprite* Frame;
 
 		// Backgrounds
-		//VideoSprite* AttractTitleScreen;
+		VideoSprite* AttractTitleScreen;
+		bool attractVideoLoaded;
 		QuadSprite* SetMorning;
 		QuadSprite* SetAfternoon;
 		QuadSprite* SetEvening;
@@ -150,3 +161,6 @@ class ScreenRenderer {
 };
 
 extern ScreenRenderer screenRenderer;
+
+// Screen Size Ratio (width over height, shared with the game renderer)
+extern const float aspect;
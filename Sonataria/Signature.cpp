@@ -0,0 +1,266 @@
+#include "Signature.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+// Keep std::min usable
+#define NOMINMAX
+#include <windows.h>
+#include <bcrypt.h>
+
+#pragma comment (lib, "bcrypt.lib")
+#endif
+
+// What goes in front of a SHA-256 digest in a PKCS#1 v1.5 signature (the DigestInfo of RFC 8017)
+const uint8_t SHA256_DIGEST_INFO[] = {
+	0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20
+};
+
+/**
+ * Drop the zero bytes at the front of a big-endian number.
+ *
+ * @param number the number
+ * @return the number without them
+ */
+static vector<uint8_t> trimZeros(const vector<uint8_t>& number) {
+	size_t start = 0;
+	while (start < number.size() && number[start] == 0) {
+		start++;
+	}
+	return vector<uint8_t>(number.begin() + start, number.end());
+}
+
+/**
+ * Turn a big-endian number into 32 bit words, lowest first.
+ *
+ * @param number the number
+ * @param words how many words to make
+ * @return the words
+ */
+static vector<uint32_t> toWords(const vector<uint8_t>& number, size_t words) {
+	vector<uint32_t> result(words, 0);
+	for (size_t i = 0; i < number.size() && i / 4 < words; i++) {
+		result[i / 4] |= (uint32_t)number[number.size() - 1 - i] << (8 * (i % 4));
+	}
+	return result;
+}
+
+/**
+ * Compare two numbers of the same number of words.
+ *
+ * @param a the first number
+ * @param b the second number
+ * @return true if a >= b
+ */
+static bool atLeast(const vector<uint32_t>& a, const vector<uint32_t>& b) {
+	for (size_t i = a.size(); i-- > 0;) {
+		if (a[i] != b[i]) {
+			return a[i] > b[i];
+		}
+	}
+	return true;
+}
+
+/**
+ * Subtract b from a in place.
+ *
+ * @param a the number to subtract from
+ * @param b the number to subtract
+ */
+static void subtract(vector<uint32_t>& a, const vector<uint32_t>& b) {
+	uint64_t borrow = 0;
+	for (size_t i = 0; i < a.size(); i++) {
+		uint64_t difference = (uint64_t)a[i] - b[i] - borrow;
+		a[i] = (uint32_t)difference;
+		borrow = (difference >> 32) & 1;
+	}
+}
+
+/**
+ * Montgomery multiplication: a * b / 2^(32 * words) mod m.
+ *
+ * @param a the first number, below m
+ * @param b the second number, below m
+ * @param m the modulus (odd)
+ * @param mInverse -1/m mod 2^32
+ * @return the product, below m
+ */
+static vector<uint32_t> montgomery(const vector<uint32_t>& a, const vector<uint32_t>& b, const vector<uint32_t>& m, uint32_t mInverse) {
+	size_t n = m.size();
+	vector<uint32_t> t(n + 2, 0);
+
+	for (size_t i = 0; i < n; i++) {
+		uint64_t carry = 0;
+		for (size_t j = 0; j < n; j++) {
+			uint64_t sum = t[j] + (uint64_t)a[j] * b[i] + carry;
+			t[j] = (uint32_t)sum;
+			carry = sum >> 32;
+		}
+		uint64_t sum = t[n] + carry;
+		t[n] = (uint32_t)sum;
+		t[n + 1] = (uint32_t)(sum >> 32);
+
+		// Add the multiple of m that clears the lowest word, then drop that word
+		uint32_t factor = t[0] * mInverse;
+		sum = t[0] + (uint64_t)factor * m[0];
+		carry = sum >> 32;
+		for (size_t j = 1; j < n; j++) {
+			sum = t[j] + (uint64_t)factor * m[j] + carry;
+			t[j - 1] = (uint32_t)sum;
+			carry = sum >> 32;
+		}
+		sum = t[n] + carry;
+		t[n - 1] = (uint32_t)sum;
+		t[n] = t[n + 1] + (uint32_t)(sum >> 32);
+		t[n + 1] = 0;
+	}
+
+	vector<uint32_t> result(t.begin(), t.begin() + n);
+	if (t[n] != 0 || atLeast(result, m)) {
+		subtract(result, m);
+	}
+	return result;
+}
+
+/**
+ * Raise a number to a power modulo an odd modulus, as RSA does with a key.
+ *
+ * @param value the number, big-endian
+ * @param exponent the power, big-endian
+ * @param modulus the modulus, big-endian
+ * @return the result, big-endian and as long as the modulus (without its leading zeros),
+ *         or empty if the modulus is even or the value isn't below it
+ */
+vector<uint8_t> rsaPower(const vector<uint8_t>& value, const vector<uint8_t>& exponent, const vector<uint8_t>& modulus) {
+	vector<uint8_t> modulusBytes = trimZeros(modulus);
+	vector<uint8_t> valueBytes = trimZeros(value);
+	if (modulusBytes.empty() || (modulusBytes.back() & 1) == 0 || valueBytes.size() > modulusBytes.size()) {
+		return vector<uint8_t>();
+	}
+
+	size_t words = (modulusBytes.size() + 3) / 4;
+	vector<uint32_t> m = toWords(modulusBytes, words);
+	vector<uint32_t> x = toWords(valueBytes, words);
+	if (atLeast(x, m)) {
+		return vector<uint8_t>();
+	}
+
+	// Newton's method, each step doubles the bits of 1/m that are right
+	uint32_t inverse = m[0];
+	for (int i = 0; i < 5; i++) {
+		inverse *= 2 - m[0] * inverse;
+	}
+	uint32_t mInverse = (uint32_t)0 - inverse;
+
+	// 2^(64 * words) mod m, for moving numbers into Montgomery form
+	vector<uint32_t> r2(words, 0);
+	r2[0] = 1;
+	for (size_t i = 0; i < 64 * words; i++) {
+		uint32_t carry = 0;
+		for (size_t j = 0; j < words; j++) {
+			uint32_t next = r2[j] >> 31;
+			r2[j] = (r2[j] << 1) | carry;
+			carry = next;
+		}
+		if (carry != 0 || atLeast(r2, m)) {
+			subtract(r2, m);
+		}
+	}
+
+	vector<uint32_t> one(words, 0);
+	one[0] = 1;
+	vector<uint32_t> base = montgomery(x, r2, m, mInverse);
+	vector<uint32_t> result = montgomery(one, r2, m, mInverse);
+
+	for (size_t i = 0; i < exponent.size(); i++) {
+		for (int bit = 7; bit >= 0; bit--) {
+			result = montgomery(result, result, m, mInverse);
+			if ((exponent[i] >> bit) & 1) {
+				result = montgomery(result, base, m, mInverse);
+			}
+		}
+	}
+	result = montgomery(result, one, m, mInverse);
+
+	vector<uint8_t> bytes(modulusBytes.size());
+	for (size_t i = 0; i < bytes.size(); i++) {
+		bytes[bytes.size() - 1 - i] = (uint8_t)(result[i / 4] >> (8 * (i % 4)));
+	}
+	return bytes;
+}
+
+/**
+ * Pad a SHA-256 digest the way a PKCS#1 v1.5 signature holds it:
+ * 00 01 FF...FF 00 DigestInfo digest.
+ *
+ * @param digest the digest
+ * @param length the length of the key's modulus in bytes
+ * @return the padded digest, or empty if the key is too short
+ */
+vector<uint8_t> rsaSha256Padding(const uint8_t digest[32], size_t length) {
+	size_t used = 3 + sizeof(SHA256_DIGEST_INFO) + 32;
+	if (length < used + 8) {
+		return vector<uint8_t>();
+	}
+
+	vector<uint8_t> padded(length, 0xff);
+	padded[0] = 0x00;
+	padded[1] = 0x01;
+	size_t position = length - sizeof(SHA256_DIGEST_INFO) - 32 - 1;
+	padded[position++] = 0x00;
+	memcpy(&padded[position], SHA256_DIGEST_INFO, sizeof(SHA256_DIGEST_INFO));
+	memcpy(&padded[position + sizeof(SHA256_DIGEST_INFO)], digest, 32);
+	return padded;
+}
+
+/**
+ * Check an RSA PKCS#1 v1.5 signature of a SHA-256 digest. Windows uses CNG,
+ * other platforms (the headless checks) work it out with rsaPower().
+ *
+ * @param modulus the key's modulus, big-endian
+ * @param exponent the key's public exponent, big-endian
+ * @param digest the SHA-256 of what was signed
+ * @param signature the signature, big-endian
+ * @return true if the signature is good
+ */
+bool verifyRsaSha256(const vector<uint8_t>& modulus, const vector<uint8_t>& exponent, const uint8_t digest[32],
+	const vector<uint8_t>& signature) {
+#ifdef _WIN32
+	// A public key blob is the header, then the exponent and modulus big-endian
+	BCRYPT_RSAKEY_BLOB header = {};
+	header.Magic = BCRYPT_RSAPUBLIC_MAGIC;
+	header.BitLength = (ULONG)modulus.size() * 8;
+	header.cbPublicExp = (ULONG)exponent.size();
+	header.cbModulus = (ULONG)modulus.size();
+
+	vector<uint8_t> blob(sizeof(header));
+	memcpy(blob.data(), &header, sizeof(header));
+	blob.insert(blob.end(), exponent.begin(), exponent.end());
+	blob.insert(blob.end(), modulus.begin(), modulus.end());
+
+	BCRYPT_ALG_HANDLE algorithm = NULL;
+	BCRYPT_KEY_HANDLE key = NULL;
+	bool valid = false;
+
+	if (BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&algorithm, BCRYPT_RSA_ALGORITHM, NULL, 0))) {
+		if (BCRYPT_SUCCESS(BCryptImportKeyPair(algorithm, NULL, BCRYPT_RSAPUBLIC_BLOB, &key, blob.data(), (ULONG)blob.size(), 0))) {
+			BCRYPT_PKCS1_PADDING_INFO padding = { BCRYPT_SHA256_ALGORITHM };
+			valid = BCRYPT_SUCCESS(BCryptVerifySignature(key, &padding, (PUCHAR)digest, 32,
+				(PUCHAR)signature.data(), (ULONG)signature.size(), BCRYPT_PAD_PKCS1));
+			BCryptDestroyKey(key);
+		}
+		BCryptCloseAlgorithmProvider(algorithm, 0);
+	}
+	return valid;
+#else
+	// The signature has to be exactly as long as the modulus
+	vector<uint8_t> modulusBytes = trimZeros(modulus);
+	if (signature.size() != modulusBytes.size()) {
+		return false;
+	}
+
+	vector<uint8_t> recovered = rsaPower(signature, exponent, modulusBytes);
+	vector<uint8_t> expected = rsaSha256Padding(digest, modulusBytes.size());
+	return !recovered.empty() && !expected.empty() && recovered == expected;
+#endif
+}
@@ -0,0 +1,17 @@
+/**
+ * @file Signature.h
+ *
+ * @brief Signature
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+using namespace std;
+
+bool verifyRsaSha256(const vector<uint8_t>& modulus, const vector<uint8_t>& exponent, const uint8_t digest[32],
+	const vector<uint8_t>& signature);
+vector<uint8_t> rsaPower(const vector<uint8_t>& value, const vector<uint8_t>& exponent, const vector<uint8_t>& modulus);
+vector<uint8_t> rsaSha256Padding(const uint8_t digest[32], size_t length);
@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#include <windows.h>
+#include <psapi.h>
+
+#include "Autoplay.h"
+#include "Logger.h"
+#include "ScreenRenderer.h"
+#include "SoakTest.h"
+#include "StartupTasks.h"
+
+#pragma comment (lib, "psapi.lib")
+
+SoakTest soakTest;
+
+// A frame slower than this counts as a hitch (two frames at 60 fps)
+const float SLOW_FRAME_MS = 33.3f;
+
+// How long to wait for a state change before asking again
+const int STATE_SWITCH_TIMEOUT_MS = 5000;
+
+// How often to check the game state while waiting
+const int STATE_POLL_MS = 50;
+
+/**
+ * Default constructor.
+ *
+ */
+SoakTest::SoakTest() {
+	this->enabled = false;
+	this->finished = false;
+	this->loops = 1;
+	this->currentLoop = 0;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+SoakTest::~SoakTest() {
+
+}
+
+/**
+ * Turn the soak test on or off (must be set before the game starts).
+ *
+ * @param enable true to run the soak test
+ */
+void SoakTest::setEnabled(bool enable) {
+	this->enabled = enable;
+}
+
+bool SoakTest::isEnabled() {
+	return this->enabled;
+}
+
+/**
+ * Gets if every loop has been played and the report written.
+ *
+ * @return true when the soak test is done
+ */
+bool SoakTest::isFinished() {
+	return this->finished;
+}
+
+/**
+ * Set how many times to play through the whole library.
+ *
+ * @param count number of passes through the library
+ */
+void SoakTest::setLoops(int count) {
+	this->loops = count < 1 ? 1 : count;
+}
+
+/**
+ * Play every difficulty of every song, then shut the game down.
+ * Runs on its own thread and drives the game state like an operator would.
+ *
+ */
+void SoakTest::run() {
+	logger.log(L"Soak test waiting for the title screen...");
+	if (!waitForState(GameState::CurrentState::TITLE_SCREEN)) {
+		return;
+	}
+
+	// Leave out the dummy songs that fill the last song select page
+	startupTasks.waitFor("Song index");
+	vector<Song> library;
+	vector<Song> songs = screenRenderer.getSongs();
+	for (size_t i = 0; i < songs.size(); i++) {
+		if (songs[i].isSongValid()) {
+			library.push_back(songs[i]);
+		}
+	}
+
+	logger.log(L"Soak test starting: " + to_wstring(library.size()) + L" songs, " + to_wstring(this->loops) + L" loop(s), autoplay noise "
+		+ to_wstring(autoplay.getTimingNoise()) + L"ms, miss chance " + to_wstring(autoplay.getMissChance()));
+
+	bool stopped = false;
+	for (int loop = 1; loop <= this->loops && !stopped; loop++) {
+		this->currentLoop = loop;
+
+		for (size_t i = 0; i < library.size() && !stopped; i++) {
+			for (int d = 0; d < library[i].getNumberOfDifficulties() && !stopped; d++) {
+				int difficulty = library[i].getDifficultyNumber(d);
+				logger.log(L"Soak test [loop " + to_wstring(loop) + L"] playing ", library[i].getTitle(), L" difficulty " + to_wstring(difficulty));
+
+				// Keep only this song's results so a long run doesn't collect them
+				gameState.resetResults();
+				gameState.setSongPlaying(library[i], difficulty);
+
+				if (!switchToState(GameState::CurrentState::GAME) || !waitForState(GameState::CurrentState::RESULTS)) {
+					stopped = true;
+					break;
+				}
+
+				// The screen renderer has to see the results state before another game can start
+				while (screenRenderer.gameEnded) {
+					this_thread::sleep_for(chrono::milliseconds(STATE_POLL_MS));
+				}
+			}
+		}
+	}
+
+	if (stopped) {
+		logger.logError(L"Soak test stopped before finishing the library.");
+	}
+
+	writeReport();
+
+	logger.log(L"Soak test finished - Shutting down.");
+	switchToState(GameState::CurrentState::SHUTDOWN);
+	this->finished = true;
+}
+
+/**
+ * Ask the game state to change and wait for it to happen.
+ *
+ * @param newState the state to switch to
+ * @return false if the game was shut down or put in service mode instead
+ */
+bool SoakTest::switchToState(GameState::CurrentState newState) {
+	while (gameState.getGameState() != newState) {
+		// Wait for any other state change to finish (changes are ignored while switching)
+		while (gameState.isTransitioning) {
+			this_thread::sleep_for(chrono::milliseconds(STATE_POLL_MS));
+		}
+
+		gameState.setGameState(newState);
+
+		for (int waited = 0; waited < STATE_SWITCH_TIMEOUT_MS && gameState.getGameState() != newState; waited += STATE_POLL_MS) {
+			if (newState != GameState::CurrentState::SHUTDOWN
+				&& (gameState.getGameState() == GameState::CurrentState::SHUTDOWN || gameState.checkService())) {
+				return false;
+			}
+			this_thread::sleep_for(chrono::milliseconds(STATE_POLL_MS));
+		}
+	}
+	return true;
+}
+
+/**
+ * Wait until the game reaches a state.
+ *
+ * @param waitState the state to wait for
+ * @return false if the game was shut down or put in service mode instead
+ */
+bool SoakTest::waitForState(GameState::CurrentState waitState) {
+	while (gameState.getGameState() != waitState) {
+		if (gameState.getGameState() == GameState::CurrentState::SHUTDOWN || gameState.checkService()) {
+			return false;
+		}
+		this_thread::sleep_for(chrono::milliseconds(STATE_POLL_MS));
+	}
+	return true;
+}
+
+/**
+ * Start collecting statistics for a song.
+ *
+ */
+void SoakTest::beginPlay() {
+	lock_guard<mutex> lock(this->statsLock);
+	this->frameTimes.clear();
+}
+
+/**
+ * Record how long a frame of the song took.
+ *
+ * @param frameMs time since the last frame in milliseconds
+ */
+void SoakTest::recordFrame(float frameMs) {
+	lock_guard<mutex> lock(this->statsLock);
+	this->frameTimes.push_back(frameMs);
+}
+
+/**
+ * Finish the statistics for a song and store them for the report.
+ *
+ * @param songID ID of the song played
+ * @param songPath path of the song played
+ * @param difficulty difficulty played
+ * @param totalNotes notes in the chart
+ * @param perfectCount perfect judgements
+ * @param nearCount near judgements
+ * @param missCount miss judgements
+ */
+void SoakTest::endPlay(int songID, string songPath, int difficulty, int totalNotes, int perfectCount, int nearCount, int missCount) {
+	PlayReport report = {};
+	report.loop = this->currentLoop;
+	report.songID = songID;
+	report.songPath = songPath;
+	report.difficulty = difficulty;
+	report.totalNotes = totalNotes;
+	report.perfectCount = perfectCount;
+	report.nearCount = nearCount;
+	report.missCount = missCount;
+
+	{
+		lock_guard<mutex> lock(this->statsLock);
+
+		report.frameCount = this->frameTimes.size();
+		if (!this->frameTimes.empty()) {
+			vector<float> sorted = this->frameTimes;
+			sort(sorted.begin(), sorted.end());
+
+			double total = 0.0;
+			for (size_t i = 0; i < sorted.size(); i++) {
+				total += sorted[i];
+				if (sorted[i] > SLOW_FRAME_MS) {
+					report.slowFrames++;
+				}
+			}
+			report.averageFrameMs = (float)(total / sorted.size());
+			report.p99FrameMs = sorted[(sorted.size() - 1) * 99 / 100];
+			report.maxFrameMs = sorted.back();
+		}
+	}
+
+	getMemoryUsage(report.workingSetKB, report.privateKB);
+
+	std::ostringstream line;
+	line << std::fixed << std::setprecision(2)
+		<< "Soak play: song " << songID << " diff " << difficulty
+		<< " | " << perfectCount << "/" << nearCount << "/" << missCount << " of " << totalNotes
+		<< " | frames " << report.frameCount << " avg " << report.averageFrameMs << "ms p99 " << report.p99FrameMs
+		<< "ms max " << report.maxFrameMs << "ms slow " << report.slowFrames
+		<< " | working set " << report.workingSetKB << "KB private " << report.privateKB << "KB";
+	logger.log(line.str());
+
+	lock_guard<mutex> lock(this->statsLock);
+	this->reports.push_back(report);
+}
+
+/**
+ * Get how much memory the game is using.
+ *
+ * @param workingSetKB set to the physical memory in use (KB)
+ * @param privateKB set to the memory committed by the game (KB)
+ */
+void SoakTest::getMemoryUsage(size_t& workingSetKB, size_t& privateKB) {
+	workingSetKB = 0;
+	privateKB = 0;
+
+	PROCESS_MEMORY_COUNTERS_EX counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters))) {
+		workingSetKB = counters.WorkingSetSize / 1024;
+		privateKB = counters.PrivateUsage / 1024;
+	}
+}
+
+/**
+ * Write every play to a CSV file in Soak/ and log a summary of each loop.
+ *
+ */
+void SoakTest::writeReport() {
+	lock_guard<mutex> lock(this->statsLock);
+
+	char timeStamp[32];
+	time_t now = time(NULL);
+	tm local = {};
+	localtime_s(&local, &now);
+	strftime(timeStamp, sizeof(timeStamp), "%Y%m%d-%H%M%S", &local);
+
+	filesystem::create_directories("Soak");
+	string reportPath = string("Soak/soak_") + timeStamp + ".csv";
+
+	ofstream csv(reportPath, ios::out | ios::trunc);
+	csv << "loop,song_id,song_path,difficulty,total_notes,perfect,near,miss,unjudged,frames,avg_frame_ms,p99_frame_ms,max_frame_ms,slow_frames,working_set_kb,private_kb\n";
+	csv << std::fixed << std::setprecision(2);
+	for (size_t i = 0; i < this->reports.size(); i++) {
+		const PlayReport& r = this->reports[i];
+		csv << r.loop << "," << r.songID << "," << r.songPath << "," << r.difficulty << ","
+			<< r.totalNotes << "," << r.perfectCount << "," << r.nearCount << "," << r.missCount << ","
+			<< (r.totalNotes - r.perfectCount - r.nearCount - r.missCount) << ","
+			<< r.frameCount << "," << r.averageFrameMs << "," << r.p99FrameMs << "," << r.maxFrameMs << "," << r.slowFrames << ","
+			<< r.workingSetKB << "," << r.privateKB << "\n";
+	}
+	csv.close();
+
+	if (csv.fail()) {
+		logger.logError("Failed to write soak report to ", reportPath);
+	}
+	else {
+		logger.log("Soak report written to ", reportPath);
+	}
+
+	// Summarize each loop so performance and memory can be compared between passes
+	size_t firstLoopPrivateKB = 0;
+	size_t lastLoopPrivateKB = 0;
+	for (int loop = 1; loop <= this->currentLoop; loop++) {
+		long long notes = 0;
+		long long perfect = 0;
+		long long missed = 0;
+		long long frames = 0;
+		long long slowFrames = 0;
+		double frameTotal = 0.0;
+		float worstFrame = 0.f;
+		size_t privateKB = 0;
+		int imperfectPlays = 0;
+
+		for (size_t i = 0; i < this->reports.size(); i++) {
+			const PlayReport& r = this->reports[i];
+			if (r.loop != loop) {
+				continue;
+			}
+			notes += r.totalNotes;
+			perfect += r.perfectCount;
+			missed += r.missCount + (r.totalNotes - r.perfectCount - r.nearCount - r.missCount);
+			frames += r.frameCount;
+			slowFrames += r.slowFrames;
+			frameTotal += (double)r.averageFrameMs * r.frameCount;
+			if (r.maxFrameMs > worstFrame) {
+				worstFrame = r.maxFrameMs;
+			}
+			privateKB = r.privateKB;
+			if (r.perfectCount != r.totalNotes) {
+				imperfectPlays++;
+			}
+		}
+
+		if (loop == 1) {
+			firstLoopPrivateKB = privateKB;
+		}
+		lastLoopPrivateKB = privateKB;
+
+		std::ostringstream summary;
+		summary << std::fixed << std::setprecision(2)
+			<< "Soak loop " << loop << ": " << perfect << "/" << notes << " perfect (" << (notes > 0 ? 100.0 * perfect / notes : 0.0) << "%), "
+			<< missed << " missed or unjudged | avg frame " << (frames > 0 ? frameTotal / frames : 0.0) << "ms, worst " << worstFrame
+			<< "ms, " << slowFrames << " slow frames | private memory " << privateKB << "KB";
+		logger.log(summary.str());
+
+		// A perfect bot should only lose notes to chart or judgement quirks, so list the plays that did
+		if (autoplay.isPerfect() && imperfectPlays > 0) {
+			logger.logError("Soak loop " + to_string(loop) + ": " + to_string(imperfectPlays) + " play(s) were not all perfect (see report)");
+		}
+	}
+
+	// Memory still growing after the first pass through the library points to a leak
+	if (this->currentLoop > 1) {
+		long long growthKB = (long long)lastLoopPrivateKB - (long long)firstLoopPrivateKB;
+		logger.log("Soak private memory change from loop 1 to loop " + to_string(this->currentLoop) + ": " + to_string(growthKB) + "KB");
+	}
+}
@@ -0,0 +1,79 @@
+/**
+ * @file SoakTest.h
+ *
+ * @brief Soak Test
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "GameState.h"
+
+/**
+ * Plays every chart in the library with autoplay, unattended, and records
+ * frame times, judgements and memory use of each play
+ */
+class SoakTest {
+
+	public:
+		/**
+		 * Statistics of one autoplayed song
+		 */
+		struct PlayReport {
+			int loop;
+			int songID;
+			string songPath;
+			int difficulty;
+
+			int totalNotes;
+			int perfectCount;
+			int nearCount;
+			int missCount;
+
+			size_t frameCount;
+			float averageFrameMs;
+			float p99FrameMs;
+			float maxFrameMs;
+			int slowFrames;
+
+			size_t workingSetKB;
+			size_t privateKB;
+		};
+
+	private:
+		atomic<bool> enabled;
+		atomic<bool> finished;
+		int loops;
+		int currentLoop;
+
+		mutex statsLock;
+		vector<float> frameTimes;
+		vector<PlayReport> reports;
+
+		bool switchToState(GameState::CurrentState newState);
+		bool waitForState(GameState::CurrentState waitState);
+		void writeReport();
+
+	public:
+		SoakTest();
+		~SoakTest();
+		void setEnabled(bool);
+		bool isEnabled();
+		bool isFinished();
+		void setLoops(int);
+
+		void run();
+
+		void beginPlay();
+		void recordFrame(float frameMs);
+		void endPlay(int songID, string songPath, int difficulty, int totalNotes, int perfectCount, int nearCount, int missCount);
+
+		static void getMemoryUsage(size_t& workingSetKB, size_t& privateKB);
+};
+
+extern SoakTest soakTest;
@@ -7,10 +7,13 @@
 #include <iostream>
 #include <string>
 #include "Logger.h"
+#include "Tracer.h"
 #include <codecvt>
 #include <locale>
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 using json = nlohmann::json;
 
@@ -47,6 +50,8 @@ Song::~Song() {
  * @param path to the info file
  */
 Song::Song(string path) {
+	TraceScope trace("Parse song", "load", path.c_str());
+
 	// Set the path to the file
 	this->path = eraseAllSubStr(path, "info.json");
 
@@ -55,7 +60,11 @@ Song::Song(string path) {
 	wstring line;
 	wstring fullFileData;
 
+#ifdef _WIN32
 	inStream.imbue(std::locale(std::locale::empty(), new std::codecvt_utf8<wchar_t>));
+#else
+	inStream.imbue(std::locale(std::locale(), new std::codecvt_utf8<wchar_t>));
+#endif
 
 	if (inStream.is_open()) {
 		while (getline(inStream, line)) {
@@ -99,6 +108,11 @@ Song::Song(string path) {
 	// Audio File
 	this->audioFile = j["audioFile"];
 
+	// Background Video (optional)
+	if (j.contains("video") && j["video"].is_string()) {
+		this->videoFile = j["video"];
+	}
+
 	// Difficulties
 	
 	// Easy
@@ -152,6 +166,7 @@ Song::Song(const Song& old_str) {
 	this->jacketArt = old_str.jacketArt;
 	this->path = old_str.path;
 	this->audioFile = old_str.audioFile;
+	this->videoFile = old_str.videoFile;
 }
 
 /**
@@ -194,6 +209,15 @@ string eraseAllSubStr(string mainStr, string toErase) {
 	return mainStr;
 }
 
+/**
+ * Gets the ID of the song.
+ * 
+ * @return the song ID
+ */
+int Song::getSongID() {
+	return this->songID;
+}
+
 /**
  * Gets the path to the jacket art of the song.
  * 
@@ -214,6 +238,24 @@ string Song::getAudioFilePath() {
 	return this->path + this->audioFile;
 }
 
+/**
+ * Checks if the song has a background video.
+ * 
+ * @return true if info.json named a video file
+ */
+bool Song::hasVideo() {
+	return !this->videoFile.empty();
+}
+
+/**
+ * Gets the path to the background video file.
+ * 
+ * @return path to video file
+ */
+string Song::getVideoFilePath() {
+	return this->path + this->videoFile;
+}
+
 /**
  * Gets the title of the song.
  * 
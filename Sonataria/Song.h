@@ -26,12 +26,14 @@ class Song {
 		string jacketArt;
 		string path;
 		string audioFile;
+		string videoFile;
 
 	public:
 		Song();
 		Song(string);
 		Song(const Song& old_obj);
 		~Song();
+		int getSongID();
 		string getJacketArtPath();
 		wstring getTitle();
 		wstring getArtist();
@@ -40,5 +42,7 @@ class Song {
 		int getDifficultyNumber(int);
 		bool isSongValid();
 		string getAudioFilePath();
+		bool hasVideo();
+		string getVideoFilePath();
 		string getPath();
 };
\ No newline at end of file
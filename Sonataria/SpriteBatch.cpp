@@ -0,0 +1,291 @@
+#include <cstdio>
+#include <cstring>
+
+#include "Logger.h"
+#include "OpenGLSprite.h"
+#include "SpriteBatch.h"
+#include "StreamBuffer.h"
+#include "TextureLoader.h"
+
+SpriteBatch spriteBatch;
+
+/**
+ * Default constructor.
+ *
+ */
+SpriteBatch::SpriteBatch() {
+	this->program = 0;
+	this->open = false;
+	this->batchCount = 0;
+	this->streamVao = 0;
+	this->fallbackVao = 0;
+	this->fallbackVbo = 0;
+	this->uniformProgram = 0;
+	this->modelLoc = this->projectionLoc = this->opacityLoc = this->enableStretchLoc = this->zClipLoc = -1;
+	this->frame = 0;
+	this->frameSprites = 0;
+	this->frameDraws = 0;
+	this->reportSprites = 0;
+	this->reportDraws = 0;
+	this->reportFrames = 0;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+SpriteBatch::~SpriteBatch() {
+	// The OpenGL context is gone by the time globals are destroyed, so the arrays go with it
+}
+
+/**
+ * Start collecting sprites drawn with a program.
+ *
+ * @param program the program, sprites drawn with any other are drawn straight away
+ */
+void SpriteBatch::begin(GLuint program) {
+	// The stream buffer moves on once a frame, so it tells when a new one started
+	if (streamBuffer.getFrame() != this->frame) {
+		countFrame();
+		this->frame = streamBuffer.getFrame();
+	}
+
+	// Anything left from a frame that was never finished was never meant to be seen
+	this->batchCount = 0;
+
+	this->program = program;
+	this->open = true;
+}
+
+/**
+ * Draw everything collected and stop collecting.
+ *
+ */
+void SpriteBatch::end() {
+	flush();
+	this->open = false;
+}
+
+/**
+ * Check if sprites drawn with a program are being collected.
+ *
+ * @param program the program the sprite is drawn with
+ * @return true if the sprite should be added instead of drawn
+ */
+bool SpriteBatch::isBatching(GLuint program) {
+	return this->open && program == this->program;
+}
+
+/**
+ * Add a sprite.
+ *
+ * @param texture the sprite's texture (as used by texture manager)
+ * @param opacity the sprite's opacity
+ * @param projection the projection matrix
+ * @param renderType GL_TRIANGLES or GL_TRIANGLE_FAN
+ * @param vertices the transformed vertices, SPRITE_BATCH_VERTEX_FLOATS each
+ * @param vertexCount number of vertices
+ * @param bounds where the sprite is on screen
+ */
+void SpriteBatch::add(GLuint texture, float opacity, const Matrix4& projection, GLuint renderType, const float* vertices, size_t vertexCount, const Bounds& bounds) {
+	this->frameSprites++;
+
+	// Find the latest batch it can join, without moving under anything it overlaps
+	Batch* target = nullptr;
+	size_t lowest = this->batchCount > SPRITE_BATCH_LOOKBACK ? this->batchCount - SPRITE_BATCH_LOOKBACK : 0;
+	for (size_t i = this->batchCount; i > lowest; i--) {
+		Batch& batch = this->batches[i - 1];
+		if (batch.texture == texture && batch.opacity == opacity && sameMatrix(batch.projection, projection)) {
+			target = &batch;
+			break;
+		}
+		if (overlaps(batch.bounds, bounds)) {
+			break;
+		}
+	}
+
+	if (target == nullptr) {
+		if (this->batchCount == this->batches.size()) {
+			this->batches.push_back(Batch());
+		}
+		target = &this->batches[this->batchCount++];
+		target->texture = texture;
+		target->opacity = opacity;
+		target->projection = projection;
+		target->bounds = bounds;
+		target->vertices.clear();
+	}
+	else {
+		target->bounds.left = bounds.left < target->bounds.left ? bounds.left : target->bounds.left;
+		target->bounds.bottom = bounds.bottom < target->bounds.bottom ? bounds.bottom : target->bounds.bottom;
+		target->bounds.right = bounds.right > target->bounds.right ? bounds.right : target->bounds.right;
+		target->bounds.top = bounds.top > target->bounds.top ? bounds.top : target->bounds.top;
+	}
+
+	// Everything is drawn as triangles so sprites can share a draw
+	vector<float>& out = target->vertices;
+	if (renderType == GL_TRIANGLE_FAN) {
+		for (size_t i = 1; i + 1 < vertexCount; i++) {
+			out.insert(out.end(), vertices, vertices + SPRITE_BATCH_VERTEX_FLOATS);
+			out.insert(out.end(), vertices + i * SPRITE_BATCH_VERTEX_FLOATS, vertices + (i + 2) * SPRITE_BATCH_VERTEX_FLOATS);
+		}
+	}
+	else {
+		out.insert(out.end(), vertices, vertices + vertexCount / 3 * 3 * SPRITE_BATCH_VERTEX_FLOATS);
+	}
+}
+
+/**
+ * Draw everything collected so far, keeping on collecting.
+ *
+ */
+void SpriteBatch::flush() {
+	if (this->batchCount == 0) {
+		return;
+	}
+
+	// Something else may have switched programs since the batch began
+	GLint current = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+	if ((GLuint)current != this->program) {
+		glUseProgram(this->program);
+	}
+
+	if (this->uniformProgram != this->program) {
+		this->uniformProgram = this->program;
+		this->modelLoc = glGetUniformLocation(this->program, "model");
+		this->projectionLoc = glGetUniformLocation(this->program, "projection");
+		this->opacityLoc = glGetUniformLocation(this->program, "opacity");
+		this->enableStretchLoc = glGetUniformLocation(this->program, "enableStretch");
+		this->zClipLoc = glGetUniformLocation(this->program, "zClip");
+	}
+
+	// Vertices are already transformed and stretched
+	Matrix4 identity;
+	glProgramUniformMatrix4fv(this->program, this->modelLoc, 1, GL_FALSE, identity.get());
+	glProgramUniform1i(this->program, this->enableStretchLoc, GL_FALSE);
+	glProgramUniform1f(this->program, this->zClipLoc, 5.5f);
+
+	for (size_t i = 0; i < this->batchCount; i++) {
+		draw(this->batches[i]);
+	}
+	this->batchCount = 0;
+
+	if ((GLuint)current != this->program) {
+		glUseProgram((GLuint)current);
+	}
+}
+
+/**
+ * Draw one batch.
+ *
+ * @param batch the batch
+ */
+void SpriteBatch::draw(const Batch& batch) {
+	size_t stride = SPRITE_BATCH_VERTEX_FLOATS * sizeof(float);
+	size_t vertexCount = batch.vertices.size() / SPRITE_BATCH_VERTEX_FLOATS;
+	if (vertexCount == 0) {
+		return;
+	}
+
+	GLint first = 0;
+	GLintptr offset;
+	if (streamBuffer.write(batch.vertices.data(), vertexCount * stride, stride, offset)) {
+		if (this->streamVao == 0) {
+			this->streamVao = makeVao(streamBuffer.getBuffer());
+		}
+		glBindVertexArray(this->streamVao);
+		first = (GLint)(offset / stride);
+	}
+	else {
+		// The stream buffer is full this frame
+		if (this->fallbackVao == 0) {
+			glGenBuffers(1, &this->fallbackVbo);
+			this->fallbackVao = makeVao(this->fallbackVbo);
+		}
+		glBindVertexArray(this->fallbackVao);
+		glBindBuffer(GL_ARRAY_BUFFER, this->fallbackVbo);
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * stride, batch.vertices.data(), GL_STREAM_DRAW);
+	}
+
+	TextureLoader::Inst()->BindTexture(batch.texture);
+	glProgramUniform1f(this->program, this->opacityLoc, batch.opacity);
+	glProgramUniformMatrix4fv(this->program, this->projectionLoc, 1, GL_FALSE, batch.projection.get());
+
+	glDrawArrays(GL_TRIANGLES, first, (GLsizei)vertexCount);
+	this->frameDraws++;
+}
+
+/**
+ * Make a vertex array for batched vertices in a buffer.
+ *
+ * @param buffer the buffer
+ * @return the vertex array
+ */
+GLuint SpriteBatch::makeVao(GLuint buffer) {
+	GLsizei stride = SPRITE_BATCH_VERTEX_FLOATS * sizeof(float);
+
+	GLuint vao;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	glVertexAttribPointer(ATTRIB_POSITION_INDEX, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glEnableVertexAttribArray(ATTRIB_POSITION_INDEX);
+	glVertexAttribPointer(ATTRIB_COLOR_INDEX, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(ATTRIB_COLOR_INDEX);
+	glVertexAttribPointer(ATTRIB_TEX_UV_INDEX, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+	glEnableVertexAttribArray(ATTRIB_TEX_UV_INDEX);
+	return vao;
+}
+
+/**
+ * Check if two areas on screen overlap.
+ *
+ * @param a an area
+ * @param b another area
+ * @return true if they overlap, or are close enough that they might
+ */
+bool SpriteBatch::overlaps(const Bounds& a, const Bounds& b) {
+	return a.left <= b.right + SPRITE_BATCH_PADDING && b.left <= a.right + SPRITE_BATCH_PADDING
+		&& a.bottom <= b.top + SPRITE_BATCH_PADDING && b.bottom <= a.top + SPRITE_BATCH_PADDING;
+}
+
+/**
+ * Check if two matrices are the same.
+ *
+ * @param a a matrix
+ * @param b another matrix
+ * @return true if they are
+ */
+bool SpriteBatch::sameMatrix(const Matrix4& a, const Matrix4& b) {
+	return memcmp(a.get(), b.get(), 16 * sizeof(float)) == 0;
+}
+
+/**
+ * Add the last frame to the report, and log it every so often.
+ *
+ */
+void SpriteBatch::countFrame() {
+	if (this->frameSprites == 0) {
+		return;
+	}
+
+	this->reportSprites += this->frameSprites;
+	this->reportDraws += this->frameDraws;
+	this->reportFrames++;
+	this->frameSprites = 0;
+	this->frameDraws = 0;
+
+	if (this->reportFrames >= SPRITE_BATCH_REPORT_FRAMES) {
+		char line[160];
+		snprintf(line, sizeof(line), "Sprite batching: %.1f sprites a frame in %.1f draws (%.0f%% fewer draw calls)",
+			(double)this->reportSprites / this->reportFrames, (double)this->reportDraws / this->reportFrames,
+			100.0 * (1.0 - (double)this->reportDraws / this->reportSprites));
+		logger.log(line);
+
+		this->reportSprites = 0;
+		this->reportDraws = 0;
+		this->reportFrames = 0;
+	}
+}
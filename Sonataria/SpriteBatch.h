@@ -0,0 +1,103 @@
+/**
+ * @file SpriteBatch.h
+ *
+ * @brief Sprite Batch
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include "Matrices.h"
+
+// Floats in a batched vertex (position, color, UV, the same as a QuadSprite's)
+#define SPRITE_BATCH_VERTEX_FLOATS 8
+
+// How many batches back a sprite may move to join one with the same texture
+#define SPRITE_BATCH_LOOKBACK 16
+
+// Added around a sprite's bounds so sprites that only touch (or share multisampled edge pixels) are kept in order
+#define SPRITE_BATCH_PADDING (2.f / 1080.f)
+
+// Frames between reports of how many draws batching saves
+#define SPRITE_BATCH_REPORT_FRAMES 3600
+
+/**
+ * Collects the sprites drawn with one shader program over part of a frame and
+ * draws them with as few draw calls as it can.
+ *
+ * Each sprite's vertices are transformed on the CPU, so sprites with different
+ * model matrices can share a draw. A sprite joins the latest batch with the same
+ * texture, opacity and projection, as long as it doesn't overlap anything drawn
+ * between that batch and itself on screen. Otherwise it starts a new batch. Order
+ * only changes between sprites that don't overlap, so the result is the same as
+ * drawing them one at a time in painter's order. Vertices go through the stream
+ * buffer. Only used from the render thread.
+ */
+class SpriteBatch {
+
+	public:
+		/**
+		 * Area on screen, in normalized device coordinates
+		 */
+		struct Bounds {
+			float left;
+			float bottom;
+			float right;
+			float top;
+		};
+
+	private:
+		/**
+		 * Sprites that are drawn together
+		 */
+		struct Batch {
+			GLuint texture;
+			float opacity;
+			Matrix4 projection;
+			Bounds bounds;
+			vector<float> vertices;		// Triangles
+		};
+
+		GLuint program;
+		bool open;
+		vector<Batch> batches;		// Reused between frames, only the first batchCount are in use
+		size_t batchCount;
+
+		GLuint streamVao;
+		GLuint fallbackVao, fallbackVbo;
+
+		// Uniforms of the program the locations were looked up in
+		GLuint uniformProgram;
+		GLint modelLoc, projectionLoc, opacityLoc, enableStretchLoc, zClipLoc;
+
+		// Draw call report
+		uint64_t frame;
+		uint64_t frameSprites;
+		uint64_t frameDraws;
+		uint64_t reportSprites;
+		uint64_t reportDraws;
+		int reportFrames;
+
+		static bool overlaps(const Bounds& a, const Bounds& b);
+		static bool sameMatrix(const Matrix4& a, const Matrix4& b);
+		static GLuint makeVao(GLuint buffer);
+		void draw(const Batch& batch);
+		void countFrame();
+
+	public:
+		SpriteBatch();
+		~SpriteBatch();
+
+		void begin(GLuint program);
+		void end();
+		void flush();
+		bool isBatching(GLuint program);
+		void add(GLuint texture, float opacity, const Matrix4& projection, GLuint renderType, const float* vertices, size_t vertexCount, const Bounds& bounds);
+};
+
+extern SpriteBatch spriteBatch;
@@ -4,7 +4,7 @@
 
 #include "OpenGLSprite.h"
 
-SpriteShader::SpriteShader() : OpenGLShader(IDR_VERTEX_SHADER, IDR_FRAGMENT_SHADER) {}
+SpriteShader::SpriteShader() : OpenGLShader(IDR_VERTEX_SHADER, IDR_FRAGMENT_SHADER, "vertex.shader", "fragment.shader") {}
 SpriteShader::~SpriteShader() {}
 
 void SpriteShader::initAttributes() {
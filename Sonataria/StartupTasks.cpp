@@ -0,0 +1,385 @@
+#include <algorithm>
+#include <cstdio>
+#include "Logger.h"
+#include "StartupTasks.h"
+#include "Tracer.h"
+
+StartupTasks startupTasks;
+
+/**
+ * Default constructor.
+ *
+ */
+StartupTasks::StartupTasks() {
+	this->bootTime = chrono::steady_clock::now();
+	this->started = false;
+	this->stopping = false;
+	this->reported = false;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+StartupTasks::~StartupTasks() {
+	{
+		lock_guard<mutex> lock(this->taskLock);
+		this->stopping = true;
+	}
+	this->taskSignal.notify_all();
+
+	// Tasks already running are left to finish, ones still waiting give up
+	for (size_t i = 0; i < this->workers.size(); i++) {
+		if (this->workers[i].joinable()) {
+			this->workers[i].join();
+		}
+	}
+}
+
+/**
+ * Add a task that runs on its own thread.
+ *
+ * @param name name of the task, used by other tasks to come after it
+ * @param after the tasks that have to be done before this one starts
+ * @param work the work to do
+ */
+void StartupTasks::add(string name, vector<string> after, function<void()> work) {
+	unique_ptr<Task> task(new Task());
+	task->name = name;
+	task->after = after;
+	task->work = [work]() {
+		work();
+		return true;
+	};
+	task->onRenderThread = false;
+	task->started = task->running = task->done = false;
+	task->startMs = task->endMs = task->busyMs = 0;
+	task->slices = 0;
+
+	lock_guard<mutex> lock(this->taskLock);
+	this->tasks.push_back(move(task));
+}
+
+/**
+ * Add a task that needs OpenGL, so has to run on the render thread.
+ *
+ * @param name name of the task, used by other tasks to come after it
+ * @param after the tasks that have to be done before this one starts
+ * @param work does some of the work, returns true once there is none left
+ */
+void StartupTasks::addOnRenderThread(string name, vector<string> after, function<bool()> work) {
+	unique_ptr<Task> task(new Task());
+	task->name = name;
+	task->after = after;
+	task->work = work;
+	task->onRenderThread = true;
+	task->started = task->running = task->done = false;
+	task->startMs = task->endMs = task->busyMs = 0;
+	task->slices = 0;
+
+	lock_guard<mutex> lock(this->taskLock);
+	this->tasks.push_back(move(task));
+}
+
+/**
+ * Start every task that doesn't need the render thread. Each one waits on its own
+ * thread for the tasks it comes after.
+ *
+ */
+void StartupTasks::start() {
+	lock_guard<mutex> lock(this->taskLock);
+	if (this->started) {
+		return;
+	}
+	this->started = true;
+
+	// A task can't wait for one that will never exist
+	for (size_t i = 0; i < this->tasks.size(); i++) {
+		Task* task = this->tasks[i].get();
+		for (vector<string>::iterator it = task->after.begin(); it != task->after.end();) {
+			if (findTask(*it) == nullptr) {
+				logger.logError("Startup task ", task->name, " comes after unknown task ", *it);
+				it = task->after.erase(it);
+			}
+			else {
+				it++;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < this->tasks.size(); i++) {
+		if (!this->tasks[i]->onRenderThread) {
+			this->workers.push_back(thread(&StartupTasks::runWorker, this, this->tasks[i].get()));
+		}
+	}
+}
+
+/**
+ * Do render thread tasks until a task is done, waiting for other threads when
+ * there is nothing to do here. Only call this on the render thread.
+ *
+ * @param name the task to wait for
+ */
+void StartupTasks::runUntil(const string& name) {
+	unique_lock<mutex> lock(this->taskLock);
+
+	Task* target = findTask(name);
+	if (target == nullptr || !this->started) {
+		logger.logError("Can't wait for startup task ", name);
+		return;
+	}
+
+	while (!target->done && !this->stopping) {
+		Task* next = nextRenderTask();
+		if (next != nullptr) {
+			runSlice(next, lock);
+		}
+		else {
+			this->taskSignal.wait(lock);
+		}
+	}
+}
+
+/**
+ * Do render thread tasks for a while, without waiting for anything. Called every
+ * frame while startup work is left. Only call this on the render thread.
+ *
+ * @param budgetMs how long to spend
+ * @return true if render thread tasks are left
+ */
+bool StartupTasks::runOnRenderThread(int budgetMs) {
+	unique_lock<mutex> lock(this->taskLock);
+	if (!this->started) {
+		return true;
+	}
+
+	chrono::steady_clock::time_point until = chrono::steady_clock::now() + chrono::milliseconds(budgetMs);
+	while (chrono::steady_clock::now() < until) {
+		Task* next = nextRenderTask();
+		if (next == nullptr) {
+			break;
+		}
+		runSlice(next, lock);
+	}
+
+	for (size_t i = 0; i < this->tasks.size(); i++) {
+		if (this->tasks[i]->onRenderThread && !this->tasks[i]->done) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Wait for a task to be done. Not for the render thread, use runUntil() there.
+ *
+ * @param name the task to wait for
+ */
+void StartupTasks::waitFor(const string& name) {
+	unique_lock<mutex> lock(this->taskLock);
+
+	Task* target = findTask(name);
+	if (target == nullptr) {
+		return;
+	}
+
+	this->taskSignal.wait(lock, [this, target]() {
+		return target->done || this->stopping;
+	});
+}
+
+/**
+ * Check if a task is done.
+ *
+ * @param name the task
+ * @return true if it is done (or doesn't exist)
+ */
+bool StartupTasks::isDone(const string& name) {
+	lock_guard<mutex> lock(this->taskLock);
+
+	Task* task = findTask(name);
+	return task == nullptr || task->done;
+}
+
+/**
+ * Check if every task is done.
+ *
+ * @return true if startup is finished
+ */
+bool StartupTasks::isFinished() {
+	lock_guard<mutex> lock(this->taskLock);
+	return this->reported;
+}
+
+/**
+ * Find a task by its name. Call with the lock held.
+ *
+ * @param name the task
+ * @return the task, null if there is none
+ */
+StartupTasks::Task* StartupTasks::findTask(const string& name) {
+	for (size_t i = 0; i < this->tasks.size(); i++) {
+		if (this->tasks[i]->name == name) {
+			return this->tasks[i].get();
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * Check if the tasks a task comes after are all done. Call with the lock held.
+ *
+ * @param task the task
+ * @return true if it can run
+ */
+bool StartupTasks::isReady(const Task& task) {
+	for (size_t i = 0; i < task.after.size(); i++) {
+		Task* before = findTask(task.after[i]);
+		if (before != nullptr && !before->done) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Pick the next render thread task that can run, in the order they were added.
+ * Call with the lock held.
+ *
+ * @return the task, null if there is none
+ */
+StartupTasks::Task* StartupTasks::nextRenderTask() {
+	for (size_t i = 0; i < this->tasks.size(); i++) {
+		Task* task = this->tasks[i].get();
+		if (task->onRenderThread && !task->done && !task->running && isReady(*task)) {
+			return task;
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * Wait for a task's turn, then run it. Runs on the task's own thread.
+ *
+ * @param task the task
+ */
+void StartupTasks::runWorker(Task* task) {
+	tracer.setThreadName("Startup: " + task->name);
+
+	unique_lock<mutex> lock(this->taskLock);
+	this->taskSignal.wait(lock, [this, task]() {
+		return isReady(*task) || this->stopping;
+	});
+	if (this->stopping) {
+		return;
+	}
+
+	task->started = task->running = true;
+	task->startMs = elapsedMs();
+	lock.unlock();
+
+	{
+		TraceScope trace("Startup task", "load", task->name.c_str());
+		task->work();
+	}
+
+	lock.lock();
+	task->running = false;
+	task->slices = 1;
+	task->busyMs = elapsedMs() - task->startMs;
+	finish(task);
+}
+
+/**
+ * Do some of a render thread task. Call with the lock held, it is let go while
+ * the work runs.
+ *
+ * @param task the task
+ * @param lock the held lock
+ */
+void StartupTasks::runSlice(Task* task, unique_lock<mutex>& lock) {
+	if (!task->started) {
+		task->started = true;
+		task->startMs = elapsedMs();
+	}
+	task->running = true;
+	lock.unlock();
+
+	int64_t sliceStart = elapsedMs();
+	bool finished;
+	{
+		TraceScope trace("Startup task", "load", task->name.c_str());
+		finished = task->work();
+	}
+	int64_t sliceEnd = elapsedMs();
+
+	lock.lock();
+	task->running = false;
+	task->slices++;
+	task->busyMs += sliceEnd - sliceStart;
+	if (finished) {
+		finish(task);
+	}
+}
+
+/**
+ * Mark a task as done, and log the report once it was the last one. Call with the
+ * lock held.
+ *
+ * @param task the task
+ */
+void StartupTasks::finish(Task* task) {
+	task->done = true;
+	task->endMs = elapsedMs();
+	this->taskSignal.notify_all();
+
+	for (size_t i = 0; i < this->tasks.size(); i++) {
+		if (!this->tasks[i]->done) {
+			return;
+		}
+	}
+
+	if (!this->reported) {
+		this->reported = true;
+		logReport();
+	}
+}
+
+/**
+ * Log when each task ran and how long it took. Call with the lock held.
+ *
+ */
+void StartupTasks::logReport() {
+	int64_t totalMs = 0;
+	int64_t workMs = 0;
+	for (size_t i = 0; i < this->tasks.size(); i++) {
+		totalMs = max(totalMs, this->tasks[i]->endMs);
+		workMs += this->tasks[i]->busyMs;
+	}
+
+	logger.log("Startup finished ", to_string(totalMs), "ms after boot (", to_string(workMs), "ms of work):");
+
+	for (size_t i = 0; i < this->tasks.size(); i++) {
+		Task* task = this->tasks[i].get();
+
+		char line[160];
+		if (task->onRenderThread) {
+			snprintf(line, sizeof(line), "  %-20s %6lldms - %6lldms  %6lldms  render thread, %d slice(s)", task->name.c_str(),
+				(long long)task->startMs, (long long)task->endMs, (long long)task->busyMs, task->slices);
+		}
+		else {
+			snprintf(line, sizeof(line), "  %-20s %6lldms - %6lldms  %6lldms", task->name.c_str(),
+				(long long)task->startMs, (long long)task->endMs, (long long)task->busyMs);
+		}
+		logger.log(line);
+	}
+}
+
+/**
+ * Time since boot.
+ *
+ * @return milliseconds since this object was made
+ */
+int64_t StartupTasks::elapsedMs() {
+	return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - this->bootTime).count();
+}
@@ -0,0 +1,83 @@
+/**
+ * @file StartupTasks.h
+ *
+ * @brief Startup Tasks
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Render thread time a frame may spend on startup work once something is on screen
+#define STARTUP_RENDER_BUDGET_MS 6
+
+/**
+ * Runs the work done at boot as a graph of named tasks. Each task starts as soon
+ * as the tasks it comes after are done, so independent work overlaps instead of
+ * running one after another. Tasks that need OpenGL run on the render thread,
+ * either all at once through runUntil() or a slice at a time each frame through
+ * runOnRenderThread(), everything else runs on its own thread. Once every task is
+ * done a timing report is logged.
+ */
+class StartupTasks {
+
+	private:
+		/**
+		 * A piece of startup work
+		 */
+		struct Task {
+			string name;
+			vector<string> after;
+			function<bool()> work;		// True once finished (render thread work can take several slices)
+			bool onRenderThread;
+			bool started;
+			bool running;
+			bool done;
+			int64_t startMs;			// Since boot
+			int64_t endMs;
+			int64_t busyMs;				// Time actually spent working
+			int slices;
+		};
+
+		mutex taskLock;
+		condition_variable taskSignal;
+		vector<unique_ptr<Task>> tasks;
+		vector<thread> workers;
+		chrono::steady_clock::time_point bootTime;
+		bool started;
+		bool stopping;
+		bool reported;
+
+		Task* findTask(const string& name);
+		bool isReady(const Task& task);
+		Task* nextRenderTask();
+		void runWorker(Task* task);
+		void runSlice(Task* task, unique_lock<mutex>& lock);
+		void finish(Task* task);
+		void logReport();
+		int64_t elapsedMs();
+
+	public:
+		StartupTasks();
+		~StartupTasks();
+
+		void add(string name, vector<string> after, function<void()> work);
+		void addOnRenderThread(string name, vector<string> after, function<bool()> work);
+
+		void start();
+		void runUntil(const string& name);
+		bool runOnRenderThread(int budgetMs = STARTUP_RENDER_BUDGET_MS);
+		void waitFor(const string& name);
+		bool isDone(const string& name);
+		bool isFinished();
+};
+
+extern StartupTasks startupTasks;
@@ -0,0 +1,171 @@
+#include <cstring>
+
+#include "Logger.h"
+#include "StreamBuffer.h"
+
+StreamBuffer streamBuffer;
+
+// Give up on a fence after this long rather than hang on a lost device (nanoseconds)
+const GLuint64 STREAM_FENCE_TIMEOUT_NS = 1000000000;
+
+/**
+ * Default constructor.
+ *
+ */
+StreamBuffer::StreamBuffer() {
+	this->initialized = false;
+	this->buffer = 0;
+	this->mapped = nullptr;
+	for (int i = 0; i < STREAM_BUFFER_FRAMES; i++) {
+		this->fences[i] = 0;
+	}
+	this->part = 0;
+	this->used = 0;
+	this->frame = 0;
+	this->peakUsed = 0;
+	this->overflowLogged = false;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+StreamBuffer::~StreamBuffer() {
+	// The OpenGL context is gone by the time globals are destroyed, so the buffer goes with it
+}
+
+/**
+ * Make the buffer. Done on first use since it needs the OpenGL context.
+ *
+ */
+void StreamBuffer::init() {
+	this->initialized = true;
+
+	GLsizeiptr size = (GLsizeiptr)STREAM_BUFFER_FRAME_SIZE * STREAM_BUFFER_FRAMES;
+	glGenBuffers(1, &this->buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+
+	if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+		this->mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+	}
+
+	if (this->mapped != nullptr) {
+		logger.log("Stream buffer persistently mapped, ", to_string(size / 1024), "KB");
+	}
+	else {
+		// Either storage couldn't be mapped or there is no buffer storage, start over with a plain buffer
+		glDeleteBuffers(1, &this->buffer);
+		glGenBuffers(1, &this->buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+		glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		logger.log("Stream buffer written with glBufferSubData, ", to_string(size / 1024), "KB");
+	}
+}
+
+/**
+ * Copy vertices into the current frame's part of the buffer.
+ *
+ * @param data the vertices
+ * @param bytes how much to copy
+ * @param alignment the offset is a multiple of this, so a vertex size makes it a vertex index
+ * @param offset where the vertices went in the buffer
+ * @return false if this frame's part is full (draw the old way then)
+ */
+bool StreamBuffer::write(const void* data, size_t bytes, size_t alignment, GLintptr& offset) {
+	if (!this->initialized) {
+		init();
+	}
+
+	size_t start = (size_t)this->part * STREAM_BUFFER_FRAME_SIZE;
+	size_t position = start + this->used;
+	if (alignment > 1) {
+		position = (position + alignment - 1) / alignment * alignment;
+	}
+
+	if (position + bytes > start + STREAM_BUFFER_FRAME_SIZE) {
+		if (!this->overflowLogged) {
+			this->overflowLogged = true;
+			logger.logError("Stream buffer is full for this frame, ", to_string(STREAM_BUFFER_FRAME_SIZE / 1024), "KB is too small");
+		}
+		return false;
+	}
+
+	if (this->mapped != nullptr) {
+		memcpy(this->mapped + position, data, bytes);
+	}
+	else {
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)position, (GLsizeiptr)bytes, data);
+	}
+
+	offset = (GLintptr)position;
+	this->used = position + bytes - start;
+	return true;
+}
+
+/**
+ * Finish the frame's part of the buffer and move to the next. Call once a frame,
+ * after it is submitted.
+ *
+ */
+void StreamBuffer::nextFrame() {
+	this->frame++;
+	if (!this->initialized) {
+		return;
+	}
+
+	if (this->used > this->peakUsed) {
+		this->peakUsed = this->used;
+	}
+
+	// Mark where the GPU has to get to before this part can be written again
+	if (this->used > 0) {
+		this->fences[this->part] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	this->part = (this->part + 1) % STREAM_BUFFER_FRAMES;
+	this->used = 0;
+
+	// Usually long done, since the frame pacer doesn't let the GPU fall this far behind
+	GLsync fence = this->fences[this->part];
+	if (fence) {
+		GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_FENCE_TIMEOUT_NS);
+		if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+			logger.logError(L"Timed out waiting for the GPU to finish with the stream buffer.");
+		}
+		glDeleteSync(fence);
+		this->fences[this->part] = 0;
+	}
+}
+
+/**
+ * Gets the buffer to point vertex attributes at.
+ *
+ * @return the buffer
+ */
+GLuint StreamBuffer::getBuffer() {
+	if (!this->initialized) {
+		init();
+	}
+	return this->buffer;
+}
+
+/**
+ * Gets the number of the current frame. Vertices written in an earlier frame may be gone.
+ *
+ * @return the frame
+ */
+uint64_t StreamBuffer::getFrame() {
+	return this->frame;
+}
+
+/**
+ * Gets the most of a frame's part that has been used.
+ *
+ * @return bytes
+ */
+size_t StreamBuffer::getPeakUsed() {
+	return this->peakUsed;
+}
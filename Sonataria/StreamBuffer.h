@@ -0,0 +1,58 @@
+/**
+ * @file StreamBuffer.h
+ *
+ * @brief Stream Buffer
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+using namespace std;
+
+#include <GL/glew.h>
+
+// Space each frame gets for vertices that change, and how many frames the ring holds
+#define STREAM_BUFFER_FRAME_SIZE (1024 * 1024)
+#define STREAM_BUFFER_FRAMES 3
+
+/**
+ * One vertex buffer that sprites whose vertices change every frame write into,
+ * instead of each of them re-specifying its own buffer with glBufferData.
+ *
+ * The buffer is split into a part per frame, used as a ring. Sprites take space
+ * from the current frame's part, and nextFrame() fences it and moves on to the
+ * next, waiting only if the GPU is still reading that one. The buffer is made
+ * once and kept persistently mapped where GL 4.4 or ARB_buffer_storage allows,
+ * otherwise written with glBufferSubData. Only used from the render thread.
+ */
+class StreamBuffer {
+
+	private:
+		bool initialized;
+		GLuint buffer;
+		char* mapped;		// Null when written with glBufferSubData
+		GLsync fences[STREAM_BUFFER_FRAMES];
+		int part;
+		size_t used;
+		uint64_t frame;
+
+		// Usage, for the log
+		size_t peakUsed;
+		bool overflowLogged;
+
+		void init();
+
+	public:
+		StreamBuffer();
+		~StreamBuffer();
+
+		bool write(const void* data, size_t bytes, size_t alignment, GLintptr& offset);
+		void nextFrame();
+
+		GLuint getBuffer();
+		uint64_t getFrame();
+		size_t getPeakUsed();
+};
+
+extern StreamBuffer streamBuffer;
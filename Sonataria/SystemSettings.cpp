@@ -4,6 +4,7 @@
 #include <iostream>
 #include <vector>
 #include "WindowsAudio.h"
+#include "FramePacer.h"
 #include "Logger.h"
 
 SystemSettings systemSettings;
@@ -17,6 +18,9 @@ void tokenize3(std::string const& str, const char delim, std::vector<std::string
  */
 SystemSettings::SystemSettings() {
 	this->windowsAudioLevel = 0.0f;
+	this->frameMode = "VSYNC";
+	this->frameRate = 0;
+	this->maxFramesInFlight = 1;
 }
 
 /**
@@ -62,6 +66,15 @@ void SystemSettings::initSettings() {
 			if (out[0] == "WIN-AUDIO") {
 				this->windowsAudioLevel = stof(out[1]);
 			}
+			else if (out[0] == "FRAME-MODE") {
+				this->frameMode = out[1];
+			}
+			else if (out[0] == "FRAME-RATE") {
+				this->frameRate = stoi(out[1]);
+			}
+			else if (out[0] == "MAX-FRAMES-IN-FLIGHT") {
+				this->maxFramesInFlight = stoi(out[1]);
+			}
 			
 		}
 
@@ -74,6 +87,9 @@ void SystemSettings::initSettings() {
 		// Set defaults for System Settings here
 		{
 			this->windowsAudioLevel = 0.5f;
+			this->frameMode = "VSYNC";
+			this->frameRate = 0;
+			this->maxFramesInFlight = 1;
 		}
 
 		this->setAllSettings();
@@ -95,6 +111,9 @@ void SystemSettings::saveSettingsToFile() {
 	// Write settings here
 	{
 		outFile << "WIN-AUDIO|" << this->windowsAudioLevel << endl;
+		outFile << "FRAME-MODE|" << this->frameMode << endl;
+		outFile << "FRAME-RATE|" << this->frameRate << endl;
+		outFile << "MAX-FRAMES-IN-FLIGHT|" << this->maxFramesInFlight << endl;
 	}
 
 	outFile.close();
@@ -114,9 +133,25 @@ void SystemSettings::setAllSettings() {
 	// Set Windows Audio
 	winAudio.SetSystemVolume(this->windowsAudioLevel, WindowsAudio::VolumeUnit::Scalar);
 
+	// Set Frame Pacing
+	this->setFramePacing();
+
 	// SET OTHER SETTINGS HERE
 }
 
+/**
+ * Pass the frame pacing settings to the frame pacer.
+ * Settings are first read while globals are still being constructed, so the
+ * renderer calls this again before it starts drawing.
+ *
+ */
+void SystemSettings::setFramePacing() {
+	// A frame rate of 0 matches the display's refresh rate
+	framePacer.setMode(FramePacer::getModeFromName(this->frameMode));
+	framePacer.setTargetRate(this->frameRate);
+	framePacer.setMaxFramesInFlight(this->maxFramesInFlight);
+}
+
 /**
  * Set a specific setting value and then update the settings file.
  * 
@@ -128,6 +163,15 @@ void SystemSettings::updateSetting(Setting setting, float value) {
 		case Setting::WIN_AUDIO:
 			this->windowsAudioLevel = value;
 			break;
+		case Setting::FRAME_MODE:
+			this->frameMode = FramePacer::getModeName((FramePacer::Mode)(int)value);
+			break;
+		case Setting::FRAME_RATE:
+			this->frameRate = (int)value;
+			break;
+		case Setting::MAX_FRAMES_IN_FLIGHT:
+			this->maxFramesInFlight = (int)value;
+			break;
 
 	}
 
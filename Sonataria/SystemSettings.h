@@ -1,10 +1,14 @@
+#include <string>
 using namespace std;
 
 class SystemSettings {
 	
 	public:
 		enum class Setting {
-			WIN_AUDIO
+			WIN_AUDIO,
+			FRAME_MODE,
+			FRAME_RATE,
+			MAX_FRAMES_IN_FLIGHT
 		};
 		SystemSettings();
 		~SystemSettings();
@@ -12,9 +16,13 @@ class SystemSettings {
 		void saveSettingsToFile();
 		void updateSetting(Setting, float);
 		void setAllSettings();
+		void setFramePacing();
 
 	private:
 		float windowsAudioLevel;
+		string frameMode;
+		int frameRate;
+		int maxFramesInFlight;
 };
 
 extern SystemSettings systemSettings;
\ No newline at end of file
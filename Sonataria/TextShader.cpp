@@ -3,7 +3,7 @@
 #include "resource.h"
 #include "OpenGLSprite.h"
 
-TextShader::TextShader() : OpenGLShader(IDR_TEXT_VERTEX_SHADER, IDR_TEXT_FRAGMENT_SHADER) {
+TextShader::TextShader() : OpenGLShader(IDR_TEXT_VERTEX_SHADER, IDR_TEXT_FRAGMENT_SHADER, "textVertex.shader", "textFragment.shader") {
 	texUniformLoc = 0;
 	colorTintLoc = 0;
 }
@@ -1,6 +1,10 @@
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
+#include <thread>
 #include "Logger.h"
 #include "TextureList.h"
+#include "TextureLoader.h"
 
 using namespace std;
 
@@ -124,6 +128,14 @@ TextureManager::TextureInfo tempTexList[] = {
 unordered_map<std::size_t, TextureManager::TextureInfo> TextureList::textureList;
 vector<OpenGLFont*> TextureList::fontList;
 std::size_t TextureList::nextID = 0;
+set<string> TextureList::filenames;
+mutex TextureList::listLock;
+mutex TextureList::preloadLock;
+deque<TextureManager::TextureInfo> TextureList::preloaded;
+set<std::size_t> TextureList::preloadQueued;
+
+// Most threads reading textures into memory at the same time
+const unsigned int PRELOAD_MAX_THREADS = 4;
 
 // Protected constructor, only called once internally for singleton pattern
 TextureList::TextureList()
@@ -131,25 +143,11 @@ TextureList::TextureList()
 	// Compute length of temporary array from above
 	size_t count = ((sizeof tempTexList) / (sizeof TextureManager::TextureInfo));
 
-	// Initialize with the reserved names from above
+	// Initialize with the reserved names from above (fonts are built later by BuildFonts, they need OpenGL)
 	for (std::size_t i = 0; i < count; i++)
 	{
-		// For fonts, build the font
-		TextureManager::TextureInfo curInfo = tempTexList[i];
-		if (strstr(curInfo.filename, ".ttf") != nullptr)
-		{
-			OpenGLFont* newFont = new OpenGLFont(curInfo.filename, 128, 41000UL);
-			fontList.push_back(newFont);
-			curInfo.font = newFont;
-		}
-		else if (strstr(curInfo.filename, ".otf") != nullptr)
-		{
-			OpenGLFont* newFont = new OpenGLFont(curInfo.filename, 128, 256UL);
-			fontList.push_back(newFont);
-			curInfo.font = newFont;
-		}
-
 		// Store reference to texture info
+		TextureManager::TextureInfo curInfo = tempTexList[i];
 		textureList[hasher(curInfo.filename)] = curInfo;
 	}
 
@@ -159,18 +157,91 @@ TextureList::TextureList()
 
 TextureList::~TextureList() {}
 
-void TextureList::PreloadTextures() {
+void TextureList::BuildFonts() {
+	// Fonts are built the first time their info is asked for
+	size_t count = ((sizeof tempTexList) / (sizeof TextureManager::TextureInfo));
+	for (std::size_t i = 0; i < count; i++) {
+		if (IsFont(tempTexList[i].filename)) {
+			GetTextureInfo(tempTexList[i].filename);
+		}
+	}
+}
+
+void TextureList::PreloadTextures(const vector<string>& filenames) {
 	logger.log("Preloading textures...");
 
-	// Find all Jacket Arts First
-	LoadJacketArts();
+	// Work out what to read while holding the list, the reading itself doesn't need it
+	vector<TextureManager::TextureInfo> toRead;
+	{
+		if (filenames.empty()) {
+			// Find all Jacket Arts First
+			LoadJacketArts();
+		}
+
+		lock_guard<mutex> lock(listLock);
+		lock_guard<mutex> preloadGuard(preloadLock);
+		if (filenames.empty()) {
+			for (auto& [key, value] : textureList) {
+				if (!IsFont(value.filename) && preloadQueued.insert(value.texID).second) {
+					toRead.push_back(value);
+				}
+			}
+		}
+		else {
+			for (size_t i = 0; i < filenames.size(); i++) {
+				TextureManager::TextureInfo info = FindTextureInfo(filenames[i]);
+				if (info.texID != 0 && !IsFont(info.filename) && preloadQueued.insert(info.texID).second) {
+					toRead.push_back(info);
+				}
+			}
+		}
+	}
+
+	// Read them on a few threads, each one is queued for the render thread as soon as it is in memory
+	atomic<size_t> next(0);
+	auto readTextures = [&toRead, &next]() {
+		for (size_t i = next++; i < toRead.size(); i = next++) {
+			if (TextureLoader::Inst()->DecodeTexture(toRead[i].filename, toRead[i].texID)) {
+				lock_guard<mutex> lock(preloadLock);
+				preloaded.push_back(toRead[i]);
+			}
+			else {
+				logger.logError("Failed to preload texture: ", toRead[i].filename);
+			}
+		}
+	};
+
+	unsigned int threadCount = thread::hardware_concurrency() > 1 ? thread::hardware_concurrency() - 1 : 1;
+	if (threadCount > PRELOAD_MAX_THREADS) {
+		threadCount = PRELOAD_MAX_THREADS;
+	}
+	vector<thread> readers;
+	for (unsigned int i = 1; i < threadCount && i < toRead.size(); i++) {
+		readers.push_back(thread(readTextures));
+	}
+	readTextures();
+	for (size_t i = 0; i < readers.size(); i++) {
+		readers[i].join();
+	}
+
+	logger.log("Preloaded ", to_string(toRead.size()), " textures.");
+}
 
-	// Preload texture ids
-	for (auto& [key, value] : textureList) {
-		GetTextureID(value.filename);
+bool TextureList::UploadPreloadedTexture() {
+	TextureManager::TextureInfo info;
+	{
+		lock_guard<mutex> lock(preloadLock);
+		if (preloaded.empty()) {
+			return false;
+		}
+		info = preloaded.front();
+		preloaded.pop_front();
 	}
 
-	logger.log("Preloaded textures.");
+	// Something may have drawn it (and so loaded it) first, then the copy in memory isn't needed
+	TextureManager::Inst()->loadTexture(info);
+	TextureLoader::Inst()->DiscardDecoded(info.texID);
+	return true;
 }
 
 void TextureList::LoadJacketArts() {
@@ -186,7 +257,10 @@ void TextureList::LoadJacketArts() {
 
 		replace(path.begin(), path.end(), '\\', '/');
 
-		AddTextureInfo(path, GL_BGR, GL_RGB);
+		lock_guard<mutex> lock(listLock);
+		if (FindTextureInfo(path).texID == 0) {
+			AddTextureInfo(path, GL_BGR, GL_RGB);
+		}
 	}
 }
 
@@ -202,24 +276,35 @@ TextureManager::TextureInfo TextureList::FindTextureInfo(const string& filename)
 	return TextureManager::TextureInfo();
 }
 
+const char* TextureList::KeepFilename(const std::string& filename)
+{
+	// The texture info only points at its filename, so it needs a copy that never moves
+	return filenames.insert(filename).first->c_str();
+}
+
+bool TextureList::IsFont(const char* filename)
+{
+	return strstr(filename, ".ttf") != nullptr || strstr(filename, ".otf") != nullptr;
+}
+
 TextureManager::TextureInfo TextureList::AddTextureFont(const std::string& filename, int sizePixels, unsigned long charCount)
 {
 	OpenGLFont* newFont = new OpenGLFont(filename, sizePixels, charCount);
 	fontList.push_back(newFont);
 
-	// Build the textureInfo struct
-	TextureManager::TextureInfo newTexInfo =
-	{
-		filename.c_str(),
-		nextID,
-		0,
-		0,
-		newFont
-	};
+	// Build the textureInfo struct (keeping the ID of a pre-defined font)
+	TextureManager::TextureInfo newTexInfo = FindTextureInfo(filename);
+	if (newTexInfo.texID == 0) {
+		newTexInfo.filename = KeepFilename(filename);
+		newTexInfo.texID = nextID;
+		newTexInfo.imageFormat = 0;
+		newTexInfo.internalFormat = 0;
+		nextID++;
+	}
+	newTexInfo.font = newFont;
 
 	// Hash filename and insert the textureInfo
 	textureList[hasher(filename.c_str())] = newTexInfo;
-	nextID++;
 
 	// Return the textureInfo
 	return newTexInfo;
@@ -230,7 +315,7 @@ TextureManager::TextureInfo TextureList::AddTextureInfo(const std::string& filen
 	// Build the textureInfo struct
 	TextureManager::TextureInfo newTexInfo =
 	{
-		filename.c_str(),
+		KeepFilename(filename),
 		nextID,
 		fileFormat,
 		internalFormat,
@@ -251,20 +336,42 @@ unsigned int TextureList::GetTextureID(const std::string& filename, GLenum fileF
 	return texInfo.texID;
 }
 
-TextureManager::TextureInfo TextureList::GetTextureInfo(const std::string& filename, GLenum fileFormat, GLint internalFormat)
+unsigned int TextureList::LookUpTextureID(const std::string& filename, GLenum fileFormat, GLint internalFormat)
 {
-	// Search for the texture info in the loaded texture array
+	lock_guard<mutex> lock(listLock);
+
 	TextureManager::TextureInfo myTexInfo = FindTextureInfo(filename);
 	if (myTexInfo.texID == 0)
 	{
-		// Not found, so add it to the list
-		if (filename.find(".ttf") != std::string::npos)
-		{
-			myTexInfo = AddTextureFont(filename, 128, 41000UL);
-		}
-		else
+		myTexInfo = AddTextureInfo(filename, fileFormat, internalFormat);
+	}
+
+	return myTexInfo.texID;
+}
+
+TextureManager::TextureInfo TextureList::GetTextureInfo(const std::string& filename, GLenum fileFormat, GLint internalFormat)
+{
+	TextureManager::TextureInfo myTexInfo;
+	{
+		lock_guard<mutex> lock(listLock);
+
+		// Search for the texture info in the loaded texture array
+		myTexInfo = FindTextureInfo(filename);
+		if (myTexInfo.texID == 0 || (IsFont(myTexInfo.filename) && myTexInfo.font == nullptr))
 		{
-			myTexInfo = AddTextureInfo(filename, fileFormat, internalFormat);
+			// Not found (or a font not built yet), so add it to the list
+			if (filename.find(".ttf") != std::string::npos)
+			{
+				myTexInfo = AddTextureFont(filename, 128, 41000UL);
+			}
+			else if (filename.find(".otf") != std::string::npos)
+			{
+				myTexInfo = AddTextureFont(filename, 128, 256UL);
+			}
+			else
+			{
+				myTexInfo = AddTextureInfo(filename, fileFormat, internalFormat);
+			}
 		}
 	}
 
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <deque>
+#include <mutex>
+#include <set>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include "TextureManager.h"
 #include "OpenGLFont.h"
 
@@ -17,7 +21,16 @@ public:
 	unsigned int GetTextureID(const std::string& filename, GLenum fileFormat = GL_BGR, GLint internalFormat = GL_RGB);
 	TextureManager::TextureInfo GetTextureInfo(const std::string& filename, GLenum fileFormat = GL_BGR, GLint internalFormat = GL_RGB);
 
-	void PreloadTextures();
+	// Same as GetTextureID, but leaves loading the texture to when it is first drawn or preloaded
+	unsigned int LookUpTextureID(const std::string& filename, GLenum fileFormat = GL_BGR, GLint internalFormat = GL_RGB);
+
+	// Build the pre-defined fonts (needs OpenGL)
+	void BuildFonts();
+
+	// Read textures into memory on any thread (every known texture and jacket art if no files are given),
+	// then hand them to OpenGL one at a time on the render thread
+	void PreloadTextures(const std::vector<std::string>& filenames = std::vector<std::string>());
+	bool UploadPreloadedTexture();
 
 protected:
 	TextureList();
@@ -31,10 +44,23 @@ protected:
 	// List of all loaded font objects
 	static std::vector<OpenGLFont*> fontList;
 
-	// Internal Helper functions
+	// Stable copies of the filenames the texture info points to
+	static std::set<std::string> filenames;
+
+	// Guards the lists above, textures are preloaded on other threads
+	static std::mutex listLock;
+
+	// Preloaded textures waiting for the render thread, and every ID handed out for preloading
+	static std::mutex preloadLock;
+	static std::deque<TextureManager::TextureInfo> preloaded;
+	static std::set<std::size_t> preloadQueued;
+
+	// Internal Helper functions (call with listLock held)
 	static TextureManager::TextureInfo AddTextureInfo(const std::string& filename, GLenum fileFormat, GLint internalFormat);
 	static TextureManager::TextureInfo AddTextureFont(const std::string& filename, int sizePixels = 128, unsigned long charCount = 4096);
 	static TextureManager::TextureInfo FindTextureInfo(const std::string& filename);
+	static const char* KeepFilename(const std::string& filename);
+	static bool IsFont(const char* filename);
 
 	// Singleton instance
 	static TextureList* m_inst;
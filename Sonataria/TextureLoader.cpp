@@ -10,6 +10,7 @@
 
 #include "TextureLoader.h"
 #include "Logger.h"
+#include "Tracer.h"
 
 // Initialize static instance to null
 TextureLoader* TextureLoader::m_inst(NULL);
@@ -26,6 +27,9 @@ TextureLoader* TextureLoader::Inst()
 
 TextureLoader::TextureLoader()
 {
+	// Nothing is known to be bound yet
+	InvalidateBindings();
+
 	// call this ONLY when linking with FreeImage as a static library
 	#ifdef FREEIMAGE_LIB
 		FreeImage_Initialise();
@@ -40,16 +44,19 @@ TextureLoader::~TextureLoader()
 	#endif
 
 	UnloadAllTextures();
+
+	// free images that were read ahead but never loaded
+	for (auto& [texID, decoded] : m_decoded) {
+		FreeImage_Unload(decoded.dib);
+	}
+	m_decoded.clear();
+
 	m_inst = NULL;
 }
 
 bool TextureLoader::LoadTexture(const char* filename, const unsigned int texID, GLenum image_format, GLint internal_format, GLint level, GLint border)
 {
-	// image format
-	FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
-
-	// pointer to the image, once loaded
-	FIBITMAP *dib(0);
+	TraceScope trace("Load texture", "load", filename);
 
 	// pointer to the image data
 	BYTE* bits(0);
@@ -59,23 +66,11 @@ bool TextureLoader::LoadTexture(const char* filename, const unsigned int texID,
 
 	// OpenGL's image ID to map to
 	GLuint gl_texID;
-	
-	// check the file signature and deduce its format
-	fif = FreeImage_GetFileType(filename, 0);
 
-	// if still unknown, try to guess the file format from the file extension
-	if (fif == FIF_UNKNOWN) {
-		fif = FreeImage_GetFIFFromFilename(filename);
-	}
-
-	//if still unkown, return failure
-	if (fif == FIF_UNKNOWN) {
-		return false;
-	}
-
-	// check that the plugin has reading capabilities and load the file
-	if (FreeImage_FIFSupportsReading(fif)) {
-		dib = FreeImage_Load(fif, filename);
+	// use the image if it was read ahead of time, otherwise read it now
+	FIBITMAP* dib = TakeDecoded(filename, texID);
+	if (!dib) {
+		dib = ReadImage(filename);
 	}
 
 	// if the image failed to load, return failure
@@ -92,11 +87,13 @@ bool TextureLoader::LoadTexture(const char* filename, const unsigned int texID,
 
 	// if this somehow one of these failed (they shouldn't), return failure
 	if ((bits == 0) || (width == 0) || (height == 0)) {
+		FreeImage_Unload(dib);
 		return false;
 	}
 	
 	// if this texture ID is in use, unload the current texture
 	if (m_texID.find(texID) != m_texID.end()) {
+		ForgetTexture(m_texID[texID]);
 		glDeleteTextures(1, &(m_texID[texID]));
 	}
 
@@ -107,7 +104,7 @@ bool TextureLoader::LoadTexture(const char* filename, const unsigned int texID,
 	m_texID[texID] = gl_texID;
 
 	// bind to the new texture ID
-	glBindTexture(GL_TEXTURE_2D, gl_texID);
+	BindTextureUnit(0, gl_texID);
 
 	// ensure word alignment is enabled
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
@@ -130,11 +127,84 @@ bool TextureLoader::LoadTexture(const char* filename, const unsigned int texID,
 	return true;
 }
 
+bool TextureLoader::DecodeTexture(const char* filename, const unsigned int texID)
+{
+	TraceScope trace("Decode texture", "load", filename);
+
+	FIBITMAP* dib = ReadImage(filename);
+	if (!dib) {
+		return false;
+	}
+
+	// keep it for LoadTexture, replacing anything read earlier for this ID
+	std::lock_guard<std::mutex> lock(m_decodeLock);
+	if (m_decoded.find(texID) != m_decoded.end()) {
+		FreeImage_Unload(m_decoded[texID].dib);
+	}
+	m_decoded[texID] = { filename, dib };
+
+	return true;
+}
+
+void TextureLoader::DiscardDecoded(const unsigned int texID)
+{
+	std::lock_guard<std::mutex> lock(m_decodeLock);
+	if (m_decoded.find(texID) != m_decoded.end()) {
+		FreeImage_Unload(m_decoded[texID].dib);
+		m_decoded.erase(texID);
+	}
+}
+
+FIBITMAP* TextureLoader::ReadImage(const char* filename)
+{
+	// check the file signature and deduce its format
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(filename, 0);
+
+	// if still unknown, try to guess the file format from the file extension
+	if (fif == FIF_UNKNOWN) {
+		fif = FreeImage_GetFIFFromFilename(filename);
+	}
+
+	//if still unkown, return failure
+	if (fif == FIF_UNKNOWN) {
+		return nullptr;
+	}
+
+	// check that the plugin has reading capabilities and load the file
+	if (!FreeImage_FIFSupportsReading(fif)) {
+		return nullptr;
+	}
+	return FreeImage_Load(fif, filename);
+}
+
+FIBITMAP* TextureLoader::TakeDecoded(const char* filename, const unsigned int texID)
+{
+	std::lock_guard<std::mutex> lock(m_decodeLock);
+
+	auto it = m_decoded.find(texID);
+	if (it == m_decoded.end()) {
+		return nullptr;
+	}
+
+	// an ID can be reused for another file, only the image of this file will do
+	FIBITMAP* dib = nullptr;
+	if (it->second.filename == filename) {
+		dib = it->second.dib;
+	}
+	else {
+		FreeImage_Unload(it->second.dib);
+	}
+	m_decoded.erase(it);
+
+	return dib;
+}
+
 bool TextureLoader::UnloadTexture(const unsigned int texID)
 {
 	// if this texture ID mapped, unload it's texture, and remove it from the map
 	if(m_texID.find(texID) != m_texID.end())
 	{
+		ForgetTexture(m_texID[texID]);
 		glDeleteTextures(1, &(m_texID[texID]));
 		m_texID.erase(texID);
 		return true;
@@ -144,19 +214,63 @@ bool TextureLoader::UnloadTexture(const unsigned int texID)
 	return false;
 }
 
-bool TextureLoader::BindTexture(const unsigned int texID)
+bool TextureLoader::BindTexture(const unsigned int texID, GLuint unit)
 {
 	// if this texture ID mapped, bind it's texture as current
 	if (m_texID.find(texID) != m_texID.end()) {
-		glBindTexture(GL_TEXTURE_2D, m_texID[texID]);
+		BindTextureUnit(unit, m_texID[texID]);
 		return true;
 	}
 
 	//otherwise, binding failed
-	glBindTexture(GL_TEXTURE_2D, 0);
+	BindTextureUnit(unit, 0);
 	return false;
 }
 
+void TextureLoader::BindTextureUnit(GLuint unit, GLuint glTexID)
+{
+	// Units past the tracked range are always bound directly
+	if (unit >= TRACKED_TEXTURE_UNITS) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, glTexID);
+		m_activeUnit = unit;
+		return;
+	}
+
+	// The unit is made active even when the bind is skipped, callers upload to
+	// (glTexSubImage2D) or configure (glTexParameter) the texture on the active unit
+	if (m_activeUnit != unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		m_activeUnit = unit;
+	}
+
+	// Skip the bind entirely if this texture is already on this unit
+	if (m_boundTex[unit] == glTexID) {
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, glTexID);
+	m_boundTex[unit] = glTexID;
+}
+
+void TextureLoader::ForgetTexture(GLuint glTexID)
+{
+	// Deleting a bound texture reverts its unit to texture 0
+	for (int i = 0; i < TRACKED_TEXTURE_UNITS; i++) {
+		if (m_boundTex[i] == glTexID) {
+			m_boundTex[i] = 0;
+		}
+	}
+}
+
+void TextureLoader::InvalidateBindings()
+{
+	// Use an ID that can never match so the next bind on every unit goes through
+	for (int i = 0; i < TRACKED_TEXTURE_UNITS; i++) {
+		m_boundTex[i] = (GLuint)-1;
+	}
+	m_activeUnit = (GLuint)-1;
+}
+
 void TextureLoader::UnloadAllTextures()
 {
 	// start at the beginning of the texture map
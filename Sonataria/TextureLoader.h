@@ -11,6 +11,13 @@
 #include <windows.h>
 #include <GL/glew.h>
 #include <map>
+#include <mutex>
+#include <string>
+
+struct FIBITMAP;
+
+// Number of texture units whose bindings are cached
+#define TRACKED_TEXTURE_UNITS 8
 
 class TextureLoader
 {
@@ -28,11 +35,27 @@ public:
 		GLint level = 0,					//mipmapping level
 		GLint border = 0);					//border size
 
+	//read an image into memory ahead of LoadTexture, without touching OpenGL
+	//safe on any thread, LoadTexture then uses it instead of reading the file again
+	bool DecodeTexture(const char* filename, const unsigned int texID);
+
+	//drop an image read ahead of time that won't be loaded after all
+	void DiscardDecoded(const unsigned int texID);
+
 	//free the memory for a texture
 	bool UnloadTexture(const unsigned int texID);
 
-	//set the current texture
-	bool BindTexture(const unsigned int texID);
+	//set the current texture (on texture unit 0 unless told otherwise)
+	bool BindTexture(const unsigned int texID, GLuint unit = 0);
+
+	//bind a raw OpenGL texture name to a texture unit and make that unit active, skipping the bind if already bound
+	void BindTextureUnit(GLuint unit, GLuint glTexID);
+
+	//drop any cached binding of a texture that is about to be deleted
+	void ForgetTexture(GLuint glTexID);
+
+	//drop all cached bindings (use after texture state was changed outside this class)
+	void InvalidateBindings();
 
 	//free all texture memory
 	void UnloadAllTextures();
@@ -49,4 +72,19 @@ protected:
 
 	// Global storage of managed textures and their identifiers
 	std::map<unsigned int, GLuint> m_texID;
+
+	// Cached texture unit state used to skip redundant binds
+	GLuint m_boundTex[TRACKED_TEXTURE_UNITS];
+	GLuint m_activeUnit;
+
+	// Images read ahead of time, waiting for LoadTexture
+	struct DecodedImage {
+		std::string filename;
+		FIBITMAP* dib;
+	};
+	std::mutex m_decodeLock;
+	std::map<unsigned int, DecodedImage> m_decoded;
+
+	static FIBITMAP* ReadImage(const char* filename);
+	FIBITMAP* TakeDecoded(const char* filename, const unsigned int texID);
 };
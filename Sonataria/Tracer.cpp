@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Logger.h"
+#include "Tracer.h"
+
+Tracer tracer;
+
+/**
+ * Gives a thread's ring back to the tracer when the thread exits so a later
+ * thread can reuse it (its events stay until they are overwritten)
+ */
+struct TraceRingOwner {
+	Tracer::ThreadRing* ring = NULL;
+
+	~TraceRingOwner() {
+		if (ring) {
+			tracer.releaseThreadRing(ring);
+		}
+	}
+};
+
+thread_local TraceRingOwner traceRingOwner;
+
+/**
+ * Write a string as a JSON string value.
+ *
+ * @param out stream to write to
+ * @param text the text
+ */
+static void writeJsonString(ofstream& out, const char* text) {
+	out << '"';
+	for (const char* c = text; *c; c++) {
+		switch (*c) {
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\r': out << "\\r"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if ((unsigned char)*c < 0x20) {
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*c);
+					out << escaped;
+				}
+				else {
+					out << *c;
+				}
+				break;
+		}
+	}
+	out << '"';
+}
+
+/**
+ * Default constructor.
+ *
+ */
+Tracer::Tracer() {
+	this->enabled = true;
+	this->dumping = false;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+Tracer::~Tracer() {
+	// The rings are left for the OS to free, threads may still be writing to them while the game exits
+}
+
+/**
+ * Turn recording on or off.
+ *
+ * @param enable true to record events
+ */
+void Tracer::setEnabled(bool enable) {
+	this->enabled = enable;
+}
+
+/**
+ * Name the calling thread in saved traces.
+ *
+ * @param name the name of the thread
+ */
+void Tracer::setThreadName(string name) {
+	lock_guard<mutex> lock(this->namesLock);
+	this->threadNames[currentThreadId()] = name;
+}
+
+/**
+ * Get the ring for the calling thread, claiming one the first time.
+ *
+ * @return the thread's ring
+ */
+Tracer::ThreadRing* Tracer::getThreadRing() {
+	if (traceRingOwner.ring) {
+		return traceRingOwner.ring;
+	}
+
+	lock_guard<mutex> lock(this->ringsLock);
+
+	// Reuse the ring of a thread that has exited
+	ThreadRing* ring = NULL;
+	for (size_t i = 0; i < this->rings.size(); i++) {
+		if (!this->rings[i]->inUse) {
+			ring = this->rings[i];
+			break;
+		}
+	}
+
+	if (!ring) {
+		ring = new ThreadRing();
+		ring->head = 0;
+		this->rings.push_back(ring);
+	}
+
+	ring->threadId = currentThreadId();
+	ring->inUse = true;
+	traceRingOwner.ring = ring;
+	return ring;
+}
+
+/**
+ * Give a ring back once its thread has exited.
+ *
+ * @param ring the ring to release
+ */
+void Tracer::releaseThreadRing(ThreadRing* ring) {
+	lock_guard<mutex> lock(this->ringsLock);
+	ring->inUse = false;
+}
+
+/**
+ * Store an event in the calling thread's ring (only that thread ever writes to it).
+ *
+ * @param name name of the event (string literal)
+ * @param category category of the event (string literal)
+ * @param startMicros when the event started
+ * @param endMicros when the event ended
+ * @param detail optional extra text (only the end is kept if it is too long)
+ */
+void Tracer::record(const char* name, const char* category, int64_t startMicros, int64_t endMicros, const char* detail) {
+	ThreadRing* ring = getThreadRing();
+
+	uint32_t head = ring->head.load(memory_order_relaxed);
+	Event& event = ring->events[head & (TRACE_RING_SIZE - 1)];
+	event.name = name;
+	event.category = category;
+	event.startMicros = startMicros;
+	event.durationMicros = (uint32_t)(endMicros - startMicros);
+	event.threadId = ring->threadId;
+
+	// Keep the end of long details, that is where file names are
+	if (detail) {
+		size_t length = strlen(detail);
+		const char* tail = length >= TRACE_DETAIL_LENGTH ? detail + length - (TRACE_DETAIL_LENGTH - 1) : detail;
+		memcpy(event.detail, tail, strlen(tail) + 1);
+	}
+	else {
+		event.detail[0] = '\0';
+	}
+
+	ring->head.store(head + 1, memory_order_release);
+}
+
+/**
+ * Copy every event that started after a point in time out of the rings.
+ *
+ * @param out the events
+ * @param sinceMicros only events that started after this are kept
+ */
+void Tracer::collect(vector<Event>& out, int64_t sinceMicros) {
+	lock_guard<mutex> lock(this->ringsLock);
+
+	for (size_t r = 0; r < this->rings.size(); r++) {
+		ThreadRing* ring = this->rings[r];
+		uint32_t head = ring->head.load(memory_order_acquire);
+		uint32_t available = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+
+		size_t first = out.size();
+		for (uint32_t i = head - available; i != head; i++) {
+			out.push_back(ring->events[i & (TRACE_RING_SIZE - 1)]);
+		}
+
+		// Anything the owner overwrote while it was being copied may be torn, so leave it out
+		atomic_thread_fence(memory_order_acquire);
+		uint32_t newHead = ring->head.load(memory_order_relaxed);
+		uint32_t oldest = head - available;
+		uint32_t firstIntact = newHead - TRACE_RING_SIZE + 1;
+		if (newHead >= TRACE_RING_SIZE && (int32_t)(firstIntact - oldest) > 0) {
+			uint32_t torn = firstIntact - oldest;
+			out.erase(out.begin() + first, out.begin() + first + (torn < available ? torn : available));
+		}
+
+		// Drop the events that are too old
+		out.erase(remove_if(out.begin() + first, out.end(), [sinceMicros](const Event& e) {
+			return e.startMicros < sinceMicros;
+		}), out.end());
+	}
+}
+
+/**
+ * Save the last few seconds of events as a Chrome trace event JSON file
+ * (open it in chrome://tracing or ui.perfetto.dev).
+ *
+ * @param path file to write
+ * @param seconds how much of the timeline to save
+ * @return true if the file was written
+ */
+bool Tracer::dump(string path, int seconds) {
+	vector<Event> events;
+	events.reserve(TRACE_RING_SIZE * 4);
+	collect(events, nowMicros() - (int64_t)seconds * 1000000);
+
+	sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+		return a.startMicros < b.startMicros;
+	});
+
+	filesystem::path filePath(path);
+	if (filePath.has_parent_path()) {
+		error_code error;
+		filesystem::create_directories(filePath.parent_path(), error);
+	}
+
+	ofstream out(path, ios::out | ios::trunc);
+	if (!out.is_open()) {
+		logger.logError("Failed to write trace to ", path);
+		return false;
+	}
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Sonataria\"}}";
+
+	{
+		lock_guard<mutex> lock(this->namesLock);
+		for (map<uint32_t, string>::iterator it = this->threadNames.begin(); it != this->threadNames.end(); it++) {
+			out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << it->first << ",\"args\":{\"name\":";
+			writeJsonString(out, it->second.c_str());
+			out << "}}";
+		}
+	}
+
+	for (size_t i = 0; i < events.size(); i++) {
+		const Event& e = events[i];
+		out << ",\n{\"name\":";
+		writeJsonString(out, e.name);
+		out << ",\"cat\":";
+		writeJsonString(out, e.category);
+		out << ",\"ph\":\"X\",\"ts\":" << e.startMicros << ",\"dur\":" << e.durationMicros
+			<< ",\"pid\":1,\"tid\":" << e.threadId;
+		if (e.detail[0] != '\0') {
+			out << ",\"args\":{\"detail\":";
+			writeJsonString(out, e.detail);
+			out << "}";
+		}
+		out << "}";
+	}
+	out << "\n]}\n";
+	out.close();
+
+	logger.log("Trace of the last ", to_string(seconds), " seconds (", to_string(events.size()), " events) saved to ", path);
+	return true;
+}
+
+/**
+ * Save the last few seconds to Traces/trace_<time>.json on another thread so the caller doesn't hitch.
+ *
+ * @param seconds how much of the timeline to save
+ */
+void Tracer::dumpInBackground(int seconds) {
+	// One dump at a time
+	bool expected = false;
+	if (!this->dumping.compare_exchange_strong(expected, true)) {
+		return;
+	}
+
+	char timeStamp[32];
+	time_t now = time(NULL);
+	tm local = {};
+#ifdef _WIN32
+	localtime_s(&local, &now);
+#else
+	localtime_r(&now, &local);
+#endif
+	strftime(timeStamp, sizeof(timeStamp), "%Y%m%d-%H%M%S", &local);
+	string path = string("Traces/trace_") + timeStamp + ".json";
+
+	thread([this, path, seconds]() {
+		if (dump(path, seconds)) {
+			lock_guard<mutex> lock(this->namesLock);
+			this->lastDumpPath = path;
+		}
+		this->dumping = false;
+	}).detach();
+}
+
+/**
+ * Gets where the last trace was saved.
+ *
+ * @return the path, or an empty string if none has been saved
+ */
+string Tracer::getLastDumpPath() {
+	lock_guard<mutex> lock(this->namesLock);
+	return this->lastDumpPath;
+}
+
+/**
+ * Gets a microsecond timestamp for events.
+ *
+ * @return microseconds since an arbitrary point
+ */
+int64_t Tracer::nowMicros() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Gets the OS's ID for the calling thread, so traces line up with other tools.
+ *
+ * @return the thread ID
+ */
+uint32_t Tracer::currentThreadId() {
+#ifdef _WIN32
+	return (uint32_t)GetCurrentThreadId();
+#else
+	return (uint32_t)syscall(SYS_gettid);
+#endif
+}
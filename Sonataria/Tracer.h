@@ -0,0 +1,128 @@
+/**
+ * @file Tracer.h
+ *
+ * @brief Tracer
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Events kept for each thread (must be a power of two)
+#define TRACE_RING_SIZE 8192
+
+// Characters of extra detail (such as a file name) kept with an event
+#define TRACE_DETAIL_LENGTH 32
+
+// How much of the timeline is saved by default
+#define TRACE_DUMP_SECONDS 10
+
+/**
+ * Records timed events from every thread into per-thread rings so the last few
+ * seconds can be saved as a Chrome/Perfetto trace when something hitches
+ */
+class Tracer {
+
+	public:
+		/**
+		 * One timed span on one thread (names and categories must be string literals)
+		 */
+		struct Event {
+			const char* name;
+			const char* category;
+			int64_t startMicros;
+			uint32_t durationMicros;
+			uint32_t threadId;
+			char detail[TRACE_DETAIL_LENGTH];
+		};
+
+		/**
+		 * Events written by a single thread
+		 */
+		struct ThreadRing {
+			Event events[TRACE_RING_SIZE];
+			atomic<uint32_t> head;
+			uint32_t threadId;
+			bool inUse;
+		};
+
+	private:
+		atomic<bool> enabled;
+
+		mutex ringsLock;
+		vector<ThreadRing*> rings;
+
+		mutex namesLock;
+		map<uint32_t, string> threadNames;
+
+		atomic<bool> dumping;
+		string lastDumpPath;
+
+		ThreadRing* getThreadRing();
+		void collect(vector<Event>& out, int64_t sinceMicros);
+
+	public:
+		Tracer();
+		~Tracer();
+
+		/**
+		 * Gets if events are being recorded (cheap enough to check in every scope).
+		 *
+		 * @return true if recording
+		 */
+		inline bool isEnabled() const { return this->enabled.load(memory_order_relaxed); }
+
+		void setEnabled(bool);
+		void setThreadName(string name);
+		void record(const char* name, const char* category, int64_t startMicros, int64_t endMicros, const char* detail = NULL);
+		void releaseThreadRing(ThreadRing* ring);
+
+		bool dump(string path, int seconds);
+		void dumpInBackground(int seconds = TRACE_DUMP_SECONDS);
+		string getLastDumpPath();
+
+		static int64_t nowMicros();
+		static uint32_t currentThreadId();
+};
+
+extern Tracer tracer;
+
+/**
+ * Records the scope it is declared in as one trace event
+ */
+class TraceScope {
+
+	private:
+		const char* name;
+		const char* category;
+		const char* detail;
+		bool active;
+		int64_t start;
+
+	public:
+		/**
+		 * Start the event.
+		 *
+		 * @param name name of the event (string literal)
+		 * @param category category of the event (string literal)
+		 * @param detail optional extra text, must stay valid until the scope ends (the end of it is kept)
+		 */
+		inline TraceScope(const char* name, const char* category, const char* detail = NULL)
+			: name(name), category(category), detail(detail), active(tracer.isEnabled()), start(0) {
+			if (this->active) {
+				this->start = Tracer::nowMicros();
+			}
+		}
+
+		inline ~TraceScope() {
+			if (this->active) {
+				tracer.record(this->name, this->category, this->start, Tracer::nowMicros(), this->detail);
+			}
+		}
+};
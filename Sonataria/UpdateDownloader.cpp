@@ -0,0 +1,731 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <thread>
+
+#include "Logger.h"
+#include "NetClient.h"
+#include "PeerExchange.h"
+#include "Signature.h"
+#include "Tracer.h"
+#include "UpdateDownloader.h"
+
+using json = nlohmann::json;
+
+// Where the public half of the update signing key is kept (modulus then exponent, as hex lines)
+const char UPDATE_KEY_FILE[] = "UpdateKey.txt";
+
+// Chunk sizes a manifest may ask for
+const uint64_t MIN_CHUNK_SIZE = 64 * 1024;
+const uint64_t MAX_CHUNK_SIZE = 64 * 1024 * 1024;
+
+// Wait after a failed chunk, doubled for each failure in a row
+const int CHUNK_BACKOFF_START_MS = 500;
+const int CHUNK_BACKOFF_MAX_MS = 10000;
+
+// How often the download speed is measured
+const chrono::milliseconds SPEED_SAMPLE_INTERVAL(500);
+
+// Size of the reads when hashing the part kept from an earlier attempt
+const size_t RESUME_READ_SIZE = 1024 * 1024;
+
+/**
+ * Check a path from the manifest stays inside the version folder.
+ *
+ * @param path the path
+ * @return true if it is a plain relative path
+ */
+static bool isSafePath(const string& path) {
+	if (path.empty() || path[0] == '/' || path[0] == '\\' || path.find(':') != string::npos) {
+		return false;
+	}
+
+	filesystem::path relative(path);
+	for (const filesystem::path& part : relative) {
+		if (part == "..") {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Check the chunk hashes of a file from the manifest.
+ *
+ * @param chunks hash of each chunk, or none
+ * @param size size of the file
+ * @param chunkSize size of each chunk
+ * @return true if there are none, or one valid hash for each chunk
+ */
+static bool isValidChunkList(vector<string>& chunks, uint64_t size, uint64_t chunkSize) {
+	if (chunks.empty()) {
+		return true;
+	}
+	if (chunks.size() != (size + chunkSize - 1) / chunkSize) {
+		return false;
+	}
+	for (size_t i = 0; i < chunks.size(); i++) {
+		transform(chunks[i].begin(), chunks[i].end(), chunks[i].begin(), ::tolower);
+		if (chunks[i].size() != 64 || chunks[i].find_first_not_of("0123456789abcdef") != string::npos) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Gets the SHA-256 of a chunk.
+ *
+ * @param data the chunk
+ * @return the hash as lowercase hex
+ */
+static string hashChunk(const string& data) {
+	Sha256 hash;
+	hash.update(data.data(), data.size());
+	return hash.finishHex();
+}
+
+/**
+ * Default constructor.
+ *
+ */
+UpdateDownloader::UpdateDownloader() {
+	this->keyPath = UPDATE_KEY_FILE;
+	this->generation = 0;
+	this->active = false;
+	this->received = 0;
+	this->total = 0;
+	this->resumedFrom = 0;
+	this->fromPeers = 0;
+	this->bytesPerSecond = 0.0;
+	this->filesTotal = 0;
+	this->filesChecked = 0;
+	this->filesChanged = 0;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+UpdateDownloader::~UpdateDownloader() {
+
+}
+
+/**
+ * Set the game server to download from.
+ *
+ * @param address address of the server (host:port)
+ */
+void UpdateDownloader::setServer(string address) {
+	this->serverAddress = address;
+}
+
+/**
+ * Read the signing key from another file, such as a test key.
+ *
+ * @param path the key file
+ */
+void UpdateDownloader::setKeyPath(string path) {
+	this->keyPath = path;
+}
+
+/**
+ * Be handed the bytes of each file in order as they are downloaded, starting with any
+ * part kept from an earlier attempt, such as to extract an update while it arrives.
+ * The bytes restart from 0 if a kept part turns out to be unusable.
+ *
+ * @param listener called on the downloading thread with where the bytes go in the file (nullptr to stop)
+ */
+void UpdateDownloader::setDataListener(function<void(uint64_t offset, const uint8_t* data, size_t size)> listener) {
+	this->dataListener = listener;
+}
+
+/**
+ * Have update work pace itself, such as to keep it from costing frames during songs.
+ *
+ * @param throttle called with the size of each block of work, may sleep, and returns false if the work should stop
+ */
+void UpdateDownloader::setThrottle(function<bool(size_t bytes)> throttle) {
+	this->throttleHook = throttle;
+}
+
+/**
+ * Pace a block of update work with the throttle, if there is one.
+ *
+ * @param bytes size of the block (0 only checks if the work should go on)
+ * @return false if the work should stop
+ */
+bool UpdateDownloader::throttle(size_t bytes) {
+	return !this->throttleHook || this->throttleHook(bytes);
+}
+
+/**
+ * Download the full update, carrying on from an earlier attempt if there is one.
+ *
+ * @param manifest the manifest of the update
+ * @param destination where the finished file goes
+ * @return true if the file was downloaded and its hash matched the manifest
+ */
+bool UpdateDownloader::download(const Manifest& manifest, const string& destination) {
+	TraceScope trace("Download update", "network");
+
+	beginProgress(manifest.size, 0, 0);
+	bool downloaded = fetchFile("DLUpdate", manifest.size, manifest.sha256, manifest.chunkSize, manifest.chunks, destination);
+	endProgress();
+	return downloaded;
+}
+
+/**
+ * Download one file in chunks, carrying on from an earlier attempt if there is one.
+ * Progress adds to what beginProgress() started.
+ *
+ * @param command the command that asks for part of the file (the range is added to it)
+ * @param size size of the file
+ * @param sha256 hash the file must have
+ * @param chunkSize bytes asked for in each request
+ * @param chunkHashes hash of each chunk, or none if they can't be shared with other cabinets
+ * @param destination where the finished file goes
+ * @return true if the file was downloaded and its hash matched
+ */
+bool UpdateDownloader::fetchFile(const string& command, uint64_t size, const string& sha256, uint64_t chunkSize, const vector<string>& chunkHashes,
+	const string& destination) {
+	error_code error;
+	filesystem::create_directories(filesystem::path(destination).parent_path(), error);
+
+	string partPath = destination + ".part";
+	Sha256 hash;
+	uint64_t writeOffset = prepareResume(size, sha256, partPath, hash);
+
+	FILE* file = fopen(partPath.c_str(), writeOffset > 0 ? "r+b" : "wb");
+	if (file == NULL) {
+		logger.logError("Could not create ", partPath);
+		return false;
+	}
+	// Chunks are written whole, so the file doesn't need a buffer of its own
+	setvbuf(file, NULL, _IONBF, 0);
+	fseek(file, 0, SEEK_END);
+
+	this->resumedFrom += writeOffset;
+	this->received += writeOffset;
+
+	if (writeOffset > 0) {
+		logger.log("Resuming the download of ", destination, " at ", to_string(writeOffset), " of ", to_string(size), " bytes.");
+	}
+
+	// Whole chunks kept from an earlier attempt can be shared straight away
+	for (size_t i = 0; i < chunkHashes.size() && (i + 1) * chunkSize <= writeOffset; i++) {
+		peerExchange.addChunk(chunkHashes[i], partPath, i * chunkSize, chunkSize);
+	}
+
+	// Chunks still on the way from a call that stopped early are told apart from this call's
+	this->generation++;
+
+	// Chunks that arrived ahead of the one to write next
+	map<uint64_t, shared_ptr<Chunk>> ready;
+	uint64_t nextOffset = writeOffset;
+	int inFlight = 0;
+	int failures = 0;
+	bool giveUp = false;
+	bool writeFailed = false;
+
+	chrono::steady_clock::time_point lastSample = chrono::steady_clock::now();
+	uint64_t lastSampleBytes = this->received;
+
+	while (inFlight > 0 || (!giveUp && writeOffset < size)) {
+		// Stop at once when told to, the chunks still on the way are dropped when they arrive
+		if (!throttle(0)) {
+			logger.log("Stopped the download of ", destination, ", it will resume from here next time");
+			giveUp = true;
+			break;
+		}
+
+		// Keep a few chunks on the way so one slow connection doesn't stall the download
+		while (!giveUp && inFlight < UPDATE_PARALLEL_CHUNKS && nextOffset < size) {
+			shared_ptr<Chunk> chunk = make_shared<Chunk>();
+			chunk->offset = nextOffset;
+			chunk->length = min(chunkSize - nextOffset % chunkSize, size - nextOffset);
+			chunk->complete = false;
+			chunk->fromPeer = false;
+			chunk->peerOwns = false;
+			chunk->peerUnreachable = false;
+			chunk->peersTried = false;
+			chunk->generation = this->generation;
+
+			// Only whole chunks have a hash (a resumed download can start part way into one)
+			if (!chunkHashes.empty() && nextOffset % chunkSize == 0) {
+				chunk->sha256 = chunkHashes[(size_t)(nextOffset / chunkSize)];
+			}
+			chunk->data.reserve((size_t)chunk->length);
+			requestChunk(command, chunk);
+
+			nextOffset += chunk->length;
+			inFlight++;
+		}
+
+		shared_ptr<Chunk> chunk;
+		{
+			unique_lock<mutex> lock(this->finishedLock);
+			this->finishedSignal.wait_for(lock, SPEED_SAMPLE_INTERVAL, [this]() { return !this->finished.empty(); });
+			if (!this->finished.empty()) {
+				chunk = this->finished.front();
+				this->finished.pop_front();
+			}
+		}
+
+		// Measure the speed over the last interval, smoothed so the screen doesn't flicker
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (now - lastSample >= SPEED_SAMPLE_INTERVAL) {
+			double seconds = chrono::duration<double>(now - lastSample).count();
+			double speed = (double)(this->received - lastSampleBytes) / seconds;
+			this->bytesPerSecond = this->bytesPerSecond == 0.0 ? speed : this->bytesPerSecond * 0.7 + speed * 0.3;
+			lastSample = now;
+			lastSampleBytes = this->received;
+		}
+
+		if (!chunk) {
+			continue;
+		}
+
+		// Left over from an earlier call that stopped while it was on the way
+		if (chunk->generation != this->generation) {
+			continue;
+		}
+
+		// A damaged chunk is caught here rather than after the whole file
+		if (chunk->complete && !chunk->sha256.empty() && hashChunk(chunk->data) != chunk->sha256) {
+			if (chunk->fromPeer) {
+				peerExchange.distrust(chunk->peer);
+			}
+			chunk->complete = false;
+			chunk->error = "chunk failed its checksum";
+			this->received -= chunk->data.size();
+			chunk->data.clear();
+		}
+
+		// Whatever another cabinet couldn't give is asked of the game server instead
+		if (!chunk->complete && chunk->fromPeer) {
+			if (chunk->peerUnreachable) {
+				peerExchange.forget(chunk->peer);
+			}
+			if (chunk->peerOwns) {
+				logger.logError("Chunk of ", destination, " at ", to_string(chunk->offset), " didn't come from the other cabinet (", chunk->error, "), asking the server");
+			}
+			this->received -= chunk->data.size();
+			chunk->data.clear();
+			chunk->error.clear();
+			chunk->fromPeer = false;
+			chunk->peersTried = true;
+			requestChunk(command, chunk);
+			continue;
+		}
+
+		if (!chunk->complete) {
+			failures++;
+			if (giveUp || failures > UPDATE_MAX_FAILURES) {
+				if (!giveUp) {
+					logger.logError("Giving up on the download of ", destination, " (", chunk->error, "), it will resume from here next time");
+				}
+				giveUp = true;
+				inFlight--;
+				continue;
+			}
+
+			// Ask again for only the part of the chunk that is still missing
+			int backoffMs = min(CHUNK_BACKOFF_START_MS << min(failures - 1, 5), CHUNK_BACKOFF_MAX_MS);
+			logger.logError("Chunk of ", destination, " at ", to_string(chunk->offset + chunk->data.size()), " failed (", chunk->error, "), retrying in ", to_string(backoffMs), " ms");
+			this_thread::sleep_for(chrono::milliseconds(backoffMs));
+			requestChunk(command, chunk);
+			continue;
+		}
+
+		failures = 0;
+		inFlight--;
+		ready[chunk->offset] = chunk;
+		if (chunk->fromPeer) {
+			this->fromPeers += chunk->data.size();
+		}
+
+		// Write every chunk that now follows on from the file, in one write each
+		while (!ready.empty() && ready.begin()->first == writeOffset && !writeFailed) {
+			shared_ptr<Chunk> next = ready.begin()->second;
+			ready.erase(ready.begin());
+
+			if (fwrite(next->data.data(), 1, next->data.size(), file) != next->data.size() || fflush(file) != 0) {
+				logger.logError("Could not write the update to ", partPath);
+				writeFailed = true;
+				giveUp = true;
+				break;
+			}
+			hash.update(next->data.data(), next->data.size());
+			if (!next->sha256.empty()) {
+				peerExchange.addChunk(next->sha256, partPath, writeOffset, next->length);
+			}
+			if (this->dataListener) {
+				this->dataListener(writeOffset, (const uint8_t*)next->data.data(), next->data.size());
+			}
+			writeOffset += next->length;
+
+			if (!throttle(next->data.size())) {
+				break;
+			}
+		}
+	}
+
+	bool closed = fclose(file) == 0;
+
+	if (writeFailed || !closed || writeOffset < size) {
+		return false;
+	}
+
+	// Only a file that matches the signed manifest is kept
+	string digest = hash.finishHex();
+	if (digest != sha256) {
+		logger.logError(destination, " failed its checksum (got ", digest, ", expected ", sha256, "), discarding it");
+		peerExchange.removeFile(partPath);
+		filesystem::remove(partPath, error);
+		filesystem::remove(partPath + ".json", error);
+		return false;
+	}
+
+	peerExchange.removeFile(destination);
+	filesystem::remove(destination, error);
+	filesystem::rename(partPath, destination, error);
+	if (error) {
+		logger.logError("Could not move the download to ", destination, ": ", error.message());
+		peerExchange.removeFile(partPath);
+		return false;
+	}
+	peerExchange.moveFile(partPath, destination);
+	filesystem::remove(partPath + ".json", error);
+
+	logger.log("Downloaded and verified ", destination, " (", to_string(size), " bytes, SHA-256 ", digest, ")");
+	return true;
+}
+
+/**
+ * Start counting progress for a new download.
+ *
+ * @param totalBytes bytes that will be downloaded (including any resumed parts)
+ * @param filesTotal files in the new version (delta updates)
+ * @param filesChanged files that have to be downloaded (delta updates)
+ */
+void UpdateDownloader::beginProgress(uint64_t totalBytes, size_t filesTotal, size_t filesChanged) {
+	this->total = totalBytes;
+	this->received = 0;
+	this->resumedFrom = 0;
+	this->fromPeers = 0;
+	this->bytesPerSecond = 0.0;
+	this->filesTotal = filesTotal;
+	this->filesChecked = 0;
+	this->filesChanged = filesChanged;
+	this->active = true;
+}
+
+/**
+ * Count the installed files compared with the manifest so far (delta updates).
+ *
+ * @param count files compared
+ */
+void UpdateDownloader::setFilesChecked(size_t count) {
+	this->filesChecked = count;
+}
+
+/**
+ * Stop counting progress.
+ *
+ */
+void UpdateDownloader::endProgress() {
+	this->active = false;
+}
+
+/**
+ * Gets how far the download has got.
+ *
+ * @return the progress
+ */
+UpdateDownloader::Progress UpdateDownloader::getProgress() {
+	Progress progress;
+	progress.active = this->active;
+	progress.received = this->received;
+	progress.total = this->total;
+	progress.resumedFrom = this->resumedFrom;
+	progress.fromPeers = this->fromPeers;
+	progress.bytesPerSecond = this->bytesPerSecond;
+	progress.filesTotal = this->filesTotal;
+	progress.filesChecked = this->filesChecked;
+	progress.filesChanged = this->filesChanged;
+	return progress;
+}
+
+/**
+ * Get the manifest from the server and check it was signed with the update key.
+ *
+ * @param manifest set to the manifest
+ * @return true if the manifest is genuine
+ */
+bool UpdateDownloader::fetchManifest(Manifest& manifest) {
+	NetRequest request;
+	request.protocol = NET_COMMAND;
+	request.url = this->serverAddress;
+	request.body = "UpdateManifest";
+	request.lengthPrefixed = true;
+	request.timeoutMs = 5000;
+	request.retries = 2;
+
+	NetResponse response = netClient.send(request).get();
+	if (!response.completed) {
+		logger.logError("Could not get the update manifest. (", response.error, ")");
+		return false;
+	}
+
+	try {
+		json reply = json::parse(response.body);
+		string text = reply["Manifest"];
+
+		vector<uint8_t> signature;
+		if (!fromHex(reply["Signature"].get<string>(), signature) || !verifySignature(text, signature)) {
+			logger.logError("Update manifest signature is not valid, refusing the update");
+			return false;
+		}
+
+		json fields = json::parse(text);
+		manifest.version = fields["Version"];
+		manifest.size = fields.value("Size", (uint64_t)0);
+		manifest.sha256 = fields.value("SHA256", "");
+		manifest.chunkSize = fields.value("ChunkSize", (uint64_t)UPDATE_CHUNK_SIZE);
+		manifest.chunks = fields.value("Chunks", vector<string>());
+		transform(manifest.sha256.begin(), manifest.sha256.end(), manifest.sha256.begin(), ::tolower);
+
+		manifest.files.clear();
+		if (fields.contains("Files")) {
+			for (const json& entry : fields["Files"]) {
+				ManifestFile file;
+				file.path = entry["Path"];
+				file.size = entry["Size"];
+				file.sha256 = entry["SHA256"];
+				file.chunks = entry.value("Chunks", vector<string>());
+				transform(file.sha256.begin(), file.sha256.end(), file.sha256.begin(), ::tolower);
+
+				if (!isSafePath(file.path) || file.sha256.size() != 64) {
+					logger.logError("Update manifest has a bad file entry: ", file.path);
+					return false;
+				}
+				manifest.files.push_back(file);
+			}
+		}
+	}
+	catch (const std::exception& e) {
+		logger.logError("Update manifest could not be read: ", e.what());
+		return false;
+	}
+
+	// There has to be a full update, a file list or both
+	bool hasFull = manifest.size > 0 && manifest.sha256.size() == 64;
+	if (manifest.chunkSize < MIN_CHUNK_SIZE || manifest.chunkSize > MAX_CHUNK_SIZE || (!hasFull && manifest.files.empty())
+		|| !isValidChunkList(manifest.chunks, manifest.size, manifest.chunkSize)) {
+		logger.logError("Update manifest is not valid");
+		return false;
+	}
+
+	for (size_t i = 0; i < manifest.files.size(); i++) {
+		ManifestFile& file = manifest.files[i];
+		if (!isValidChunkList(file.chunks, file.size, manifest.chunkSize)) {
+			logger.logError("Update manifest has bad chunk hashes for ", file.path);
+			return false;
+		}
+
+		// A file that fits in one chunk is its own chunk
+		if (file.chunks.empty() && file.size > 0 && file.size <= manifest.chunkSize) {
+			file.chunks.push_back(file.sha256);
+		}
+	}
+	return true;
+}
+
+/**
+ * Check the manifest was signed by the private half of the update key.
+ *
+ * @param text the manifest text
+ * @param signature RSA PKCS#1 v1.5 signature of the SHA-256 of the text
+ * @return true if the signature is valid
+ */
+bool UpdateDownloader::verifySignature(const string& text, const vector<uint8_t>& signature) {
+	// The key file has the modulus then the public exponent, each as a hex line
+	ifstream keyFile(this->keyPath);
+	string modulusHex, exponentHex;
+	vector<uint8_t> modulus, exponent;
+	if (!(keyFile >> modulusHex >> exponentHex) || !fromHex(modulusHex, modulus) || !fromHex(exponentHex, exponent)) {
+		logger.logError("Update signing key ", this->keyPath, " is missing or damaged");
+		return false;
+	}
+
+	Sha256 hash;
+	hash.update(text.data(), text.size());
+	uint8_t digest[32];
+	hash.finish(digest);
+
+	return verifyRsaSha256(modulus, exponent, digest, signature);
+}
+
+/**
+ * Work out how much of a file an earlier attempt already has. The part kept
+ * is hashed again so the hash carries on over the rest of the download.
+ *
+ * @param size size of the file
+ * @param sha256 hash the file must have
+ * @param partPath the partly downloaded file
+ * @param hash set to the hash of the part that is kept
+ * @return how many bytes are kept
+ */
+uint64_t UpdateDownloader::prepareResume(uint64_t size, const string& sha256, const string& partPath, Sha256& hash) {
+	hash.reset();
+
+	json expected;
+	expected["Size"] = size;
+	expected["SHA256"] = sha256;
+
+	// The part is only used if it belongs to this exact file
+	uint64_t kept = 0;
+	error_code error;
+	try {
+		ifstream in(partPath + ".json");
+		if (in.is_open() && json::parse(in) == expected && filesystem::exists(partPath, error)) {
+			kept = min((uint64_t)filesystem::file_size(partPath, error), size);
+			if (error) {
+				kept = 0;
+			}
+		}
+	}
+	catch (const std::exception&) {
+		kept = 0;
+	}
+
+	if (kept > 0) {
+		TraceScope trace("Hash partial update", "network");
+
+		ifstream part(partPath, ios::binary);
+		vector<char> buffer(RESUME_READ_SIZE);
+		uint64_t hashed = 0;
+		while (hashed < kept && part) {
+			part.read(buffer.data(), (streamsize)min((uint64_t)buffer.size(), kept - hashed));
+			hash.update(buffer.data(), (size_t)part.gcount());
+			if (this->dataListener) {
+				this->dataListener(hashed, (const uint8_t*)buffer.data(), (size_t)part.gcount());
+			}
+			hashed += (uint64_t)part.gcount();
+		}
+
+		if (hashed == kept) {
+			// Drop anything past the kept part, such as a write cut short
+			filesystem::resize_file(partPath, kept, error);
+			if (!error) {
+				return kept;
+			}
+		}
+		hash.reset();
+	}
+
+	// Start over, noting which file the new part belongs to
+	filesystem::remove(partPath, error);
+	ofstream out(partPath + ".json", ios::out | ios::trunc);
+	out << expected.dump();
+	return 0;
+}
+
+/**
+ * Ask for the rest of a chunk. A whole chunk with a hash is read from this cabinet's
+ * store or asked of the cabinet that owns it, anything else comes from the server.
+ * The answer goes onto the finished queue.
+ *
+ * @param command the command that asks for part of the file
+ * @param chunk the chunk
+ */
+void UpdateDownloader::requestChunk(const string& command, shared_ptr<Chunk> chunk) {
+	uint64_t from = chunk->offset + chunk->data.size();
+	uint64_t count = chunk->length - chunk->data.size();
+	string serverCommand = command + " " + to_string(from) + " " + to_string(count);
+
+	NetRequest request;
+	request.protocol = NET_COMMAND;
+	request.url = this->serverAddress;
+	request.body = serverCommand;
+	request.lengthPrefixed = true;
+	request.timeoutMs = 15000;
+	request.retries = 2;
+
+	// A chunk with a hash may already be here or at another cabinet, and is fetched from the server once for all of them
+	if (!chunk->sha256.empty() && chunk->data.empty()) {
+		if (peerExchange.readChunk(chunk->sha256, chunk->length, chunk->data)) {
+			chunk->complete = true;
+			this->received += chunk->data.size();
+			{
+				lock_guard<mutex> lock(this->finishedLock);
+				this->finished.push_back(chunk);
+			}
+			this->finishedSignal.notify_all();
+			return;
+		}
+
+		string peer;
+		bool owner = false;
+		if (!chunk->peersTried && peerExchange.findSource(chunk->sha256, peer, owner)) {
+			// The owner fetches the chunk first if it has to, anyone else only answers if they have it
+			chunk->fromPeer = true;
+			chunk->peerOwns = owner;
+			chunk->peer = peer;
+			request.url = peer;
+			request.body = "PeerChunk " + chunk->sha256 + " " + to_string(chunk->length) + " " + (owner ? serverCommand : "-") + "\n";
+			request.timeoutMs = owner ? 30000 : 5000;
+			request.retries = 0;
+		}
+		else if (peerExchange.fetch(chunk->sha256, chunk->length, serverCommand, [this, chunk](bool ok, const string& data) {
+			// Fetched once for this cabinet and any other asking for it at the same time
+			chunk->complete = ok;
+			if (ok) {
+				chunk->data = data;
+				this->received += data.size();
+			}
+			else {
+				chunk->error = "no reply from the server";
+			}
+
+			{
+				lock_guard<mutex> lock(this->finishedLock);
+				this->finished.push_back(chunk);
+			}
+			this->finishedSignal.notify_all();
+		})) {
+			return;
+		}
+	}
+
+	// Bytes go straight into the chunk, so whatever arrived before a disconnect is kept
+	atomic<uint64_t>* receivedBytes = &this->received;
+	request.sink = [chunk, receivedBytes](const char* data, size_t length) {
+		if (chunk->data.size() + length > chunk->length) {
+			return false;
+		}
+		chunk->data.append(data, length);
+		*receivedBytes += length;
+		return true;
+	};
+
+	netClient.send(request, [this, chunk](NetResponse& response) {
+		chunk->complete = response.completed && chunk->data.size() == chunk->length;
+		if (!chunk->complete) {
+			chunk->error = response.error.empty() ? "short reply" : response.error;
+		}
+		chunk->peerUnreachable = chunk->fromPeer && !response.completed;
+
+		{
+			lock_guard<mutex> lock(this->finishedLock);
+			this->finished.push_back(chunk);
+		}
+		this->finishedSignal.notify_all();
+	});
+}
@@ -0,0 +1,150 @@
+/**
+ * @file UpdateDownloader.h
+ *
+ * @brief Update Downloader
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Checksum.h"
+
+// Size of a chunk when the manifest doesn't give one
+#define UPDATE_CHUNK_SIZE (4 * 1024 * 1024)
+
+// Chunks requested from the server at the same time
+#define UPDATE_PARALLEL_CHUNKS 3
+
+// Failed chunk requests in a row before the download is given up (the partial file is kept)
+#define UPDATE_MAX_FAILURES 8
+
+/**
+ * Downloads an update from the game server in chunks over several connections.
+ * A broken download carries on from where it stopped, even after a restart, and
+ * a file is only kept once its SHA-256 matches the signed manifest.
+ *
+ * When the manifest gives the SHA-256 of each chunk, chunks are also shared with
+ * the other cabinets of the venue through the PeerExchange, and each chunk is
+ * checked as soon as it arrives.
+ *
+ * Commands (each reply is a 4 byte big-endian length then that many bytes):
+ *   UpdateManifest                   {"Manifest":"<JSON text>","Signature":"<hex>"}, the signature
+ *                                    is RSA PKCS#1 v1.5 with SHA-256 over the manifest text, which holds
+ *                                    {"Version","Size","SHA256","ChunkSize","Chunks","Files"}, where
+ *                                    the optional Chunks (also on each file) is the SHA-256 of every chunk
+ *   DLUpdate <offset> <n>            n bytes of the full update starting at offset
+ *   DLObject <sha256> <offset> <n>   n bytes of the file with that content hash (for delta updates)
+ */
+class UpdateDownloader {
+
+	public:
+		/**
+		 * A file of the new version, for delta updates
+		 */
+		struct ManifestFile {
+			string path;		// Relative to the version folder, with / between folders
+			uint64_t size;
+			string sha256;
+			vector<string> chunks;	// SHA-256 of each chunk, empty if not given
+		};
+
+		/**
+		 * What the server says the update is
+		 */
+		struct Manifest {
+			string version;
+			uint64_t size;		// The full update (0 if the server only offers delta updates)
+			string sha256;
+			uint64_t chunkSize;
+			vector<string> chunks;	// SHA-256 of each chunk of the full update, empty if not given
+			vector<ManifestFile> files;
+		};
+
+		/**
+		 * How far the download has got, for the UPDATES screen
+		 */
+		struct Progress {
+			bool active;
+			uint64_t received;		// Bytes on disk or in memory so far, counting resumed parts
+			uint64_t total;
+			uint64_t resumedFrom;	// Bytes kept from an earlier attempt
+			uint64_t fromPeers;		// Bytes that came from other cabinets instead of the server
+			double bytesPerSecond;
+			size_t filesTotal;		// Delta updates only: files in the new version
+			size_t filesChecked;	// Delta updates only: installed files compared so far
+			size_t filesChanged;	// Delta updates only: files that had to be downloaded
+		};
+
+	private:
+		/**
+		 * A range of the file being downloaded
+		 */
+		struct Chunk {
+			uint64_t offset;
+			uint64_t length;
+			string sha256;			// Empty if the manifest doesn't give chunk hashes
+			string data;
+			bool complete;
+			bool fromPeer;			// Asked of another cabinet
+			string peer;			// host:port of that cabinet
+			bool peerUnreachable;	// That cabinet didn't answer at all
+			bool peerOwns;			// That cabinet owns the chunk, rather than maybe having it
+			bool peersTried;		// Not asked of other cabinets again
+			string error;
+			uint32_t generation;	// The fetchFile() call that asked for it
+		};
+
+		string serverAddress;
+		string keyPath;
+		function<void(uint64_t, const uint8_t*, size_t)> dataListener;
+		function<bool(size_t)> throttleHook;
+
+		mutex finishedLock;
+		condition_variable finishedSignal;
+		deque<shared_ptr<Chunk>> finished;
+		uint32_t generation;
+
+		atomic<bool> active;
+		atomic<uint64_t> received;
+		atomic<uint64_t> total;
+		atomic<uint64_t> resumedFrom;
+		atomic<uint64_t> fromPeers;
+		atomic<double> bytesPerSecond;
+		atomic<size_t> filesTotal;
+		atomic<size_t> filesChecked;
+		atomic<size_t> filesChanged;
+
+		bool verifySignature(const string& text, const vector<uint8_t>& signature);
+		uint64_t prepareResume(uint64_t size, const string& sha256, const string& partPath, Sha256& hash);
+		void requestChunk(const string& command, shared_ptr<Chunk> chunk);
+
+	public:
+		UpdateDownloader();
+		~UpdateDownloader();
+
+		void setServer(string address);
+		void setKeyPath(string path);
+		void setDataListener(function<void(uint64_t offset, const uint8_t* data, size_t size)> listener);
+		void setThrottle(function<bool(size_t bytes)> throttle);
+		bool throttle(size_t bytes);
+
+		bool fetchManifest(Manifest& manifest);
+		bool fetchFile(const string& command, uint64_t size, const string& sha256, uint64_t chunkSize, const vector<string>& chunkHashes,
+			const string& destination);
+		bool download(const Manifest& manifest, const string& destination);
+
+		void beginProgress(uint64_t totalBytes, size_t filesTotal, size_t filesChanged);
+		void setFilesChecked(size_t count);
+		void endProgress();
+		Progress getProgress();
+};
@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+
+// Keep std::min usable
+#define NOMINMAX
+#include <windows.h>
+
+#include "GameState.h"
+#include "Logger.h"
+#include "Networking.h"
+#include "PeerExchange.h"
+#include "StartupTasks.h"
+#include "Tracer.h"
+#include "UpdateService.h"
+
+UpdateService updateService;
+
+// Remembers a version that was staged but not switched to yet, across restarts
+const char STAGED_FILE[] = "C:/SNA_UPDATE/staged.txt";
+
+// Where each version of the game is installed (C:/<version>)
+const char VERSION_FOLDER[] = "C:/";
+
+// How often a wait checks if the game is shutting down
+const chrono::milliseconds SERVICE_POLL_INTERVAL(100);
+
+// Longest sleep while throttled, so the end of a song is noticed quickly
+const chrono::milliseconds THROTTLE_SLEEP_MAX(50);
+
+/**
+ * Default constructor.
+ *
+ */
+UpdateService::UpdateService() {
+	this->running = false;
+	this->stopping = false;
+	this->wakeRequested = false;
+	this->status = Status::IDLE;
+	this->throttleUntil = chrono::steady_clock::now();
+	this->idleSince = chrono::steady_clock::now();
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+UpdateService::~UpdateService() {
+	stop();
+}
+
+/**
+ * Pick up a version staged by an earlier run and start checking for new ones.
+ *
+ */
+void UpdateService::start() {
+	if (this->running.exchange(true)) {
+		return;
+	}
+	loadStaged();
+
+	// Everything the update does is slowed down during songs and stopped on shutdown
+	network.runUpdatesInBackground([this](size_t bytes) {
+		return throttle(bytes);
+	});
+	peerExchange.start();
+	this->serviceThread = thread(&UpdateService::run, this);
+}
+
+/**
+ * Stop the service, giving up on whatever it was doing. A download carries on
+ * from where it stopped the next time.
+ *
+ */
+void UpdateService::stop() {
+	{
+		lock_guard<mutex> lock(this->serviceLock);
+		this->running = false;
+		this->stopping = true;
+	}
+	this->serviceSignal.notify_all();
+
+	if (this->serviceThread.joinable()) {
+		this->serviceThread.join();
+	}
+	peerExchange.stop();
+}
+
+/**
+ * Check for a new version now instead of waiting for the next check.
+ *
+ */
+void UpdateService::wake() {
+	{
+		lock_guard<mutex> lock(this->serviceLock);
+		this->wakeRequested = true;
+	}
+	this->serviceSignal.notify_all();
+}
+
+/**
+ * Check for new versions and stage them, until stopped.
+ *
+ */
+void UpdateService::run() {
+	tracer.setThreadName("Update");
+
+	// Lowers the CPU, disk and memory priority of everything done on this thread
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+	// The old version's leftovers in the update folder are cleaned up first
+	startupTasks.waitFor("Old version cleanup");
+
+	chrono::steady_clock::time_point nextCheck = chrono::steady_clock::now() + chrono::milliseconds(UPDATE_CHECK_INTERVAL_MS);
+	while (this->running) {
+		{
+			unique_lock<mutex> lock(this->serviceLock);
+			this->serviceSignal.wait_until(lock, nextCheck, [this]() { return !this->running || this->wakeRequested; });
+			if (!this->running) {
+				break;
+			}
+			this->wakeRequested = false;
+		}
+		nextCheck = chrono::steady_clock::now() + chrono::milliseconds(UPDATE_CHECK_INTERVAL_MS);
+
+		this->status = Status::CHECKING;
+		string version = checkVersion();
+		string staged = getStagedVersion();
+		if (version.empty() || version == network.getLocalVersion() || version == staged) {
+			this->status = staged.empty() ? Status::IDLE : Status::STAGED;
+			continue;
+		}
+
+		logger.log("Version ", version, " is available, staging it in the background");
+		this->status = Status::STAGING;
+		if (stage(version)) {
+			this->status = Status::STAGED;
+		}
+		else {
+			this->status = Status::FAILED;
+			nextCheck = chrono::steady_clock::now() + chrono::milliseconds(UPDATE_RETRY_INTERVAL_MS);
+		}
+	}
+}
+
+/**
+ * Ask the server which version it has, without holding up shutdown.
+ *
+ * @return the version, or an empty string if the server couldn't be reached
+ */
+string UpdateService::checkVersion() {
+	// The answer may come after this has stopped waiting
+	shared_ptr<promise<string>> answer = make_shared<promise<string>>();
+	future<string> result = answer->get_future();
+	network.checkForUpdates([answer](string version) {
+		answer->set_value(version);
+	});
+
+	while (this->running && result.wait_for(SERVICE_POLL_INTERVAL) != future_status::ready) {}
+	if (!this->running) {
+		return "";
+	}
+
+	string version = result.get();
+	return version == "NONE" ? "" : version;
+}
+
+/**
+ * Download a version and put its folder in place next to the running one.
+ *
+ * @param version the version
+ * @return true if it is ready to be switched to
+ */
+bool UpdateService::stage(string version) {
+	lock_guard<mutex> lock(this->stagingLock);
+	TraceScope trace("Stage update", "network");
+
+	UPDATE_RESULT result = network.downloadUpdate(version);
+	if (result == UPDATE_FULL && !network.extractUpdate()) {
+		result = UPDATE_FAILED;
+	}
+	if (result == UPDATE_FAILED) {
+		if (this->stopping) {
+			logger.log("Stopped staging version ", version, " for shutdown");
+		}
+		else {
+			logger.logError("Could not stage version ", version, ", trying again later");
+		}
+		return false;
+	}
+
+	saveStaged(version);
+	logger.log("Version ", version, " is staged and will be switched to when the cabinet is idle");
+	return true;
+}
+
+/**
+ * Read which version an earlier run staged, if it is still there.
+ *
+ */
+void UpdateService::loadStaged() {
+	string version;
+	ifstream in(STAGED_FILE);
+	in >> version;
+	in.close();
+
+	error_code error;
+	if (version.empty() || version == network.getLocalVersion() || !filesystem::is_directory(VERSION_FOLDER + version, error)) {
+		filesystem::remove(STAGED_FILE, error);
+		return;
+	}
+
+	lock_guard<mutex> lock(this->serviceLock);
+	this->stagedVersion = version;
+	this->status = Status::STAGED;
+	logger.log("Version ", version, " was staged by an earlier run");
+}
+
+/**
+ * Remember a staged version, on disk too so a restart doesn't stage it again.
+ *
+ * @param version the version
+ */
+void UpdateService::saveStaged(string version) {
+	{
+		ofstream out(STAGED_FILE, ios::out | ios::trunc);
+		out << version;
+	}
+
+	lock_guard<mutex> lock(this->serviceLock);
+	this->stagedVersion = version;
+}
+
+/**
+ * Called by update work for each block it reads, writes or downloads. During a song
+ * it sleeps long enough to keep update work to UPDATE_GAME_BYTES_PER_SECOND, and
+ * otherwise returns straight away.
+ *
+ * @param bytes size of the block (0 only checks if the work should go on)
+ * @return false if the game is shutting down and the work should stop
+ */
+bool UpdateService::throttle(size_t bytes) {
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if (gameState.getGameState() != GameState::CurrentState::GAME) {
+		lock_guard<mutex> lock(this->throttleLock);
+		this->throttleUntil = now;
+		return !this->stopping;
+	}
+
+	// Each block pushes the time the next one may start further out
+	chrono::steady_clock::time_point until;
+	{
+		lock_guard<mutex> lock(this->throttleLock);
+		this->throttleUntil = max(this->throttleUntil, now)
+			+ chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>((double)bytes / UPDATE_GAME_BYTES_PER_SECOND));
+		until = this->throttleUntil;
+	}
+
+	while (!this->stopping && gameState.getGameState() == GameState::CurrentState::GAME) {
+		now = chrono::steady_clock::now();
+		if (now >= until) {
+			break;
+		}
+		this_thread::sleep_for(min(chrono::duration_cast<chrono::milliseconds>(until - now) + chrono::milliseconds(1), THROTTLE_SLEEP_MAX));
+	}
+	return !this->stopping;
+}
+
+/**
+ * Called every frame by the render thread. A staged version is switched to once the
+ * cabinet has been idle for UPDATE_IDLE_SECONDS in a row.
+ *
+ * @param idle whether nobody is playing right now (attract mode)
+ * @return true if it's time to switch to the staged version
+ */
+bool UpdateService::readyToActivate(bool idle) {
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if (!idle) {
+		this->idleSince = now;
+		return false;
+	}
+
+	// Not while a newer version is on its way
+	if (this->status == Status::STAGING || getStagedVersion().empty()) {
+		return false;
+	}
+	return now - this->idleSince >= chrono::seconds(UPDATE_IDLE_SECONDS);
+}
+
+/**
+ * Point the startup batch file at the staged version, so it runs from the next start.
+ *
+ * @return true if there was a staged version
+ */
+bool UpdateService::activate() {
+	string version = getStagedVersion();
+	if (version.empty()) {
+		return false;
+	}
+
+	ofstream startup("C:/Rhythm.bat", ios::out | ios::trunc);
+	startup << "start \"SNA\" /d C:\\" + version + "\\ \"Sonataria.exe\"";
+	startup.close();
+
+	// The new version removes this one when it starts
+	ofstream oldVersion("C:/old_version.txt", ios::out | ios::trunc);
+	oldVersion << network.getLocalVersion();
+	oldVersion.close();
+
+	error_code error;
+	filesystem::remove(STAGED_FILE, error);
+	{
+		lock_guard<mutex> lock(this->serviceLock);
+		this->stagedVersion.clear();
+	}
+	this->status = Status::IDLE;
+
+	logger.log("Startup switched to version ", version);
+	return true;
+}
+
+/**
+ * Gets what the service is doing.
+ *
+ * @return the status
+ */
+UpdateService::Status UpdateService::getStatus() {
+	return this->status;
+}
+
+/**
+ * Gets the version that is staged and waiting to be switched to.
+ *
+ * @return the version, or an empty string if there isn't one
+ */
+string UpdateService::getStagedVersion() {
+	lock_guard<mutex> lock(this->serviceLock);
+	return this->stagedVersion;
+}
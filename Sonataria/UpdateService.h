@@ -0,0 +1,83 @@
+/**
+ * @file UpdateService.h
+ *
+ * @brief Update Service
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+using namespace std;
+
+// Time between checks for a new version
+#define UPDATE_CHECK_INTERVAL_MS (15 * 60 * 1000)
+
+// Time before trying again after an update failed to stage
+#define UPDATE_RETRY_INTERVAL_MS (5 * 60 * 1000)
+
+// Bytes a second update work may move while a song is being played
+#define UPDATE_GAME_BYTES_PER_SECOND (2 * 1024 * 1024)
+
+// Time on the title screen with nobody playing before a staged update is switched to
+#define UPDATE_IDLE_SECONDS 120
+
+/**
+ * Downloads and stages new versions on a low priority background thread while the
+ * cabinet stays playable. Update work is slowed down during songs so it doesn't
+ * cost frames, and a staged version is only switched to once the cabinet has sat
+ * idle on the title screen, or when the game shuts down.
+ */
+class UpdateService {
+
+	public:
+		/**
+		 * What the service is doing, for the system information page
+		 */
+		enum class Status {
+			IDLE, CHECKING, STAGING, STAGED, FAILED
+		};
+
+	private:
+		thread serviceThread;
+		mutex serviceLock;
+		condition_variable serviceSignal;
+		atomic<bool> running;
+		atomic<bool> stopping;
+		bool wakeRequested;
+
+		atomic<Status> status;
+		mutex stagingLock;
+		string stagedVersion;
+
+		mutex throttleLock;
+		chrono::steady_clock::time_point throttleUntil;
+		chrono::steady_clock::time_point idleSince;
+
+		void run();
+		string checkVersion();
+		bool stage(string version);
+		void loadStaged();
+		void saveStaged(string version);
+
+	public:
+		UpdateService();
+		~UpdateService();
+
+		void start();
+		void stop();
+		void wake();
+
+		bool throttle(size_t bytes);
+		bool readyToActivate(bool idle);
+		bool activate();
+
+		Status getStatus();
+		string getStagedVersion();
+};
+
+extern UpdateService updateService;
@@ -0,0 +1,265 @@
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <vector>
+
+#include "Checksum.h"
+#include "Logger.h"
+#include "PeerExchange.h"
+#include "Tracer.h"
+#include "UpdateStager.h"
+
+using json = nlohmann::json;
+
+// Size of the reads when hashing an installed file
+const size_t HASH_READ_SIZE = 1024 * 1024;
+
+/**
+ * Default constructor.
+ *
+ */
+UpdateStager::UpdateStager() {
+	this->storeFolder = "C:/SNA_UPDATE";
+	this->indexLoaded = false;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+UpdateStager::~UpdateStager() {
+
+}
+
+/**
+ * Keep downloaded files and the hash index in another folder.
+ *
+ * @param path the folder
+ */
+void UpdateStager::setStoreFolder(string path) {
+	this->storeFolder = path;
+	this->index.clear();
+	this->indexLoaded = false;
+}
+
+/**
+ * Build the folder of the new version. It is put together under a temporary
+ * name and only renamed into place once every file is there.
+ *
+ * @param downloader downloads the changed files
+ * @param manifest the manifest of the new version
+ * @param currentFolder folder of the running version
+ * @param targetFolder where the new version goes
+ * @return true if the new version is ready
+ */
+bool UpdateStager::stage(UpdateDownloader& downloader, const UpdateDownloader::Manifest& manifest, const string& currentFolder, const string& targetFolder) {
+	TraceScope trace("Stage update", "network");
+	loadIndex();
+
+	string objectFolder = this->storeFolder + "/objects";
+	error_code error;
+	filesystem::create_directories(objectFolder, error);
+
+	// Where each file of the new version will come from
+	vector<string> sources(manifest.files.size());
+	set<string> needed;
+	uint64_t neededBytes = 0;
+	size_t reused = 0;
+
+	downloader.beginProgress(0, manifest.files.size(), 0);
+	for (size_t i = 0; i < manifest.files.size(); i++) {
+		if (!downloader.throttle(0)) {
+			saveIndex();
+			downloader.endProgress();
+			return false;
+		}
+
+		const UpdateDownloader::ManifestFile& file = manifest.files[i];
+		string object = objectFolder + "/" + file.sha256;
+		string installed = currentFolder + "/" + file.path;
+
+		// Downloads are only kept once verified, so a stored object can be used as is
+		if (filesystem::file_size(object, error) == file.size && !error) {
+			sources[i] = object;
+			peerExchange.addFile(object, file.size, manifest.chunkSize, file.chunks);
+		}
+		else if (hashInstalledFile(downloader, installed, file.size) == file.sha256) {
+			// Other cabinets can have the unchanged files too
+			sources[i] = installed;
+			peerExchange.addFile(installed, file.size, manifest.chunkSize, file.chunks);
+			reused++;
+		}
+		else {
+			sources[i] = object;
+			if (needed.insert(file.sha256).second) {
+				neededBytes += file.size;
+			}
+		}
+		downloader.setFilesChecked(i + 1);
+	}
+	saveIndex();
+
+	logger.log("Delta update: ", to_string(reused), " of ", to_string(manifest.files.size()), " files unchanged, downloading ",
+		to_string(needed.size()), " files (", to_string(neededBytes), " bytes)");
+
+	// Download what changed
+	downloader.beginProgress(neededBytes, manifest.files.size(), needed.size());
+	downloader.setFilesChecked(manifest.files.size());
+	bool downloaded = true;
+	for (size_t i = 0; i < manifest.files.size() && downloaded; i++) {
+		const UpdateDownloader::ManifestFile& file = manifest.files[i];
+		if (needed.erase(file.sha256) > 0) {
+			downloaded = downloader.fetchFile("DLObject " + file.sha256, file.size, file.sha256, manifest.chunkSize, file.chunks,
+				objectFolder + "/" + file.sha256);
+		}
+	}
+	downloader.endProgress();
+	if (!downloaded) {
+		return false;
+	}
+
+	// Put the new version together, then move it into place in one step
+	string stagingFolder = targetFolder + ".staging";
+	filesystem::remove_all(stagingFolder, error);
+	for (size_t i = 0; i < manifest.files.size(); i++) {
+		if (!placeFile(sources[i], stagingFolder + "/" + manifest.files[i].path)) {
+			logger.logError("Could not stage ", manifest.files[i].path, " for the update");
+			return false;
+		}
+	}
+
+	filesystem::remove_all(targetFolder, error);
+	filesystem::rename(stagingFolder, targetFolder, error);
+	if (error) {
+		logger.logError("Could not move the staged update to ", targetFolder, ": ", error.message());
+		return false;
+	}
+
+	logger.log("Update staged in ", targetFolder);
+	return true;
+}
+
+/**
+ * Read the hashes of installed files from the last update.
+ *
+ */
+void UpdateStager::loadIndex() {
+	if (this->indexLoaded) {
+		return;
+	}
+	this->indexLoaded = true;
+
+	try {
+		ifstream in(this->storeFolder + "/index.json");
+		if (!in.is_open()) {
+			return;
+		}
+
+		json entries = json::parse(in);
+		for (json::iterator it = entries.begin(); it != entries.end(); it++) {
+			IndexEntry entry;
+			entry.size = it.value()["Size"];
+			entry.writeTime = it.value()["Time"];
+			entry.sha256 = it.value()["SHA256"];
+			this->index[it.key()] = entry;
+		}
+	}
+	catch (const std::exception& e) {
+		// Every file is just hashed again
+		logger.logError("Update hash index could not be read: ", e.what());
+		this->index.clear();
+	}
+}
+
+/**
+ * Keep the hashes of installed files for the next update.
+ *
+ */
+void UpdateStager::saveIndex() {
+	json entries = json::object();
+	for (map<string, IndexEntry>::iterator it = this->index.begin(); it != this->index.end(); it++) {
+		entries[it->first]["Size"] = it->second.size;
+		entries[it->first]["Time"] = it->second.writeTime;
+		entries[it->first]["SHA256"] = it->second.sha256;
+	}
+
+	string path = this->storeFolder + "/index.json";
+	{
+		ofstream out(path + ".tmp", ios::out | ios::trunc);
+		out << entries.dump();
+	}
+
+	error_code error;
+	filesystem::rename(path + ".tmp", path, error);
+}
+
+/**
+ * Gets the hash of an installed file, reading it only if it changed since it was last hashed.
+ *
+ * @param downloader paces the reads
+ * @param path the file
+ * @param size the size the new version's file has (a file of another size is different anyway)
+ * @return the hash, or an empty string if the file is missing or a different size
+ */
+string UpdateStager::hashInstalledFile(UpdateDownloader& downloader, const string& path, uint64_t size) {
+	error_code error;
+	uint64_t actualSize = filesystem::file_size(path, error);
+	if (error || actualSize != size) {
+		return "";
+	}
+	int64_t writeTime = (int64_t)filesystem::last_write_time(path, error).time_since_epoch().count();
+	if (error) {
+		return "";
+	}
+
+	map<string, IndexEntry>::iterator it = this->index.find(path);
+	if (it != this->index.end() && it->second.size == actualSize && it->second.writeTime == writeTime) {
+		return it->second.sha256;
+	}
+
+	ifstream in(path, ios::binary);
+	vector<char> buffer(HASH_READ_SIZE);
+	Sha256 hash;
+	uint64_t hashed = 0;
+	while (in) {
+		in.read(buffer.data(), buffer.size());
+		hash.update(buffer.data(), (size_t)in.gcount());
+		hashed += (uint64_t)in.gcount();
+		if (!downloader.throttle((size_t)in.gcount())) {
+			return "";
+		}
+	}
+	if (hashed != actualSize) {
+		return "";
+	}
+
+	IndexEntry entry;
+	entry.size = actualSize;
+	entry.writeTime = writeTime;
+	entry.sha256 = hash.finishHex();
+	this->index[path] = entry;
+	return entry.sha256;
+}
+
+/**
+ * Put a file into the new version, as a hard link when possible so nothing is copied.
+ *
+ * @param source the file
+ * @param destination where it goes
+ * @return true if it is in place
+ */
+bool UpdateStager::placeFile(const string& source, const string& destination) {
+	error_code error;
+	filesystem::create_directories(filesystem::path(destination).parent_path(), error);
+
+	filesystem::create_hard_link(source, destination, error);
+	if (!error) {
+		return true;
+	}
+
+	// Another drive or a file system without links
+	error.clear();
+	filesystem::copy_file(source, destination, filesystem::copy_options::overwrite_existing, error);
+	return !error;
+}
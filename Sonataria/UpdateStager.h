@@ -0,0 +1,48 @@
+/**
+ * @file UpdateStager.h
+ *
+ * @brief Update Stager
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <map>
+#include <stdint.h>
+#include <string>
+using namespace std;
+
+#include "UpdateDownloader.h"
+
+/**
+ * Builds the folder of a new version from the manifest's file list. Files that
+ * are the same as in the running version are linked across, and only changed
+ * files are downloaded into a store named by their content hash.
+ */
+class UpdateStager {
+
+	private:
+		/**
+		 * The hash of an installed file, reused while the file is unchanged
+		 */
+		struct IndexEntry {
+			uint64_t size;
+			int64_t writeTime;
+			string sha256;
+		};
+
+		string storeFolder;
+		map<string, IndexEntry> index;
+		bool indexLoaded;
+
+		void loadIndex();
+		void saveIndex();
+		string hashInstalledFile(UpdateDownloader& downloader, const string& path, uint64_t size);
+		bool placeFile(const string& source, const string& destination);
+
+	public:
+		UpdateStager();
+		~UpdateStager();
+
+		void setStoreFolder(string path);
+		bool stage(UpdateDownloader& downloader, const UpdateDownloader::Manifest& manifest, const string& currentFolder, const string& targetFolder);
+};
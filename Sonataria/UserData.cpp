@@ -32,7 +32,9 @@ UserData::~UserData() {
 void UserData::setUserData(string data) {
 	logger.log(data);
 
+	// Parse before locking, a bad profile throws and leaves the old data alone
 	json j = json::parse(data);
+	lock_guard<mutex> lock(this->dataLock);
 
 	// Check to see if new user
 	this->NewUser = j["NewUser"];
@@ -75,6 +77,8 @@ void UserData::setUserData(string data) {
  * 
  */
 void UserData::clearData() {
+	lock_guard<mutex> lock(this->dataLock);
+
 	// Profile Information
 	this->DisplayName = "GUEST";
 	this->CardNumber = "";
@@ -97,29 +101,41 @@ void UserData::clearData() {
  * @return 
  */
 bool UserData::isNewUser() {
+	lock_guard<mutex> lock(this->dataLock);
 	return this->NewUser;
 }
 
 string UserData::getDisplayName() {
+	lock_guard<mutex> lock(this->dataLock);
 	return this->DisplayName;
 }
 
 bool UserData::useCustomSpeed() {
+	lock_guard<mutex> lock(this->dataLock);
 	return this->UseCustomSpeed;
 }
 
 int UserData::getGameSpeed() {
+	lock_guard<mutex> lock(this->dataLock);
 	return this->Speed;
 }
 
 string UserData::getTitle() {
+	lock_guard<mutex> lock(this->dataLock);
 	return this->Title;
 }
 
 int UserData::getLevel() {
+	lock_guard<mutex> lock(this->dataLock);
 	return this->Level;
 }
 
+string UserData::getCardNumber() {
+	lock_guard<mutex> lock(this->dataLock);
+	return this->CardNumber;
+}
+
 int UserData::getPlayCount() {
+	lock_guard<mutex> lock(this->dataLock);
 	return this->PlayCount;
 }
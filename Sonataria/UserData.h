@@ -1,3 +1,4 @@
+#include <mutex>
 #include <string>
 #pragma once
 using namespace std;
@@ -15,6 +16,7 @@ class UserData {
 		
 		bool isNewUser();
 		string getDisplayName();
+		string getCardNumber();
 		string getTitle();
 		int getLevel();
 		int getPlayCount();
@@ -37,6 +39,9 @@ class UserData {
 
 		// Validity
 		bool NewUser;
+
+		// Profiles can be refreshed from the network thread while the screen is drawn
+		mutex dataLock;
 };
 
 extern UserData userData;
\ No newline at end of file
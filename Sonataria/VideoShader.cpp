@@ -3,7 +3,7 @@
 #include "resource.h"
 #include "OpenGLSprite.h"
 
-VideoShader::VideoShader() : OpenGLShader(IDR_VIDEO_VERTEX_SHADER, IDR_VIDEO_FRAGMENT_SHADER) {
+VideoShader::VideoShader() : OpenGLShader(IDR_VIDEO_VERTEX_SHADER, IDR_VIDEO_FRAGMENT_SHADER, "videoVertex.shader", "videoFragment.shader") {
 	textureLoc[0] = 0;
 	textureLoc[1] = 0;
 	textureLoc[2] = 0;
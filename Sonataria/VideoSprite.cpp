@@ -3,19 +3,25 @@
 #include <string>
 #include "Logger.h"
 #include "AVDecode.h"
+#include "TextureLoader.h"
 using namespace std;
 
 VideoSprite::VideoSprite(const std::wstring& newName, bool enableLoop) : QuadSprite(newName)
 {
 	myDecoder = new AVDecode();
+    textures[0] = textures[1] = textures[2] = 0;
 	videoDone = true; // Until the video is loaded, say it is done
     this->enableLoop = enableLoop;
-    loopOffset = startOffset = 0.0f;
+    positionOffset = startOffset = 0.0f;
+    curFrameTimestampSec = 0.0;
 }
 
 VideoSprite::~VideoSprite()
 {
     delete myDecoder;
+    for (int i = 0; i < 3; i++) {
+        TextureLoader::Inst()->ForgetTexture(textures[i]);
+    }
     glDeleteTextures(3, textures);
 }
 
@@ -27,6 +33,28 @@ void VideoSprite::setStartTimeInSeconds(double startTime)
 void VideoSprite::enableLooping(bool newEnableLoop)
 {
     enableLoop = newEnableLoop;
+    myDecoder->setLooping(enableLoop);
+}
+
+bool VideoSprite::seek(double videoTimeSec, double elapsedTimeSec)
+{
+    if (videoDone || myDecoder->seek(videoTimeSec) < 0) {
+        return false;
+    }
+
+    // Map the caller's current clock to the new position in the video
+    positionOffset = videoTimeSec - (elapsedTimeSec - startOffset);
+    curFrameTimestampSec = videoTimeSec;
+    return true;
+}
+
+void VideoSprite::resumeClock(double elapsedTimeSec)
+{
+    // Carry on from the frame on screen rather than catching up on the time the video was hidden
+    // (the decoder waits on its full queue meanwhile, so the next frames are already there)
+    if (!videoDone) {
+        positionOffset = curFrameTimestampSec - (elapsedTimeSec - startOffset);
+    }
 }
 
 bool VideoSprite::loadVideo(const char* videoFilename)
@@ -44,17 +72,17 @@ bool VideoSprite::loadVideo(const char* videoFilename)
 
     // Generate the textures in OpenGL state only
     glGenTextures(3, textures);
-    glBindTexture(GL_TEXTURE_2D, textures[0]);
+    TextureLoader::Inst()->BindTextureUnit(0, textures[0]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glBindTexture(GL_TEXTURE_2D, textures[1]);
+    TextureLoader::Inst()->BindTextureUnit(1, textures[1]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width / 2, height / 2, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glBindTexture(GL_TEXTURE_2D, textures[2]);
+    TextureLoader::Inst()->BindTextureUnit(2, textures[2]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width / 2, height / 2, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -62,53 +90,51 @@ bool VideoSprite::loadVideo(const char* videoFilename)
     // Update the decoder textures
     myDecoder->setTextureIDs(this->textures[0], this->textures[1], this->textures[2]);
 
+    // Start filling the frame queue ahead of playback
+    myDecoder->setLooping(enableLoop);
+    myDecoder->startDecoding();
+
     // Return success
 	return true;
 }
 
 void VideoSprite::update(double elapsedTimeSec)
 {
-    if (!videoDone && (elapsedTimeSec - loopOffset) >= curFrameTimestampSec + startOffset) {
-        // Skip a frame after rewinding to avoid timestamp issue
-        if (curFrameTimestampSec <= 0) { myDecoder->decodeFrame(); }
-
-        // Decode next frame
-    	if ((curFrameTimestampSec = myDecoder->decodeFrame()) < 0) {
-            if (enableLoop)
-            {
-	            myDecoder->rewind();
-                loopOffset = elapsedTimeSec;
-            }
-            else
-            {
-	            myDecoder->closeDecoder();
-	            videoDone = true;
-            }
-        }
+    // Position in the video the clock is currently asking for
+    double videoClockSec = elapsedTimeSec - startOffset + positionOffset;
+    if (videoDone || videoClockSec < 0) {
+        return;
+    }
+
+    // Present whichever queued frame is due (decoding and looping happen on the decoder's thread)
+    if ((curFrameTimestampSec = myDecoder->presentFrame(videoClockSec)) < 0) {
+        myDecoder->closeDecoder();
+        videoDone = true;
     }
 }
 
-void VideoSprite::render(PROJECTION projType) const
+int VideoSprite::getPresentedFrameCount() const
+{
+    return myDecoder->getPresentedFrameCount();
+}
+
+int VideoSprite::getDroppedFrameCount() const
 {
-    // Bind the three texture planes to the first three texture targets
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textures[0]);
+    return myDecoder->getDroppedFrameCount();
+}
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, textures[1]);
+int VideoSprite::getRepeatedFrameCount() const
+{
+    return myDecoder->getRepeatedFrameCount();
+}
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, textures[2]);
+void VideoSprite::render(PROJECTION projType) const
+{
+    // Bind the three texture planes to the first three texture units (skipped if already bound)
+    TextureLoader::Inst()->BindTextureUnit(0, textures[0]);
+    TextureLoader::Inst()->BindTextureUnit(1, textures[1]);
+    TextureLoader::Inst()->BindTextureUnit(2, textures[2]);
 
     // Render the underlying quad
     QuadSprite::render(projType);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, 0);
 }
@@ -11,10 +11,16 @@ public:
 
 	void setStartTimeInSeconds(double startTime);
 	void enableLooping(bool newEnableLoop);
+	bool seek(double videoTimeSec, double elapsedTimeSec);
+	void resumeClock(double elapsedTimeSec);
 	bool loadVideo(const char* videoFilename);
 	void update(double elapsedTimeSec);
 	virtual void render(PROJECTION projType) const;
 
+	int getPresentedFrameCount() const;
+	int getDroppedFrameCount() const;
+	int getRepeatedFrameCount() const;
+
 protected:
 	// The video decoder object
 	AVDecode* myDecoder;
@@ -22,7 +28,7 @@ protected:
 	// Playback state
 	bool videoDone, enableLoop;
 	double curFrameTimestampSec;
-	double loopOffset, startOffset;
+	double positionOffset, startOffset;
 
 	// Internal texture IDs
 	GLuint textures[3];
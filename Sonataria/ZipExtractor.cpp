@@ -0,0 +1,787 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+// Keep std::min usable
+#define NOMINMAX
+#include <windows.h>
+#else
+// 64-bit offsets are the default for these outside Windows
+#define _fseeki64 fseeko
+#define _ftelli64 ftello
+#endif
+
+#include "Logger.h"
+#include "Tracer.h"
+#include "unzip.h"
+#include "ZipExtractor.h"
+
+// Signatures of the zip records that are read
+const uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+const uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+const uint32_t END_OF_DIRECTORY_SIGNATURE = 0x06054b50;
+
+// Fixed sizes of the records, before their names and extra fields
+const size_t LOCAL_HEADER_SIZE = 30;
+const size_t CENTRAL_HEADER_SIZE = 46;
+const size_t END_OF_DIRECTORY_SIZE = 22;
+
+// The end of the central directory is followed by a comment of up to this many bytes
+const size_t MAX_COMMENT_SIZE = 0xFFFF;
+
+// Compression methods that can be extracted
+const uint16_t METHOD_STORED = 0;
+const uint16_t METHOD_DEFLATED = 8;
+
+// General purpose flags that rule out streaming an entry
+const uint16_t FLAG_ENCRYPTED = 0x0001;
+const uint16_t FLAG_DATA_DESCRIPTOR = 0x0008;
+
+static uint16_t read16(const uint8_t* data) {
+	return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+static uint32_t read32(const uint8_t* data) {
+	return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/**
+ * Check a name from the archive stays inside the folder it is extracted to.
+ *
+ * @param name the name
+ * @return true if it is a plain relative path
+ */
+static bool isSafeName(const string& name) {
+	if (name.empty() || name[0] == '/' || name[0] == '\\' || name.find(':') != string::npos) {
+		return false;
+	}
+
+	filesystem::path relative(name);
+	for (const filesystem::path& part : relative) {
+		if (part == "..") {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Default constructor.
+ *
+ */
+ZipExtractor::ZipExtractor() {
+	this->threadCount = 1;
+	this->lowPriority = false;
+	this->queuedBytes = 0;
+	this->stopping = false;
+	this->streaming = false;
+	this->streamOffset = 0;
+	this->currentRemaining = 0;
+	this->entriesTotal = 0;
+	this->entriesDone = 0;
+	this->bytesWritten = 0;
+}
+
+/**
+ * Default deconstructor.
+ *
+ */
+ZipExtractor::~ZipExtractor() {
+	endStream();
+	stopWorkers();
+}
+
+/**
+ * Have the threads pace themselves, such as to keep them from costing frames during songs.
+ *
+ * @param throttle called with the size of each block written, may sleep, and returns false if extraction should stop
+ */
+void ZipExtractor::setThrottle(function<bool(size_t bytes)> throttle) {
+	this->throttleHook = throttle;
+}
+
+/**
+ * Extract on a single background priority thread (lower CPU and disk priority)
+ * unless a thread count is given.
+ *
+ * @param lowPriority true for background priority
+ */
+void ZipExtractor::setLowPriority(bool lowPriority) {
+	this->lowPriority = lowPriority;
+}
+
+/**
+ * Start the threads so entries can be extracted while the archive arrives through write().
+ *
+ * @param destination folder the archive is extracted into
+ * @param threads threads to use (0 for one per core)
+ */
+void ZipExtractor::begin(string destination, int threads) {
+	endStream();
+	stopWorkers();
+
+	this->destination = destination;
+	if (threads <= 0) {
+		threads = this->lowPriority ? 1 : (int)thread::hardware_concurrency();
+	}
+	this->threadCount = max(1, min(threads, ZIP_MAX_THREADS));
+
+	this->streamed.clear();
+	this->queuedBytes = 0;
+	this->streaming = true;
+	this->streamOffset = 0;
+	this->header.clear();
+	this->entriesTotal = 0;
+	this->entriesDone = 0;
+	this->bytesWritten = 0;
+
+	startWorkers();
+}
+
+/**
+ * Pass on the next bytes of the archive. Entries are queued as soon as their local
+ * header has arrived, and their data is inflated as it follows. Streaming stops at
+ * the central directory, at an entry whose sizes aren't known up front, or if the
+ * bytes don't carry on from the last ones, and finish() does the rest.
+ *
+ * @param offset where the bytes are in the archive
+ * @param data the bytes
+ * @param size how many bytes
+ */
+void ZipExtractor::write(uint64_t offset, const uint8_t* data, size_t size) {
+	if (!this->streaming) {
+		return;
+	}
+	if (offset != this->streamOffset) {
+		logger.log("Update archive restarted at ", to_string(offset), ", the rest is extracted once it has downloaded");
+		endStream();
+		return;
+	}
+
+	while (size > 0 && this->streaming) {
+		if (!this->current) {
+			readHeader(data, size);
+			continue;
+		}
+
+		size_t count = (size_t)min((uint64_t)size, this->currentRemaining);
+		{
+			// Hold the download up while the threads catch up
+			unique_lock<mutex> lock(this->jobLock);
+			this->jobSignal.wait(lock, [this]() { return this->queuedBytes < ZIP_STREAM_QUEUE_LIMIT; });
+
+			this->current->pieces.emplace_back(data, data + count);
+			this->queuedBytes += count;
+			this->currentRemaining -= count;
+			if (this->currentRemaining == 0) {
+				this->current->complete = true;
+			}
+		}
+		this->jobSignal.notify_all();
+
+		if (this->currentRemaining == 0) {
+			this->current.reset();
+		}
+		data += count;
+		size -= count;
+		this->streamOffset += count;
+	}
+}
+
+/**
+ * Take the bytes of a local header out of the stream, queueing its entry once the
+ * whole header is in.
+ *
+ * @param data the bytes, moved past the ones used
+ * @param size how many bytes, less the ones used
+ * @return true if an entry was queued
+ */
+bool ZipExtractor::readHeader(const uint8_t*& data, size_t& size) {
+	size_t needed = LOCAL_HEADER_SIZE;
+	if (this->header.size() >= LOCAL_HEADER_SIZE) {
+		needed += read16(&this->header[26]) + read16(&this->header[28]);
+	}
+
+	size_t count = min(size, needed - this->header.size());
+	this->header.insert(this->header.end(), data, data + count);
+	data += count;
+	size -= count;
+	this->streamOffset += count;
+
+	if (this->header.size() >= 4 && read32(&this->header[0]) != LOCAL_HEADER_SIGNATURE) {
+		// Reached the central directory
+		endStream();
+		return false;
+	}
+	if (this->header.size() < LOCAL_HEADER_SIZE) {
+		return false;
+	}
+	needed = LOCAL_HEADER_SIZE + read16(&this->header[26]) + read16(&this->header[28]);
+	if (this->header.size() < needed) {
+		return false;
+	}
+
+	shared_ptr<Job> job = make_shared<Job>();
+	job->entry.name = string((const char*)&this->header[LOCAL_HEADER_SIZE], read16(&this->header[26]));
+	job->entry.headerOffset = this->streamOffset - this->header.size();
+	job->entry.method = read16(&this->header[8]);
+	job->entry.crc = read32(&this->header[14]);
+	job->entry.compressedSize = read32(&this->header[18]);
+	job->entry.size = read32(&this->header[22]);
+	job->fromArchive = false;
+	job->complete = job->entry.compressedSize == 0;
+	job->abandoned = false;
+	job->done = false;
+	job->ok = false;
+
+	uint16_t flags = read16(&this->header[6]);
+	this->header.clear();
+
+	// Without sizes up front there's no telling where the entry ends
+	if ((flags & (FLAG_ENCRYPTED | FLAG_DATA_DESCRIPTOR)) != 0 || job->entry.compressedSize == 0xFFFFFFFF
+		|| (job->entry.method != METHOD_STORED && job->entry.method != METHOD_DEFLATED) || !isSafeName(job->entry.name)) {
+		endStream();
+		return false;
+	}
+
+	{
+		lock_guard<mutex> lock(this->jobLock);
+		this->waiting.push_back(job);
+		this->streamed[job->entry.name] = job;
+	}
+	this->jobSignal.notify_all();
+
+	if (!job->complete) {
+		this->current = job;
+		this->currentRemaining = job->entry.compressedSize;
+	}
+	return true;
+}
+
+/**
+ * Stop taking entries from the stream. An entry that was cut short is dropped.
+ *
+ */
+void ZipExtractor::endStream() {
+	this->streaming = false;
+	this->header.clear();
+
+	if (this->current) {
+		{
+			lock_guard<mutex> lock(this->jobLock);
+			this->current->abandoned = true;
+		}
+		this->jobSignal.notify_all();
+		this->current.reset();
+	}
+}
+
+/**
+ * Extract whatever wasn't extracted while the archive arrived, now that it is complete.
+ *
+ * @param archivePath the archive
+ * @return true if every entry was extracted and passed its CRC check
+ */
+bool ZipExtractor::finish(string archivePath) {
+	TraceScope trace("Extract update", "load");
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	// Let the threads finish the entries that were streamed
+	endStream();
+	stopWorkers();
+	this->archivePath = archivePath;
+
+	vector<Entry> entries;
+	if (!readCentralDirectory(entries)) {
+		return false;
+	}
+	this->entriesTotal = entries.size();
+
+	vector<shared_ptr<Job>> jobs;
+	size_t reused = 0;
+	for (size_t i = 0; i < entries.size(); i++) {
+		const Entry& entry = entries[i];
+		if (!isSafeName(entry.name)) {
+			logger.logError("Refusing to extract ", entry.name, " from ", archivePath);
+			return false;
+		}
+
+		// An entry extracted while streaming is kept if the central directory agrees with it
+		map<string, shared_ptr<Job>>::iterator found = this->streamed.find(entry.name);
+		if (found != this->streamed.end() && found->second->ok) {
+			const Entry& done = found->second->entry;
+			if (done.headerOffset == entry.headerOffset && done.crc == entry.crc && done.size == entry.size
+				&& done.compressedSize == entry.compressedSize && done.method == entry.method) {
+				reused++;
+				continue;
+			}
+		}
+
+		shared_ptr<Job> job = make_shared<Job>();
+		job->entry = entry;
+		job->fromArchive = true;
+		job->complete = true;
+		job->abandoned = false;
+		job->done = false;
+		job->ok = false;
+		jobs.push_back(job);
+	}
+	this->streamed.clear();
+	this->entriesDone = reused;
+
+	// Largest first, so one big file doesn't end up finishing on its own
+	stable_sort(jobs.begin(), jobs.end(), [](const shared_ptr<Job>& a, const shared_ptr<Job>& b) {
+		return a->entry.compressedSize > b->entry.compressedSize;
+	});
+
+	{
+		lock_guard<mutex> lock(this->jobLock);
+		this->waiting.assign(jobs.begin(), jobs.end());
+	}
+	startWorkers();
+	stopWorkers();
+
+	bool ok = true;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		ok = ok && jobs[i]->ok;
+	}
+	if (!ok) {
+		logger.logError("Could not extract ", archivePath);
+		return false;
+	}
+
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+	logger.log("Extracted ", to_string(entries.size()), " entries from ", archivePath, " (", to_string(reused), " while it downloaded) in ",
+		to_string(elapsed.count()), "s with ", to_string(this->threadCount), " threads");
+	return true;
+}
+
+/**
+ * Stop streaming and let the threads go, such as when the download failed. The
+ * destination folder is removed with everything extracted into it, so it should be
+ * a folder of its own such as a staging folder.
+ *
+ */
+void ZipExtractor::cancel() {
+	endStream();
+	stopWorkers();
+	this->streamed.clear();
+
+	error_code error;
+	filesystem::remove_all(this->destination, error);
+}
+
+/**
+ * Extract a complete archive.
+ *
+ * @param archivePath the archive
+ * @param destination folder the archive is extracted into
+ * @param threads threads to use (0 for one per core)
+ * @return true if every entry was extracted and passed its CRC check
+ */
+bool ZipExtractor::extract(string archivePath, string destination, int threads) {
+	begin(destination, threads);
+	endStream();
+	return finish(archivePath);
+}
+
+/**
+ * Gets how far the extraction has got.
+ *
+ * @return the progress
+ */
+ZipExtractor::Progress ZipExtractor::getProgress() {
+	Progress progress;
+	progress.entriesTotal = this->entriesTotal;
+	progress.entriesDone = this->entriesDone;
+	progress.bytesWritten = this->bytesWritten;
+	return progress;
+}
+
+/**
+ * Start the threads, which take entries until stopWorkers() is called and none are left.
+ *
+ */
+void ZipExtractor::startWorkers() {
+	this->stopping = false;
+	for (int i = 0; i < this->threadCount; i++) {
+		this->workers.emplace_back(&ZipExtractor::work, this);
+	}
+}
+
+/**
+ * Wait for the threads to finish every queued entry.
+ *
+ */
+void ZipExtractor::stopWorkers() {
+	{
+		lock_guard<mutex> lock(this->jobLock);
+		this->stopping = true;
+	}
+	this->jobSignal.notify_all();
+
+	for (size_t i = 0; i < this->workers.size(); i++) {
+		this->workers[i].join();
+	}
+	this->workers.clear();
+	this->stopping = false;
+}
+
+/**
+ * Extract queued entries one at a time.
+ *
+ */
+void ZipExtractor::work() {
+	tracer.setThreadName("Unzip");
+#ifdef _WIN32
+	if (this->lowPriority) {
+		SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+	}
+#endif
+
+	FILE* archive = NULL;
+	vector<uint8_t> readBuffer(ZIP_READ_SIZE);
+	vector<uint8_t> writeBuffer(ZIP_WRITE_SIZE);
+
+	while (true) {
+		shared_ptr<Job> job;
+		{
+			unique_lock<mutex> lock(this->jobLock);
+			this->jobSignal.wait(lock, [this]() { return this->stopping || !this->waiting.empty(); });
+			if (this->waiting.empty()) {
+				break;
+			}
+			job = this->waiting.front();
+			this->waiting.pop_front();
+		}
+
+		bool ok = extractEntry(*job, archive, readBuffer, writeBuffer);
+		if (ok) {
+			this->entriesDone++;
+		}
+
+		{
+			lock_guard<mutex> lock(this->jobLock);
+			job->done = true;
+			job->ok = ok;
+		}
+		this->jobSignal.notify_all();
+	}
+
+	if (archive != NULL) {
+		fclose(archive);
+	}
+}
+
+/**
+ * Extract one entry, from the stream or the finished archive, and check its CRC.
+ *
+ * @param job the entry
+ * @param archive this thread's handle on the archive, opened when first needed
+ * @param readBuffer space for compressed bytes read from the archive
+ * @param writeBuffer space for inflated bytes waiting to be written
+ * @return true if the entry was extracted and matched its CRC and size
+ */
+bool ZipExtractor::extractEntry(Job& job, FILE*& archive, vector<uint8_t>& readBuffer, vector<uint8_t>& writeBuffer) {
+	const Entry& entry = job.entry;
+	filesystem::path path = filesystem::path(this->destination) / entry.name;
+	bool isFolder = entry.name.back() == '/' || entry.name.back() == '\\';
+
+	error_code error;
+	filesystem::create_directories(isFolder ? path : path.parent_path(), error);
+
+	FILE* out = NULL;
+	HINFLATE inflater = NULL;
+	bool ok = !error && (!this->throttleHook || this->throttleHook(0));
+	if (ok && !isFolder) {
+		out = fopen(path.string().c_str(), "wb");
+		// Everything is written in large blocks, so the file doesn't need a buffer of its own
+		if (out != NULL) {
+			setvbuf(out, NULL, _IONBF, 0);
+		}
+		if (entry.method == METHOD_DEFLATED) {
+			inflater = OpenInflate();
+		}
+		ok = out != NULL && (entry.method == METHOD_STORED || inflater != NULL);
+		if (!ok) {
+			logger.logError("Could not create ", path.string());
+		}
+	}
+
+	uint32_t crc = 0;
+	uint64_t written = 0;
+	size_t buffered = 0;
+
+	// Write out the inflated bytes collected so far
+	auto flush = [&]() {
+		if (buffered == 0) {
+			return;
+		}
+		crc = ZipCrc32(crc, writeBuffer.data(), (unsigned int)buffered);
+		if (fwrite(writeBuffer.data(), 1, buffered, out) != buffered) {
+			logger.logError("Could not write ", path.string());
+			ok = false;
+		}
+		written += buffered;
+		this->bytesWritten += buffered;
+		if (this->throttleHook && !this->throttleHook(buffered)) {
+			ok = false;
+		}
+		buffered = 0;
+	};
+
+	// Inflate (or copy) the next compressed bytes into the write buffer
+	auto consume = [&](const uint8_t* data, size_t size) {
+		if (entry.method == METHOD_STORED) {
+			while (ok && size > 0) {
+				size_t count = min(size, writeBuffer.size() - buffered);
+				memcpy(writeBuffer.data() + buffered, data, count);
+				buffered += count;
+				data += count;
+				size -= count;
+				if (buffered == writeBuffer.size()) {
+					flush();
+				}
+			}
+			return;
+		}
+
+		while (ok) {
+			unsigned int used = 0;
+			unsigned int made = 0;
+			ZRESULT result = InflateChunk(inflater, data, (unsigned int)size, &used, writeBuffer.data() + buffered,
+				(unsigned int)(writeBuffer.size() - buffered), &made);
+			data += used;
+			size -= used;
+			buffered += made;
+
+			if (result != ZR_OK && result != ZR_MORE) {
+				logger.logError(entry.name, " is corrupt");
+				ok = false;
+				break;
+			}
+			if (written + buffered > entry.size) {
+				logger.logError(entry.name, " inflated past its size");
+				ok = false;
+				break;
+			}
+			if (buffered == writeBuffer.size()) {
+				flush();
+				continue;
+			}
+			if (result == ZR_OK || size == 0 || (used == 0 && made == 0)) {
+				break;
+			}
+		}
+	};
+
+	if (job.fromArchive) {
+		// Each thread reads the archive through a handle of its own
+		if (ok && archive == NULL) {
+			archive = fopen(this->archivePath.c_str(), "rb");
+			if (archive == NULL) {
+				logger.logError("Could not open ", this->archivePath);
+				ok = false;
+			}
+			else {
+				setvbuf(archive, NULL, _IONBF, 0);
+			}
+		}
+
+		// The data starts after the local header's own name and extra field
+		uint8_t local[LOCAL_HEADER_SIZE];
+		if (ok && (_fseeki64(archive, (long long)entry.headerOffset, SEEK_SET) != 0 || fread(local, 1, LOCAL_HEADER_SIZE, archive) != LOCAL_HEADER_SIZE
+			|| read32(local) != LOCAL_HEADER_SIGNATURE
+			|| _fseeki64(archive, (long long)(entry.headerOffset + LOCAL_HEADER_SIZE + read16(&local[26]) + read16(&local[28])), SEEK_SET) != 0)) {
+			logger.logError("Bad local header for ", entry.name, " in ", this->archivePath);
+			ok = false;
+		}
+
+		uint64_t remaining = isFolder ? 0 : entry.compressedSize;
+		while (ok && remaining > 0) {
+			size_t count = (size_t)min((uint64_t)readBuffer.size(), remaining);
+			if (fread(readBuffer.data(), 1, count, archive) != count) {
+				logger.logError("Could not read ", entry.name, " from ", this->archivePath);
+				ok = false;
+				break;
+			}
+			consume(readBuffer.data(), count);
+			remaining -= count;
+		}
+	}
+	else {
+		// Take the pieces as they arrive, still draining them after a failure so the download isn't held up
+		while (true) {
+			vector<uint8_t> piece;
+			{
+				unique_lock<mutex> lock(this->jobLock);
+				this->jobSignal.wait(lock, [&job]() { return !job.pieces.empty() || job.complete || job.abandoned; });
+				if (job.pieces.empty()) {
+					break;
+				}
+				piece.swap(job.pieces.front());
+				job.pieces.pop_front();
+				this->queuedBytes -= piece.size();
+			}
+			this->jobSignal.notify_all();
+
+			if (ok && !isFolder) {
+				consume(piece.data(), piece.size());
+			}
+		}
+		if (job.abandoned) {
+			ok = false;
+		}
+	}
+
+	if (ok && !isFolder) {
+		flush();
+	}
+	if (inflater != NULL) {
+		CloseInflate(inflater);
+	}
+	if (out != NULL && fclose(out) != 0) {
+		ok = false;
+	}
+
+	if (ok && !isFolder && (written != entry.size || crc != entry.crc)) {
+		logger.logError(entry.name, " failed its CRC check");
+		ok = false;
+	}
+	if (!ok && !isFolder) {
+		filesystem::remove(path, error);
+	}
+	return ok;
+}
+
+/**
+ * Read the list of entries from the end of the archive.
+ *
+ * @param entries set to the entries
+ * @return true if the central directory could be read
+ */
+bool ZipExtractor::readCentralDirectory(vector<Entry>& entries) {
+	FILE* archive = fopen(this->archivePath.c_str(), "rb");
+	if (archive == NULL) {
+		logger.logError("Could not open ", this->archivePath);
+		return false;
+	}
+
+	// The end record is the last thing in the file, apart from its comment
+	_fseeki64(archive, 0, SEEK_END);
+	uint64_t fileSize = (uint64_t)_ftelli64(archive);
+	size_t tailSize = (size_t)min(fileSize, (uint64_t)(END_OF_DIRECTORY_SIZE + MAX_COMMENT_SIZE));
+	vector<uint8_t> tail(tailSize);
+	_fseeki64(archive, (long long)(fileSize - tailSize), SEEK_SET);
+	bool ok = fread(tail.data(), 1, tailSize, archive) == tailSize;
+
+	const uint8_t* end = NULL;
+	for (size_t i = tailSize >= END_OF_DIRECTORY_SIZE ? tailSize - END_OF_DIRECTORY_SIZE + 1 : 0; ok && i-- > 0;) {
+		if (read32(&tail[i]) == END_OF_DIRECTORY_SIGNATURE) {
+			end = &tail[i];
+			break;
+		}
+	}
+	if (end == NULL) {
+		logger.logError(this->archivePath, " is not a zip file");
+		fclose(archive);
+		return false;
+	}
+
+	size_t count = read16(&end[10]);
+	uint32_t directorySize = read32(&end[12]);
+	uint32_t directoryOffset = read32(&end[16]);
+	if (count == 0xFFFF || directoryOffset == 0xFFFFFFFF) {
+		logger.logError(this->archivePath, " is a Zip64 archive, which isn't supported");
+		fclose(archive);
+		return false;
+	}
+
+	vector<uint8_t> directory(directorySize);
+	ok = (uint64_t)directoryOffset + directorySize <= fileSize && _fseeki64(archive, directoryOffset, SEEK_SET) == 0
+		&& fread(directory.data(), 1, directorySize, archive) == directorySize;
+	fclose(archive);
+
+	entries.clear();
+	size_t position = 0;
+	for (size_t i = 0; ok && i < count; i++) {
+		if (position + CENTRAL_HEADER_SIZE > directory.size() || read32(&directory[position]) != CENTRAL_HEADER_SIGNATURE) {
+			ok = false;
+			break;
+		}
+		const uint8_t* record = &directory[position];
+		size_t nameSize = read16(&record[28]);
+		size_t recordSize = CENTRAL_HEADER_SIZE + nameSize + read16(&record[30]) + read16(&record[32]);
+		if (position + recordSize > directory.size()) {
+			ok = false;
+			break;
+		}
+
+		Entry entry;
+		entry.name = string((const char*)&record[CENTRAL_HEADER_SIZE], nameSize);
+		entry.method = read16(&record[10]);
+		entry.crc = read32(&record[16]);
+		entry.compressedSize = read32(&record[20]);
+		entry.size = read32(&record[24]);
+		entry.headerOffset = read32(&record[42]);
+		if ((read16(&record[8]) & FLAG_ENCRYPTED) != 0 || (entry.method != METHOD_STORED && entry.method != METHOD_DEFLATED)) {
+			logger.logError(entry.name, " in ", this->archivePath, " is encrypted or uses an unsupported compression method");
+			return false;
+		}
+		entries.push_back(entry);
+		position += recordSize;
+	}
+
+	if (!ok) {
+		logger.logError("The central directory of ", this->archivePath, " is damaged");
+	}
+	return ok;
+}
+
+/**
+ * Time extracting an archive, first from the finished file and then fed in as if it
+ * were downloading (Sonataria.exe --benchmark-unzip <zip> <folder> [threads]).
+ *
+ * @param archivePath the archive
+ * @param destination folder to extract into
+ * @param threads threads to use (0 for one per core)
+ * @return megabytes written per second from the finished file, or -1 on failure
+ */
+double ZipExtractor::benchmark(const char* archivePath, const char* destination, int threads) {
+	ZipExtractor extractor;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	if (!extractor.extract(archivePath, destination, threads)) {
+		logger.logError("Unzip benchmark could not extract ", string(archivePath));
+		return -1.0;
+	}
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+	double megabytes = extractor.bytesWritten / 1048576.0;
+	double speed = elapsed.count() > 0.0 ? megabytes / elapsed.count() : 0.0;
+	logger.log("Unzip benchmark ", string(archivePath), ": ", to_string(extractor.entriesTotal), " entries, ", to_string(megabytes), " MB in ",
+		to_string(elapsed.count()), "s (", to_string(speed), " MB/s, ", to_string(extractor.threadCount), " threads)");
+
+	// The same archive passed in download sized pieces
+	FILE* file = fopen(archivePath, "rb");
+	if (file == NULL) {
+		return speed;
+	}
+	vector<uint8_t> buffer(4 * 1024 * 1024);
+	start = chrono::steady_clock::now();
+	extractor.begin(destination, threads);
+	uint64_t offset = 0;
+	size_t count;
+	while ((count = fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+		extractor.write(offset, buffer.data(), count);
+		offset += count;
+	}
+	fclose(file);
+	size_t streamedEntries = extractor.entriesDone;
+	bool ok = extractor.finish(archivePath);
+	elapsed = chrono::steady_clock::now() - start;
+	logger.log("Unzip benchmark ", string(archivePath), " streamed: ", ok ? "" : "FAILED ", to_string(streamedEntries), " entries done by the end of the stream, ",
+		to_string(elapsed.count()), "s (", to_string(elapsed.count() > 0.0 ? megabytes / elapsed.count() : 0.0), " MB/s)");
+	return speed;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file ZipExtractor.h
+ *
+ * @brief Zip Extractor
+ *
+ * @author Julia Butenhoff
+ */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Most threads inflating entries at the same time
+#define ZIP_MAX_THREADS 8
+
+// Compressed bytes read from the archive at a time
+#define ZIP_READ_SIZE (1024 * 1024)
+
+// Inflated bytes collected before each write to disk
+#define ZIP_WRITE_SIZE (4 * 1024 * 1024)
+
+// Downloaded bytes waiting for a thread before the download is held up
+#define ZIP_STREAM_QUEUE_LIMIT (64 * 1024 * 1024)
+
+/**
+ * Extracts a zip archive on a pool of threads, one entry per thread at a time,
+ * checking every entry against its CRC-32.
+ *
+ * Entries can also be extracted while the archive is still arriving. The bytes
+ * are passed to write() in order, and each entry is extracted as soon as its
+ * data has come in, as long as its local header gives the sizes up front (no
+ * data descriptor). finish() then reads the central directory of the complete
+ * archive and extracts whatever streaming didn't. Streamed bytes haven't been
+ * checked as a whole yet, so they should be extracted into a staging folder.
+ */
+class ZipExtractor {
+
+	public:
+		/**
+		 * How far the extraction has got, for the UPDATES screen
+		 */
+		struct Progress {
+			size_t entriesTotal;	// 0 until the central directory is read
+			size_t entriesDone;
+			uint64_t bytesWritten;
+		};
+
+	private:
+		/**
+		 * A file or folder in the archive
+		 */
+		struct Entry {
+			string name;
+			uint64_t headerOffset;
+			uint64_t compressedSize;
+			uint64_t size;
+			uint32_t crc;
+			uint16_t method;
+		};
+
+		/**
+		 * An entry waiting for or on a thread
+		 */
+		struct Job {
+			Entry entry;
+			bool fromArchive;				// Read from the finished archive rather than streamed
+			deque<vector<uint8_t>> pieces;	// Streamed data not inflated yet
+			bool complete;					// All the streamed data has been handed over
+			bool abandoned;					// The stream ended before the entry did
+			bool done;
+			bool ok;
+		};
+
+		string destination;
+		string archivePath;
+		int threadCount;
+		bool lowPriority;
+		function<bool(size_t)> throttleHook;
+		vector<thread> workers;
+
+		mutex jobLock;
+		condition_variable jobSignal;
+		deque<shared_ptr<Job>> waiting;
+		map<string, shared_ptr<Job>> streamed;
+		uint64_t queuedBytes;
+		bool stopping;
+
+		// Reading local headers out of the stream
+		bool streaming;
+		uint64_t streamOffset;
+		vector<uint8_t> header;
+		shared_ptr<Job> current;
+		uint64_t currentRemaining;
+
+		atomic<size_t> entriesTotal;
+		atomic<size_t> entriesDone;
+		atomic<uint64_t> bytesWritten;
+
+		void startWorkers();
+		void stopWorkers();
+		void work();
+		bool extractEntry(Job& job, FILE*& archive, vector<uint8_t>& readBuffer, vector<uint8_t>& writeBuffer);
+		bool readHeader(const uint8_t*& data, size_t& size);
+		void endStream();
+		bool readCentralDirectory(vector<Entry>& entries);
+
+	public:
+		ZipExtractor();
+		~ZipExtractor();
+
+		void setThrottle(function<bool(size_t bytes)> throttle);
+		void setLowPriority(bool lowPriority);
+
+		void begin(string destination, int threads = 0);
+		void write(uint64_t offset, const uint8_t* data, size_t size);
+		bool finish(string archivePath);
+		void cancel();
+		bool extract(string archivePath, string destination, int threads = 0);
+		Progress getProgress();
+
+		static double benchmark(const char* archivePath, const char* destination, int threads);
+};
@@ -2,6 +2,7 @@
 #include "GameState.h"
 #include <iostream>
 #include "Networking.h"
+#include "PeerExchange.h"
 #include <PacDrive/PacDrive.h>
 #include "ScreenRenderer.h"
 #include <SFML/Graphics.hpp>
@@ -13,11 +14,22 @@
 #include <GL/glew.h>
 #include <sstream>
 #include "SoundEffects.h"
+#include "AVDecode.h"
+#include "Replay.h"
+#include "Autoplay.h"
+#include "SoakTest.h"
+#include "Profiler.h"
+#include "Tracer.h"
+#include "ScoreQueue.h"
+#include "UpdateService.h"
+#include "ZipExtractor.h"
+#include "OpenGLShader.h"
 
 //Forward Declarations
 void renderingThread(sf::RenderWindow* window);
 void resetAll();
 void networkCheckingThread();
+void setOnlineStateFromStatus(int status);
 
 // Hold the copy of the screen renderer
 ScreenRenderer screenRenderer;
@@ -73,6 +85,104 @@ void GLAPIENTRY MessageCallback(GLenum source, GLenum type, GLuint id, GLenum se
  * @return exit code
  */
 int main(int argc, char** argv) {
+
+	// Headless video decode benchmark (Sonataria.exe --benchmark-video <file>)
+	if (argc >= 3 && string(argv[1]) == "--benchmark-video") {
+		return AVDecode::benchmarkDecode(argv[2]) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	// Logging call cost benchmark (Sonataria.exe --benchmark-log [calls])
+	if (argc >= 2 && string(argv[1]) == "--benchmark-log") {
+		return Logger::benchmark(argc >= 3 ? atoi(argv[2]) : 100000) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	// Update extraction benchmark (Sonataria.exe --benchmark-unzip <zip> <folder> [threads])
+	if (argc >= 4 && string(argv[1]) == "--benchmark-unzip") {
+		return ZipExtractor::benchmark(argv[2], argv[3], argc >= 5 ? atoi(argv[4]) : 0) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	// Headless replay check (Sonataria.exe --replay <file>... [--iterations N])
+	if (argc >= 3 && string(argv[1]) == "--replay") {
+		vector<string> replayFiles;
+		int iterations = 1;
+		for (int i = 2; i < argc; i++) {
+			if (string(argv[i]) == "--iterations" && i + 1 < argc) {
+				iterations = atoi(argv[++i]);
+				if (iterations < 1) iterations = 1;
+			} else {
+				replayFiles.push_back(argv[i]);
+			}
+		}
+		return runReplayCheck(replayFiles, iterations) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Autoplay, soak test, profiler and logging options
+	// (Sonataria.exe [--autoplay] [--autoplay-noise <ms>] [--autoplay-miss <percent>] [--soak [--loops N]] [--profile]
+	//  [--no-trace] [--log-level debug|info|warn|off] [--no-console-log]
+	//  [--profile-server http://host:port] [--game-server host:port] [--score-server http://host:port/path]
+	//  [--update-key file] [--shaders folder] [--no-shader-cache])
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--autoplay") {
+			autoplay.setEnabled(true);
+		}
+		else if (arg == "--autoplay-noise" && i + 1 < argc) {
+			autoplay.setTimingNoise((float)atof(argv[++i]));
+		}
+		else if (arg == "--autoplay-miss" && i + 1 < argc) {
+			autoplay.setMissChance((float)atof(argv[++i]) / 100.f);
+		}
+		else if (arg == "--soak") {
+			soakTest.setEnabled(true);
+			autoplay.setEnabled(true);
+		}
+		else if (arg == "--loops" && i + 1 < argc) {
+			soakTest.setLoops(atoi(argv[++i]));
+		}
+		else if (arg == "--profile") {
+			profiler.setOverlayVisible(true);
+		}
+		else if (arg == "--no-trace") {
+			tracer.setEnabled(false);
+		}
+		else if (arg == "--log-level" && i + 1 < argc) {
+			logger.setLevel(Logger::getLevelFromName(argv[++i]));
+		}
+		else if (arg == "--no-console-log") {
+			logger.setConsoleEnabled(false);
+		}
+		else if (arg == "--profile-server" && i + 1 < argc) {
+			network.setProfileServer(argv[++i]);
+		}
+		else if (arg == "--game-server" && i + 1 < argc) {
+			network.setGameServer(argv[++i]);
+		}
+		else if (arg == "--score-server" && i + 1 < argc) {
+			scoreQueue.setServer(argv[++i]);
+		}
+		else if (arg == "--update-key" && i + 1 < argc) {
+			network.setUpdateKey(argv[++i]);
+		}
+		else if (arg == "--peer-port" && i + 1 < argc) {
+			peerExchange.setPort(atoi(argv[++i]));
+		}
+		else if (arg == "--peer-interface" && i + 1 < argc) {
+			peerExchange.setInterface(argv[++i]);
+		}
+		else if (arg == "--no-peers") {
+			peerExchange.setEnabled(false);
+		}
+		else if (arg == "--shaders" && i + 1 < argc) {
+			OpenGLShader::setShaderFolder(argv[++i]);
+		}
+		else if (arg == "--no-shader-cache") {
+			OpenGLShader::setCacheFolder("");
+		}
+	}
+	tracer.setThreadName("Main");
+
+	// Clean up, read in the songs and settings, and check the network while the window is made
+	screenRenderer.beginStartup();
 	
 	// Declare the window to be used
 	sf::ContextSettings mySettings = sf::ContextSettings();
@@ -132,10 +242,30 @@ int main(int argc, char** argv) {
 	sf::Thread updateTimerThread(&networkCheckingThread);
 	updateTimerThread.launch();
 
+	// Send any scores a previous run didn't get to the server
+	scoreQueue.start();
+
+	// Check for and stage new versions while the game stays playable
+	updateService.start();
+
+	// Start the soak test driver if one was asked for
+	sf::Thread soakThread(&SoakTest::run, &soakTest);
+	if (soakTest.isEnabled()) {
+		soakThread.launch();
+	}
+
 	// Used to poll the window for events
 	while (gameWindow.isOpen()) {
 		RFIDCardReader::getCardReader()->poll();
 
+		// A finished soak test shuts down on its own without any input
+		if (soakTest.isFinished()) {
+			thread.wait();
+			controllerInput.reset();
+			PacShutdown();
+			exit(0);
+		}
+
 		sf::Event evnt;
 		while (gameWindow.pollEvent(evnt)) {
 			if (evnt.type == sf::Event::Closed) {
@@ -156,6 +286,9 @@ int main(int argc, char** argv) {
 				 if (evnt.key.code == sf::Keyboard::A) {
 					 controllerInput.setKeyState(1, true);
 					 PacSetLEDState(0, 0, true);
+					 if (gameState.getGameState() == GameState::CurrentState::TEST_MENU_SYSINFO) {
+						 tracer.dumpInBackground();
+					 }
 				 } 
 				 else if(evnt.key.code == sf::Keyboard::C) {
 					 controllerInput.setKeyState(2, true);
@@ -270,26 +403,21 @@ int main(int argc, char** argv) {
 							 }
 						 }
 						 else if (gameState.getGameState() == GameState::CurrentState::TEST_MENU_NETWORKING) {
-							 int status = 0;
 							 switch (screenRenderer.getTestMenuNetworkingPos()) {
 							 case 0: // Network check
+								 // Don't start another check while one is running
+								 if (screenRenderer.isNetworkChecking) {
+									 break;
+								 }
 								 logger.log(L"Testing Network...");
 								 screenRenderer.isNetworkChecking = true;
-								 status = network.checkConnection();
 
-								 switch (status) {
-								 case 1:
-									 gameState.setOnlineState(GameState::OnlineState::ONLINE);
-									 break;
-								 case 2:
-									 gameState.setOnlineState(GameState::OnlineState::OFFLINE);
-									 break;
-								 case 3:
-									 gameState.setOnlineState(GameState::OnlineState::MAINTENENCE);
-									 break;
-								 }
-								 screenRenderer.isNetworkChecking = false;
-								 logger.log(L"Network Test Finished.");
+								 // The check finishes on the network thread so events keep being handled
+								 network.checkConnection([](int status) {
+									 setOnlineStateFromStatus(status);
+									 screenRenderer.isNetworkChecking = false;
+									 logger.log(L"Network Test Finished.");
+								 });
 								 break;
 							 case 1: // Move back back a menu
 								 gameState.setGameState(GameState::CurrentState::TEST_MENU_MAIN);
@@ -340,10 +468,22 @@ int main(int argc, char** argv) {
 						 }
 					 }
 				 }
+				 else if(evnt.key.code == sf::Keyboard::F3) {
+					 // Show or hide the frame times overlay
+					 profiler.toggleOverlay();
+				 }
+				 else if(evnt.key.code == sf::Keyboard::F4) {
+					 // Save the last few seconds of every thread's timeline
+					 tracer.dumpInBackground();
+				 }
 				 else if(evnt.key.code == sf::Keyboard::Escape) {
 					 logger.log(L"Shutting down from ESC key");
 					 gameState.setGameState(GameState::CurrentState::SHUTDOWN);
 					 thread.wait();
+
+					 // A staged version runs from the next start
+					 updateService.stop();
+					 updateService.activate();
 					 controllerInput.reset();
 					 PacShutdown();
 					 exit(0);
@@ -456,6 +596,8 @@ int main(int argc, char** argv) {
 			 // Mostly used when the update finishes downloading
 			 if (gameState.getGameState() == GameState::CurrentState::SHUTDOWN) {
 				 thread.wait();
+				 updateService.stop();
+				 updateService.activate();
 				 controllerInput.reset();
 				 PacShutdown();
 				 exit(0);
@@ -480,30 +622,42 @@ void renderingThread(sf::RenderWindow* window) {
  * 
  */
 void networkCheckingThread() {
+	tracer.setThreadName("Network Check");
 	while (true) {
 		std::this_thread::sleep_for(std::chrono::milliseconds(30000));
 		// Only check the network while on loop while on title screen
 		// Save scores and other things try to connect on their own
 		if (gameState.getGameState() == GameState::CurrentState::TITLE_SCREEN) {
 			int result = network.checkConnection();
-			//1-online 2-offline 3-maint
-
-			switch (result) {
-				case 1:
-					gameState.setOnlineState(GameState::OnlineState::ONLINE);
-					break;
-				case 2:
-					gameState.setOnlineState(GameState::OnlineState::OFFLINE);
-					break;
-				case 3:
-					gameState.setOnlineState(GameState::OnlineState::MAINTENENCE);
-					break;
-			}
+			setOnlineStateFromStatus(result);
 			logger.log(L"SET ONLINE STATE TO: [" + to_wstring(result) + L"]");
 		}
 	}
 }
 
+/**
+ * Set the online state from the status the server reported.
+ *
+ * @param status the status (1 online, 2 offline, 3 maintenance)
+ */
+void setOnlineStateFromStatus(int status) {
+	switch (status) {
+		case 1:
+			gameState.setOnlineState(GameState::OnlineState::ONLINE);
+
+			// Send any profile changes and scores made while the server was unreachable
+			network.syncPendingProfiles();
+			scoreQueue.wake();
+			break;
+		case 2:
+			gameState.setOnlineState(GameState::OnlineState::OFFLINE);
+			break;
+		case 3:
+			gameState.setOnlineState(GameState::OnlineState::MAINTENENCE);
+			break;
+	}
+}
+
 /**
  * Reset the game state, screen renderer and controller input.
  * 
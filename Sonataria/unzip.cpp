@@ -1,10 +1,12 @@
 #define _CRT_SECURE_NO_WARNINGS
 
+#ifdef _WIN32
 #include <windows.h>
+#include <tchar.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <tchar.h>
 #include "unzip.h"
 
 // THIS FILE is almost entirely based upon code by Jean-loup Gailly
@@ -2601,6 +2603,10 @@ typedef struct unz_file_info_internal_s
 } unz_file_info_internal;
 
 
+// Reading zip files goes through Win32 handles; only the raw inflate API
+// below is built on other platforms
+#ifdef _WIN32
+
 typedef struct
 { bool is_handle; // either a handle or memory
   bool canseek;
@@ -4161,4 +4167,37 @@ bool IsZipHandleU(HZIP hz)
   return (han->flag==1);
 }
 
+#endif // _WIN32
+
+
+
+HINFLATE OpenInflate()
+{ z_stream *z = new z_stream; memset(z,0,sizeof(z_stream));
+  if (inflateInit2(z)!=Z_OK) {delete z; return 0;}
+  return (HINFLATE)z;
+}
+
+ZRESULT InflateChunk(HINFLATE hi, const void *src, unsigned int srclen, unsigned int *srcused, void *dst, unsigned int dstlen, unsigned int *dstmade)
+{ *srcused=0; *dstmade=0;
+  if (hi==0) return ZR_ARGS;
+  z_stream *z = (z_stream*)hi;
+  z->next_in=(Byte*)src; z->avail_in=srclen;
+  z->next_out=(Byte*)dst; z->avail_out=dstlen;
+  int err = inflate(z,Z_SYNC_FLUSH);
+  *srcused = srclen-z->avail_in; *dstmade = dstlen-z->avail_out;
+  if (err==Z_STREAM_END) return ZR_OK;
+  if (err==Z_OK || err==Z_BUF_ERROR) return ZR_MORE;
+  return ZR_FLATE;
+}
+
+void CloseInflate(HINFLATE hi)
+{ if (hi==0) return;
+  z_stream *z = (z_stream*)hi;
+  inflateEnd(z); delete z;
+}
+
+unsigned long ZipCrc32(unsigned long crc, const void *buf, unsigned int len)
+{ return ucrc32(crc,(const Byte*)buf,len);
+}
+
 
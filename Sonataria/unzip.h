@@ -9,14 +9,23 @@
 // encryption and unicode filenames have been added.
 
 
+#ifdef _WIN32
+typedef DWORD ZRESULT;
+#else
+typedef unsigned long ZRESULT;
+#endif
+// return codes from any of the zip functions. Listed later.
+
+
+// Opening zip files takes Win32 handles and TCHAR names, so only the raw
+// inflate API further down is available on other platforms
+#ifdef _WIN32
+
 #ifndef _zip_H
 DECLARE_HANDLE(HZIP);
 #endif
 // An HZIP identifies a zip file that has been opened
 
-typedef DWORD ZRESULT;
-// return codes from any of the zip functions. Listed later.
-
 typedef struct
 { int index;                 // index of this file within the zip
   TCHAR name[MAX_PATH];      // filename within the zip
@@ -98,6 +107,27 @@ unsigned int FormatZipMessage(ZRESULT code, TCHAR *buf,unsigned int len);
 // It returns the length of the error message. If buf/len points
 // to a real buffer, then it also writes as much as possible into there.
 
+#endif // _WIN32
+
+
+typedef struct HINFLATE__ *HINFLATE;
+// An HINFLATE inflates a single raw deflate stream (compression method 8)
+// that the caller reads out of the zip itself, e.g. an item that is still
+// being downloaded. Each one is independent, so separate threads can use
+// separate ones at the same time.
+
+HINFLATE OpenInflate();
+ZRESULT InflateChunk(HINFLATE hi, const void *src, unsigned int srclen, unsigned int *srcused, void *dst, unsigned int dstlen, unsigned int *dstmade);
+void CloseInflate(HINFLATE hi);
+// InflateChunk - inflates as much of src into dst as fits, and says how
+// much of each it used. It returns ZR_OK at the end of the stream, ZR_MORE
+// when it wants more input or more room, and ZR_FLATE if the data is bad.
+// Note: the end of a raw stream is only seen after a byte past it, so go by
+// the item's sizes from its header rather than waiting for ZR_OK.
+
+unsigned long ZipCrc32(unsigned long crc, const void *buf, unsigned int len);
+// ZipCrc32 - the CRC-32 that zip items are checked against. Start with crc=0.
+
 
 // These are the result codes:
 #define ZR_OK         0x00000000     // nb. the pseudo-code zr-recent is never returned,
@@ -198,6 +228,7 @@ unsigned int FormatZipMessage(ZRESULT code, TCHAR *buf,unsigned int len);
 // the cpp files for zip and unzip are both present, so we will call
 // one or the other of them based on a dynamic choice. If the header file
 // for only one is present, then we will bind to that particular one.
+#ifdef _WIN32
 ZRESULT CloseZipU(HZIP hz);
 unsigned int FormatZipMessageU(ZRESULT code, TCHAR *buf,unsigned int len);
 bool IsZipHandleU(HZIP hz);
@@ -208,6 +239,7 @@ bool IsZipHandleU(HZIP hz);
 #define CloseZip CloseZipU
 #define FormatZipMessage FormatZipMessageU
 #endif
+#endif // _WIN32
 
 
 